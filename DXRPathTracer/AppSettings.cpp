@@ -27,6 +27,13 @@ static const char* ClusterRasterizationModesLabels[] =
     "Conservative",
 };
 
+static const char* TextureCompressionModesLabels[] =
+{
+    "Uncompressed",
+    "Fast (BC1)",
+    "High Quality (BC7)",
+};
+
 namespace AppSettings
 {
     static SettingsContainer Settings;
@@ -38,11 +45,21 @@ namespace AppSettings
     DirectionSetting SunDirection;
     FloatSetting Turbidity;
     ColorSetting GroundAlbedo;
+    BoolSetting UseSkyLUT;
     MSAAModesSetting MSAAMode;
     ScenesSetting CurrentScene;
     BoolSetting RenderLights;
+    TextureCompressionModesSetting TextureCompression;
+    BoolSetting EnableTextureStreaming;
+    IntSetting TextureBudget;
     IntSetting MaxLightClamp;
     ClusterRasterizationModesSetting ClusterRasterizationMode;
+    BoolSetting EnableProbeGrid;
+    FloatSetting ProbeGridSpacing;
+    IntSetting ProbeRaysPerProbe;
+    BoolSetting UseMeshletCulling;
+    BoolSetting UseOcclusionCulling;
+    IntSetting MaxOccluderTriangles;
     BoolSetting EnableRayTracing;
     BoolSetting EnableLightMapRender;
     BoolSetting ClampRoughness;
@@ -50,6 +67,11 @@ namespace AppSettings
     IntSetting SqrtNumSamples;
     IntSetting MaxPathLength;
     IntSetting MaxAnyHitPathLength;
+    BoolSetting UseLightBVH;
+    IntSetting NumLightSamples;
+    BoolSetting SampleEmissiveTriangles;
+    BoolSetting UseEmissiveBVH;
+    BoolSetting UseCompressedVertices;
     FloatSetting Exposure;
     FloatSetting BloomExposure;
     FloatSetting BloomMagnitude;
@@ -69,6 +91,8 @@ namespace AppSettings
     BoolSetting EnableWhiteFurnaceMode;
     BoolSetting AlwaysResetPathTrace;
     BoolSetting ShowProgressBar;
+    BoolSetting ShowCullingStats;
+    BoolSetting ShowTextureStreamingStats;
 
     ConstantBuffer CBuffer;
     const uint32 CBufferRegister = 12;
@@ -113,6 +137,9 @@ namespace AppSettings
         GroundAlbedo.Initialize("GroundAlbedo", "Sun And Sky", "Ground Albedo", "Ground albedo color used for procedural sun and sky model", Float3(0.2500f, 0.2500f, 0.2500f), false, -340282300000000000000000000000000000000.0000f, 340282300000000000000000000000000000000.0000f, 0.0100f, ColorUnit::None);
         Settings.AddSetting(&GroundAlbedo);
 
+        UseSkyLUT.Initialize("UseSkyLUT", "Sun And Sky", "Use Sky LUT", "Interpolates the sky model, sun irradiance, and sky SH from a pre-computed table instead of evaluating the full model whenever the sun changes", true);
+        Settings.AddSetting(&UseSkyLUT);
+
         MSAAMode.Initialize("MSAAMode", "Anti Aliasing", "MSAA Mode", "MSAA mode to use for rendering", MSAAModes::MSAA4x, 3, MSAAModesLabels);
         Settings.AddSetting(&MSAAMode);
 
@@ -122,12 +149,39 @@ namespace AppSettings
         RenderLights.Initialize("RenderLights", "Scene", "Render Lights", "Enable or disable spot light rendering", true);
         Settings.AddSetting(&RenderLights);
 
+        TextureCompression.Initialize("TextureCompression", "Scene", "Texture Compression", "Block compression for material textures, which takes effect the next time a scene is loaded. Color maps use BC1 or BC7, normal maps use BC5, and the packed roughness/metallic/opacity maps use BC7 mode 5, which gives one of the masks in each block its own indices.", TextureCompressionModes::HighQuality, 3, TextureCompressionModesLabels);
+        Settings.AddSetting(&TextureCompression);
+
+        EnableTextureStreaming.Initialize("EnableTextureStreaming", "Scene", "Enable Texture Streaming", "Streams the mips of material textures in and out based on how large they appear on screen, keeping them within the texture budget. The path tracer samples the finest resident mip, so this is best left off for reference renders.", false);
+        Settings.AddSetting(&EnableTextureStreaming);
+
+        TextureBudget.Initialize("TextureBudget", "Scene", "Texture Budget (MB)", "GPU memory available to the material textures of every loaded scene when texture streaming is enabled", 512, 16, 8192);
+        Settings.AddSetting(&TextureBudget);
+
         MaxLightClamp.Initialize("MaxLightClamp", "Rendering", "Max Lights", "Limits the number of lights in the scene", 32, 0, 32);
         Settings.AddSetting(&MaxLightClamp);
 
         ClusterRasterizationMode.Initialize("ClusterRasterizationMode", "Rendering", "Cluster Rasterization Mode", "Conservative rasterization mode to use for light binning", ClusterRasterizationModes::Conservative, 4, ClusterRasterizationModesLabels);
         Settings.AddSetting(&ClusterRasterizationMode);
 
+        EnableProbeGrid.Initialize("EnableProbeGrid", "Rendering", "Enable Probe Grid", "Uses the baked SH probe grid for indirect diffuse instead of the sky SH", true);
+        Settings.AddSetting(&EnableProbeGrid);
+
+        ProbeGridSpacing.Initialize("ProbeGridSpacing", "Rendering", "Probe Grid Spacing", "Distance between probes in the baked probe grid", 1.0000f, 0.1000f, 10.0000f, 0.0500f, ConversionMode::None, 1.0000f);
+        Settings.AddSetting(&ProbeGridSpacing);
+
+        ProbeRaysPerProbe.Initialize("ProbeRaysPerProbe", "Rendering", "Probe Rays Per Probe", "Number of rays traced from each probe when baking the probe grid", 256, 16, 4096);
+        Settings.AddSetting(&ProbeRaysPerProbe);
+
+        UseMeshletCulling.Initialize("UseMeshletCulling", "Rendering", "Use Meshlet Culling", "Culls the meshlets of visible meshes against the view frustum and their normal cones before drawing", true);
+        Settings.AddSetting(&UseMeshletCulling);
+
+        UseOcclusionCulling.Initialize("UseOcclusionCulling", "Rendering", "Use Occlusion Culling", "Rasterizes the largest meshes into a low-resolution depth buffer on the CPU, and skips main pass draws that are hidden behind them", true);
+        Settings.AddSetting(&UseOcclusionCulling);
+
+        MaxOccluderTriangles.Initialize("MaxOccluderTriangles", "Rendering", "Max Occluder Triangles", "Limits the number of triangles rasterized for occlusion culling each frame", 100000, 1000, 1000000);
+        Settings.AddSetting(&MaxOccluderTriangles);
+
         EnableRayTracing.Initialize("EnableRayTracing", "Path Tracing", "Enable Ray Tracing", "", true);
         Settings.AddSetting(&EnableRayTracing);
 
@@ -149,6 +203,21 @@ namespace AppSettings
         MaxAnyHitPathLength.Initialize("MaxAnyHitPathLength", "Path Tracing", "Max Any-Hit Path Length", "The maximum path length where any-hit shaders will be used for alpha testing. Increasing this with improve the render quality, but will also increase frame times", 1, 0, 8);
         Settings.AddSetting(&MaxAnyHitPathLength);
 
+        UseLightBVH.Initialize("UseLightBVH", "Path Tracing", "Use Light BVH", "Picks spot lights to sample by stochastically traversing a light BVH, instead of shading every light at every hit", true);
+        Settings.AddSetting(&UseLightBVH);
+
+        NumLightSamples.Initialize("NumLightSamples", "Path Tracing", "Num Light Samples", "The number of spot light and emissive triangle samples taken at every hit", 1, 1, 8);
+        Settings.AddSetting(&NumLightSamples);
+
+        SampleEmissiveTriangles.Initialize("SampleEmissiveTriangles", "Path Tracing", "Sample Emissive Triangles", "Uses next-event estimation towards emissive triangles, instead of only picking up emission when a path hits them", true);
+        Settings.AddSetting(&SampleEmissiveTriangles);
+
+        UseEmissiveBVH.Initialize("UseEmissiveBVH", "Path Tracing", "Use Emissive BVH", "Picks emissive triangles by traversing a light BVH instead of only by their power, which accounts for distance and orientation", false);
+        Settings.AddSetting(&UseEmissiveBVH);
+
+        UseCompressedVertices.Initialize("UseCompressedVertices", "Path Tracing", "Use Compressed Vertices", "Fetches quantized 24-byte vertices in the hit shaders instead of the full-precision 68-byte vertices", false);
+        Settings.AddSetting(&UseCompressedVertices);
+
         Exposure.Initialize("Exposure", "Post Processing", "Exposure", "Simple exposure value applied to the scene before tone mapping (uses log2 scale)", -14.0000f, -24.0000f, 24.0000f, 0.1000f, ConversionMode::None, 1.0000f);
         Settings.AddSetting(&Exposure);
 
@@ -207,6 +276,12 @@ namespace AppSettings
         ShowProgressBar.Initialize("ShowProgressBar", "Debug", "Show Progress Bar", "", true);
         Settings.AddSetting(&ShowProgressBar);
 
+        ShowCullingStats.Initialize("ShowCullingStats", "Debug", "Show Culling Stats", "Shows how many meshlets and triangles were culled for each view", false);
+        Settings.AddSetting(&ShowCullingStats);
+
+        ShowTextureStreamingStats.Initialize("ShowTextureStreamingStats", "Debug", "Show Texture Streaming Stats", "Shows the resident texture memory and how many mips were streamed in and out each frame", false);
+        Settings.AddSetting(&ShowTextureStreamingStats);
+
         ConstantBufferInit cbInit;
         cbInit.Size = sizeof(AppSettingsCBuffer);
         cbInit.Dynamic = true;
@@ -252,6 +327,12 @@ namespace AppSettings
         cbData.MetallicScale = MetallicScale;
         cbData.EnableWhiteFurnaceMode = EnableWhiteFurnaceMode;
         cbData.EnableLightMapRender = EnableLightMapRender;
+        cbData.EnableProbeGrid = EnableProbeGrid;
+        cbData.UseLightBVH = UseLightBVH;
+        cbData.NumLightSamples = NumLightSamples;
+        cbData.SampleEmissiveTriangles = SampleEmissiveTriangles;
+        cbData.UseEmissiveBVH = UseEmissiveBVH;
+        cbData.UseCompressedVertices = UseCompressedVertices;
 
         CBuffer.MapAndSetData(cbData);
     }
@@ -26,6 +26,18 @@ enum ClusterRasterizationModes
     Conservative
 }
 
+enum TextureCompressionModes
+{
+    [EnumLabel("Uncompressed")]
+    Uncompressed = 0,
+
+    [EnumLabel("Fast (BC1)")]
+    Fast,
+
+    [EnumLabel("High Quality (BC7)")]
+    HighQuality,
+}
+
 enum DepthSortModes
 {
     None,
@@ -66,6 +78,11 @@ public class Settings
         [UseAsShaderConstant(false)]
         [HelpText("Ground albedo color used for procedural sun and sky model")]
         Color GroundAlbedo = new Color(0.25f, 0.25f, 0.25f);
+
+        [UseAsShaderConstant(false)]
+        [DisplayName("Use Sky LUT")]
+        [HelpText("Interpolates the sky model, sun irradiance, and sky SH from a pre-computed table instead of evaluating the full model whenever the sun changes")]
+        bool UseSkyLUT = true;
     }
 
     [ExpandGroup(false)]
@@ -84,6 +101,22 @@ public class Settings
 
         [HelpText("Enable or disable spot light rendering")]
         bool RenderLights = true;
+
+        [UseAsShaderConstant(false)]
+        [HelpText("Block compression for material textures, which takes effect the next time a scene is loaded. Color maps use BC1 or BC7, normal maps use BC5, and the packed roughness/metallic/opacity maps use BC7 mode 5, which gives one of the masks in each block its own indices.")]
+        TextureCompressionModes TextureCompression = TextureCompressionModes.HighQuality;
+
+        [UseAsShaderConstant(false)]
+        [DisplayName("Enable Texture Streaming")]
+        [HelpText("Streams the mips of material textures in and out based on how large they appear on screen, keeping them within the texture budget. The path tracer samples the finest resident mip, so this is best left off for reference renders.")]
+        bool EnableTextureStreaming = false;
+
+        [UseAsShaderConstant(false)]
+        [MinValue(16)]
+        [MaxValue(8192)]
+        [DisplayName("Texture Budget (MB)")]
+        [HelpText("GPU memory available to the material textures of every loaded scene when texture streaming is enabled")]
+        int TextureBudget = 512;
     }
 
     const uint ClusterTileSize = 16;
@@ -108,6 +141,42 @@ public class Settings
         [UseAsShaderConstant(false)]
         [HelpText("Conservative rasterization mode to use for light binning")]
         ClusterRasterizationModes ClusterRasterizationMode = ClusterRasterizationModes.Conservative;
+
+        [DisplayName("Enable Probe Grid")]
+        [HelpText("Uses the baked SH probe grid for indirect diffuse instead of the sky SH")]
+        bool EnableProbeGrid = true;
+
+        [UseAsShaderConstant(false)]
+        [MinValue(0.1f)]
+        [MaxValue(10.0f)]
+        [StepSize(0.05f)]
+        [DisplayName("Probe Grid Spacing")]
+        [HelpText("Distance between probes in the baked probe grid")]
+        float ProbeGridSpacing = 1.0f;
+
+        [UseAsShaderConstant(false)]
+        [MinValue(16)]
+        [MaxValue(4096)]
+        [DisplayName("Probe Rays Per Probe")]
+        [HelpText("Number of rays traced from each probe when baking the probe grid")]
+        int ProbeRaysPerProbe = 256;
+
+        [UseAsShaderConstant(false)]
+        [DisplayName("Use Meshlet Culling")]
+        [HelpText("Culls the meshlets of visible meshes against the view frustum and their normal cones before drawing")]
+        bool UseMeshletCulling = true;
+
+        [UseAsShaderConstant(false)]
+        [DisplayName("Use Occlusion Culling")]
+        [HelpText("Rasterizes the largest meshes into a low-resolution depth buffer on the CPU, and skips main pass draws that are hidden behind them")]
+        bool UseOcclusionCulling = true;
+
+        [UseAsShaderConstant(false)]
+        [MinValue(1000)]
+        [MaxValue(1000000)]
+        [DisplayName("Max Occluder Triangles")]
+        [HelpText("Limits the number of triangles rasterized for occlusion culling each frame")]
+        int MaxOccluderTriangles = 100000;
     }
 
     const uint NumSampleSets = 8;
@@ -144,6 +213,28 @@ public class Settings
         [MaxValue(MaxPathLengthSetting)]
         [DisplayName("Max Any-Hit Path Length")]
         int MaxAnyHitPathLength = 1;
+
+        [DisplayName("Use Light BVH")]
+        [HelpText("Picks spot lights to sample by stochastically traversing a light BVH, instead of shading every light at every hit")]
+        bool UseLightBVH = true;
+
+        [HelpText("The number of spot light and emissive triangle samples taken at every hit")]
+        [MinValue(1)]
+        [MaxValue(8)]
+        [DisplayName("Num Light Samples")]
+        int NumLightSamples = 1;
+
+        [DisplayName("Sample Emissive Triangles")]
+        [HelpText("Uses next-event estimation towards emissive triangles, instead of only picking up emission when a path hits them")]
+        bool SampleEmissiveTriangles = true;
+
+        [DisplayName("Use Emissive BVH")]
+        [HelpText("Picks emissive triangles by traversing a light BVH instead of only by their power, which accounts for distance and orientation")]
+        bool UseEmissiveBVH = false;
+
+        [DisplayName("Use Compressed Vertices")]
+        [HelpText("Fetches quantized 24-byte vertices in the hit shaders instead of the full-precision 68-byte vertices")]
+        bool UseCompressedVertices = false;
     }
 
     [ExpandGroup(false)]
@@ -234,5 +325,15 @@ public class Settings
 
         [UseAsShaderConstant(false)]
         bool ShowProgressBar = true;
+
+        [UseAsShaderConstant(false)]
+        [DisplayName("Show Culling Stats")]
+        [HelpText("Shows how many meshlets and triangles were culled for each view")]
+        bool ShowCullingStats = false;
+
+        [UseAsShaderConstant(false)]
+        [DisplayName("Show Texture Streaming Stats")]
+        [HelpText("Shows the resident texture memory and how many mips were streamed in and out each frame")]
+        bool ShowTextureStreamingStats = false;
     }
 }
\ No newline at end of file
@@ -42,6 +42,17 @@ enum class ClusterRasterizationModes
 
 typedef EnumSettingT<ClusterRasterizationModes> ClusterRasterizationModesSetting;
 
+enum class TextureCompressionModes
+{
+    Uncompressed = 0,
+    Fast = 1,
+    HighQuality = 2,
+
+    NumValues
+};
+
+typedef EnumSettingT<TextureCompressionModes> TextureCompressionModesSetting;
+
 namespace AppSettings
 {
     static const uint64 ClusterTileSize = 16;
@@ -62,17 +73,32 @@ namespace AppSettings
     extern DirectionSetting SunDirection;
     extern FloatSetting Turbidity;
     extern ColorSetting GroundAlbedo;
+    extern BoolSetting UseSkyLUT;
     extern MSAAModesSetting MSAAMode;
     extern ScenesSetting CurrentScene;
     extern BoolSetting RenderLights;
+    extern TextureCompressionModesSetting TextureCompression;
+    extern BoolSetting EnableTextureStreaming;
+    extern IntSetting TextureBudget;
     extern IntSetting MaxLightClamp;
     extern ClusterRasterizationModesSetting ClusterRasterizationMode;
+    extern BoolSetting EnableProbeGrid;
+    extern FloatSetting ProbeGridSpacing;
+    extern IntSetting ProbeRaysPerProbe;
+    extern BoolSetting UseMeshletCulling;
+    extern BoolSetting UseOcclusionCulling;
+    extern IntSetting MaxOccluderTriangles;
     extern BoolSetting EnableRayTracing;
     extern BoolSetting ClampRoughness;
     extern BoolSetting AvoidCausticPaths;
     extern IntSetting SqrtNumSamples;
     extern IntSetting MaxPathLength;
     extern IntSetting MaxAnyHitPathLength;
+    extern BoolSetting UseLightBVH;
+    extern IntSetting NumLightSamples;
+    extern BoolSetting SampleEmissiveTriangles;
+    extern BoolSetting UseEmissiveBVH;
+    extern BoolSetting UseCompressedVertices;
     extern FloatSetting Exposure;
     extern FloatSetting BloomExposure;
     extern FloatSetting BloomMagnitude;
@@ -92,6 +118,8 @@ namespace AppSettings
     extern BoolSetting EnableWhiteFurnaceMode;
     extern BoolSetting AlwaysResetPathTrace;
     extern BoolSetting ShowProgressBar;
+    extern BoolSetting ShowCullingStats;
+    extern BoolSetting ShowTextureStreamingStats;
     extern BoolSetting EnableLightMapRender;
 
     struct AppSettingsCBuffer
@@ -125,6 +153,12 @@ namespace AppSettings
         float MetallicScale;
         bool32 EnableWhiteFurnaceMode;
         bool32 EnableLightMapRender;
+        bool32 EnableProbeGrid;
+        bool32 UseLightBVH;
+        int32 NumLightSamples;
+        bool32 SampleEmissiveTriangles;
+        bool32 UseEmissiveBVH;
+        bool32 UseCompressedVertices;
     };
 
     extern ConstantBuffer CBuffer;
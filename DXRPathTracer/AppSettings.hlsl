@@ -30,6 +30,12 @@ struct AppSettings_Layout
     float MetallicScale;
     bool EnableWhiteFurnaceMode;
     bool EnableLightMapRender;
+    bool EnableProbeGrid;
+    bool UseLightBVH;
+    int NumLightSamples;
+    bool SampleEmissiveTriangles;
+    bool UseEmissiveBVH;
+    bool UseCompressedVertices;
 };
 
 ConstantBuffer<AppSettings_Layout> AppSettings : register(b12);
@@ -11,9 +11,12 @@
 #include <BRDF.hlsl>
 #include <RayTracing.hlsl>
 #include <Sampling.hlsl>
+#include <SH.hlsl>
 
 #include "SharedTypes.h"
 #include "AppSettings.hlsl"
+#include "LightBVH.hlsl"
+#include "EmissiveLights.hlsl"
 
 // C++端绑定的常量缓冲结构体 (与RayTrace.hlsl一致)
 struct RayTraceConstants
@@ -34,6 +37,13 @@ struct RayTraceConstants
     uint MaterialBufferIdx;
     uint SkyTextureIdx;
     uint NumLights;
+    uint LightBufferIdx;
+    uint LightBVHBufferIdx;
+    uint NumBVHLights;
+    uint EmissiveTriangleBufferIdx;
+    uint EmissiveAliasTableIdx;
+    uint EmissiveBVHBufferIdx;
+    uint NumEmissiveTriangles;
 };
 
 // C++端绑定的烘焙专用常量缓冲结构体
@@ -43,7 +53,12 @@ struct BakingConstants
     uint SampleIndex; 
     uint SurfaceMapPositionIdx;
     uint SurfaceMapNormalIdx;
-    uint Padding1;
+    uint NumProbeRays;
+
+    float3 ProbeGridOrigin;
+    float ProbeGridSpacing;
+    uint3 ProbeGridDims;
+    uint Padding;
 };
 
 struct LightConstants
@@ -58,6 +73,7 @@ RaytracingAccelerationStructure Scene : register(t0, space200);
 // UAVs
 RWTexture2D<float4> g_AccumulationBuffer : register(u0);
 RWTexture2D<float4> g_BakedLightMap      : register(u1);
+RWTexture2D<float4> g_ProbeBakeOutput    : register(u2);
 
 // 常量缓冲
 ConstantBuffer<RayTraceConstants> RayTraceCB : register(b0);
@@ -78,6 +94,8 @@ struct PrimaryPayload
     uint PixelIdx;
     uint SampleSetIdx;
     bool IsDiffuse;
+    bool HitBackFace;
+    bool EmissiveSampled;
 };
 
 struct ShadowPayload
@@ -112,6 +130,7 @@ void ClosestHitShader(inout PrimaryPayload payload, in HitAttributes attr)
 {
     const MeshVertex hitSurface = GetHitSurface(attr, GeometryIndex());
     const Material material = GetGeometryMaterial(GeometryIndex()); 
+    payload.HitBackFace = HitKind() == HIT_KIND_TRIANGLE_BACK_FACE;
     payload.Radiance = PathTrace(hitSurface, material, payload);
 }
 
@@ -120,8 +139,8 @@ void AnyHitShader(inout PrimaryPayload payload, in HitAttributes attr)
 {
     const MeshVertex hitSurface = GetHitSurface(attr, GeometryIndex());
     const Material material = GetGeometryMaterial(GeometryIndex());
-    Texture2D opacityMap = ResourceDescriptorHeap[NonUniformResourceIndex(material.Opacity)];
-    if(opacityMap.SampleLevel(MeshSampler, hitSurface.UV, 0.0f).x < 0.35f)
+    Texture2D opacityMap = ResourceDescriptorHeap[NonUniformResourceIndex(material.RoughnessMetallicOpacity)];
+    if(opacityMap.SampleLevel(MeshSampler, hitSurface.UV, 0.0f).z < 0.35f)
         IgnoreHit();
 }
 
@@ -130,8 +149,8 @@ void ShadowAnyHitShader(inout ShadowPayload payload, in HitAttributes attr)
 {
     const MeshVertex hitSurface = GetHitSurface(attr, GeometryIndex());
     const Material material = GetGeometryMaterial(GeometryIndex());
-    Texture2D opacityMap = ResourceDescriptorHeap[NonUniformResourceIndex(material.Opacity)];
-    if(opacityMap.SampleLevel(MeshSampler, hitSurface.UV, 0.0f).x < 0.35f)
+    Texture2D opacityMap = ResourceDescriptorHeap[NonUniformResourceIndex(material.RoughnessMetallicOpacity)];
+    if(opacityMap.SampleLevel(MeshSampler, hitSurface.UV, 0.0f).z < 0.35f)
         IgnoreHit();
 }
 
@@ -175,15 +194,26 @@ MeshVertex GetHitSurface(in HitAttributes attr, in uint geometryIdx)
     float3 barycentrics = float3(1 - attr.barycentrics.x - attr.barycentrics.y, attr.barycentrics.x, attr.barycentrics.y);
     StructuredBuffer<GeometryInfo> geoInfoBuffer = ResourceDescriptorHeap[RayTraceCB.GeometryInfoBufferIdx];
     const GeometryInfo geoInfo = geoInfoBuffer[geometryIdx];
-    StructuredBuffer<MeshVertex> vtxBuffer = ResourceDescriptorHeap[RayTraceCB.VtxBufferIdx];
-    Buffer<uint> idxBuffer = ResourceDescriptorHeap[RayTraceCB.IdxBufferIdx];
-    const uint primIdx = PrimitiveIndex();
-    const uint idx0 = idxBuffer[primIdx * 3 + geoInfo.IdxOffset + 0];
-    const uint idx1 = idxBuffer[primIdx * 3 + geoInfo.IdxOffset + 1];
-    const uint idx2 = idxBuffer[primIdx * 3 + geoInfo.IdxOffset + 2];
-    const MeshVertex vtx0 = vtxBuffer[idx0 + geoInfo.VtxOffset];
-    const MeshVertex vtx1 = vtxBuffer[idx1 + geoInfo.VtxOffset];
-    const MeshVertex vtx2 = vtxBuffer[idx2 + geoInfo.VtxOffset];
+    ByteAddressBuffer idxBuffer = ResourceDescriptorHeap[RayTraceCB.IdxBufferIdx];
+    const uint3 triIndices = LoadTriangleIndices(idxBuffer, geoInfo.IdxByteOffset, PrimitiveIndex(), geoInfo.Index16Bit != 0);
+    const uint idx0 = triIndices.x;
+    const uint idx1 = triIndices.y;
+    const uint idx2 = triIndices.z;
+    MeshVertex vtx0, vtx1, vtx2;
+    if(AppSettings.UseCompressedVertices)
+    {
+        StructuredBuffer<CompressedMeshVertex> vtxBuffer = ResourceDescriptorHeap[RayTraceCB.VtxBufferIdx];
+        vtx0 = DecompressMeshVertex(vtxBuffer[idx0 + geoInfo.VtxOffset], geoInfo.QuantizationMin, geoInfo.QuantizationScale);
+        vtx1 = DecompressMeshVertex(vtxBuffer[idx1 + geoInfo.VtxOffset], geoInfo.QuantizationMin, geoInfo.QuantizationScale);
+        vtx2 = DecompressMeshVertex(vtxBuffer[idx2 + geoInfo.VtxOffset], geoInfo.QuantizationMin, geoInfo.QuantizationScale);
+    }
+    else
+    {
+        StructuredBuffer<MeshVertex> vtxBuffer = ResourceDescriptorHeap[RayTraceCB.VtxBufferIdx];
+        vtx0 = vtxBuffer[idx0 + geoInfo.VtxOffset];
+        vtx1 = vtxBuffer[idx1 + geoInfo.VtxOffset];
+        vtx2 = vtxBuffer[idx2 + geoInfo.VtxOffset];
+    }
     return BarycentricLerp(vtx0, vtx1, vtx2, barycentrics);
 }
 Material GetGeometryMaterial(in uint geometryIdx)
@@ -193,6 +223,43 @@ Material GetGeometryMaterial(in uint geometryIdx)
     StructuredBuffer<Material> materialBuffer = ResourceDescriptorHeap[RayTraceCB.MaterialBufferIdx];
     return materialBuffer[geoInfo.MaterialIdx];
 }
+float3 ShadeSpotLight(in SpotLight spotLight, in float3 positionWS, in float3 normalWS, in float3 diffuseAlbedo, in float3 specularAlbedo, in float roughness, in float3 incomingRayOriginWS, in float3 msEnergyCompensation, in uint pathLength)
+{
+    float3 surfaceToLight = spotLight.Position - positionWS; float distanceToLight = length(surfaceToLight); surfaceToLight /= distanceToLight;
+    float angleFactor = saturate(dot(surfaceToLight, spotLight.Direction)); float angularAttenuation = smoothstep(spotLight.AngularAttenuationY, spotLight.AngularAttenuationX, angleFactor);
+    float d = distanceToLight / spotLight.Range; float falloff = saturate(1.0f - (d * d * d * d)); falloff = (falloff * falloff) / (distanceToLight * distanceToLight + 1.0f);
+    angularAttenuation *= falloff;
+    if (angularAttenuation <= 0.0f) return 0.0f;
+    RayDesc ray; ray.Origin = positionWS + normalWS * 0.01f; ray.Direction = surfaceToLight; ray.TMin = SpotShadowNearClip; ray.TMax = distanceToLight - SpotShadowNearClip;
+    ShadowPayload payload; payload.Visibility = 1.0f;
+    uint traceRayFlags = RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH;
+    if (pathLength > AppSettings.MaxAnyHitPathLength) traceRayFlags = RAY_FLAG_FORCE_OPAQUE;
+    const uint hitGroupOffset = RayTypeShadow; const uint hitGroupGeoMultiplier = NumRayTypes; const uint missShaderIdx = RayTypeShadow;
+    TraceRay(Scene, traceRayFlags, 0xFFFFFFFF, hitGroupOffset, hitGroupGeoMultiplier, missShaderIdx, ray, payload);
+    float3 intensity = spotLight.Intensity * angularAttenuation;
+    return CalcLighting(normalWS, surfaceToLight, intensity, diffuseAlbedo, specularAlbedo, roughness, positionWS, incomingRayOriginWS, msEnergyCompensation) * payload.Visibility;
+}
+float3 ShadeEmissiveTriangle(in EmissiveTriangle emissiveTriangle, in float2 pointSample, in float3 positionWS, in float3 normalWS, in float3 diffuseAlbedo, in float3 specularAlbedo, in float roughness, in float3 incomingRayOriginWS, in float3 msEnergyCompensation, in uint pathLength)
+{
+    const float2 barycentrics = SampleTriangleBarycentrics(pointSample);
+    const float3 edge1 = emissiveTriangle.Position1 - emissiveTriangle.Position0; const float3 edge2 = emissiveTriangle.Position2 - emissiveTriangle.Position0;
+    const float3 lightPos = emissiveTriangle.Position0 + edge1 * barycentrics.x + edge2 * barycentrics.y;
+    const float2 lightUV = emissiveTriangle.UV0 + (emissiveTriangle.UV1 - emissiveTriangle.UV0) * barycentrics.x + (emissiveTriangle.UV2 - emissiveTriangle.UV0) * barycentrics.y;
+    float3 surfaceToLight = lightPos - positionWS; const float distSq = dot(surfaceToLight, surfaceToLight); const float distanceToLight = sqrt(distSq); surfaceToLight /= distanceToLight;
+    const float cosLight = abs(dot(normalize(cross(edge1, edge2)), surfaceToLight));
+    if (cosLight <= 0.0f || dot(normalWS, surfaceToLight) <= 0.0f) return 0.0f;
+    Texture2D emissiveMap = ResourceDescriptorHeap[NonUniformResourceIndex(emissiveTriangle.EmissiveTextureIdx)];
+    const float3 emission = emissiveMap.SampleLevel(MeshSampler, lightUV, 0.0f).xyz;
+    if (all(emission <= 0.0f)) return 0.0f;
+    RayDesc ray; ray.Origin = positionWS + normalWS * 0.01f; ray.Direction = surfaceToLight; ray.TMin = 0.00001f; ray.TMax = distanceToLight * 0.999f;
+    ShadowPayload payload; payload.Visibility = 1.0f;
+    uint traceRayFlags = RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH;
+    if (pathLength > AppSettings.MaxAnyHitPathLength) traceRayFlags = RAY_FLAG_FORCE_OPAQUE;
+    const uint hitGroupOffset = RayTypeShadow; const uint hitGroupGeoMultiplier = NumRayTypes; const uint missShaderIdx = RayTypeShadow;
+    TraceRay(Scene, traceRayFlags, 0xFFFFFFFF, hitGroupOffset, hitGroupGeoMultiplier, missShaderIdx, ray, payload);
+    const float3 irradiance = emission * cosLight * emissiveTriangle.Area / distSq;
+    return CalcLighting(normalWS, surfaceToLight, irradiance, diffuseAlbedo, specularAlbedo, roughness, positionWS, incomingRayOriginWS, msEnergyCompensation) * payload.Visibility;
+}
 float3 PathTrace(in MeshVertex hitSurface, in Material material, in PrimaryPayload inPayload)
 {
     if((!AppSettings.EnableDiffuse && !AppSettings.EnableSpecular) || (!AppSettings.EnableDirect && !AppSettings.EnableIndirect))
@@ -217,14 +284,14 @@ float3 PathTrace(in MeshVertex hitSurface, in Material material, in PrimaryPaylo
         Texture2D albedoMap = ResourceDescriptorHeap[NonUniformResourceIndex(material.Albedo)];
         baseColor = albedoMap.SampleLevel(MeshSampler, hitSurface.UV, 0.0f).xyz;
     }
-    Texture2D metallicMap = ResourceDescriptorHeap[NonUniformResourceIndex(material.Metallic)];
-    const float metallic = saturate((AppSettings.EnableWhiteFurnaceMode ? 1.0f : metallicMap.SampleLevel(MeshSampler, hitSurface.UV, 0.0f).x) * AppSettings.MetallicScale);
+    Texture2D roughnessMetallicMap = ResourceDescriptorHeap[NonUniformResourceIndex(material.RoughnessMetallicOpacity)];
+    const float2 roughnessMetallic = AppSettings.EnableWhiteFurnaceMode ? 1.0f : roughnessMetallicMap.SampleLevel(MeshSampler, hitSurface.UV, 0.0f).xy;
+    const float metallic = saturate(roughnessMetallic.y * AppSettings.MetallicScale);
     const bool enableDiffuse = (AppSettings.EnableDiffuse && metallic < 1.0f) || AppSettings.EnableWhiteFurnaceMode;
     const bool enableSpecular = (AppSettings.EnableSpecular && (AppSettings.EnableIndirectSpecular ? !(AppSettings.AvoidCausticPaths && inPayload.IsDiffuse) : (inPayload.PathLength == 1)));
     if(enableDiffuse == false && enableSpecular == false)
         return 0.0f;
-    Texture2D roughnessMap = ResourceDescriptorHeap[NonUniformResourceIndex(material.Roughness)];
-    const float sqrtRoughness = saturate((AppSettings.EnableWhiteFurnaceMode ? 1.0f : roughnessMap.SampleLevel(MeshSampler, hitSurface.UV, 0.0f).x) * AppSettings.RoughnessScale);
+    const float sqrtRoughness = saturate(roughnessMetallic.x * AppSettings.RoughnessScale);
     const float3 diffuseAlbedo = lerp(baseColor, 0.0f, metallic) * (enableDiffuse ? 1.0f : 0.0f);
     const float3 specularAlbedo = lerp(0.03f, baseColor, metallic) * (enableSpecular ? 1.0f : 0.0f);
     float roughness = sqrtRoughness * sqrtRoughness;
@@ -237,7 +304,7 @@ float3 PathTrace(in MeshVertex hitSurface, in Material material, in PrimaryPaylo
         msEnergyCompensation = 1.0.xxx + specularAlbedo * (1.0f / Ess - 1.0f);
     }
     Texture2D emissiveMap = ResourceDescriptorHeap[NonUniformResourceIndex(material.Emissive)];
-    float3 radiance = AppSettings.EnableWhiteFurnaceMode ? 0.0.xxx : emissiveMap.SampleLevel(MeshSampler, hitSurface.UV, 0.0f).xyz;
+    float3 radiance = (AppSettings.EnableWhiteFurnaceMode || inPayload.EmissiveSampled) ? 0.0.xxx : emissiveMap.SampleLevel(MeshSampler, hitSurface.UV, 0.0f).xyz;
     if(AppSettings.EnableSun && !AppSettings.EnableWhiteFurnaceMode){
         float3 sunDirection = RayTraceCB.SunDirectionWS;
         if(AppSettings.SunAreaLightApproximation){
@@ -258,22 +325,37 @@ float3 PathTrace(in MeshVertex hitSurface, in Material material, in PrimaryPaylo
         radiance += CalcLighting(normalWS, sunDirection, RayTraceCB.SunIrradiance, diffuseAlbedo, specularAlbedo, roughness, positionWS, incomingRayOriginWS, msEnergyCompensation) * payload.Visibility;
     }
     if (AppSettings.RenderLights){
-        for (uint spotLightIdx = 0; spotLightIdx < RayTraceCB.NumLights; spotLightIdx++){
-            SpotLight spotLight = LightCBuffer.Lights[spotLightIdx];
-            float3 surfaceToLight = spotLight.Position - positionWS; float distanceToLight = length(surfaceToLight); surfaceToLight /= distanceToLight;
-            float angleFactor = saturate(dot(surfaceToLight, spotLight.Direction)); float angularAttenuation = smoothstep(spotLight.AngularAttenuationY, spotLight.AngularAttenuationX, angleFactor);
-            float d = distanceToLight / spotLight.Range; float falloff = saturate(1.0f - (d * d * d * d)); falloff = (falloff * falloff) / (distanceToLight * distanceToLight + 1.0f);
-            angularAttenuation *= falloff;
-            if (angularAttenuation > 0.0f){
-                RayDesc ray; ray.Origin = positionWS + normalWS * 0.01f; ray.Direction = surfaceToLight; ray.TMin = SpotShadowNearClip; ray.TMax = distanceToLight - SpotShadowNearClip;
-                ShadowPayload payload; payload.Visibility = 1.0f;
-                uint traceRayFlags = RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH;
-                if (inPayload.PathLength > AppSettings.MaxAnyHitPathLength) traceRayFlags = RAY_FLAG_FORCE_OPAQUE;
-                const uint hitGroupOffset = RayTypeShadow; const uint hitGroupGeoMultiplier = NumRayTypes; const uint missShaderIdx = RayTypeShadow;
-                TraceRay(Scene, traceRayFlags, 0xFFFFFFFF, hitGroupOffset, hitGroupGeoMultiplier, missShaderIdx, ray, payload);
-                float3 intensity = spotLight.Intensity * angularAttenuation;
-                radiance += CalcLighting(normalWS, surfaceToLight, intensity, diffuseAlbedo, specularAlbedo, roughness, positionWS, incomingRayOriginWS, msEnergyCompensation) * payload.Visibility;
+        if (AppSettings.UseLightBVH && RayTraceCB.NumBVHLights > 0){
+            StructuredBuffer<SpotLight> lightBuffer = ResourceDescriptorHeap[RayTraceCB.LightBufferIdx];
+            StructuredBuffer<LightBVHNode> lightBVH = ResourceDescriptorHeap[RayTraceCB.LightBVHBufferIdx];
+            const uint numLightSamples = uint(AppSettings.NumLightSamples);
+            for (uint sampleIdx = 0; sampleIdx < numLightSamples; ++sampleIdx){
+                const float lightSample = SamplePoint(inPayload.PixelIdx, inPayload.SampleSetIdx).x;
+                uint spotLightIdx = 0; float lightPdf = 0.0f;
+                if (SampleLightBVH(lightBVH, positionWS, normalWS, lightSample, spotLightIdx, lightPdf))
+                    radiance += ShadeSpotLight(lightBuffer[spotLightIdx], positionWS, normalWS, diffuseAlbedo, specularAlbedo, roughness, incomingRayOriginWS, msEnergyCompensation, inPayload.PathLength) / (lightPdf * numLightSamples);
             }
+        } else {
+            for (uint spotLightIdx = 0; spotLightIdx < RayTraceCB.NumLights; spotLightIdx++)
+                radiance += ShadeSpotLight(LightCBuffer.Lights[spotLightIdx], positionWS, normalWS, diffuseAlbedo, specularAlbedo, roughness, incomingRayOriginWS, msEnergyCompensation, inPayload.PathLength);
+        }
+    }
+    const bool sampleEmissive = AppSettings.SampleEmissiveTriangles && RayTraceCB.NumEmissiveTriangles > 0 && !AppSettings.EnableWhiteFurnaceMode;
+    if (sampleEmissive){
+        StructuredBuffer<EmissiveTriangle> triangleBuffer = ResourceDescriptorHeap[RayTraceCB.EmissiveTriangleBufferIdx];
+        const uint numLightSamples = uint(AppSettings.NumLightSamples);
+        for (uint sampleIdx = 0; sampleIdx < numLightSamples; ++sampleIdx){
+            const float selectionSample = SamplePoint(inPayload.PixelIdx, inPayload.SampleSetIdx).x;
+            const float2 pointSample = SamplePoint(inPayload.PixelIdx, inPayload.SampleSetIdx);
+            uint triangleIdx = 0; float selectionPdf = 0.0f;
+            if (AppSettings.UseEmissiveBVH){
+                StructuredBuffer<LightBVHNode> emissiveBVH = ResourceDescriptorHeap[RayTraceCB.EmissiveBVHBufferIdx];
+                if (SampleLightBVH(emissiveBVH, positionWS, normalWS, selectionSample, triangleIdx, selectionPdf) == false) continue;
+            } else {
+                StructuredBuffer<AliasTableEntry> aliasTable = ResourceDescriptorHeap[RayTraceCB.EmissiveAliasTableIdx];
+                triangleIdx = SampleAliasTable(aliasTable, RayTraceCB.NumEmissiveTriangles, selectionSample, selectionPdf);
+            }
+            radiance += ShadeEmissiveTriangle(triangleBuffer[triangleIdx], pointSample, positionWS, normalWS, diffuseAlbedo, specularAlbedo, roughness, incomingRayOriginWS, msEnergyCompensation, inPayload.PathLength) / (selectionPdf * numLightSamples);
         }
     }
     float2 brdfSample = SamplePoint(inPayload.PixelIdx, inPayload.SampleSetIdx);
@@ -304,9 +386,9 @@ float3 PathTrace(in MeshVertex hitSurface, in Material material, in PrimaryPaylo
     RayDesc ray; ray.Origin = positionWS; ray.Direction = rayDirWS; ray.TMin = 0.00001f; ray.TMax = FP32Max;
     if(inPayload.PathLength == 1 && !AppSettings.EnableDirect) radiance = 0.0.xxx;
     if(AppSettings.EnableIndirect && (inPayload.PathLength + 1 < AppSettings.MaxPathLength) && !AppSettings.EnableWhiteFurnaceMode){
-        PrimaryPayload payload; payload.Radiance = 0.0f; payload.PathLength = inPayload.PathLength + 1;
+        PrimaryPayload payload; payload.Radiance = 0.0f; payload.PathLength = inPayload.PathLength + 1; payload.HitBackFace = false;
         payload.PixelIdx = inPayload.PixelIdx; payload.SampleSetIdx = inPayload.SampleSetIdx;
-        payload.IsDiffuse = (selector < 0.5f); payload.Roughness = roughness;
+        payload.IsDiffuse = (selector < 0.5f); payload.Roughness = roughness; payload.EmissiveSampled = sampleEmissive;
         uint traceRayFlags = 0;
         if(payload.PathLength > AppSettings.MaxAnyHitPathLength) traceRayFlags = RAY_FLAG_FORCE_OPAQUE;
         const uint hitGroupOffset = RayTypeRadiance; const uint hitGroupGeoMultiplier = NumRayTypes; const uint missShaderIdx = RayTypeRadiance;
@@ -402,6 +484,8 @@ void BakeRayGen()
     payload.PixelIdx = pixelIdx;
     payload.SampleSetIdx = sampleSetIdx;
     payload.IsDiffuse = true; // 从漫反射表面发出，影响后续弹射
+    payload.EmissiveSampled = false;
+    payload.HitBackFace = false;
 
     // 发射光线
     uint traceRayFlags = 0;
@@ -463,4 +547,69 @@ void BakeRayGen()
         averageColor = colorSum / validSampleCount;
     }
     g_BakedLightMap[pixelCoord] = float4(averageColor, 1.0f);
-}
\ No newline at end of file
+}
+
+//-------------------------------------------------------------------------------------------------
+// Bakes one probe of the SH probe grid per thread. Every probe traces the same Hammersley
+// directions as the CPU baker (see BakeProbeGridCPU), and writes its 9 SH coefficients followed
+// by the fraction of rays that hit back faces to its own row of g_ProbeBakeOutput.
+//-------------------------------------------------------------------------------------------------
+[shader("raygeneration")]
+void ProbeRayGen()
+{
+    const uint probeIdx = DispatchRaysIndex().x;
+    const uint3 dims = BakingCB.ProbeGridDims;
+    const uint3 probeCoord = uint3(probeIdx % dims.x, (probeIdx / dims.x) % dims.y, probeIdx / (dims.x * dims.y));
+    const float3 probePos = BakingCB.ProbeGridOrigin + float3(probeCoord) * BakingCB.ProbeGridSpacing;
+
+    const uint numRays = BakingCB.NumProbeRays;
+    SH9Color sh = (SH9Color)0;
+    uint numBackFaces = 0;
+
+    for(uint rayIdx = 0; rayIdx < numRays; ++rayIdx)
+    {
+        const float2 u = float2(rayIdx / float(numRays), reversebits(rayIdx) * 2.3283064365386963e-10f);
+        const float3 rayDir = SampleDirectionSphere(u.x, u.y);
+
+        RayDesc ray;
+        ray.Origin = probePos;
+        ray.Direction = rayDir;
+        ray.TMin = 0.0f;
+        ray.TMax = FP32Max;
+
+        // Probes only store indirect lighting, so start at a path length of 2 so that the
+        // miss shader leaves out the sun disc
+        PrimaryPayload payload;
+        payload.Radiance = 0.0f;
+        payload.Roughness = 0.0f;
+        payload.PathLength = 2;
+        payload.PixelIdx = probeIdx * numRays + rayIdx;
+        payload.SampleSetIdx = 0;
+        payload.IsDiffuse = true;
+        payload.HitBackFace = false;
+        payload.EmissiveSampled = false;
+
+        uint traceRayFlags = 0;
+        if(payload.PathLength > AppSettings.MaxAnyHitPathLength)
+            traceRayFlags = RAY_FLAG_FORCE_OPAQUE;
+
+        const uint hitGroupOffset = RayTypeRadiance;
+        const uint hitGroupGeoMultiplier = NumRayTypes;
+        const uint missShaderIdx = RayTypeRadiance;
+        TraceRay(Scene, traceRayFlags, 0xFFFFFFFF, hitGroupOffset, hitGroupGeoMultiplier, missShaderIdx, ray, payload);
+
+        if(payload.HitBackFace)
+        {
+            numBackFaces += 1;
+            continue;
+        }
+
+        sh = SHAdd(sh, ProjectOntoSH9Color(rayDir, payload.Radiance));
+    }
+
+    sh = SHScale(sh, (4.0f * Pi) / numRays);
+
+    for(uint i = 0; i < 9; ++i)
+        g_ProbeBakeOutput[uint2(i, probeIdx)] = float4(sh.c[i], 0.0f);
+    g_ProbeBakeOutput[uint2(9, probeIdx)] = float4(numBackFaces / float(numRays), 0.0f, 0.0f, 0.0f);
+}
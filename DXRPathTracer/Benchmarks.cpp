@@ -0,0 +1,1526 @@
+//=================================================================================================
+//
+//  DXR Path Tracer
+//  by MJP
+//  http://mynameismjp.wordpress.com/
+//
+//  All code and content licensed under the MIT license
+//
+//=================================================================================================
+
+#include <PCH.h>
+
+#include <Utility.h>
+#include <Timer.h>
+#include <Tasks.h>
+#include <SF12_Math.h>
+#include <FileIO.h>
+#include <EXRWriter.h>
+#include <TinyEXR.h>
+#include <Graphics/Textures.h>
+#include <Graphics/SH.h>
+#include <Graphics/SG.h>
+#include <Graphics/CubemapProjection.h>
+#include <Graphics/Camera.h>
+#include <Graphics/TextureSampler.h>
+#include <Graphics/TextureResidency.h>
+
+#include "Benchmarks.h"
+#include "ProbeGrid.h"
+#include "LightBVH.h"
+#include "FrustumCulling.h"
+
+using namespace SampleFramework12;
+
+namespace Benchmarks
+{
+
+static FILE* resultsFile = nullptr;
+
+static void Report(const char* format, ...)
+{
+    char buffer[1024] = { 0 };
+    va_list args;
+    va_start(args, format);
+    vsprintf_s(buffer, ArraySize_(buffer) - 1, format, args);
+    va_end(args);
+
+    WriteLog("%s", buffer);
+    if(resultsFile != nullptr)
+        fprintf(resultsFile, "%s\n", buffer);
+}
+
+// Runs func the given number of times and returns the average time in milliseconds
+template<typename T> static double TimeAverage(uint64 numIterations, const T& func)
+{
+    Timer timer;
+    for(uint64 i = 0; i < numIterations; ++i)
+        func();
+    timer.Update();
+    return timer.ElapsedMillisecondsD() / numIterations;
+}
+
+// == Cubemap projection ==========================================================================
+
+// The straightforward per-texel projection that the plan replaces
+static SH9Color ProjectSH9Reference(const Float3* texels, uint32 resolution)
+{
+    SH9Color result;
+    float weightSum = 0.0f;
+    for(uint32 face = 0; face < 6; ++face)
+    {
+        for(uint32 y = 0; y < resolution; ++y)
+        {
+            for(uint32 x = 0; x < resolution; ++x)
+            {
+                const uint64 idx = face * (resolution * resolution) + y * resolution + x;
+
+                float u = ((x + 0.5f) / resolution) * 2.0f - 1.0f;
+                float v = ((y + 0.5f) / resolution) * 2.0f - 1.0f;
+                const float temp = 1.0f + u * u + v * v;
+                const float weight = 4.0f / (std::sqrt(temp) * temp);
+
+                Float3 dir = MapXYSToDirection(x, y, face, resolution, resolution);
+                result += ProjectOntoSH9Color(dir, texels[idx]) * weight;
+                weightSum += weight;
+            }
+        }
+    }
+
+    result *= (4.0f * Pi) / weightSum;
+    return result;
+}
+
+static void BenchmarkCubemapProjection()
+{
+    const uint32 resolutions[] = { 128, 512 };
+    const uint64 batchSizes[] = { 16, 4 };
+
+    for(uint64 resIdx = 0; resIdx < ArraySize_(resolutions); ++resIdx)
+    {
+        const uint32 resolution = resolutions[resIdx];
+        const uint64 batchSize = batchSizes[resIdx];
+        const uint64 numTexels = uint64(resolution) * resolution * 6;
+
+        Random random;
+        Array<Float3> texels(numTexels * batchSize);
+        for(uint64 i = 0; i < texels.Size(); ++i)
+            texels[i] = Float3(random.RandomFloat(), random.RandomFloat(), random.RandomFloat());
+
+        Array<const Float3*> cubemaps(batchSize);
+        for(uint64 i = 0; i < batchSize; ++i)
+            cubemaps[i] = &texels[i * numTexels];
+
+        CubemapProjectionPlan plan;
+        const double buildTime = TimeAverage(1, [&]() { plan.Initialize(resolution); });
+
+        SH9Color referenceSH;
+        const double referenceTime = TimeAverage(2, [&]() { referenceSH = ProjectSH9Reference(cubemaps[0], resolution); });
+
+        SH9Color planSH;
+        const double planTime = TimeAverage(8, [&]() { planSH = plan.ProjectSH9(cubemaps[0]); });
+
+        Array<SH9Color> batchSH(batchSize);
+        const double batchTime = TimeAverage(4, [&]() { plan.ProjectSH9Batch(cubemaps.Data(), batchSize, batchSH.Data()); });
+
+        Array<SG9> batchSG(batchSize);
+        const double sgBatchTime = TimeAverage(4, [&]() { plan.ProjectSG9Batch(cubemaps.Data(), batchSize, batchSG.Data()); });
+
+        float maxError = 0.0f;
+        for(uint64 i = 0; i < 9; ++i)
+        {
+            const Float3 diff = referenceSH.Coefficients[i] - planSH.Coefficients[i];
+            maxError = Max(maxError, Max(std::abs(diff.x), Max(std::abs(diff.y), std::abs(diff.z))));
+        }
+
+        const double texelsPerMS = numTexels / 1000.0;
+        Report("Cubemap projection %ux%u: plan build %.2f ms", resolution, resolution, buildTime);
+        Report("    Reference SH9:      %8.3f ms (%.1f MTexels/s)", referenceTime, texelsPerMS / referenceTime);
+        Report("    Plan SH9:           %8.3f ms (%.1f MTexels/s, %.1fx), max error %.6f", planTime,
+               texelsPerMS / planTime, referenceTime / planTime, maxError);
+        Report("    Plan SH9 batch x%llu: %8.3f ms per cubemap (%.1f MTexels/s)", batchSize, batchTime / batchSize,
+               texelsPerMS * batchSize / batchTime);
+        Report("    Plan SG9 batch x%llu: %8.3f ms per cubemap (%.1f MTexels/s)", batchSize, sgBatchTime / batchSize,
+               texelsPerMS * batchSize / sgBatchTime);
+    }
+}
+
+// == SG solver ===================================================================================
+
+static void BenchmarkSGSolver()
+{
+    const uint32 resolution = 32;
+    const uint64 numSGs = 9;
+    const uint64 numProbes = 256;
+    const uint64 numTexels = uint64(resolution) * resolution * 6;
+
+    Random random;
+    Array<Float3> texels(numTexels * numProbes);
+    for(uint64 i = 0; i < texels.Size(); ++i)
+        texels[i] = Float3(random.RandomFloat(), random.RandomFloat(), random.RandomFloat());
+
+    Array<const Float3*> probes(numProbes);
+    for(uint64 i = 0; i < numProbes; ++i)
+        probes[i] = &texels[i * numTexels];
+
+    const CubemapProjectionPlan& plan = CubemapProjectionPlan::Get(resolution);
+    Array<Float3> sampleDirs(numTexels);
+    for(uint64 i = 0; i < numTexels; ++i)
+        sampleDirs[i] = plan.Direction(i);
+
+    const SGSolveMode modes[] = { SGSolveMode::NNLS, SGSolveMode::SVD };
+    const char* modeNames[] = { "NNLS", "SVD" };
+    for(uint64 modeIdx = 0; modeIdx < ArraySize_(modes); ++modeIdx)
+    {
+        // One-off solve that builds the design matrix from scratch every time
+        SG uncachedSGs[numSGs];
+        const double uncachedTime = TimeAverage(4, [&]()
+        {
+            SGSolveParams params;
+            params.SampleDirs = sampleDirs.Data();
+            params.SampleValues = const_cast<Float3*>(probes[0]);
+            params.NumSamples = numTexels;
+            params.SolveMode = modes[modeIdx];
+            params.NumSGs = numSGs;
+            params.OutSGs = uncachedSGs;
+            SolveSGs(params);
+        });
+
+        SGSolver solver;
+        const double buildTime = TimeAverage(1, [&]() { solver.Initialize(sampleDirs.Data(), numTexels, numSGs, modes[modeIdx]); });
+
+        SG cachedSGs[numSGs];
+        const double cachedTime = TimeAverage(16, [&]() { solver.Solve(probes[0], cachedSGs); });
+
+        Array<SG> batchSGs(numProbes * numSGs);
+        const double batchTime = TimeAverage(2, [&]() { solver.SolveBatch(probes.Data(), numProbes, batchSGs.Data()); });
+
+        float maxError = 0.0f;
+        for(uint64 i = 0; i < numSGs; ++i)
+        {
+            const Float3 diff = uncachedSGs[i].Amplitude - batchSGs[i].Amplitude;
+            maxError = Max(maxError, Max(std::abs(diff.x), Max(std::abs(diff.y), std::abs(diff.z))));
+        }
+
+        Report("SG solver %s, %u lobes, %ux%u cubemap: solver build %.2f ms", modeNames[modeIdx], uint32(numSGs),
+               resolution, resolution, buildTime);
+        Report("    Uncached solve:        %8.3f ms", uncachedTime);
+        Report("    Cached solve:          %8.3f ms (%.1fx)", cachedTime, uncachedTime / cachedTime);
+        Report("    Cached batch x%llu:    %8.3f ms per probe (%.1fx), max error %.6f", numProbes,
+               batchTime / numProbes, uncachedTime * numProbes / batchTime, maxError);
+    }
+}
+
+// == Probe grid ==================================================================================
+
+// Appends an axis-aligned box, with normals pointing inwards for rooms and outwards for solid boxes
+static void AddBox(const Float3& boxMin, const Float3& boxMax, bool inward, GrowableList<Float3>& positions,
+                   GrowableList<Float3>& normals, GrowableList<uint32>& indices)
+{
+    for(uint32 axis = 0; axis < 3; ++axis)
+    {
+        for(uint32 side = 0; side < 2; ++side)
+        {
+            const uint32 axisU = (axis + 1) % 3;
+            const uint32 axisV = (axis + 2) % 3;
+
+            float normal[3] = { 0.0f, 0.0f, 0.0f };
+            normal[axis] = (side == 0 ? -1.0f : 1.0f) * (inward ? -1.0f : 1.0f);
+
+            const uint32 baseIdx = uint32(positions.Count());
+            for(uint32 corner = 0; corner < 4; ++corner)
+            {
+                float pos[3] = { };
+                pos[axis] = side == 0 ? boxMin[axis] : boxMax[axis];
+                pos[axisU] = (corner & 1) ? boxMax[axisU] : boxMin[axisU];
+                pos[axisV] = (corner & 2) ? boxMax[axisV] : boxMin[axisV];
+                positions.Add(Float3(pos[0], pos[1], pos[2]));
+                normals.Add(Float3(normal[0], normal[1], normal[2]));
+            }
+
+            const uint32 quadIndices[6] = { 0, 1, 2, 2, 1, 3 };
+            for(uint32 i = 0; i < 6; ++i)
+                indices.Add(baseIdx + quadIndices[i]);
+        }
+    }
+}
+
+static void BenchmarkProbeGrid()
+{
+    // A room with a few solid boxes inside of it, so that some probes end up inside geometry
+    GrowableList<Float3> positions;
+    GrowableList<Float3> normals;
+    GrowableList<uint32> indices;
+    AddBox(Float3(-10.0f, 0.0f, -10.0f), Float3(10.0f, 6.0f, 10.0f), true, positions, normals, indices);
+
+    Random random;
+    for(uint32 i = 0; i < 64; ++i)
+    {
+        const Float3 center = Float3(random.RandomFloat() * 16.0f - 8.0f, random.RandomFloat() * 4.0f, random.RandomFloat() * 16.0f - 8.0f);
+        const Float3 halfSize = Float3(0.25f + random.RandomFloat(), 0.25f + random.RandomFloat(), 0.25f + random.RandomFloat());
+        AddBox(center - halfSize, center + halfSize, false, positions, normals, indices);
+    }
+
+    ProbeBakeScene scene;
+    scene.Initialize(&positions[0], &normals[0], positions.Count(), &indices[0], indices.Count());
+
+    ProbeBakeLighting lighting;
+    lighting.SunDirection = Float3::Normalize(Float3(0.3f, 1.0f, 0.2f));
+    lighting.SunIrradiance = Float3(10.0f, 9.0f, 8.0f);
+    lighting.SkySH = ProjectOntoSH9Color(Float3(0.0f, 1.0f, 0.0f), Float3(0.5f, 0.7f, 1.0f));
+
+    const float spacings[] = { 1.0f, 0.5f };
+    const uint64 raysPerProbe = 256;
+    for(uint64 spacingIdx = 0; spacingIdx < ArraySize_(spacings); ++spacingIdx)
+    {
+        ProbeGridLayout layout;
+        layout.Initialize(scene.AABBMin, scene.AABBMax, spacings[spacingIdx], ProbeGrid::MaxProbes);
+
+        ProbeGridData gridData;
+        const double bakeTime = TimeAverage(2, [&]() { BakeProbeGridCPU(scene, lighting, layout, raysPerProbe, gridData); });
+
+        Array<Half4> compressed;
+        const double compressTime = TimeAverage(4, [&]() { ProbeGrid::Compress(gridData, compressed); });
+
+        uint64 numValid = 0;
+        for(uint64 i = 0; i < gridData.Validity.Size(); ++i)
+            numValid += gridData.Validity[i] > 0.0f ? 1 : 0;
+
+        const uint64 numProbes = layout.NumProbes();
+        const double numRays = double(numProbes * raysPerProbe);
+        Report("Probe grid %ux%ux%u (%llu probes, %llu valid), %llu triangles, %llu rays per probe", layout.Dims.x, layout.Dims.y,
+               layout.Dims.z, numProbes, numValid, indices.Count() / 3, raysPerProbe);
+        Report("    CPU bake:   %8.3f ms (%.2f MRays/s)", bakeTime, numRays / (bakeTime * 1000.0));
+        Report("    Compress:   %8.3f ms, %.1f KB (%.1f KB uncompressed)", compressTime, compressed.MemorySize() / 1024.0,
+               gridData.SH.MemorySize() / 1024.0);
+    }
+}
+
+static void BenchmarkLightBVH()
+{
+    const uint64 lightCounts[] = { 32, 1024, 16384, 65536 };
+
+    Random random;
+    for(uint64 countIdx = 0; countIdx < ArraySize_(lightCounts); ++countIdx)
+    {
+        // Spot lights scattered through a 100m x 20m x 100m volume, mostly pointing down
+        const uint64 numLights = lightCounts[countIdx];
+        Array<SpotLight> lights(numLights);
+        for(uint64 i = 0; i < numLights; ++i)
+        {
+            SpotLight& light = lights[i];
+            light.Position = Float3(random.RandomFloat() * 100.0f - 50.0f, random.RandomFloat() * 20.0f, random.RandomFloat() * 100.0f - 50.0f);
+            light.Direction = Float3::Normalize(Float3(random.RandomFloat() - 0.5f, 2.0f, random.RandomFloat() - 0.5f));
+            light.Intensity = Float3(random.RandomFloat(), random.RandomFloat(), random.RandomFloat()) * 2500.0f;
+            light.AngularAttenuationX = std::cos(DegToRad(15.0f + random.RandomFloat() * 15.0f));
+            light.AngularAttenuationY = std::cos(DegToRad(35.0f + random.RandomFloat() * 25.0f));
+            light.Range = AppSettings::SpotLightRange;
+        }
+
+        LightBVH bvh;
+        const double buildTime = TimeAverage(4, [&]() { bvh.Build(lights.Data(), lights.Size()); });
+
+        Report("Light BVH with %llu spot lights: %llu nodes, depth %llu", bvh.NumLights(), bvh.NumNodes(), bvh.Depth());
+        Report("    Build:      %8.3f ms, %.1f KB", buildTime, bvh.Nodes().MemorySize() / 1024.0);
+    }
+}
+
+// == Frustum culling =============================================================================
+
+// The per-box DirectXCollision tests that the SoA culler replaces
+static uint64 CullReference(const Camera& camera, const Array<DirectX::BoundingBox>& boxes)
+{
+    uint64 numVisible = 0;
+    if(camera.IsOrthographic())
+    {
+        const OrthographicCamera& orthoCamera = static_cast<const OrthographicCamera&>(camera);
+        const Float3 mins = Float3(orthoCamera.MinX(), orthoCamera.MinY(), -10000.0f);
+        const Float3 maxes = Float3(orthoCamera.MaxX(), orthoCamera.MaxY(), orthoCamera.FarClip());
+        const Float3 extents = (maxes - mins) / 2.0f;
+        const Float3 center = Float3::Transform(mins + extents, camera.Orientation()) + camera.Position();
+
+        DirectX::BoundingOrientedBox obb;
+        obb.Extents = extents.ToXMFLOAT3();
+        obb.Center = center.ToXMFLOAT3();
+        obb.Orientation = camera.Orientation().ToXMFLOAT4();
+        for(uint64 i = 0; i < boxes.Size(); ++i)
+            numVisible += obb.Intersects(boxes[i]) ? 1 : 0;
+    }
+    else
+    {
+        DirectX::BoundingFrustum frustum(camera.ProjectionMatrix().ToSIMD());
+        frustum.Transform(frustum, 1.0f, camera.Orientation().ToSIMD(), camera.Position().ToSIMD());
+        for(uint64 i = 0; i < boxes.Size(); ++i)
+            numVisible += frustum.Intersects(boxes[i]) ? 1 : 0;
+    }
+
+    return numVisible;
+}
+
+static uint64 CountVisible(const Array<uint64>& visibilityMasks, uint64 numViews)
+{
+    uint64 numVisible = 0;
+    for(uint64 i = 0; i < visibilityMasks.Size(); ++i)
+        for(uint64 viewIdx = 0; viewIdx < numViews; ++viewIdx)
+            numVisible += (visibilityMasks[i] >> viewIdx) & 1;
+    return numVisible;
+}
+
+static void BenchmarkFrustumCulling()
+{
+    // Instances scattered over a 2km x 2km area, with the same views that MeshRenderer culls each frame:
+    // the main camera, 4 sun shadow cascades, and a set of spot light shadows
+    const uint64 numInstances = 100000;
+    const uint64 numCascades = 4;
+    const uint64 numSpotLights = 8;
+
+    Random random;
+    Array<DirectX::BoundingBox> boxes(numInstances);
+    for(uint64 i = 0; i < numInstances; ++i)
+    {
+        const Float3 center = Float3(random.RandomFloat() * 2000.0f - 1000.0f, random.RandomFloat() * 50.0f, random.RandomFloat() * 2000.0f - 1000.0f);
+        const Float3 extents = Float3(0.25f + random.RandomFloat() * 4.0f, 0.25f + random.RandomFloat() * 8.0f, 0.25f + random.RandomFloat() * 4.0f);
+        boxes[i].Center = center.ToXMFLOAT3();
+        boxes[i].Extents = extents.ToXMFLOAT3();
+    }
+
+    PerspectiveCamera mainCamera;
+    mainCamera.Initialize(16.0f / 9.0f, Pi_4, 0.1f, 1000.0f);
+    mainCamera.SetLookAt(Float3(0.0f, 20.0f, -500.0f), Float3(0.0f, 0.0f, 0.0f), Float3(0.0f, 1.0f, 0.0f));
+
+    const Float3 sunDirection = Float3::Normalize(Float3(0.3f, 1.0f, 0.4f));
+    OrthographicCamera cascadeCameras[numCascades];
+    for(uint64 cascadeIdx = 0; cascadeIdx < numCascades; ++cascadeIdx)
+    {
+        const float radius = 25.0f * float(1 << (cascadeIdx * 2));
+        const Float3 center = mainCamera.Position() + mainCamera.Forward() * radius;
+        cascadeCameras[cascadeIdx].Initialize(-radius, -radius, radius, radius, 0.0f, radius * 2.0f + 100.0f);
+        cascadeCameras[cascadeIdx].SetLookAt(center + sunDirection * (radius + 50.0f), center, Float3(0.0f, 0.0f, 1.0f));
+    }
+
+    PerspectiveCamera spotCameras[numSpotLights];
+    for(uint64 i = 0; i < numSpotLights; ++i)
+    {
+        const Float3 position = Float3(random.RandomFloat() * 400.0f - 200.0f, 60.0f, random.RandomFloat() * 400.0f - 200.0f);
+        spotCameras[i].Initialize(1.0f, Pi_4 + random.RandomFloat() * Pi_4, 0.1f, 100.0f);
+        spotCameras[i].SetLookAt(position, position + Float3(random.RandomFloat() - 0.5f, -1.0f, random.RandomFloat() - 0.5f), Float3(0.0f, 0.0f, 1.0f));
+    }
+
+    const Camera* cameras[1 + numCascades + numSpotLights] = { };
+    CullingFrustum frusta[ArraySize_(cameras)];
+    uint64 numViews = 0;
+    cameras[numViews] = &mainCamera;
+    frusta[numViews++] = CullingFrustum::FromViewProjection(mainCamera.ViewProjectionMatrix());
+    for(uint64 i = 0; i < numCascades; ++i)
+    {
+        cameras[numViews] = &cascadeCameras[i];
+        frusta[numViews++] = CullingFrustum::FromViewProjection(cascadeCameras[i].ViewProjectionMatrix(), false);
+    }
+    for(uint64 i = 0; i < numSpotLights; ++i)
+    {
+        cameras[numViews] = &spotCameras[i];
+        frusta[numViews++] = CullingFrustum::FromViewProjection(spotCameras[i].ViewProjectionMatrix());
+    }
+
+    uint64 referenceVisible = 0;
+    const double referenceTime = TimeAverage(4, [&]()
+    {
+        referenceVisible = 0;
+        for(uint64 viewIdx = 0; viewIdx < numViews; ++viewIdx)
+            referenceVisible += CullReference(*cameras[viewIdx], boxes);
+    });
+
+    FrustumCuller flatCuller;
+    const double flatBuildTime = TimeAverage(1, [&]() { flatCuller.Initialize(boxes.Data(), numInstances, false); });
+
+    FrustumCuller bvhCuller;
+    const double bvhBuildTime = TimeAverage(1, [&]() { bvhCuller.Initialize(boxes.Data(), numInstances, true); });
+
+    // One view at a time on a single thread, and then every view at once across the task threads
+    Array<uint64> visibilityMasks(numInstances, 0);
+    uint64 flatVisible = 0;
+    const double flatTime = TimeAverage(16, [&]()
+    {
+        flatVisible = 0;
+        for(uint64 viewIdx = 0; viewIdx < numViews; ++viewIdx)
+        {
+            flatCuller.CullViews(&frusta[viewIdx], 1, visibilityMasks.Data(), false);
+            flatVisible += CountVisible(visibilityMasks, 1);
+        }
+    });
+
+    uint64 bvhVisible = 0;
+    const double bvhTime = TimeAverage(16, [&]()
+    {
+        bvhVisible = 0;
+        for(uint64 viewIdx = 0; viewIdx < numViews; ++viewIdx)
+        {
+            bvhCuller.CullViews(&frusta[viewIdx], 1, visibilityMasks.Data(), false);
+            bvhVisible += CountVisible(visibilityMasks, 1);
+        }
+    });
+
+    const double flatBatchTime = TimeAverage(64, [&]() { flatCuller.CullViews(frusta, numViews, visibilityMasks.Data()); });
+    const uint64 flatBatchVisible = CountVisible(visibilityMasks, numViews);
+
+    const double bvhBatchTime = TimeAverage(64, [&]() { bvhCuller.CullViews(frusta, numViews, visibilityMasks.Data()); });
+    const uint64 bvhBatchVisible = CountVisible(visibilityMasks, numViews);
+
+    // The plane tests are conservative, so they can keep a few boxes that DirectXCollision rejects
+    Report("Frustum culling %llu instances against %llu views (%llu visible with DirectXCollision)", numInstances, numViews, referenceVisible);
+    Report("    SoA build:              %8.3f ms, BVH build %.3f ms (%llu nodes, %llu blocks)", flatBuildTime, bvhBuildTime,
+           bvhCuller.NumBVHNodes(), bvhCuller.NumBlocks());
+    Report("    DirectXCollision:       %8.3f ms", referenceTime);
+    Report("    SoA per view:           %8.3f ms (%.1fx), %llu visible", flatTime, referenceTime / flatTime, flatVisible);
+    Report("    BVH per view:           %8.3f ms (%.1fx), %llu visible", bvhTime, referenceTime / bvhTime, bvhVisible);
+    Report("    SoA batched, threaded:  %8.3f ms (%.1fx), %llu visible", flatBatchTime, referenceTime / flatBatchTime, flatBatchVisible);
+    Report("    BVH batched, threaded:  %8.3f ms (%.1fx), %llu visible", bvhBatchTime, referenceTime / bvhBatchTime, bvhBatchVisible);
+}
+
+// == Texture sampling ============================================================================
+
+static void BenchmarkTextureSampler()
+{
+    // A 4K texture with detail at several scales, so that the mips don't all average out to the same color
+    const uint32 texSize = 4096;
+    TextureData<Float4> texData;
+    texData.Init(texSize, texSize, 1);
+    Tasks::ParallelFor(texSize, [&](uint64 start, uint64 end, uint32)
+    {
+        for(uint64 y = start; y < end; ++y)
+        {
+            for(uint64 x = 0; x < texSize; ++x)
+            {
+                const float u = float(x) / texSize;
+                const float v = float(y) / texSize;
+                texData.Texels[y * texSize + x] = Float4(0.5f + 0.5f * std::sin(u * Pi * 64.0f + v * 13.0f),
+                                                         0.5f + 0.5f * std::cos(v * Pi * 128.0f), float((x ^ y) & 255) / 255.0f, 1.0f);
+            }
+        }
+    }, 64);
+
+    TextureSampler tiledSampler;
+    const double tiledBuildTime = TimeAverage(1, [&]() { tiledSampler.Initialize(texData); });
+
+    TextureSampler linearSampler;
+    const double linearBuildTime = TimeAverage(1, [&]() { linearSampler.Initialize(texData, false); });
+
+    // Coherent samples come from a 1080p camera looking down at a textured ground plane in scanline order, with
+    // the mip picked from ray differentials. Incoherent samples are scattered over the whole texture with random
+    // ray cone footprints, like the secondary bounces of a path tracer.
+    const uint32 screenWidth = 1920;
+    const uint32 screenHeight = 1080;
+    const uint64 numSamples = uint64(screenWidth) * screenHeight;
+    const float tanHalfFOVY = std::tan(Pi_4 * 0.5f);
+    const float tanHalfFOVX = tanHalfFOVY * screenWidth / screenHeight;
+    const float cameraHeight = 2.0f;
+    const float uvScale = 0.05f;
+
+    auto groundPlaneUV = [&](float pixelX, float pixelY)
+    {
+        const float dirX = ((pixelX / screenWidth) * 2.0f - 1.0f) * tanHalfFOVX;
+        const float dirY = (1.0f - (pixelY / screenHeight) * 2.0f) * tanHalfFOVY - 0.6f;
+        const float t = cameraHeight / -dirY;
+        return Float2(dirX * t, t) * uvScale;
+    };
+
+    Array<float> coherentU(numSamples);
+    Array<float> coherentV(numSamples);
+    Array<float> coherentLODs(numSamples);
+    for(uint32 pixelY = 0; pixelY < screenHeight; ++pixelY)
+    {
+        for(uint32 pixelX = 0; pixelX < screenWidth; ++pixelX)
+        {
+            const uint64 idx = uint64(pixelY) * screenWidth + pixelX;
+            const Float2 uv = groundPlaneUV(pixelX + 0.5f, pixelY + 0.5f);
+            const Float2 duvdx = groundPlaneUV(pixelX + 1.5f, pixelY + 0.5f) - uv;
+            const Float2 duvdy = groundPlaneUV(pixelX + 0.5f, pixelY + 1.5f) - uv;
+            coherentU[idx] = uv.x;
+            coherentV[idx] = uv.y;
+            coherentLODs[idx] = tiledSampler.LODFromDifferentials(duvdx, duvdy);
+        }
+    }
+
+    Random random;
+    Array<float> incoherentU(numSamples);
+    Array<float> incoherentV(numSamples);
+    Array<float> incoherentLODs(numSamples);
+    for(uint64 i = 0; i < numSamples; ++i)
+    {
+        incoherentU[i] = random.RandomFloat();
+        incoherentV[i] = random.RandomFloat();
+        const float coneWidth = 0.0001f + random.RandomFloat() * 0.01f;
+        const float cosTheta = 0.2f + random.RandomFloat() * 0.8f;
+        incoherentLODs[i] = tiledSampler.LODFromRayCone(coneWidth, cosTheta, uvScale);
+    }
+
+    Array<Float4> results(numSamples);
+    const double referenceTime = TimeAverage(2, [&]()
+    {
+        for(uint64 i = 0; i < numSamples; ++i)
+            results[i] = Float4(SampleTexture2D(Float2(coherentU[i], coherentV[i]), texData));
+    });
+
+    auto sampleAll = [&](const TextureSampler& sampler, const Array<float>& u, const Array<float>& v, const Array<float>& lods)
+    {
+        sampler.Sample(u.Data(), v.Data(), lods.Data(), numSamples, results.Data());
+    };
+
+    const double tiledCoherentTime = TimeAverage(4, [&]() { sampleAll(tiledSampler, coherentU, coherentV, coherentLODs); });
+    const double linearCoherentTime = TimeAverage(4, [&]() { sampleAll(linearSampler, coherentU, coherentV, coherentLODs); });
+    const double tiledIncoherentTime = TimeAverage(4, [&]() { sampleAll(tiledSampler, incoherentU, incoherentV, incoherentLODs); });
+    const double linearIncoherentTime = TimeAverage(4, [&]() { sampleAll(linearSampler, incoherentU, incoherentV, incoherentLODs); });
+
+    // Split up by scanline, which keeps every range a multiple of the batch size
+    const double threadedTime = TimeAverage(8, [&]()
+    {
+        Tasks::ParallelFor(screenHeight, [&](uint64 start, uint64 end, uint32)
+        {
+            const uint64 sampleStart = start * screenWidth;
+            const uint64 sampleCount = (end - start) * screenWidth;
+            tiledSampler.Sample(&coherentU[sampleStart], &coherentV[sampleStart], &coherentLODs[sampleStart], sampleCount, &results[sampleStart]);
+        }, 4);
+    });
+
+    // With the LOD forced to 0 the sampler should match SampleTexture2D, away from the edges where SampleTexture2D
+    // clamps instead of wrapping
+    const uint64 numCompared = 65536;
+    Array<float> zeroLODs(numCompared, 0.0f);
+    tiledSampler.Sample(incoherentU.Data(), incoherentV.Data(), zeroLODs.Data(), numCompared, results.Data());
+    float maxError = 0.0f;
+    const float edge = 1.0f / texSize;
+    for(uint64 i = 0; i < numCompared; ++i)
+    {
+        const Float2 uv = Float2(incoherentU[i], incoherentV[i]);
+        if(uv.x < edge || uv.y < edge || uv.x > 1.0f - edge || uv.y > 1.0f - edge)
+            continue;
+
+        const Float4 diff = Float4(SampleTexture2D(uv, texData)) - results[i];
+        maxError = Max(maxError, Max(Max(std::abs(diff.x), std::abs(diff.y)), Max(std::abs(diff.z), std::abs(diff.w))));
+    }
+
+    // Bad coordinates from degenerate hits have to stay inside the texture. With wrapping, non-finite coordinates
+    // sample at 0 and huge ones are whole numbers, so either way they should match a sample at 0.
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    const float inf = std::numeric_limits<float>::infinity();
+    const float badCoords[] = { nan, inf, -inf, FloatMax, -FloatMax, 1e10f, -1e10f, 3e9f, -16777216.0f };
+    const uint64 numBadCoords = ArraySize_(badCoords);
+    Array<float> badU(numBadCoords * 2);
+    Array<float> badV(numBadCoords * 2);
+    Array<float> badLODs(numBadCoords * 2, 0.0f);
+    Array<Float4> badResults(numBadCoords * 2);
+    for(uint64 i = 0; i < numBadCoords; ++i)
+    {
+        badU[i] = badCoords[i];
+        badV[i] = 0.25f;
+        badU[numBadCoords + i] = 0.25f;
+        badV[numBadCoords + i] = badCoords[i];
+    }
+
+    const float refU[2] = { 0.0f, 0.25f };
+    const float refV[2] = { 0.25f, 0.0f };
+    const float refLODs[2] = { 0.0f, 0.0f };
+    Float4 refResults[2];
+    tiledSampler.Sample(refU, refV, refLODs, 2, refResults);
+
+    uint64 badCoordFailures = 0;
+    tiledSampler.Sample(badU.Data(), badV.Data(), badLODs.Data(), badU.Size(), badResults.Data());
+    for(uint64 i = 0; i < badU.Size(); ++i)
+    {
+        const Float4 diff = badResults[i] - refResults[i / numBadCoords];
+        if(Max(Max(std::abs(diff.x), std::abs(diff.y)), Max(std::abs(diff.z), std::abs(diff.w))) > 0.0001f)
+            ++badCoordFailures;
+    }
+
+    // Clamping has no single expected texel for these, they only need to come out finite
+    tiledSampler.Sample(badU.Data(), badV.Data(), badLODs.Data(), badU.Size(), badResults.Data(), 0, SamplerAddressMode::Clamp);
+    for(uint64 i = 0; i < badU.Size(); ++i)
+    {
+        const Float4 result = badResults[i];
+        if(std::isfinite(result.x) == false || std::isfinite(result.y) == false || std::isfinite(result.z) == false ||
+           std::isfinite(result.w) == false)
+            ++badCoordFailures;
+    }
+
+    const double samplesPerMS = numSamples / 1000.0;
+    Report("Texture sampling %ux%u Float4, %llu samples per pass", texSize, texSize, numSamples);
+    Report("    Build:                  tiled %.2f ms, linear %.2f ms (%.1f MB with mips)", tiledBuildTime, linearBuildTime,
+           tiledSampler.MemorySize() / (1024.0 * 1024.0));
+    Report("    SampleTexture2D mip 0:  %8.3f ms (%.1f MSamples/s)", referenceTime, samplesPerMS / referenceTime);
+    Report("    Tiled, coherent:        %8.3f ms (%.1f MSamples/s)", tiledCoherentTime, samplesPerMS / tiledCoherentTime);
+    Report("    Linear, coherent:       %8.3f ms (%.1f MSamples/s)", linearCoherentTime, samplesPerMS / linearCoherentTime);
+    Report("    Tiled, incoherent:      %8.3f ms (%.1f MSamples/s)", tiledIncoherentTime, samplesPerMS / tiledIncoherentTime);
+    Report("    Linear, incoherent:     %8.3f ms (%.1f MSamples/s)", linearIncoherentTime, samplesPerMS / linearIncoherentTime);
+    Report("    Tiled, coherent, threaded: %8.3f ms (%.1f MSamples/s)", threadedTime, samplesPerMS / threadedTime);
+    Report("    Max error vs SampleTexture2D at LOD 0: %.6f", maxError);
+    Report("    Bad coordinate failures: %llu %s", badCoordFailures, badCoordFailures == 0 ? "(ok)" : "(FAILED)");
+}
+
+// == Texture residency ===========================================================================
+
+// The first mip that the residency manager keeps resident no matter what, worked out independently of the manager
+static uint32 ResidencyTailMip(uint32 size, uint32 numMips)
+{
+    uint32 tailMip = 0;
+    while(tailMip + 1 < numMips && (size >> tailMip) > TextureResidencyManager::MipTailSize)
+        ++tailMip;
+    return tailMip;
+}
+
+// Walks a window of requested textures across a scene's worth of BC7 textures, with the budget cut in half partway
+// through, and checks the backend's state after every update against what the manager promises
+static void BenchmarkTextureResidency()
+{
+    const uint64 numTextures = 512;
+    const uint64 windowSize = 16;
+    const uint64 numFrames = 400;
+    const uint64 shrinkFrame = 250;
+    const uint64 initialBudget = 256 * 1024 * 1024;
+    const uint32 sizes[] = { 512, 1024, 2048 };
+
+    SimulatedResidencyBackend backend;
+    TextureResidencyManager manager;
+    manager.Initialize(&backend, initialBudget);
+
+    // Everything starts out with only its mip tail resident
+    Random random;
+    Array<uint32> tailMips(numTextures);
+    uint64 totalBytes = 0;
+    for(uint64 i = 0; i < numTextures; ++i)
+    {
+        const uint32 size = sizes[random.RandomUint() % ArraySize_(sizes)];
+        const uint32 numMips = uint32(std::log2(float(size))) + 1;
+        tailMips[i] = ResidencyTailMip(size, numMips);
+
+        const uint32 textureIdx = backend.AddTexture(size, size, numMips, 8, true);
+        backend.SetFirstResidentMip(textureIdx, tailMips[i]);
+        manager.AddTexture(size, size, numMips, numMips - 1, tailMips[i]);
+        totalBytes += backend.ResidentSize(textureIdx, 0);
+    }
+
+    Array<uint64> lastUsedFrame(numTextures, 0);
+    Array<uint32> requestedMips(numTextures, 0);
+    Array<uint32> prevFirstMips(numTextures, 0);
+
+    uint64 budgetFailures = 0;
+    uint64 lruFailures = 0;
+    uint64 tailFailures = 0;
+    uint64 maxResidentBytes = 0;
+    uint64 totalEvicted = 0;
+    uint64 totalStreamedIn = 0;
+    uint64 totalStarved = 0;
+    double totalUpdateTime = 0.0;
+    for(uint64 frame = 1; frame <= numFrames; ++frame)
+    {
+        if(frame == shrinkFrame)
+            manager.SetBudget(initialBudget / 2);
+
+        // The window moves by a texture every other frame, and wraps around so that old textures come back
+        const uint64 windowStart = (frame / 2) % numTextures;
+        for(uint64 w = 0; w < windowSize; ++w)
+        {
+            const uint64 textureIdx = (windowStart + w) % numTextures;
+            const uint32 mip = random.RandomUint() % 3;
+            manager.RequestMip(uint32(textureIdx), mip);
+            requestedMips[textureIdx] = Min(mip, tailMips[textureIdx]);
+            lastUsedFrame[textureIdx] = frame;
+        }
+
+        for(uint64 i = 0; i < numTextures; ++i)
+            prevFirstMips[i] = backend.FirstResidentMip(uint32(i));
+
+        manager.Update();
+
+        const TextureResidencyStats& stats = manager.Stats();
+        totalUpdateTime += stats.UpdateTime;
+        totalEvicted += stats.NumEvicted;
+        totalStreamedIn += stats.NumStreamedIn;
+        totalStarved += stats.NumStarved;
+
+        // The budget has to hold for what's actually resident in the backend, not just the manager's own count
+        uint64 residentBytes = 0;
+        for(uint64 i = 0; i < numTextures; ++i)
+            residentBytes += backend.ResidentSize(uint32(i), backend.FirstResidentMip(uint32(i)));
+        maxResidentBytes = Max(maxResidentBytes, residentBytes);
+        if(residentBytes > stats.BudgetBytes || residentBytes != manager.ResidentBytes())
+            ++budgetFailures;
+
+        // Of the textures that had more resident than they needed this frame, every one that got trimmed has to have
+        // been used less recently than every one that was left alone
+        uint64 newestEvicted = 0;
+        uint64 oldestKept = uint64(-1);
+        for(uint64 i = 0; i < numTextures; ++i)
+        {
+            const uint32 firstMip = backend.FirstResidentMip(uint32(i));
+            if(firstMip > tailMips[i])
+                ++tailFailures;
+
+            const uint32 neededMip = lastUsedFrame[i] == frame ? requestedMips[i] : tailMips[i];
+            if(prevFirstMips[i] >= neededMip)
+                continue;
+
+            if(firstMip > prevFirstMips[i])
+                newestEvicted = Max(newestEvicted, lastUsedFrame[i]);
+            else
+                oldestKept = Min(oldestKept, lastUsedFrame[i]);
+        }
+
+        if(newestEvicted > oldestKept)
+            ++lruFailures;
+    }
+
+    const double mb = 1024.0 * 1024.0;
+    Report("Texture residency, %llu textures (%.1f MB with all mips), %llu requested per frame, %llu frames",
+           numTextures, totalBytes / mb, windowSize, numFrames);
+    Report("    Budget %.1f MB, cut to %.1f MB at frame %llu, peak resident %.1f MB", initialBudget / mb,
+           initialBudget / (2.0 * mb), shrinkFrame, maxResidentBytes / mb);
+    Report("    Update:                 %8.3f ms per frame", totalUpdateTime / numFrames);
+    Report("    Streamed in %llu, evicted %llu, starved %llu, %llu backend calls", totalStreamedIn, totalEvicted,
+           totalStarved, backend.NumCalls());
+    Report("    Frames over budget:         %llu %s", budgetFailures, budgetFailures == 0 ? "(ok)" : "(FAILED)");
+    Report("    Frames with non-LRU evicts: %llu %s", lruFailures, lruFailures == 0 ? "(ok)" : "(FAILED)");
+    Report("    Mip tails not resident:     %llu %s", tailFailures, tailFailures == 0 ? "(ok)" : "(FAILED)");
+
+    manager.Shutdown();
+}
+
+// == EXR =========================================================================================
+
+// Reads back the files that EXRWriter makes. This follows the OpenEXR decoders (ImfZipCompressor.cpp,
+// ImfPizCompressor.cpp, ImfHuf.cpp and ImfWav.cpp) instead of the writer, so that the two check each other. The
+// TinyEXR reader in the framework only handles scanline files with half channels and ZIP or no compression, so
+// this is what covers float channels, tiles and PIZ. Anything malformed makes it return false.
+
+struct EXRBitReader
+{
+    const uint8* Data = nullptr;
+    uint64 NumBits = 0;
+    uint64 Pos = 0;
+
+    bool Read(uint32 numBits, uint64& bits)
+    {
+        if(Pos + numBits > NumBits)
+            return false;
+
+        bits = 0;
+        for(uint32 i = 0; i < numBits; ++i, ++Pos)
+            bits = (bits << 1) | ((Data[Pos >> 3] >> (7 - (Pos & 7))) & 1);
+        return true;
+    }
+};
+
+static bool DecompressEXRHuffman(const uint8* src, uint64 srcSize, uint16* dst, uint64 numValues)
+{
+    const uint32 encodingSize = 65537;
+    uint32 header[5] = { };
+    if(srcSize < sizeof(header))
+        return false;
+
+    memcpy(header, src, sizeof(header));
+    const uint32 minSymbol = header[0];
+    const uint32 maxSymbol = header[1];
+    const uint64 tableSize = header[2];
+    const uint64 numDataBits = header[3];
+    if(minSymbol > maxSymbol || maxSymbol >= encodingSize || sizeof(header) + tableSize + (numDataBits + 7) / 8 > srcSize)
+        return false;
+
+    // Code lengths, where 59-62 stand for 2-5 unused symbols and 63 is followed by a longer run
+    Array<uint8> lengths(encodingSize, 0);
+    EXRBitReader tableReader = { src + sizeof(header), tableSize * 8, 0 };
+    for(uint32 symbol = minSymbol; symbol <= maxSymbol; )
+    {
+        uint64 length = 0;
+        if(tableReader.Read(6, length) == false)
+            return false;
+
+        uint64 zeroRun = 0;
+        if(length == 63)
+        {
+            if(tableReader.Read(8, zeroRun) == false)
+                return false;
+            zeroRun += 6;
+        }
+        else if(length >= 59)
+        {
+            zeroRun = length - 59 + 2;
+        }
+        else
+        {
+            lengths[symbol++] = uint8(length);
+            continue;
+        }
+
+        if(symbol + zeroRun > maxSymbol + 1)
+            return false;
+        symbol += uint32(zeroRun);
+    }
+
+    // Canonical codes, where the codes of each length count up from a base in symbol order
+    uint64 counts[59] = { };
+    for(uint32 symbol = minSymbol; symbol <= maxSymbol; ++symbol)
+        counts[lengths[symbol]] += 1;
+
+    uint64 bases[59] = { };
+    uint64 nextBase = 0;
+    for(uint32 length = 58; length > 0; --length)
+    {
+        bases[length] = nextBase;
+        nextBase = (nextBase + counts[length]) >> 1;
+    }
+
+    uint64 firstSymbols[59] = { };
+    for(uint32 length = 1; length < 59; ++length)
+        firstSymbols[length] = firstSymbols[length - 1] + (length > 1 ? counts[length - 1] : 0);
+
+    Array<uint32> symbolsByLength(maxSymbol - minSymbol + 1);
+    uint64 filled[59] = { };
+    for(uint32 symbol = minSymbol; symbol <= maxSymbol; ++symbol)
+        if(lengths[symbol] > 0)
+            symbolsByLength[firstSymbols[lengths[symbol]] + filled[lengths[symbol]]++] = symbol;
+
+    // The symbol after the last used one marks a run, followed by 8 bits of how many times the last value repeats
+    EXRBitReader dataReader = { src + sizeof(header) + tableSize, numDataBits, 0 };
+    uint64 numDecoded = 0;
+    while(dataReader.Pos < numDataBits)
+    {
+        uint64 code = 0;
+        uint32 length = 0;
+        uint32 symbol = encodingSize;
+        while(symbol == encodingSize)
+        {
+            uint64 bit = 0;
+            if(++length > 58 || dataReader.Read(1, bit) == false)
+                return false;
+
+            code = (code << 1) | bit;
+            if(code >= bases[length] && code - bases[length] < counts[length])
+                symbol = symbolsByLength[firstSymbols[length] + code - bases[length]];
+        }
+
+        if(symbol == maxSymbol)
+        {
+            uint64 runCount = 0;
+            if(dataReader.Read(8, runCount) == false || numDecoded == 0 || numDecoded + runCount > numValues)
+                return false;
+
+            for(uint64 i = 0; i < runCount; ++i, ++numDecoded)
+                dst[numDecoded] = dst[numDecoded - 1];
+        }
+        else
+        {
+            if(numDecoded == numValues)
+                return false;
+            dst[numDecoded++] = uint16(symbol);
+        }
+    }
+
+    return numDecoded == numValues;
+}
+
+static void EXRWaveletDecode14(uint16 l, uint16 h, uint16& a, uint16& b)
+{
+    const int32 hi = int16(h);
+    const int32 ai = int16(l) + (hi & 1) + (hi >> 1);
+    a = uint16(int16(ai));
+    b = uint16(int16(ai - hi));
+}
+
+static void EXRWaveletDecode16(uint16 l, uint16 h, uint16& a, uint16& b)
+{
+    const int32 modMask = 0xFFFF;
+    const int32 bb = (int32(l) - (int32(h) >> 1)) & modMask;
+    a = uint16((int32(h) + bb - 0x8000) & modMask);
+    b = uint16(bb);
+}
+
+static void EXRWaveletDecode(uint16 l, uint16 h, uint16& a, uint16& b, bool w14)
+{
+    if(w14)
+        EXRWaveletDecode14(l, h, a, b);
+    else
+        EXRWaveletDecode16(l, h, a, b);
+}
+
+// Undoes the 2D wavelet transform, going from the coarsest level back down to the finest
+static void EXRWavelet2DDecode(uint16* data, uint32 nx, uint32 ox, uint32 ny, uint32 oy, uint16 maxValue)
+{
+    const bool w14 = maxValue < (1 << 14);
+    const uint32 n = Min(nx, ny);
+    uint32 p = 1;
+    while(p <= n)
+        p <<= 1;
+    p >>= 1;
+    uint32 p2 = p;
+    p >>= 1;
+
+    while(p >= 1)
+    {
+        uint16* py = data;
+        uint16* ey = data + uint64(oy) * (ny - p2);
+        const uint32 oy1 = oy * p;
+        const uint32 oy2 = oy * p2;
+        const uint32 ox1 = ox * p;
+        const uint32 ox2 = ox * p2;
+        uint16 i00 = 0;
+        uint16 i01 = 0;
+        uint16 i10 = 0;
+        uint16 i11 = 0;
+
+        for(; py <= ey; py += oy2)
+        {
+            uint16* px = py;
+            uint16* ex = py + uint64(ox) * (nx - p2);
+            for(; px <= ex; px += ox2)
+            {
+                uint16* p01 = px + ox1;
+                uint16* p10 = px + oy1;
+                uint16* p11 = p10 + ox1;
+                EXRWaveletDecode(*px, *p10, i00, i10, w14);
+                EXRWaveletDecode(*p01, *p11, i01, i11, w14);
+                EXRWaveletDecode(i00, i01, *px, *p01, w14);
+                EXRWaveletDecode(i10, i11, *p10, *p11, w14);
+            }
+
+            if(nx & p)
+            {
+                uint16* p10 = px + oy1;
+                EXRWaveletDecode(*px, *p10, i00, *p10, w14);
+                *px = i00;
+            }
+        }
+
+        if(ny & p)
+        {
+            uint16* px = py;
+            uint16* ex = py + uint64(ox) * (nx - p2);
+            for(; px <= ex; px += ox2)
+            {
+                uint16* p01 = px + ox1;
+                EXRWaveletDecode(*px, *p01, i00, *p01, w14);
+                *px = i00;
+            }
+        }
+
+        p2 = p;
+        p >>= 1;
+    }
+}
+
+static bool DecompressEXRPIZ(const uint8* src, uint64 srcSize, uint32 blockWidth, uint32 blockHeight, uint32 numChannels,
+                             uint32 wordsPerValue, uint8* dst, uint64 dstSize)
+{
+    uint16 minNonZero = 0;
+    uint16 maxNonZero = 0;
+    if(srcSize < 4)
+        return false;
+    memcpy(&minNonZero, src, sizeof(uint16));
+    memcpy(&maxNonZero, src + 2, sizeof(uint16));
+    uint64 srcPos = 4;
+
+    Array<uint8> bitmap(8192, 0);
+    if(maxNonZero >= bitmap.Size())
+        return false;
+
+    if(minNonZero <= maxNonZero)
+    {
+        const uint64 bitmapBytes = maxNonZero - minNonZero + 1;
+        if(srcPos + bitmapBytes > srcSize)
+            return false;
+        memcpy(&bitmap[minNonZero], src + srcPos, bitmapBytes);
+        srcPos += bitmapBytes;
+    }
+
+    // Maps the dense range back to the values that were used, with 0 always included
+    Array<uint16> lut(65536, 0);
+    uint32 numUsed = 0;
+    for(uint32 i = 0; i < 65536; ++i)
+        if(i == 0 || (bitmap[i >> 3] & (1 << (i & 7))))
+            lut[numUsed++] = uint16(i);
+    const uint16 maxValue = uint16(numUsed - 1);
+
+    int32 huffmanSize = 0;
+    if(srcPos + sizeof(int32) > srcSize)
+        return false;
+    memcpy(&huffmanSize, src + srcPos, sizeof(int32));
+    srcPos += sizeof(int32);
+    if(huffmanSize < 0 || srcPos + huffmanSize > srcSize)
+        return false;
+
+    const uint64 numWords = dstSize / sizeof(uint16);
+    Array<uint16> words(numWords);
+    if(DecompressEXRHuffman(src + srcPos, uint64(huffmanSize), words.Data(), numWords) == false)
+        return false;
+
+    const uint64 lineWords = uint64(blockWidth) * wordsPerValue;
+    const uint64 channelWords = lineWords * blockHeight;
+    for(uint32 c = 0; c < numChannels; ++c)
+        for(uint32 j = 0; j < wordsPerValue; ++j)
+            EXRWavelet2DDecode(&words[c * channelWords + j], blockWidth, wordsPerValue, blockHeight, uint32(lineWords), maxValue);
+
+    for(uint64 i = 0; i < numWords; ++i)
+        words[i] = lut[words[i]];
+
+    // Channels were stored one after another, and the raw layout has every channel for each line
+    uint16* dstWords = reinterpret_cast<uint16*>(dst);
+    for(uint32 y = 0; y < blockHeight; ++y)
+        for(uint32 c = 0; c < numChannels; ++c)
+            memcpy(dstWords + (uint64(y) * numChannels + c) * lineWords, &words[c * channelWords + y * lineWords],
+                   lineWords * sizeof(uint16));
+
+    return true;
+}
+
+// Index of an R, G, B or A channel in a Float4, or 4 for anything else
+static uint32 EXRComponentIndex(const char* channelName)
+{
+    const char* components = "RGBA";
+    for(uint32 i = 0; i < 4; ++i)
+        if(channelName[0] == components[i] && channelName[1] == 0)
+            return i;
+    return 4;
+}
+
+static bool DecompressEXRZIP(const uint8* src, uint64 srcSize, uint8* dst, uint64 dstSize)
+{
+    Array<uint8> inflated(dstSize);
+    if(DecompressZlib(inflated.Data(), dstSize, src, srcSize) != dstSize)
+        return false;
+
+    for(uint64 i = 1; i < dstSize; ++i)
+        inflated[i] = uint8(int32(inflated[i - 1]) + int32(inflated[i]) - 128);
+
+    const uint64 half = (dstSize + 1) / 2;
+    for(uint64 i = 0; i < dstSize; ++i)
+        dst[i] = inflated[(i & 1) ? half + i / 2 : i / 2];
+
+    return true;
+}
+
+// Reads an RGB(A) image, with alpha set to 1 if the file doesn't have it
+static bool ReadEXRImage(const wchar* filePath, uint32& width, uint32& height, Array<Float4>& texels)
+{
+    Array<uint8> fileData;
+    {
+        File file(filePath, FileOpenMode::Read);
+        fileData.Init(file.Size());
+        file.Read(fileData.Size(), fileData.Data());
+    }
+
+    const uint8* data = fileData.Data();
+    const uint64 dataSize = fileData.Size();
+    uint64 pos = 0;
+
+    auto readBytes = [&](void* dst, uint64 size)
+    {
+        if(pos + size > dataSize)
+            return false;
+        memcpy(dst, data + pos, size);
+        pos += size;
+        return true;
+    };
+
+    auto readString = [&](std::string& str)
+    {
+        str.clear();
+        while(pos < dataSize && data[pos] != 0)
+            str += char(data[pos++]);
+        return pos++ < dataSize;
+    };
+
+    uint32 magic = 0;
+    uint32 version = 0;
+    if(readBytes(&magic, 4) == false || readBytes(&version, 4) == false || magic != 20000630)
+        return false;
+
+    // Single part images with short names, optionally tiled
+    const bool tiled = (version & 0x200) != 0;
+    if((version & 0xFF) != 2 || (version & ~0x2FFu) != 0)
+        return false;
+
+    GrowableList<uint32> channelComponents;
+    GrowableList<uint32> channelTypes;
+    uint8 compression = 255;
+    int32 window[4] = { };
+    uint32 tileSize[2] = { };
+    while(true)
+    {
+        std::string name;
+        std::string type;
+        int32 size = 0;
+        if(readString(name) == false)
+            return false;
+        if(name.empty())
+            break;
+        if(readString(type) == false || readBytes(&size, 4) == false || size < 0 || pos + size > dataSize)
+            return false;
+
+        const uint64 valueEnd = pos + size;
+        if(name == "channels")
+        {
+            std::string channelName;
+            while(readString(channelName) && channelName.empty() == false)
+            {
+                uint32 pixelType = 0;
+                uint32 linear = 0;
+                int32 sampling[2] = { };
+                if(readBytes(&pixelType, 4) == false || readBytes(&linear, 4) == false || readBytes(sampling, 8) == false)
+                    return false;
+
+                const uint32 component = EXRComponentIndex(channelName.c_str());
+                if(component == 4 || (pixelType != 1 && pixelType != 2) || sampling[0] != 1 || sampling[1] != 1)
+                    return false;
+
+                channelComponents.Add(component);
+                channelTypes.Add(pixelType);
+            }
+        }
+        else if(name == "compression")
+            compression = data[pos];
+        else if(name == "dataWindow" && size == sizeof(window))
+            memcpy(window, data + pos, sizeof(window));
+        else if(name == "tiles" && size == 9)
+        {
+            memcpy(tileSize, data + pos, sizeof(tileSize));
+            if(data[pos + 8] != 0)
+                return false;
+        }
+        else if(name == "lineOrder" && data[pos] != 0)
+            return false;
+
+        pos = valueEnd;
+    }
+
+    if(window[0] != 0 || window[1] != 0 || window[2] < 0 || window[3] < 0 || channelComponents.Count() == 0)
+        return false;
+
+    width = uint32(window[2]) + 1;
+    height = uint32(window[3]) + 1;
+
+    uint32 chunkWidth = width;
+    uint32 chunkHeight = 1;
+    if(tiled)
+    {
+        chunkWidth = tileSize[0];
+        chunkHeight = tileSize[1];
+        if(chunkWidth == 0 || chunkHeight == 0)
+            return false;
+    }
+    else if(compression == 3)
+        chunkHeight = 16;
+    else if(compression == 4)
+        chunkHeight = 32;
+
+    if(compression != 0 && compression != 3 && compression != 4)
+        return false;
+
+    const uint32 chunksPerRow = (width + chunkWidth - 1) / chunkWidth;
+    const uint64 numChunks = uint64(chunksPerRow) * ((height + chunkHeight - 1) / chunkHeight);
+    Array<uint64> chunkOffsets(numChunks);
+    if(readBytes(chunkOffsets.Data(), chunkOffsets.MemorySize()) == false)
+        return false;
+
+    uint64 bytesPerPixel = 0;
+    for(uint64 c = 0; c < channelTypes.Count(); ++c)
+        bytesPerPixel += channelTypes[c] == 1 ? 2 : 4;
+    const bool anyFloat = bytesPerPixel != channelTypes.Count() * 2;
+
+    texels.Init(uint64(width) * height, Float4(0.0f, 0.0f, 0.0f, 1.0f));
+    Array<uint8> written(texels.Size(), 0);
+    for(uint64 chunkIdx = 0; chunkIdx < numChunks; ++chunkIdx)
+    {
+        pos = chunkOffsets[chunkIdx];
+
+        int32 chunkHeader[5] = { };
+        uint32 x0 = 0;
+        uint32 y0 = 0;
+        int32 chunkSize = 0;
+        if(tiled)
+        {
+            if(readBytes(chunkHeader, 5 * sizeof(int32)) == false || chunkHeader[0] < 0 || chunkHeader[1] < 0 ||
+               chunkHeader[2] != 0 || chunkHeader[3] != 0)
+                return false;
+            x0 = uint32(chunkHeader[0]) * chunkWidth;
+            y0 = uint32(chunkHeader[1]) * chunkHeight;
+            chunkSize = chunkHeader[4];
+        }
+        else
+        {
+            if(readBytes(chunkHeader, 2 * sizeof(int32)) == false || chunkHeader[0] < 0)
+                return false;
+            y0 = uint32(chunkHeader[0]);
+            chunkSize = chunkHeader[1];
+        }
+
+        if(x0 >= width || y0 >= height || chunkSize < 0 || pos + chunkSize > dataSize)
+            return false;
+
+        const uint32 blockWidth = Min(chunkWidth, width - x0);
+        const uint32 blockHeight = Min(chunkHeight, height - y0);
+        const uint64 rawSize = blockWidth * blockHeight * bytesPerPixel;
+
+        // Chunks that didn't get any smaller are stored as they are
+        Array<uint8> raw(rawSize);
+        const uint8* chunkData = data + pos;
+        if(compression == 0 || uint64(chunkSize) == rawSize)
+        {
+            if(uint64(chunkSize) != rawSize)
+                return false;
+            memcpy(raw.Data(), chunkData, rawSize);
+        }
+        else if(compression == 3)
+        {
+            if(DecompressEXRZIP(chunkData, chunkSize, raw.Data(), rawSize) == false)
+                return false;
+        }
+        else if(anyFloat == false || bytesPerPixel == channelTypes.Count() * 4)
+        {
+            const uint32 wordsPerValue = anyFloat ? 2 : 1;
+            if(DecompressEXRPIZ(chunkData, chunkSize, blockWidth, blockHeight, uint32(channelTypes.Count()), wordsPerValue,
+                                raw.Data(), rawSize) == false)
+                return false;
+        }
+        else
+        {
+            // Mixing half and float channels isn't something EXRWriter does
+            return false;
+        }
+
+        const uint8* src = raw.Data();
+        for(uint32 y = 0; y < blockHeight; ++y)
+        {
+            for(uint64 c = 0; c < channelTypes.Count(); ++c)
+            {
+                for(uint32 x = 0; x < blockWidth; ++x)
+                {
+                    float value = 0.0f;
+                    if(channelTypes[c] == 1)
+                    {
+                        uint16 halfValue = 0;
+                        memcpy(&halfValue, src, sizeof(uint16));
+                        value = DirectX::PackedVector::XMConvertHalfToFloat(halfValue);
+                        src += sizeof(uint16);
+                    }
+                    else
+                    {
+                        memcpy(&value, src, sizeof(float));
+                        src += sizeof(float);
+                    }
+
+                    const uint64 texelIdx = uint64(y0 + y) * width + x0 + x;
+                    (&texels[texelIdx].x)[channelComponents[c]] = value;
+                    written[texelIdx] = 1;
+                }
+            }
+        }
+    }
+
+    for(uint64 i = 0; i < written.Size(); ++i)
+        if(written[i] == 0)
+            return false;
+
+    return true;
+}
+
+// Number of texels that don't exactly match, or the texel count if the file couldn't be read
+static uint64 CountEXRMismatches(const Array<Float4>& expected, uint32 width, uint32 height, uint32 readWidth,
+                                 uint32 readHeight, const Array<Float4>& texels)
+{
+    if(readWidth != width || readHeight != height || texels.Size() != expected.Size())
+        return expected.Size();
+
+    uint64 numMismatches = 0;
+    for(uint64 i = 0; i < expected.Size(); ++i)
+        if(memcmp(&expected[i], &texels[i], sizeof(Float4)) != 0)
+            ++numMismatches;
+    return numMismatches;
+}
+
+// Writes an image with every combination of pixel type, layout and compression and reads it back. Everything is
+// lossless apart from the conversion to half, so the texels have to match exactly.
+static void BenchmarkEXR()
+{
+    // Smooth lighting with path tracing noise over a wide range of values, at a size that doesn't line up with the
+    // scanline blocks or the tiles so that the last chunk in each row and column gets cut off
+    const uint32 width = 1000;
+    const uint32 height = 700;
+    Array<Float4> texels(uint64(width) * height);
+    Random random;
+    for(uint32 y = 0; y < height; ++y)
+    {
+        for(uint32 x = 0; x < width; ++x)
+        {
+            const float u = float(x) / width;
+            const float v = float(y) / height;
+            const float lighting = 0.5f + 0.5f * std::sin(u * 12.0f) * std::cos(v * 9.0f);
+            const float noise = random.RandomFloat();
+            Float4 texel = Float4(lighting * (0.5f + noise), lighting * v * 4.0f, (1.0f - u) * 200.0f * noise * noise, u);
+            if(x % 97 == 13 && y % 89 == 7)
+                texel = Float4(20000.0f, 15000.0f, 9000.0f, 1.0f);
+            else if((x + y) % 211 == 0)
+                texel = Float4(0.0f, -0.001f, 0.0f, 0.0f);
+            texels[uint64(y) * width + x] = texel;
+        }
+    }
+
+    // What reading back a half file should give
+    Array<Float4> halfTexels(texels.Size());
+    for(uint64 i = 0; i < texels.Size(); ++i)
+        for(uint32 c = 0; c < 4; ++c)
+            (&halfTexels[i].x)[c] = DirectX::PackedVector::XMConvertHalfToFloat(DirectX::PackedVector::XMConvertFloatToHalf((&texels[i].x)[c]));
+
+    const wchar* filePath = L"BenchmarkEXR.exr";
+    const EXRCompression compressions[] = { EXRCompression::None, EXRCompression::ZIP, EXRCompression::PIZ };
+    const char* compressionNames[] = { "none", "ZIP", "PIZ" };
+
+    Report("EXR write and read back, %ux%u RGBA", width, height);
+    uint64 numFailures = 0;
+    for(uint32 pixelType = 0; pixelType < 2; ++pixelType)
+    {
+        for(uint32 tiled = 0; tiled < 2; ++tiled)
+        {
+            for(uint64 compressionIdx = 0; compressionIdx < ArraySize_(compressions); ++compressionIdx)
+            {
+                EXRWriteSettings settings;
+                settings.PixelType = pixelType == 0 ? EXRPixelType::Half : EXRPixelType::Float;
+                settings.Tiled = tiled != 0;
+                settings.Compression = compressions[compressionIdx];
+                settings.WriteAlpha = true;
+
+                EXRWriteStats stats;
+                const double writeTime = TimeAverage(2, [&]() { stats = SaveEXR(filePath, texels.Data(), width, height, settings); });
+
+                uint32 readWidth = 0;
+                uint32 readHeight = 0;
+                Array<Float4> readTexels;
+                const bool readSucceeded = ReadEXRImage(filePath, readWidth, readHeight, readTexels);
+                const uint64 numMismatches = readSucceeded ? CountEXRMismatches(pixelType == 0 ? halfTexels : texels, width, height,
+                                                                                readWidth, readHeight, readTexels) : texels.Size();
+                numFailures += numMismatches > 0 ? 1 : 0;
+
+                Report("    %-5s %-8s %-4s  %7.2f MB (%5.2f:1)  %8.2f ms  %llu mismatches %s", pixelType == 0 ? "half" : "float",
+                       tiled ? "tiled" : "scanline", compressionNames[compressionIdx], stats.FileSize / (1024.0 * 1024.0),
+                       double(stats.UncompressedSize) / stats.FileSize, writeTime, numMismatches, numMismatches == 0 ? "(ok)" : "(FAILED)");
+            }
+        }
+    }
+
+    // The default settings, read back with TinyEXR as well. TinyEXR leaves the channels out of order and doesn't
+    // have alpha here, so they're matched up by name.
+    for(uint64 compressionIdx = 0; compressionIdx < 2; ++compressionIdx)
+    {
+        EXRWriteSettings settings;
+        settings.Compression = compressions[compressionIdx];
+        SaveEXR(filePath, texels.Data(), width, height, settings);
+
+        Array<Float4> expected(halfTexels.Size());
+        for(uint64 i = 0; i < expected.Size(); ++i)
+            expected[i] = Float4(halfTexels[i].x, halfTexels[i].y, halfTexels[i].z, 1.0f);
+
+        EXRImage image = { };
+        const char* error = nullptr;
+        const std::string filePathAnsi = WStringToAnsi(filePath);
+        uint64 numMismatches = expected.Size();
+        if(LoadMultiChannelEXR(&image, filePathAnsi.c_str(), &error) == 0)
+        {
+            Array<Float4> readTexels(expected.Size(), Float4(0.0f, 0.0f, 0.0f, 1.0f));
+            for(int32 c = 0; c < image.num_channels; ++c)
+            {
+                const uint32 component = EXRComponentIndex(image.channel_names[c]);
+                for(uint64 i = 0; i < readTexels.Size() && component < 4; ++i)
+                    (&readTexels[i].x)[component] = image.images[c][i];
+            }
+
+            numMismatches = CountEXRMismatches(expected, width, height, uint32(image.width), uint32(image.height), readTexels);
+
+            for(int32 c = 0; c < image.num_channels; ++c)
+            {
+                free(image.images[c]);
+                free(const_cast<char*>(image.channel_names[c]));
+            }
+            free(image.images);
+            free(image.channel_names);
+        }
+
+        numFailures += numMismatches > 0 ? 1 : 0;
+        Report("    TinyEXR, half scanline %-4s: %llu mismatches %s", compressionNames[compressionIdx], numMismatches,
+               numMismatches == 0 ? "(ok)" : "(FAILED)");
+    }
+
+    DeleteFile(filePath);
+
+    Report("    Failed round trips: %llu %s", numFailures, numFailures == 0 ? "(ok)" : "(FAILED)");
+}
+
+// ================================================================================================
+
+struct Benchmark
+{
+    const char* Name;
+    void (*Function)();
+};
+
+static const Benchmark BenchmarkList[] =
+{
+    { "cubemapprojection", BenchmarkCubemapProjection },
+    { "sgsolver", BenchmarkSGSolver },
+    { "probegrid", BenchmarkProbeGrid },
+    { "lightbvh", BenchmarkLightBVH },
+    { "frustumculling", BenchmarkFrustumCulling },
+    { "texturesampler", BenchmarkTextureSampler },
+    { "textureresidency", BenchmarkTextureResidency },
+    { "exr", BenchmarkEXR },
+};
+
+bool ParseCommandLine(const wchar* cmdLine, std::string& benchmarkName)
+{
+    if(cmdLine == nullptr)
+        return false;
+
+    GrowableList<std::string> parts = Split(WStringToAnsi(cmdLine), " ");
+    for(uint64 i = 0; i < parts.Count(); ++i)
+    {
+        if(parts[i] == "-benchmark" || parts[i] == "--benchmark")
+        {
+            benchmarkName = i + 1 < parts.Count() ? parts[i + 1] : "all";
+            return true;
+        }
+    }
+
+    return false;
+}
+
+int32 Run(const std::string& benchmarkName)
+{
+    fopen_s(&resultsFile, "BenchmarkResults.txt", "w");
+
+    Tasks::Initialize();
+    Report("Running benchmarks with %u task threads", Tasks::NumThreads() - 1);
+
+    bool foundBenchmark = false;
+    for(uint64 i = 0; i < ArraySize_(BenchmarkList); ++i)
+    {
+        if(benchmarkName == "all" || benchmarkName == BenchmarkList[i].Name)
+        {
+            Report("== %s ==", BenchmarkList[i].Name);
+            BenchmarkList[i].Function();
+            foundBenchmark = true;
+        }
+    }
+
+    if(foundBenchmark == false)
+        Report("Unknown benchmark '%s'", benchmarkName.c_str());
+
+    SGSolver::ReleaseSharedSolvers();
+    CubemapProjectionPlan::ReleaseSharedPlans();
+    Tasks::Shutdown();
+
+    if(resultsFile != nullptr)
+    {
+        fclose(resultsFile);
+        resultsFile = nullptr;
+    }
+
+    return foundBenchmark ? 0 : 1;
+}
+
+}
@@ -0,0 +1,24 @@
+//=================================================================================================
+//
+//  DXR Path Tracer
+//  by MJP
+//  http://mynameismjp.wordpress.com/
+//
+//  All code and content licensed under the MIT license
+//
+//=================================================================================================
+
+#pragma once
+
+#include <PCH.h>
+
+// Headless CPU benchmarks, which run without creating a window or a D3D12 device. They're launched
+// with "-benchmark <name>" on the command line (or "-benchmark all"), and the results are written to
+// the debug output as well as to BenchmarkResults.txt.
+namespace Benchmarks
+{
+    // Returns true if the command line requested a benchmark run, with the name of the benchmark
+    bool ParseCommandLine(const wchar* cmdLine, std::string& benchmarkName);
+
+    int32 Run(const std::string& benchmarkName);
+}
@@ -18,6 +18,8 @@
 #include <Graphics/ShaderCompilation.h>
 #include <Graphics/Profiler.h>
 #include <Graphics/Textures.h>
+#include <Graphics/TextureCooking.h>
+#include <Graphics/CubemapProjection.h>
 #include <Graphics/Sampling.h>
 #include <Graphics/DX12.h>
 #include <Graphics/DX12_Helpers.h>
@@ -30,6 +32,7 @@
 
 #include "DXRPathTracer.h"
 #include "SharedTypes.h"
+#include "Benchmarks.h"
 #include <wrl.h>
 
 using Microsoft::WRL::ComPtr;
@@ -38,25 +41,6 @@ using namespace SampleFramework12;
 #include <fstream>
 #include <algorithm>
 
-void SaveFloatVectorAsPPM(const std::string& filename, const std::vector<float>& data, int width, int height) {
-    std::ofstream file(filename, std::ios::out | std::ios::binary);
-    if (!file) return;
-
-    file << "P6\n" << width << " " << height << "\n255\n"; // PPM 文件头
-
-    for (int i = 0; i < width * height; ++i) {
-        // 将浮点数 [0, 1] 范围转换到字节 [0, 255] 范围
-        unsigned char r = static_cast<unsigned char>(std::min(1.0f, std::max(0.0f, data[i * 4 + 0])) * 255.0f);
-        unsigned char g = static_cast<unsigned char>(std::min(1.0f, std::max(0.0f, data[i * 4 + 1])) * 255.0f);
-        unsigned char b = static_cast<unsigned char>(std::min(1.0f, std::max(0.0f, data[i * 4 + 2])) * 255.0f);
-        file.write(reinterpret_cast<const char*>(&r), 1);
-        file.write(reinterpret_cast<const char*>(&g), 1);
-        file.write(reinterpret_cast<const char*>(&b), 1);
-    }
-    file.close();
-    OutputDebugStringA(("Saved image to " + filename + "\n").c_str());
-}
-
 void GpuCrashDumpCallback(const void* pGpuCrashDump, const uint32_t gpuCrashDumpSize, void* pUserData)
 {
     // 收到崩溃回调，将数据写入文件
@@ -103,6 +87,20 @@ StaticAssert_(ArraySize_(SceneScales) == uint64(Scenes::NumValues));
 StaticAssert_(ArraySize_(SceneCameraPositions) == uint64(Scenes::NumValues));
 StaticAssert_(ArraySize_(SceneCameraRotations) == uint64(Scenes::NumValues));
 StaticAssert_(ArraySize_(SceneSunDirections) == uint64(Scenes::NumValues));
+StaticAssert_(uint64(TextureCompressionModes::NumValues) == uint64(BlockCompressionQuality::NumValues));
+
+// The texture cooker uses these too, so that what it cooks matches what gets loaded
+static ModelLoadSettings SceneLoadSettings(uint64 sceneIdx, BlockCompressionQuality textureCompression)
+{
+    ModelLoadSettings settings;
+    settings.FilePath = ScenePaths[sceneIdx];
+    settings.TextureDir = SceneTextureDirs[sceneIdx];
+    settings.ForceSRGB = true;
+    settings.SceneScale = SceneScales[sceneIdx];
+    settings.MergeMeshes = false;
+    settings.TextureCompression = textureCompression;
+    return settings;
+}
 
 static const uint64 NumConeSides = 16;
 
@@ -162,6 +160,26 @@ struct RayTraceConstants
     uint32 MaterialBufferIdx = uint32(-1);
     uint32 SkyTextureIdx = uint32(-1);
     uint32 NumLights = 0;
+    uint32 LightBufferIdx = uint32(-1);
+    uint32 LightBVHBufferIdx = uint32(-1);
+    uint32 NumBVHLights = 0;
+    uint32 EmissiveTriangleBufferIdx = uint32(-1);
+    uint32 EmissiveAliasTableIdx = uint32(-1);
+    uint32 EmissiveBVHBufferIdx = uint32(-1);
+    uint32 NumEmissiveTriangles = 0;
+};
+
+struct BakingConstants
+{
+    uint32 SampleIndex = 0;
+    uint32 SurfaceMapPositionIdx = uint32(-1);
+    uint32 SurfaceMapNormalIdx = uint32(-1);
+    uint32 NumProbeRays = 0;
+
+    Float3 ProbeGridOrigin;
+    float ProbeGridSpacing = 1.0f;
+    Uint3 ProbeGridDims;
+    uint32 Padding = 0;
 };
 
 enum ClusterRootParams : uint32
@@ -216,6 +234,19 @@ static bool SphereConeIntersection(const Float3& coneTip, const Float3& coneDir,
     return e < sphereRadius;
 }
 
+// Converts a spot light from the model into the format used by the shaders
+static SpotLight ConvertSpotLight(const ModelSpotLight& srcLight)
+{
+    SpotLight spotLight;
+    spotLight.Position = srcLight.Position;
+    spotLight.Direction = -srcLight.Direction;
+    spotLight.Intensity = srcLight.Intensity * 2500.0f;
+    spotLight.AngularAttenuationX = std::cos(srcLight.AngularAttenuation.x * 0.5f);
+    spotLight.AngularAttenuationY = std::cos(srcLight.AngularAttenuation.y * 0.5f);
+    spotLight.Range = AppSettings::SpotLightRange;
+    return spotLight;
+}
+
 float Pow5(const float x)
 {
     float xx = x * x;
@@ -266,17 +297,23 @@ void DXRPathTracer::Initialize()
 
     ShadowHelper::Initialize(ShadowMapMode::DepthMap, ShadowMSAAMode::MSAA1x);
 
+    textureStreamer.Initialize(uint64(AppSettings::TextureBudget) * 1024 * 1024);
+
     InitializeScene();
 
     skybox.Initialize();
+    skyLUT.Initialize(L"SkyLUT.dat");
 
     postProcessor.Initialize();
 
-    medianDenoiseCS = CompileFromFile(L"DenoiseMedian.hlsl", "DenoiseCS", ShaderType::Compute);
+    // Shaders are queued up here and compiled together at the end
+    ShaderCompileBatch shaderBatch;
+
+    shaderBatch.Add(medianDenoiseCS, L"DenoiseMedian.hlsl", "DenoiseCS", ShaderType::Compute);
 
     {
-        uvVisVS = CompileFromFile(L"UVVisualizer.hlsl", "VSMain", ShaderType::Vertex);
-        uvVisPS = CompileFromFile(L"UVVisualizer.hlsl", "PSMain", ShaderType::Pixel);
+        shaderBatch.Add(uvVisVS, L"UVVisualizer.hlsl", "VSMain", ShaderType::Vertex);
+        shaderBatch.Add(uvVisPS, L"UVVisualizer.hlsl", "PSMain", ShaderType::Pixel);
 
         // --- 新增代码：为 UV 可视化器创建空白的根签名 ---
         D3D12_ROOT_SIGNATURE_DESC1 rootSignatureDesc = {};
@@ -294,11 +331,11 @@ void DXRPathTracer::Initialize()
 
     {
         // 编译 SurfaceMap 着色器
-        surfaceMapVS = CompileFromFile(L"SurfaceMap.hlsl", "VSMain", ShaderType::Vertex);
-        surfaceMapPS = CompileFromFile(L"SurfaceMap.hlsl", "PSMain", ShaderType::Pixel);
+        shaderBatch.Add(surfaceMapVS, L"SurfaceMap.hlsl", "VSMain", ShaderType::Vertex);
+        shaderBatch.Add(surfaceMapPS, L"SurfaceMap.hlsl", "PSMain", ShaderType::Pixel);
 
         // 编译 Baking DXR 库
-        bakingLib = CompileFromFile(L"Baking.hlsl", nullptr, ShaderType::Library);
+        shaderBatch.Add(bakingLib, L"Baking.hlsl", nullptr, ShaderType::Library);
 
             // 创建 SurfaceMap 的根签名
         D3D12_ROOT_PARAMETER1 rootParameters[1] = {};
@@ -357,20 +394,20 @@ void DXRPathTracer::Initialize()
         opts.Add("Intersecting_", 0);
 
         // Clustering shaders
-        clusterVS = CompileFromFile(L"Clusters.hlsl", "ClusterVS", ShaderType::Vertex, opts);
-        clusterFrontFacePS = CompileFromFile(L"Clusters.hlsl", "ClusterPS", ShaderType::Pixel, opts);
+        shaderBatch.Add(clusterVS, L"Clusters.hlsl", "ClusterVS", ShaderType::Vertex, opts);
+        shaderBatch.Add(clusterFrontFacePS, L"Clusters.hlsl", "ClusterPS", ShaderType::Pixel, opts);
 
         opts.Reset();
         opts.Add("FrontFace_", 0);
         opts.Add("BackFace_", 1);
         opts.Add("Intersecting_", 0);
-        clusterBackFacePS = CompileFromFile(L"Clusters.hlsl", "ClusterPS", ShaderType::Pixel, opts);
+        shaderBatch.Add(clusterBackFacePS, L"Clusters.hlsl", "ClusterPS", ShaderType::Pixel, opts);
 
         opts.Reset();
         opts.Add("FrontFace_", 0);
         opts.Add("BackFace_", 0);
         opts.Add("Intersecting_", 1);
-        clusterIntersectingPS = CompileFromFile(L"Clusters.hlsl", "ClusterPS", ShaderType::Pixel, opts);
+        shaderBatch.Add(clusterIntersectingPS, L"Clusters.hlsl", "ClusterPS", ShaderType::Pixel, opts);
     }
 
     MakeConeGeometry(NumConeSides, spotLightClusterVtxBuffer, spotLightClusterIdxBuffer, coneVertices);
@@ -378,16 +415,16 @@ void DXRPathTracer::Initialize()
     // Compile resolve shaders
     for(uint64 msaaMode = 1; msaaMode < NumMSAAModes; ++msaaMode)
     {
-        for(uint64 deferred = 0; deferred < 2; ++deferred)
-        {
-            CompileOptions opts;
-            opts.Add("MSAASamples_", AppSettings::NumMSAASamples(MSAAModes(msaaMode)));
-            resolvePS[msaaMode] = CompileFromFile(L"Resolve.hlsl", "ResolvePS", ShaderType::Pixel, opts);
-        }
+        CompileOptions opts;
+        opts.Add("MSAASamples_", AppSettings::NumMSAASamples(MSAAModes(msaaMode)));
+        shaderBatch.Add(resolvePS[msaaMode], L"Resolve.hlsl", "ResolvePS", ShaderType::Pixel, opts);
     }
 
     std::wstring fullScreenTriPath = SampleFrameworkDir() + L"Shaders\\FullScreenTriangle.hlsl";
-    fullScreenTriVS = CompileFromFile(fullScreenTriPath.c_str(), "FullScreenTriangleVS", ShaderType::Vertex);
+    shaderBatch.Add(fullScreenTriVS, fullScreenTriPath.c_str(), "FullScreenTriangleVS", ShaderType::Vertex);
+    shaderBatch.Add(rayTraceLib, L"RayTrace.hlsl", nullptr, ShaderType::Library);
+
+    shaderBatch.Compile();
 
     {
         // Clustering root signature
@@ -484,12 +521,19 @@ void DXRPathTracer::Shutdown()
 {
     ShadowHelper::Shutdown();
 
+    textureStreamer.Shutdown();
     for(uint64 i = 0; i < ArraySize_(sceneModels); ++i)
         sceneModels[i].Shutdown();
+    for(uint64 i = 0; i < ArraySize_(sceneOpacity); ++i)
+        sceneOpacity[i].Shutdown();
 
     meshRenderer.Shutdown();
     skybox.Shutdown();
     skyCache.Shutdown();
+    skyLUT.Shutdown();
+    probeGrid.Shutdown();
+    SGSolver::ReleaseSharedSolvers();
+    CubemapProjectionPlan::ReleaseSharedPlans();
     postProcessor.Shutdown();
 
     spotLightBuffer.Shutdown();
@@ -517,10 +561,17 @@ void DXRPathTracer::Shutdown()
     rtHitTable.Shutdown();
     rtMissTable.Shutdown();
     rtGeoInfoBuffer.Shutdown();
+    rtLightBuffer.Shutdown();
+    rtLightBVHBuffer.Shutdown();
+    emissiveLights.Shutdown();
 
     bakingRayGenTable.Shutdown();
     bakingHitTable.Shutdown();
     bakingMissTable.Shutdown();
+    probeRayGenTable.Shutdown();
+    probeBakeTarget.Shutdown();
+    probeBakeReadback.Shutdown();
+    lightmapExportReadback.Shutdown();
     surfaceMap.Shutdown();
     surfaceMapNormal.Shutdown();
     surfaceMapAlbedo.Shutdown();
@@ -557,15 +608,14 @@ void DXRPathTracer::VisualizeUVs(Model* model)
 
     // 4. 绑定光照贴图几何体的缓冲
     D3D12_VERTEX_BUFFER_VIEW vbView = model->GetLightmappedVertexBuffer().VBView();
-    D3D12_INDEX_BUFFER_VIEW ibView = model->GetLightmappedIndexBuffer().IBView();
     cmdList->IASetVertexBuffers(0, 1, &vbView);
-    cmdList->IASetIndexBuffer(&ibView);
 
-    // 5. 绘制所有网格
+    // 5. 绘制所有网格, binding each mesh's own index buffer view since the index width varies per mesh
     const Array<Mesh>& meshesToDraw = model->GetLightmappedMeshes();
     for (const Mesh& mesh : meshesToDraw)
     {
-        cmdList->DrawIndexedInstanced(mesh.NumIndices(), 1, mesh.IndexOffset(), mesh.VertexOffset(), 0);
+        cmdList->IASetIndexBuffer(mesh.IBView());
+        cmdList->DrawIndexedInstanced(mesh.NumIndices(), 1, 0, mesh.VertexOffset(), 0);
     }
 
     // 6. 将 uvLayoutMap 切换回可读状态，以便HUD显示
@@ -943,20 +993,20 @@ void DXRPathTracer::InitializeScene()
         }
         else
         {
-            ModelLoadSettings settings;
-            settings.FilePath = ScenePaths[currSceneIdx];
-            settings.TextureDir = SceneTextureDirs[currSceneIdx];
-            settings.ForceSRGB = true;
-            settings.SceneScale = SceneScales[currSceneIdx];
-            settings.MergeMeshes = false;
-            sceneModels[currSceneIdx].CreateWithAssimp(settings);
+            const BlockCompressionQuality textureCompression = BlockCompressionQuality(uint32(AppSettings::TextureCompression));
+            sceneModels[currSceneIdx].CreateWithAssimp(SceneLoadSettings(currSceneIdx, textureCompression));
         }
     }
 
     currentModel = &sceneModels[currSceneIdx];
+    textureStreamer.AddModel(*currentModel);
     meshRenderer.Shutdown();
     DX12::FlushGPU();
     meshRenderer.Initialize(currentModel);
+
+    // Any existing or in-flight probe bake belongs to the previous scene
+    probeGrid.Shutdown();
+    probeBakeFrame = uint64(-1);
     camera.SetPosition(SceneCameraPositions[currSceneIdx]);
     camera.SetXRotation(SceneCameraRotations[currSceneIdx].x);
     camera.SetYRotation(SceneCameraRotations[currSceneIdx].y);
@@ -968,26 +1018,53 @@ void DXRPathTracer::InitializeScene()
         spotLights.Init(numSpotLights);
 
         for(uint64 i = 0; i < numSpotLights; ++i)
+            spotLights[i] = ConvertSpotLight(currentModel->SpotLights()[i]);
+    }
+
+    {
+        // The path tracer samples lights through the light BVH, which isn't limited to MaxSpotLights
+        const uint64 numRTSpotLights = currentModel->SpotLights().Size();
+        Array<SpotLight> rtSpotLights(numRTSpotLights);
+        for(uint64 i = 0; i < numRTSpotLights; ++i)
+            rtSpotLights[i] = ConvertSpotLight(currentModel->SpotLights()[i]);
+
+        lightBVH.Build(rtSpotLights.Data(), rtSpotLights.Size());
+
+        rtLightBuffer.Shutdown();
+        rtLightBVHBuffer.Shutdown();
+        if(lightBVH.NumLights() > 0)
         {
-            const ModelSpotLight& srcLight = currentModel->SpotLights()[i];
-
-            SpotLight& spotLight = spotLights[i];
-            spotLight.Position = srcLight.Position;
-            spotLight.Direction = -srcLight.Direction;
-            spotLight.Intensity = srcLight.Intensity * 2500.0f;
-            spotLight.AngularAttenuationX = std::cos(srcLight.AngularAttenuation.x * 0.5f);
-            spotLight.AngularAttenuationY = std::cos(srcLight.AngularAttenuation.y * 0.5f);
-            spotLight.Range = AppSettings::SpotLightRange;
+            StructuredBufferInit sbInit;
+            sbInit.Stride = sizeof(SpotLight);
+            sbInit.NumElements = rtSpotLights.Size();
+            sbInit.Name = L"RT Spot Light Buffer";
+            sbInit.InitData = rtSpotLights.Data();
+            rtLightBuffer.Initialize(sbInit);
+
+            sbInit.Stride = sizeof(LightBVHNode);
+            sbInit.NumElements = lightBVH.NumNodes();
+            sbInit.Name = L"Light BVH Buffer";
+            sbInit.InitData = lightBVH.Nodes().Data();
+            rtLightBVHBuffer.Initialize(sbInit);
         }
+
+        WriteLog("Built light BVH with %llu nodes for %llu spot lights (depth %llu)",
+                 lightBVH.NumNodes(), lightBVH.NumLights(), lightBVH.Depth());
     }
 
+    // Find the emissive triangles that the path tracer and the baker can sample directly
+    emissiveLights.Initialize(*currentModel);
+
+    // Split the ray tracing geometry by opacity, which only needs to happen the first time the scene is loaded
+    currentOpacity = &sceneOpacity[currSceneIdx];
+    if(currentOpacity->Initialized() == false)
+        currentOpacity->Initialize(*currentModel);
+
     buildAccelStructure = true;
 }
 
 void DXRPathTracer::InitRayTracing()
 {
-    rayTraceLib = CompileFromFile(L"RayTrace.hlsl", nullptr, ShaderType::Library);
-
     {
         // RayTrace root signature
         D3D12_DESCRIPTOR_RANGE1 uavRanges[1] = {};
@@ -1115,7 +1192,7 @@ void DXRPathTracer::CreateRayTracingPSOs()
     {
         D3D12_RAYTRACING_SHADER_CONFIG shaderConfig = { };
         shaderConfig.MaxAttributeSizeInBytes = 2 * sizeof(float);                      // float2 barycentrics;
-        shaderConfig.MaxPayloadSizeInBytes = 4 * sizeof(float) + 4 * sizeof(uint32);   // float3 radiance + float roughness + uint pathLength + uint pixelIdx + uint setIdx + bool IsDiffuse
+        shaderConfig.MaxPayloadSizeInBytes = 4 * sizeof(float) + 5 * sizeof(uint32);   // float3 radiance + float roughness + uint pathLength + uint pixelIdx + uint setIdx + bool IsDiffuse + bool EmissiveSampled
         builder.AddSubObject(shaderConfig);
     }
 
@@ -1173,17 +1250,13 @@ void DXRPathTracer::CreateRayTracingPSOs()
     }
 
     {
-        const uint32 numMeshes = uint32(currentModel->NumMeshes());
+        const uint64 numGeometries = currentOpacity->NumGeometries();
 
-        Array<HitGroupRecord> hitGroupRecords(numMeshes * 2);
-        for(uint64 i = 0; i < numMeshes; ++i)
+        Array<HitGroupRecord> hitGroupRecords(numGeometries * 2);
+        for(uint64 i = 0; i < numGeometries; ++i)
         {
-            // Use the alpha test hit group (with an any hit shader) if the material has an opacity map
-            const Mesh& mesh = currentModel->Meshes()[i];
-            Assert_(mesh.NumMeshParts() == 1);
-            const uint32 materialIdx = mesh.MeshParts()[0].MaterialIdx;
-            const MeshMaterial& material = currentModel->Materials()[materialIdx];
-            const bool alphaTest = material.Textures[uint32(MaterialTextures::Opacity)] != nullptr;
+            // Use the alpha test hit group (with an any hit shader) only for triangles that are partially cut out
+            const bool alphaTest = currentOpacity->Geometries()[i].Opaque == false;
 
             hitGroupRecords[i * 2 + 0].ID = alphaTest ? ShaderIdentifier(alphaTestHitGroupID) : ShaderIdentifier(hitGroupID);
             hitGroupRecords[i * 2 + 1].ID = alphaTest ? ShaderIdentifier(shadowAlphaTestHitGroupID) : ShaderIdentifier(shadowHitGroupID);
@@ -1249,7 +1322,7 @@ void DXRPathTracer::CreateRayTracingPSOs()
     {
         D3D12_RAYTRACING_SHADER_CONFIG shaderConfig = { };
         shaderConfig.MaxAttributeSizeInBytes = 2 * sizeof(float);
-        shaderConfig.MaxPayloadSizeInBytes = 4 * sizeof(float) + 4 * sizeof(uint32);
+        shaderConfig.MaxPayloadSizeInBytes = 4 * sizeof(float) + 6 * sizeof(uint32);   // Also includes bool EmissiveSampled and bool HitBackFace
         bakingBuilder.AddSubObject(shaderConfig);
     }
     
@@ -1275,6 +1348,7 @@ void DXRPathTracer::CreateRayTracingPSOs()
     bakingPSO->QueryInterface(IID_PPV_ARGS(&bakingPsoProps));
 
     const void* bakeRayGenID = bakingPsoProps->GetShaderIdentifier(L"BakeRayGen");
+    const void* probeRayGenID = bakingPsoProps->GetShaderIdentifier(L"ProbeRayGen");
     const void* bakingHitGroupID = bakingPsoProps->GetShaderIdentifier(L"HitGroup");
     const void* bakingAlphaTestHitGroupID = bakingPsoProps->GetShaderIdentifier(L"AlphaTestHitGroup");
     const void* bakingShadowHitGroupID = bakingPsoProps->GetShaderIdentifier(L"ShadowHitGroup");
@@ -1296,6 +1370,17 @@ void DXRPathTracer::CreateRayTracingPSOs()
         bakingRayGenTable.Initialize(sbInit);
     }
 
+    {
+        ShaderIdentifier probeRayGenRecords[1] = { ShaderIdentifier(probeRayGenID) };
+        StructuredBufferInit sbInit;
+        sbInit.Stride = sizeof(ShaderIdentifier);
+        sbInit.NumElements = ArraySize_(probeRayGenRecords);
+        sbInit.InitData = probeRayGenRecords;
+        sbInit.ShaderTable = true;
+        sbInit.Name = L"Probe Ray Gen Shader Table";
+        probeRayGenTable.Initialize(sbInit);
+    }
+
     // 4. 创建烘焙专用的未命中着色器表 (Miss Shader Table)
     {
         ShaderIdentifier missRecords[2] = { ShaderIdentifier(bakingMissID), ShaderIdentifier(bakingShadowMissID) };
@@ -1310,16 +1395,12 @@ void DXRPathTracer::CreateRayTracingPSOs()
 
     // 5. 创建烘焙专用的命中组表 (Hit Group Table)
     {
-        const uint32 numMeshes = uint32(currentModel->NumMeshes());
-        Array<HitGroupRecord> hitGroupRecords(numMeshes * 2);
-        for (uint64 i = 0; i < numMeshes; ++i)
+        const uint64 numGeometries = currentOpacity->NumGeometries();
+        Array<HitGroupRecord> hitGroupRecords(numGeometries * 2);
+        for (uint64 i = 0; i < numGeometries; ++i)
         {
-            const Mesh& mesh = currentModel->Meshes()[i];
-            Assert_(mesh.NumMeshParts() == 1);
-            const uint32 materialIdx = mesh.MeshParts()[0].MaterialIdx;
-            const MeshMaterial& material = currentModel->Materials()[materialIdx];
-            const bool alphaTest = material.Textures[uint32(MaterialTextures::Opacity)] != nullptr;
-            
+            const bool alphaTest = currentOpacity->Geometries()[i].Opaque == false;
+
             hitGroupRecords[i * 2 + 0].ID = alphaTest ? ShaderIdentifier(bakingAlphaTestHitGroupID) : ShaderIdentifier(bakingHitGroupID);
             hitGroupRecords[i * 2 + 1].ID = alphaTest ? ShaderIdentifier(bakingShadowAlphaTestHitGroupID) : ShaderIdentifier(bakingShadowHitGroupID);
         }
@@ -1394,7 +1475,8 @@ void DXRPathTracer::Update(const Timer& timer)
         stablePowerState = AppSettings::StablePowerState;
     }
 
-    skyCache.Init(AppSettings::SunDirection, AppSettings::SunSize, AppSettings::GroundAlbedo, AppSettings::Turbidity, true);
+    skyCache.Init(AppSettings::SunDirection, AppSettings::SunSize, AppSettings::GroundAlbedo, AppSettings::Turbidity, true,
+                  AppSettings::UseSkyLUT ? &skyLUT : nullptr);
 
     if(AppSettings::MSAAMode.Changed() || AppSettings::ClusterRasterizationMode.Changed())
     {
@@ -1413,6 +1495,19 @@ void DXRPathTracer::Update(const Timer& timer)
         rtShouldRestartPathTrace = true;
     }
 
+    if(AppSettings::UseCompressedVertices)
+        currentModel->CreateCompressedVertexBuffer();
+
+    // Textures that change resolution would otherwise be mixed into the samples that were already accumulated
+    bool texturesChanged = false;
+    if(AppSettings::EnableTextureStreaming)
+        texturesChanged = textureStreamer.Update(*currentModel, camera, float(swapChain.Height()), uint64(AppSettings::TextureBudget) * 1024 * 1024);
+    else
+        texturesChanged = textureStreamer.RestoreFullResolution();
+
+    if(texturesChanged)
+        rtShouldRestartPathTrace = true;
+
     const Setting* settingsToCheck[] =
     {
         &AppSettings::SqrtNumSamples,
@@ -1437,7 +1532,12 @@ void DXRPathTracer::Update(const Timer& timer)
         &AppSettings::MaxAnyHitPathLength,
         &AppSettings::AvoidCausticPaths,
         &AppSettings::ClampRoughness,
-        &AppSettings::ApplyMultiscatteringEnergyCompensation
+        &AppSettings::ApplyMultiscatteringEnergyCompensation,
+        &AppSettings::UseLightBVH,
+        &AppSettings::NumLightSamples,
+        &AppSettings::SampleEmissiveTriangles,
+        &AppSettings::UseEmissiveBVH,
+        &AppSettings::UseCompressedVertices
     };
 
     for(const Setting* setting : settingsToCheck)
@@ -1499,6 +1599,24 @@ void DXRPathTracer::Render(const Timer& timer)
     else if(lastBuildAccelStructureFrame + DX12::RenderLatency == DX12::CurrentCPUFrame)
         WriteLog("Acceleration structure build time: %.2f ms", Profiler::GlobalProfiler.GPUProfileTiming("Build Acceleration Structure"));
 
+    if(probeBakeCPURequested)
+    {
+        BakeProbeGridOnCPU();
+        probeBakeCPURequested = false;
+    }
+
+    if(probeBakeFrame != uint64(-1) && probeBakeFrame + DX12::RenderLatency <= DX12::CurrentCPUFrame)
+        ReadbackProbeGridBake();
+    else if(probeBakeDXRRequested && probeBakeFrame == uint64(-1))
+        RenderProbeGridBake();
+    probeBakeDXRRequested = false;
+
+    if(lightmapExportFrame != uint64(-1) && lightmapExportFrame + DX12::RenderLatency <= DX12::CurrentCPUFrame)
+        WriteLightmapExport();
+    else if(lightmapExportRequested && lightmapExportFrame == uint64(-1))
+        ExportLightmap();
+    lightmapExportRequested = false;
+
     ID3D12GraphicsCommandList4* cmdList = DX12::CmdList;
 
     CPUProfileBlock cpuProfileBlock("Render");
@@ -1543,13 +1661,16 @@ void DXRPathTracer::Render(const Timer& timer)
     }
     else
     {
+        // Culling goes first so that the occluders rasterize on the task threads while the clusters are set up
+        meshRenderer.CullViews(camera, AppSettings::EnableSun, AppSettings::RenderLights);
+
         RenderClusters();
 
         if(AppSettings::EnableSun)
-            meshRenderer.RenderSunShadowMap(cmdList, camera);
+            meshRenderer.RenderSunShadowMap(cmdList);
 
         if(AppSettings::RenderLights)
-            meshRenderer.RenderSpotLightShadowMap(cmdList, camera);
+            meshRenderer.RenderSpotLightShadowMap(cmdList);
 
         RenderForward();
 
@@ -1783,6 +1904,7 @@ void DXRPathTracer::RenderForward()
         mainPassData.SpotLightBuffer = &spotLightBuffer;
         mainPassData.SpotLightClusterBuffer = &spotLightClusterBuffer;
         mainPassData.BakedLightMap = useDenoisedLightmap ? &denoisedLightMap : &bakedLightMap;
+        mainPassData.ProbeGrid = &probeGrid;
         meshRenderer.RenderMainPass(cmdList, camera, mainPassData);
 
         cmdList->OMSetRenderTargets(1, rtvHandles, false, &depthBuffer.DSV);
@@ -1875,15 +1997,14 @@ void DXRPathTracer::RenderSurfaceMap()
 
     // 5. 绑定几何体数据 (这部分不变)
     D3D12_VERTEX_BUFFER_VIEW vbView = currentModel->GetLightmappedVertexBuffer().VBView();
-    D3D12_INDEX_BUFFER_VIEW ibView = currentModel->GetLightmappedIndexBuffer().IBView();
     cmdList->IASetVertexBuffers(0, 1, &vbView);
-    cmdList->IASetIndexBuffer(&ibView);
 
-    // 6. 绘制网格 (这部分不变)
+    // 6. 绘制网格, with a per-mesh index buffer view since the index width varies per mesh
     const Array<Mesh>& meshesToDraw = currentModel->GetLightmappedMeshes();
     for (const Mesh& mesh : meshesToDraw)
     {
-        cmdList->DrawIndexedInstanced(mesh.NumIndices(), 1, mesh.IndexOffset(), mesh.VertexOffset(), 0);
+        cmdList->IASetIndexBuffer(mesh.IBView());
+        cmdList->DrawIndexedInstanced(mesh.NumIndices(), 1, 0, mesh.VertexOffset(), 0);
     }
 
     // 7. 将三个资源都切换回可读状态
@@ -1935,27 +2056,26 @@ void DXRPathTracer::RenderBakingPass_Progressive()
     rtConstants.TotalNumPixels = LightMapResolution * LightMapResolution; // 使用光照贴图的总像素数
 
     // c. 填充几何体、材质等资源索引
-    rtConstants.VtxBufferIdx = currentModel->VertexBuffer().SRV;
-    rtConstants.IdxBufferIdx = currentModel->IndexBuffer().SRV;
+    rtConstants.VtxBufferIdx = AppSettings::UseCompressedVertices ? currentModel->CompressedVertexBuffer().SRV : currentModel->VertexBuffer().SRV;
+    rtConstants.IdxBufferIdx = currentOpacity->IndexBuffer().SRV;
     rtConstants.GeometryInfoBufferIdx = rtGeoInfoBuffer.SRV;
     rtConstants.MaterialBufferIdx = meshRenderer.MaterialBuffer().SRV;
     rtConstants.SkyTextureIdx = skyCache.CubeMap.SRV;
     rtConstants.NumLights = Min<uint32>(uint32(spotLights.Size()), AppSettings::MaxLightClamp);
+    rtConstants.LightBufferIdx = rtLightBuffer.SRV;
+    rtConstants.LightBVHBufferIdx = rtLightBVHBuffer.SRV;
+    rtConstants.NumBVHLights = uint32(lightBVH.NumLights());
+    rtConstants.EmissiveTriangleBufferIdx = emissiveLights.TriangleBuffer().SRV;
+    rtConstants.EmissiveAliasTableIdx = emissiveLights.AliasTableBuffer().SRV;
+    rtConstants.EmissiveBVHBufferIdx = emissiveLights.BVHBuffer().SRV;
+    rtConstants.NumEmissiveTriangles = uint32(emissiveLights.NumTriangles());
     
     // 绑定这个完整的常量缓冲到 b0
     DX12::BindTempConstantBuffer(cmdList, rtConstants, RTParams_CBuffer, CmdListMode::Compute);
     // --- 修改结束 ---
 
     // b. 绑定烘焙专用常量
-    struct BakingConstants
-    {
-        uint32 SampleIndex;
-        uint32 SurfaceMapPositionIdx; // <-- 将原来的 SurfaceMapIdx 重命名
-        uint32 SurfaceMapNormalIdx;   // <-- 新增这一行
-        uint32 Padding1;
-    };
-
-    BakingConstants bakingConstants = {};
+    BakingConstants bakingConstants;
     bakingConstants.SampleIndex = bakingSampleIndex;
     bakingConstants.SurfaceMapPositionIdx = surfaceMap.SRV(); // <-- 修改点
     bakingConstants.SurfaceMapNormalIdx = surfaceMapNormal.SRV(); // <-- 新增这一行
@@ -2057,12 +2177,19 @@ void DXRPathTracer::RenderRayTracing()
     rtConstants.CurrSampleIdx = rtCurrSampleIdx;
     rtConstants.TotalNumPixels = uint32(rtTarget.Width()) * uint32(rtTarget.Height());
 
-    rtConstants.VtxBufferIdx = currentModel->VertexBuffer().SRV;
-    rtConstants.IdxBufferIdx = currentModel->IndexBuffer().SRV;
+    rtConstants.VtxBufferIdx = AppSettings::UseCompressedVertices ? currentModel->CompressedVertexBuffer().SRV : currentModel->VertexBuffer().SRV;
+    rtConstants.IdxBufferIdx = currentOpacity->IndexBuffer().SRV;
     rtConstants.GeometryInfoBufferIdx = rtGeoInfoBuffer.SRV;
     rtConstants.MaterialBufferIdx = meshRenderer.MaterialBuffer().SRV;
     rtConstants.SkyTextureIdx = skyCache.CubeMap.SRV;
     rtConstants.NumLights = Min<uint32>(uint32(spotLights.Size()), AppSettings::MaxLightClamp);
+    rtConstants.LightBufferIdx = rtLightBuffer.SRV;
+    rtConstants.LightBVHBufferIdx = rtLightBVHBuffer.SRV;
+    rtConstants.NumBVHLights = uint32(lightBVH.NumLights());
+    rtConstants.EmissiveTriangleBufferIdx = emissiveLights.TriangleBuffer().SRV;
+    rtConstants.EmissiveAliasTableIdx = emissiveLights.AliasTableBuffer().SRV;
+    rtConstants.EmissiveBVHBufferIdx = emissiveLights.BVHBuffer().SRV;
+    rtConstants.NumEmissiveTriangles = uint32(emissiveLights.NumTriangles());
 
     DX12::BindTempConstantBuffer(cmdList, rtConstants, RTParams_CBuffer, CmdListMode::Compute);
 
@@ -2181,6 +2308,68 @@ void DXRPathTracer::RenderHUD(const Timer& timer)
         ImGui::End();
     }
 
+    if(AppSettings::ShowCullingStats)
+    {
+        ImGui::SetNextWindowSize(ImVec2(380.0f, 300.0f), ImGuiCond_FirstUseEver);
+        if(ImGui::Begin("Culling Stats"))
+        {
+            auto showStats = [](const char* viewName, const MeshletCullStats& stats)
+            {
+                if(ImGui::CollapsingHeader(viewName, ImGuiTreeNodeFlags_DefaultOpen) == false)
+                    return;
+
+                const double culledPercent = stats.NumTriangles > 0 ? 100.0 * stats.NumTrianglesCulled / stats.NumTriangles : 0.0;
+                ImGui::Text("Meshes tested: %llu", stats.NumMeshes);
+                ImGui::Text("Meshes occluded: %llu", stats.NumMeshesOccluded);
+                ImGui::Text("Meshlets tested: %llu", stats.NumMeshlets);
+                ImGui::Text("Frustum culled: %llu", stats.NumFrustumCulled);
+                ImGui::Text("Backface culled: %llu", stats.NumBackfaceCulled);
+                ImGui::Text("Occluded: %llu", stats.NumMeshletsOccluded);
+                ImGui::Text("Triangles drawn: %llu", stats.NumTriangles - stats.NumTrianglesCulled);
+                ImGui::Text("Triangles culled: %llu (%.1f%%)", stats.NumTrianglesCulled, culledPercent);
+            };
+
+            showStats("Main Pass", meshRenderer.MainPassCullStats());
+
+            if(AppSettings::UseOcclusionCulling && ImGui::CollapsingHeader("Occlusion Culling", ImGuiTreeNodeFlags_DefaultOpen))
+            {
+                const MeshletCullStats& mainStats = meshRenderer.MainPassCullStats();
+                const OcclusionStats& occlusionStats = meshRenderer.MainPassOcclusionStats();
+                const double meshPercent = mainStats.NumMeshes > 0 ? 100.0 * mainStats.NumMeshesOccluded / mainStats.NumMeshes : 0.0;
+                const double trianglePercent = mainStats.NumTriangles > 0 ? 100.0 * mainStats.NumTrianglesOccluded / mainStats.NumTriangles : 0.0;
+                ImGui::Text("Mesh draws occluded: %.1f%%", meshPercent);
+                ImGui::Text("Triangles occluded: %.1f%%", trianglePercent);
+                ImGui::Text("Occluders: %llu (%llu triangles)", occlusionStats.NumOccluders, occlusionStats.NumOccluderTriangles);
+                ImGui::Text("Rasterization: %.3f ms", occlusionStats.RasterizeTime);
+                ImGui::Text("Main thread wait: %.3f ms", meshRenderer.OcclusionWaitTime());
+            }
+
+            showStats("Sun Shadow Cascades", meshRenderer.SunShadowCullStats());
+            showStats("Spot Light Shadows", meshRenderer.SpotLightShadowCullStats());
+        }
+        ImGui::End();
+    }
+
+    if(AppSettings::ShowTextureStreamingStats)
+    {
+        ImGui::SetNextWindowSize(ImVec2(380.0f, 260.0f), ImGuiCond_FirstUseEver);
+        if(ImGui::Begin("Texture Streaming Stats"))
+        {
+            const TextureResidencyStats& stats = textureStreamer.Stats();
+            const double mb = 1024.0 * 1024.0;
+            ImGui::Text("Streaming: %s", AppSettings::EnableTextureStreaming ? "enabled" : "disabled");
+            ImGui::Text("Resident: %.1f MB", stats.ResidentBytes / mb);
+            ImGui::Text("Requested: %.1f MB", stats.RequestedBytes / mb);
+            ImGui::Text("Budget: %.1f MB", stats.BudgetBytes == uint64(-1) ? 0.0 : stats.BudgetBytes / mb);
+            ImGui::Text("Textures: %llu (%llu requested, %llu starved)", stats.NumTextures, stats.NumRequested, stats.NumStarved);
+            ImGui::Text("Streamed in: %llu (%.2f MB)", stats.NumStreamedIn, stats.BytesStreamedIn / mb);
+            ImGui::Text("Evicted: %llu (%.2f MB)", stats.NumEvicted, stats.BytesEvicted / mb);
+            ImGui::Text("Failed: %llu", stats.NumFailed);
+            ImGui::Text("Update: %.3f ms", stats.UpdateTime);
+        }
+        ImGui::End();
+    }
+
     if (showLightmapWindow)
     {
         // 设置窗口的初始大小
@@ -2258,6 +2447,33 @@ void DXRPathTracer::RenderHUD(const Timer& timer)
                 medianDenoiseRequested = true;
             }
 
+            if (ImGui::Button("Bake Probes (CPU)"))
+                probeBakeCPURequested = true;
+
+            ImGui::SameLine();
+            if (ImGui::Button("Bake Probes (DXR)"))
+                probeBakeDXRRequested = true;
+
+            if(ImGui::Button("Export EXR"))
+                lightmapExportRequested = true;
+
+            ImGui::SameLine();
+            bool exportHalf = lightmapExportSettings.PixelType == EXRPixelType::Half;
+            if(ImGui::Checkbox("Half", &exportHalf))
+                lightmapExportSettings.PixelType = exportHalf ? EXRPixelType::Half : EXRPixelType::Float;
+
+            ImGui::SameLine();
+            ImGui::Checkbox("Tiled", &lightmapExportSettings.Tiled);
+
+            const char* exportCompressionNames[] = { "None", "ZIP", "PIZ" };
+            const EXRCompression exportCompressionModes[] = { EXRCompression::None, EXRCompression::ZIP, EXRCompression::PIZ };
+            int exportCompression = 0;
+            for(int i = 0; i < IM_ARRAYSIZE(exportCompressionModes); ++i)
+                if(exportCompressionModes[i] == lightmapExportSettings.Compression)
+                    exportCompression = i;
+            if(ImGui::Combo("EXR Compression", &exportCompression, exportCompressionNames, IM_ARRAYSIZE(exportCompressionNames)))
+                lightmapExportSettings.Compression = exportCompressionModes[exportCompression];
+
             const char* items[] = {
                 "UV Layout",
                 "Surface Map (World Pos)",
@@ -2330,43 +2546,45 @@ void DXRPathTracer::RenderHUD(const Timer& timer)
 
 void DXRPathTracer::BuildRTAccelerationStructure()
 {
-    const FormattedBuffer& idxBuffer = currentModel->IndexBuffer();
-    const StructuredBuffer& vtxBuffer = currentModel->VertexBuffer();
- 
-    const uint64 numMeshes = currentModel->NumMeshes();
-    Array<D3D12_RAYTRACING_GEOMETRY_DESC> geometryDescs(numMeshes);
+    // Meshes are split into opaque and alpha-tested geometries, with fully transparent triangles left out.
+    // The build only needs positions, so it reads from the position-only stream.
+    const RawBuffer& idxBuffer = currentOpacity->PositionIndexBuffer();
+    const StructuredBuffer& vtxBuffer = currentModel->PositionBuffer();
+    const Array<OpacityGeometry>& opacityGeometries = currentOpacity->Geometries();
+
+    Array<D3D12_RAYTRACING_GEOMETRY_DESC> geometryDescs(opacityGeometries.Size());
 
     const uint32 numGeometries = uint32(geometryDescs.Size());
     Array<GeometryInfo> geoInfoBufferData(numGeometries);
 
-    for(uint64 meshIdx = 0; meshIdx < numMeshes; ++meshIdx)
+    for(uint64 geoIdx = 0; geoIdx < numGeometries; ++geoIdx)
     {
-        const Mesh& mesh = currentModel->Meshes()[meshIdx];
+        const OpacityGeometry& opacityGeometry = opacityGeometries[geoIdx];
+        const Mesh& mesh = currentModel->Meshes()[opacityGeometry.MeshIdx];
         Assert_(mesh.NumMeshParts() == 1);
-        const uint32 materialIdx = mesh.MeshParts()[0].MaterialIdx;
-        const MeshMaterial& material = currentModel->Materials()[materialIdx];
-        const bool opaque = material.Textures[uint32(MaterialTextures::Opacity)] == nullptr;
+        const bool opaque = opacityGeometry.Opaque != 0;
 
-        D3D12_RAYTRACING_GEOMETRY_DESC& geometryDesc = geometryDescs[meshIdx];
+        D3D12_RAYTRACING_GEOMETRY_DESC& geometryDesc = geometryDescs[geoIdx];
         geometryDesc = { };
         geometryDesc.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
-        geometryDesc.Triangles.IndexBuffer = idxBuffer.GPUAddress + mesh.IndexOffset() * idxBuffer.Stride;
-        geometryDesc.Triangles.IndexCount = uint32(mesh.NumIndices());
-        geometryDesc.Triangles.IndexFormat = idxBuffer.Format;
+        geometryDesc.Triangles.IndexBuffer = idxBuffer.GPUAddress + opacityGeometry.IndexByteOffset;
+        geometryDesc.Triangles.IndexCount = opacityGeometry.IndexCount;
+        geometryDesc.Triangles.IndexFormat = mesh.IndexBufferFormat();
         geometryDesc.Triangles.Transform3x4 = 0;
         geometryDesc.Triangles.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
-        geometryDesc.Triangles.VertexCount = uint32(mesh.NumVertices());
-        geometryDesc.Triangles.VertexBuffer.StartAddress = vtxBuffer.GPUAddress + mesh.VertexOffset() * vtxBuffer.Stride;
+        geometryDesc.Triangles.VertexCount = mesh.NumPositions();
+        geometryDesc.Triangles.VertexBuffer.StartAddress = vtxBuffer.GPUAddress + mesh.PositionOffset() * vtxBuffer.Stride;
         geometryDesc.Triangles.VertexBuffer.StrideInBytes = vtxBuffer.Stride;
         geometryDesc.Flags = opaque ? D3D12_RAYTRACING_GEOMETRY_FLAG_OPAQUE : D3D12_RAYTRACING_GEOMETRY_FLAG_NONE;
 
-        GeometryInfo& geoInfo = geoInfoBufferData[meshIdx];
+        GeometryInfo& geoInfo = geoInfoBufferData[geoIdx];
         geoInfo = { };
         geoInfo.VtxOffset = uint32(mesh.VertexOffset());
-        geoInfo.IdxOffset = uint32(mesh.IndexOffset());
+        geoInfo.IdxByteOffset = opacityGeometry.IndexByteOffset;
+        geoInfo.Index16Bit = mesh.IndexBufferType() == IndexType::Index16Bit;
         geoInfo.MaterialIdx = mesh.MeshParts()[0].MaterialIdx;
-
-        Assert_(mesh.NumMeshParts() == 1);
+        geoInfo.QuantizationMin = mesh.PositionQuantizationMin();
+        geoInfo.QuantizationScale = mesh.PositionQuantizationScale();
     }
 
     // Get required sizes for an acceleration structure
@@ -2608,6 +2826,209 @@ void DXRPathTracer::DenoiseLightmap()
     OutputDebugStringA("CPU denoising complete. Pending GPU upload for next frame.\n");
 }
 
+void DXRPathTracer::BakeProbeGridOnCPU()
+{
+    if(currentModel == nullptr)
+        return;
+
+    Timer timer;
+
+    ProbeBakeScene bakeScene;
+    bakeScene.Initialize(*currentModel);
+
+    ProbeBakeLighting lighting;
+    lighting.SkySH = AppSettings::EnableSky ? skyCache.SH : SH9Color();
+    lighting.SunDirection = AppSettings::SunDirection;
+    lighting.SunIrradiance = skyCache.SunIrradiance;
+    lighting.EnableSun = AppSettings::EnableSun;
+
+    ProbeGridLayout layout;
+    layout.Initialize(bakeScene.AABBMin, bakeScene.AABBMax, AppSettings::ProbeGridSpacing, ProbeGrid::MaxProbes);
+
+    ProbeGridData gridData;
+    BakeProbeGridCPU(bakeScene, lighting, layout, uint64(AppSettings::ProbeRaysPerProbe), gridData);
+    probeGrid.Upload(gridData);
+
+    timer.Update();
+    WriteLog("CPU probe grid bake: %.2f ms", timer.ElapsedMillisecondsD());
+}
+
+void DXRPathTracer::RenderProbeGridBake()
+{
+    if(currentModel == nullptr)
+        return;
+
+    ID3D12GraphicsCommandList4* cmdList = DX12::CmdList;
+
+    PIXMarker marker(cmdList, "Probe Grid Bake - DXR");
+    ProfileBlock profileBlock(cmdList, "Probe Grid Bake - DXR");
+
+    probeBakeLayout.Initialize(currentModel->AABBMin(), currentModel->AABBMax(), AppSettings::ProbeGridSpacing, ProbeGrid::MaxProbes);
+    const uint32 numProbes = uint32(probeBakeLayout.NumProbes());
+    const uint32 numRays = uint32(AppSettings::ProbeRaysPerProbe);
+
+    if(probeBakeTarget.Height() != numProbes)
+    {
+        RenderTextureInit rtInit;
+        rtInit.Width = ProbeGrid::BakeTexelsPerProbe;
+        rtInit.Height = numProbes;
+        rtInit.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+        rtInit.MSAASamples = 1;
+        rtInit.ArraySize = 1;
+        rtInit.CreateUAV = true;
+        rtInit.Name = L"Probe Bake Target";
+        probeBakeTarget.Initialize(rtInit);
+    }
+
+    cmdList->SetComputeRootSignature(rtRootSignature);
+    DX12::BindGlobalSRVDescriptorTable(cmdList, RTParams_StandardDescriptors, CmdListMode::Compute);
+    cmdList->SetComputeRootShaderResourceView(RTParams_SceneDescriptor, rtTopLevelAccelStructure.GPUAddress);
+
+    // ProbeRayGen only writes to u2, the other slots just need valid descriptors
+    D3D12_CPU_DESCRIPTOR_HANDLE uavs[4] = { accumulationBuffer.UAV, bakedLightMap.UAV, probeBakeTarget.UAV, bakedLightMap.UAV };
+    DX12::BindTempDescriptorTable(cmdList, uavs, ArraySize_(uavs), RTParams_UAVDescriptor, CmdListMode::Compute);
+
+    RayTraceConstants rtConstants;
+    rtConstants.SunDirectionWS = AppSettings::SunDirection;
+    rtConstants.SunIrradiance = skyCache.SunIrradiance;
+    rtConstants.CosSunAngularRadius = std::cos(DegToRad(AppSettings::SunSize));
+    rtConstants.SinSunAngularRadius = std::sin(DegToRad(AppSettings::SunSize));
+    rtConstants.SunRenderColor = skyCache.SunRenderColor;
+    rtConstants.CameraPosWS = camera.Position();
+    rtConstants.TotalNumPixels = numProbes * numRays;
+    rtConstants.VtxBufferIdx = AppSettings::UseCompressedVertices ? currentModel->CompressedVertexBuffer().SRV : currentModel->VertexBuffer().SRV;
+    rtConstants.IdxBufferIdx = currentOpacity->IndexBuffer().SRV;
+    rtConstants.GeometryInfoBufferIdx = rtGeoInfoBuffer.SRV;
+    rtConstants.MaterialBufferIdx = meshRenderer.MaterialBuffer().SRV;
+    rtConstants.SkyTextureIdx = skyCache.CubeMap.SRV;
+    rtConstants.NumLights = Min<uint32>(uint32(spotLights.Size()), AppSettings::MaxLightClamp);
+    rtConstants.LightBufferIdx = rtLightBuffer.SRV;
+    rtConstants.LightBVHBufferIdx = rtLightBVHBuffer.SRV;
+    rtConstants.NumBVHLights = uint32(lightBVH.NumLights());
+    rtConstants.EmissiveTriangleBufferIdx = emissiveLights.TriangleBuffer().SRV;
+    rtConstants.EmissiveAliasTableIdx = emissiveLights.AliasTableBuffer().SRV;
+    rtConstants.EmissiveBVHBufferIdx = emissiveLights.BVHBuffer().SRV;
+    rtConstants.NumEmissiveTriangles = uint32(emissiveLights.NumTriangles());
+    DX12::BindTempConstantBuffer(cmdList, rtConstants, RTParams_CBuffer, CmdListMode::Compute);
+
+    BakingConstants bakingConstants;
+    bakingConstants.NumProbeRays = numRays;
+    bakingConstants.ProbeGridOrigin = probeBakeLayout.Origin;
+    bakingConstants.ProbeGridSpacing = probeBakeLayout.Spacing;
+    bakingConstants.ProbeGridDims = probeBakeLayout.Dims;
+    DX12::BindTempConstantBuffer(cmdList, bakingConstants, RTParams_BakingCBuffer, CmdListMode::Compute);
+
+    spotLightBuffer.SetAsComputeRootParameter(cmdList, RTParams_LightCBuffer);
+    AppSettings::BindCBufferCompute(cmdList, RTParams_AppSettings);
+
+    probeBakeTarget.MakeWritableUAV(cmdList);
+
+    cmdList->SetPipelineState1(bakingPSO);
+
+    D3D12_DISPATCH_RAYS_DESC dispatchDesc = {};
+    dispatchDesc.RayGenerationShaderRecord = probeRayGenTable.ShaderRecord(0);
+    dispatchDesc.MissShaderTable = bakingMissTable.ShaderTable();
+    dispatchDesc.HitGroupTable = bakingHitTable.ShaderTable();
+    dispatchDesc.Width = numProbes;
+    dispatchDesc.Height = 1;
+    dispatchDesc.Depth = 1;
+    cmdList->DispatchRays(&dispatchDesc);
+
+    probeBakeTarget.MakeReadableUAV(cmdList);
+
+    // Copy the results to a readback buffer, which gets picked up once the GPU has finished this frame
+    D3D12_RESOURCE_DESC textureDesc = probeBakeTarget.Resource()->GetDesc();
+    D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint = { };
+    uint64 readbackSize = 0;
+    DX12::Device->GetCopyableFootprints(&textureDesc, 0, 1, 0, &footprint, nullptr, nullptr, &readbackSize);
+
+    probeBakeReadback.Shutdown();
+    probeBakeReadback.Initialize(readbackSize);
+    probeBakeReadback.Resource->SetName(L"Probe Bake Readback Buffer");
+    probeBakeRowPitch = footprint.Footprint.RowPitch;
+
+    D3D12_TEXTURE_COPY_LOCATION srcLoc = { };
+    srcLoc.pResource = probeBakeTarget.Resource();
+    srcLoc.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+    srcLoc.SubresourceIndex = 0;
+
+    D3D12_TEXTURE_COPY_LOCATION dstLoc = { };
+    dstLoc.pResource = probeBakeReadback.Resource;
+    dstLoc.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+    dstLoc.PlacedFootprint = footprint;
+
+    probeBakeTarget.Transition(cmdList, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_SOURCE);
+    cmdList->CopyTextureRegion(&dstLoc, 0, 0, 0, &srcLoc, nullptr);
+    probeBakeTarget.Transition(cmdList, D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+
+    probeBakeFrame = DX12::CurrentCPUFrame;
+}
+
+void DXRPathTracer::ReadbackProbeGridBake()
+{
+    ProbeGridData gridData;
+    UnpackProbeGridGPUBake(probeBakeLayout, probeBakeReadback.Map<Float4>(), probeBakeRowPitch, gridData);
+    probeBakeReadback.Unmap();
+
+    probeGrid.Upload(gridData);
+    probeBakeFrame = uint64(-1);
+
+    WriteLog("DXR probe grid bake: %.2f ms", Profiler::GlobalProfiler.GPUProfileTiming("Probe Grid Bake - DXR"));
+}
+
+void DXRPathTracer::ExportLightmap()
+{
+    ID3D12GraphicsCommandList4* cmdList = DX12::CmdList;
+    RenderTexture& lightmap = useDenoisedLightmap ? denoisedLightMap : bakedLightMap;
+
+    // Copy the lightmap to a readback buffer, which gets written out once the GPU has finished this frame
+    D3D12_RESOURCE_DESC textureDesc = lightmap.Resource()->GetDesc();
+    D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint = { };
+    uint64 readbackSize = 0;
+    DX12::Device->GetCopyableFootprints(&textureDesc, 0, 1, 0, &footprint, nullptr, nullptr, &readbackSize);
+
+    lightmapExportReadback.Shutdown();
+    lightmapExportReadback.Initialize(readbackSize);
+    lightmapExportReadback.Resource->SetName(L"Lightmap Export Readback Buffer");
+    lightmapExportRowPitch = footprint.Footprint.RowPitch;
+
+    D3D12_TEXTURE_COPY_LOCATION srcLoc = { };
+    srcLoc.pResource = lightmap.Resource();
+    srcLoc.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+    srcLoc.SubresourceIndex = 0;
+
+    D3D12_TEXTURE_COPY_LOCATION dstLoc = { };
+    dstLoc.pResource = lightmapExportReadback.Resource;
+    dstLoc.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+    dstLoc.PlacedFootprint = footprint;
+
+    lightmap.Transition(cmdList, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_SOURCE);
+    cmdList->CopyTextureRegion(&dstLoc, 0, 0, 0, &srcLoc, nullptr);
+    lightmap.Transition(cmdList, D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+
+    lightmapExportFrame = DX12::CurrentCPUFrame;
+}
+
+void DXRPathTracer::WriteLightmapExport()
+{
+    const wchar* filePath = L"Lightmap.exr";
+    const uint32 width = uint32(bakedLightMap.Width());
+    const uint32 height = uint32(bakedLightMap.Height());
+
+    // The rows are compressed straight out of the readback buffer
+    EXRWriter writer;
+    writer.Begin(filePath, width, height, lightmapExportSettings);
+    writer.WriteRows(lightmapExportReadback.Map<Float4>(), height, lightmapExportRowPitch);
+    lightmapExportReadback.Unmap();
+    const EXRWriteStats stats = writer.End();
+
+    lightmapExportReadback.Shutdown();
+    lightmapExportFrame = uint64(-1);
+
+    WriteLog("Exported lightmap to '%ls': %.2f MB -> %.2f MB in %.2f ms", filePath, stats.UncompressedSize / (1024.0 * 1024.0),
+             stats.FileSize / (1024.0 * 1024.0), stats.WriteTime);
+}
+
 void EnableDebugLayerAndGBV()
 {
 #if defined(_DEBUG)
@@ -2638,6 +3059,23 @@ int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmd
 {
     //EnableDebugLayerAndGBV(); 
 
+    std::string benchmarkName;
+    if(Benchmarks::ParseCommandLine(lpCmdLine, benchmarkName))
+        return Benchmarks::Run(benchmarkName);
+
+    // Defaults to the same compression as the Texture Compression setting
+    BlockCompressionQuality cookCompression = BlockCompressionQuality::High;
+    if(TextureCooker::ParseCommandLine(lpCmdLine, cookCompression))
+    {
+        ModelLoadSettings sceneSettings[uint64(Scenes::NumValues)];
+        uint64 numScenes = 0;
+        for(uint64 i = 0; i < uint64(Scenes::NumValues); ++i)
+            if(i != uint64(Scenes::BoxTest) && ScenePaths[i] != nullptr)
+                sceneSettings[numScenes++] = SceneLoadSettings(i, cookCompression);
+
+        return TextureCooker::Run(sceneSettings, numScenes);
+    }
+
     DXRPathTracer app(lpCmdLine);
     app.Run();
 
@@ -15,6 +15,7 @@
 #include <App.h>
 #include <InterfacePointers.h>
 #include <Input.h>
+#include <EXRWriter.h>
 #include <Graphics/Camera.h>
 #include <Graphics/Model.h>
 #include <Graphics/Skybox.h>
@@ -25,6 +26,11 @@
 #include "PostProcessor.h"
 #include "MeshRenderer.h"
 #include "OidnDenoiser.h"
+#include "ProbeGrid.h"
+#include "LightBVH.h"
+#include "EmissiveLights.h"
+#include "OpacityClassification.h"
+#include "TextureStreaming.h"
 
 using namespace SampleFramework12;
 using Microsoft::WRL::ComPtr;
@@ -38,13 +44,17 @@ protected:
 
     Skybox skybox;
     SkyCache skyCache;
+    SkyLUT skyLUT;
 
     PostProcessor postProcessor;
 
     // Model
     Model sceneModels[uint64(Scenes::NumValues)];
     Model* currentModel = nullptr;
+    OpacityClassification sceneOpacity[uint64(Scenes::NumValues)];
+    OpacityClassification* currentOpacity = nullptr;
     MeshRenderer meshRenderer;
+    TextureStreamer textureStreamer;
 
     RenderTexture mainTarget;
     RenderTexture resolveTarget;
@@ -115,6 +125,24 @@ protected:
     StructuredBuffer bakingHitTable;
     StructuredBuffer bakingMissTable;
 
+    // Probe grid baking
+    ProbeGrid probeGrid;
+    StructuredBuffer probeRayGenTable;
+    RenderTexture probeBakeTarget;
+    ReadbackBuffer probeBakeReadback;
+    ProbeGridLayout probeBakeLayout;
+    uint64 probeBakeRowPitch = 0;
+    uint64 probeBakeFrame = uint64(-1);
+    bool probeBakeCPURequested = false;
+    bool probeBakeDXRRequested = false;
+
+    // Lightmap export
+    ReadbackBuffer lightmapExportReadback;
+    EXRWriteSettings lightmapExportSettings;
+    uint64 lightmapExportRowPitch = 0;
+    uint64 lightmapExportFrame = uint64(-1);
+    bool lightmapExportRequested = false;
+
     bool showLightmapWindow = true;
     //bool bakeRequested = false;
     Float4 lightmapWindowRect = { 25.0f, 50.0f, 512.0f, 512.0f };
@@ -140,6 +168,10 @@ protected:
     StructuredBuffer rtHitTable;
     StructuredBuffer rtMissTable;
     StructuredBuffer rtGeoInfoBuffer;
+    StructuredBuffer rtLightBuffer;
+    StructuredBuffer rtLightBVHBuffer;
+    LightBVH lightBVH;
+    EmissiveLights emissiveLights;
     FirstPersonCamera rtCurrCamera;
     bool rtShouldRestartPathTrace = false;
     uint32 rtCurrSampleIdx = 0;
@@ -188,6 +220,13 @@ protected:
 
     void DenoiseLightmap();
 
+    void BakeProbeGridOnCPU();
+    void RenderProbeGridBake();
+    void ReadbackProbeGridBake();
+
+    void ExportLightmap();
+    void WriteLightmapExport();
+
     D3D12_CPU_DESCRIPTOR_HANDLE g_NullUAV;
 
     CompiledShaderPtr medianDenoiseCS;
@@ -13,9 +13,9 @@
 // ================================================================================================
 cbuffer VSConstants : register(b0)
 {
-    float4x4 World;
-	float4x4 View;
-    float4x4 WorldViewProjection;
+    row_major float4x4 World;
+    row_major float4x4 View;
+    row_major float4x4 WorldViewProjection;
 }
 
 // ================================================================================================
@@ -23,7 +23,7 @@ cbuffer VSConstants : register(b0)
 // ================================================================================================
 struct VSInput
 {
-    float4 PositionOS 		: POSITION;
+    float3 PositionOS 		: POSITION;
 };
 
 struct VSOutput
@@ -39,7 +39,7 @@ VSOutput VS(in VSInput input)
     VSOutput output;
 
     // Calc the clip-space position
-    output.PositionCS = mul(input.PositionOS, WorldViewProjection);
+    output.PositionCS = mul(float4(input.PositionOS, 1.0f), WorldViewProjection);
 
     return output;
 }
\ No newline at end of file
@@ -0,0 +1,298 @@
+//=================================================================================================
+//
+//  DXR Path Tracer
+//  by MJP
+//  http://mynameismjp.wordpress.com/
+//
+//  All code and content licensed under the MIT license
+//
+//=================================================================================================
+
+#include <PCH.h>
+
+#include <Timer.h>
+#include <Graphics/Model.h>
+
+#include "EmissiveLights.h"
+
+// Caps the number of texels visited per triangle, larger footprints are sampled on a coarser grid
+static const float MaxTexelsPerTriangle = 4096.0f;
+
+static float Luminance(const Float3& color)
+{
+    return Float3::Dot(color, Float3(0.2126f, 0.7152f, 0.0722f));
+}
+
+static float EdgeFunction(const Float2& a, const Float2& b, const Float2& p)
+{
+    return (b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x);
+}
+
+static Float3 LoadTexelWrapped(const TextureData<Float4>& texData, float x, float y)
+{
+    int64 tx = int64(std::floor(x)) % int64(texData.Width);
+    int64 ty = int64(std::floor(y)) % int64(texData.Height);
+    if(tx < 0)
+        tx += texData.Width;
+    if(ty < 0)
+        ty += texData.Height;
+
+    return texData.Texels[uint64(ty) * texData.Width + uint64(tx)].To3D();
+}
+
+void BuildAliasTable(const float* weights, uint64 numWeights, Array<AliasTableEntry>& table)
+{
+    table.Init(numWeights);
+    if(numWeights == 0)
+        return;
+
+    double weightSum = 0.0;
+    for(uint64 i = 0; i < numWeights; ++i)
+        weightSum += weights[i];
+    Assert_(weightSum > 0.0);
+
+    // Scale the weights so that the average is 1, then split them into entries below and above average
+    Array<float> scaled(numWeights);
+    Array<uint32> underFull(numWeights);
+    Array<uint32> overFull(numWeights);
+    uint64 numUnderFull = 0;
+    uint64 numOverFull = 0;
+    for(uint64 i = 0; i < numWeights; ++i)
+    {
+        table[i].Pmf = float(weights[i] / weightSum);
+        table[i].Alias = uint32(i);
+        table[i].PadTo16Bytes = 0;
+
+        scaled[i] = float(double(weights[i]) * double(numWeights) / weightSum);
+        if(scaled[i] < 1.0f)
+            underFull[numUnderFull++] = uint32(i);
+        else
+            overFull[numOverFull++] = uint32(i);
+    }
+
+    // Fill each under-full entry with probability mass from an over-full one
+    while(numUnderFull > 0 && numOverFull > 0)
+    {
+        const uint32 underFullIdx = underFull[--numUnderFull];
+        const uint32 overFullIdx = overFull[--numOverFull];
+
+        table[underFullIdx].Probability = scaled[underFullIdx];
+        table[underFullIdx].Alias = overFullIdx;
+
+        scaled[overFullIdx] = (scaled[overFullIdx] + scaled[underFullIdx]) - 1.0f;
+        if(scaled[overFullIdx] < 1.0f)
+            underFull[numUnderFull++] = overFullIdx;
+        else
+            overFull[numOverFull++] = overFullIdx;
+    }
+
+    // Whatever is left over is only off from 1 due to round-off error
+    while(numOverFull > 0)
+        table[overFull[--numOverFull]].Probability = 1.0f;
+    while(numUnderFull > 0)
+        table[underFull[--numUnderFull]].Probability = 1.0f;
+}
+
+Float3 IntegrateTriangleEmission(const TextureData<Float4>& emissiveMap, Float2 uv0, Float2 uv1, Float2 uv2)
+{
+    // Rasterize the triangle in texel space, without wrapping, so that it can span multiple repeats of the texture
+    const Float2 texSize = Float2(float(emissiveMap.Width), float(emissiveMap.Height));
+    const Float2 t0 = uv0 * texSize;
+    const Float2 t1 = uv1 * texSize;
+    const Float2 t2 = uv2 * texSize;
+
+    const float minX = std::floor(Min(t0.x, Min(t1.x, t2.x)));
+    const float minY = std::floor(Min(t0.y, Min(t1.y, t2.y)));
+    const float maxX = std::ceil(Max(t0.x, Max(t1.x, t2.x)));
+    const float maxY = std::ceil(Max(t0.y, Max(t1.y, t2.y)));
+
+    const float signedArea = EdgeFunction(t0, t1, t2);
+    const float step = Max(1.0f, std::sqrt((maxX - minX) * (maxY - minY) / MaxTexelsPerTriangle));
+
+    Float3 sum;
+    uint64 numSamples = 0;
+    if(signedArea != 0.0f)
+    {
+        for(float y = minY + step * 0.5f; y < maxY; y += step)
+        {
+            for(float x = minX + step * 0.5f; x < maxX; x += step)
+            {
+                // Handle both windings by checking the edge functions against the sign of the area
+                const Float2 p = Float2(x, y);
+                const float w0 = EdgeFunction(t1, t2, p) * signedArea;
+                const float w1 = EdgeFunction(t2, t0, p) * signedArea;
+                const float w2 = EdgeFunction(t0, t1, p) * signedArea;
+                if(w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+                    continue;
+
+                sum += LoadTexelWrapped(emissiveMap, x, y);
+                ++numSamples;
+            }
+        }
+    }
+
+    if(numSamples > 0 && Luminance(sum) > 0.0f)
+        return sum / float(numSamples);
+
+    // Triangles that are too small to cover any texel centers, or that only cover black ones, can still pick up
+    // emission from neighboring texels through bilinear filtering. Fall back to the average over their UV bounds
+    // (grown by a texel for the filter footprint), so that they're only culled when they really can't emit. The
+    // path tracer skips emission on hits that follow next-event estimation, so an emitter that can never be picked
+    // would otherwise go missing from the image entirely.
+    const float boundsStep = Max(1.0f, std::sqrt((maxX - minX + 2.0f) * (maxY - minY + 2.0f) / MaxTexelsPerTriangle));
+    sum = Float3();
+    numSamples = 0;
+    for(float y = minY - 1.0f + boundsStep * 0.5f; y < maxY + 1.0f; y += boundsStep)
+    {
+        for(float x = minX - 1.0f + boundsStep * 0.5f; x < maxX + 1.0f; x += boundsStep)
+        {
+            sum += LoadTexelWrapped(emissiveMap, x, y);
+            ++numSamples;
+        }
+    }
+
+    return sum / float(Max<uint64>(numSamples, 1));
+}
+
+void EmissiveLights::Initialize(const Model& model)
+{
+    Shutdown();
+
+    Timer timer;
+
+    // Read back every distinct emissive texture once, skipping the ones that are entirely black
+    const Array<MeshMaterial>& materials = model.Materials();
+    std::map<const Texture*, uint64> textureLookup;
+    GrowableList<TextureData<Float4>*> textureData;
+    Array<uint64> materialTextureData(materials.Size(), uint64(-1));
+    for(uint64 matIdx = 0; matIdx < materials.Size(); ++matIdx)
+    {
+        const Texture* emissiveTexture = materials[matIdx].Textures[uint64(MaterialTextures::Emissive)];
+        if(emissiveTexture == nullptr)
+            continue;
+
+        auto existing = textureLookup.find(emissiveTexture);
+        if(existing != textureLookup.end())
+        {
+            materialTextureData[matIdx] = existing->second;
+            continue;
+        }
+
+        TextureData<Float4>* texData = new TextureData<Float4>();
+        GetTextureData(*emissiveTexture, *texData);
+
+        bool anyEmission = false;
+        for(uint64 i = 0; i < texData->Texels.Size() && anyEmission == false; ++i)
+            anyEmission = Luminance(texData->Texels[i].To3D()) > 0.0f;
+
+        uint64 dataIdx = uint64(-1);
+        if(anyEmission)
+            dataIdx = textureData.Add(texData);
+        else
+            delete texData;
+
+        textureLookup[emissiveTexture] = dataIdx;
+        materialTextureData[matIdx] = dataIdx;
+    }
+
+    GrowableList<EmissiveTriangle> emissiveTriangles;
+    const MeshVertex* vertices = model.Vertices();
+    const Array<Mesh>& meshes = model.Meshes();
+    uint64 numCulled = 0;
+    for(uint64 meshIdx = 0; meshIdx < meshes.Size() && textureData.Count() > 0; ++meshIdx)
+    {
+        const Mesh& mesh = meshes[meshIdx];
+        for(uint64 partIdx = 0; partIdx < mesh.NumMeshParts(); ++partIdx)
+        {
+            const MeshPart& part = mesh.MeshParts()[partIdx];
+            const uint64 dataIdx = materialTextureData[part.MaterialIdx];
+            if(dataIdx == uint64(-1))
+                continue;
+
+            const TextureData<Float4>& texData = *textureData[dataIdx];
+            for(uint64 triIdx = 0; triIdx < part.IndexCount / 3; ++triIdx)
+            {
+                MeshVertex triVertices[3];
+                for(uint64 i = 0; i < 3; ++i)
+                {
+                    const uint32 idx = mesh.Index(part.IndexStart + triIdx * 3 + i);
+                    triVertices[i] = vertices[idx + mesh.VertexOffset()];
+                }
+
+                EmissiveTriangle triangle = { };
+                triangle.Position0 = triVertices[0].Position;
+                triangle.Position1 = triVertices[1].Position;
+                triangle.Position2 = triVertices[2].Position;
+                triangle.UV0 = triVertices[0].UV;
+                triangle.UV1 = triVertices[1].UV;
+                triangle.UV2 = triVertices[2].UV;
+                triangle.EmissiveTextureIdx = materials[part.MaterialIdx].Texture(MaterialTextures::Emissive);
+                triangle.Area = Float3::Length(Float3::Cross(triangle.Position1 - triangle.Position0, triangle.Position2 - triangle.Position0)) * 0.5f;
+
+                // Flux leaving a two-sided Lambertian emitter is 2 * Pi * Area * the average radiance
+                const Float3 radiance = IntegrateTriangleEmission(texData, triangle.UV0, triangle.UV1, triangle.UV2);
+                triangle.Power = Luminance(radiance) * triangle.Area * 2.0f * Pi;
+
+                // Triangles that don't emit anything are culled so that they can never be picked
+                if(triangle.Power > 0.0f)
+                    emissiveTriangles.Add(triangle);
+                else
+                    ++numCulled;
+            }
+        }
+    }
+
+    for(uint64 i = 0; i < textureData.Count(); ++i)
+        delete textureData[i];
+
+    const uint64 numTriangles = emissiveTriangles.Count();
+    if(numTriangles > 0)
+    {
+        triangles.Init(numTriangles);
+        Array<float> powers(numTriangles);
+        for(uint64 i = 0; i < numTriangles; ++i)
+        {
+            triangles[i] = emissiveTriangles[i];
+            powers[i] = triangles[i].Power;
+            totalPower += triangles[i].Power;
+        }
+
+        Array<AliasTableEntry> aliasTable;
+        BuildAliasTable(powers.Data(), powers.Size(), aliasTable);
+
+        bvh.Build(triangles.Data(), triangles.Size());
+
+        StructuredBufferInit sbInit;
+        sbInit.Stride = sizeof(EmissiveTriangle);
+        sbInit.NumElements = triangles.Size();
+        sbInit.Name = L"Emissive Triangle Buffer";
+        sbInit.InitData = triangles.Data();
+        triangleBuffer.Initialize(sbInit);
+
+        sbInit.Stride = sizeof(AliasTableEntry);
+        sbInit.NumElements = aliasTable.Size();
+        sbInit.Name = L"Emissive Alias Table Buffer";
+        sbInit.InitData = aliasTable.Data();
+        aliasTableBuffer.Initialize(sbInit);
+
+        sbInit.Stride = sizeof(LightBVHNode);
+        sbInit.NumElements = bvh.NumNodes();
+        sbInit.Name = L"Emissive BVH Buffer";
+        sbInit.InitData = bvh.Nodes().Data();
+        bvhBuffer.Initialize(sbInit);
+    }
+
+    timer.Update();
+    WriteLog("Extracted %llu emissive triangles (%llu culled with no emission) from %llu textures in %.2f ms",
+             numTriangles, numCulled, textureData.Count(), timer.ElapsedMillisecondsD());
+}
+
+void EmissiveLights::Shutdown()
+{
+    triangles.Shutdown();
+    totalPower = 0.0f;
+
+    triangleBuffer.Shutdown();
+    aliasTableBuffer.Shutdown();
+    bvhBuffer.Shutdown();
+}
@@ -0,0 +1,65 @@
+//=================================================================================================
+//
+//  DXR Path Tracer
+//  by MJP
+//  http://mynameismjp.wordpress.com/
+//
+//  All code and content licensed under the MIT license
+//
+//=================================================================================================
+
+#pragma once
+
+#include <PCH.h>
+
+#include <Containers.h>
+#include <Graphics/GraphicsTypes.h>
+#include <Graphics/Textures.h>
+
+#include "SharedTypes.h"
+#include "LightBVH.h"
+
+using namespace SampleFramework12;
+
+namespace SampleFramework12
+{
+    class Model;
+}
+
+// Builds a Walker/Vose alias table that samples entries proportionally to their weight in O(1)
+void BuildAliasTable(const float* weights, uint64 numWeights, Array<AliasTableEntry>& table);
+
+// Averages the emitted radiance of a texture over the UV footprint of a triangle. Triangles that don't cover any
+// emissive texel centers get the average over their UV bounds instead, so that the result is only zero when the
+// triangle can't emit anything.
+Float3 IntegrateTriangleEmission(const TextureData<Float4>& emissiveMap, Float2 uv0, Float2 uv1, Float2 uv2);
+
+// Triangles with emissive materials, set up for next-event estimation in the path tracer and the baker.
+// Triangles are picked in proportion to their emitted power, either through an alias table or
+// through a LightBVH that also accounts for distance and orientation to the shading point.
+class EmissiveLights
+{
+
+public:
+
+    // Reads back the emissive textures of the model, so this needs to happen before the first frame is submitted
+    void Initialize(const Model& model);
+    void Shutdown();
+
+    uint64 NumTriangles() const { return triangles.Size(); }
+    float TotalPower() const { return totalPower; }
+
+    const StructuredBuffer& TriangleBuffer() const { return triangleBuffer; }
+    const StructuredBuffer& AliasTableBuffer() const { return aliasTableBuffer; }
+    const StructuredBuffer& BVHBuffer() const { return bvhBuffer; }
+
+protected:
+
+    Array<EmissiveTriangle> triangles;
+    float totalPower = 0.0f;
+    LightBVH bvh;
+
+    StructuredBuffer triangleBuffer;
+    StructuredBuffer aliasTableBuffer;
+    StructuredBuffer bvhBuffer;
+};
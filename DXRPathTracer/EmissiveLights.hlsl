@@ -0,0 +1,37 @@
+//=================================================================================================
+//
+//  DXR Path Tracer
+//  by MJP
+//  http://mynameismjp.wordpress.com/
+//
+//  All code and content licensed under the MIT license
+//
+//=================================================================================================
+
+#ifndef EMISSIVELIGHTS_HLSL_
+#define EMISSIVELIGHTS_HLSL_
+
+// Expects SharedTypes.h to already be included for EmissiveTriangle and AliasTableEntry
+
+// Picks an entry from an alias table built by BuildAliasTable (see EmissiveLights.cpp) with a
+// single random number, and returns the probability of having picked it
+uint SampleAliasTable(in StructuredBuffer<AliasTableEntry> aliasTable, in uint numEntries, in float u, out float pmf)
+{
+    const float scaled = u * numEntries;
+    uint idx = min(uint(scaled), numEntries - 1);
+    const AliasTableEntry entry = aliasTable[idx];
+    if(scaled - idx >= entry.Probability)
+        idx = entry.Alias;
+
+    pmf = aliasTable[idx].Pmf;
+    return idx;
+}
+
+// Uniformly samples a point on a triangle, returning barycentrics for the 2nd and 3rd vertices
+float2 SampleTriangleBarycentrics(in float2 u)
+{
+    const float sqrtU = sqrt(u.x);
+    return float2(u.y * sqrtU, 1.0f - sqrtU);
+}
+
+#endif // EMISSIVELIGHTS_HLSL_
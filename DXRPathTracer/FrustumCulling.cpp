@@ -0,0 +1,441 @@
+//=================================================================================================
+//
+//  DXR Path Tracer
+//  by MJP
+//  http://mynameismjp.wordpress.com/
+//
+//  All code and content licensed under the MIT license
+//
+//=================================================================================================
+
+#include <PCH.h>
+
+#include <Tasks.h>
+
+#include "FrustumCulling.h"
+
+// Floats per block: center XYZ followed by extents XYZ, each with one lane per box
+static const uint64 BlockFloats = FrustumCuller::BlockSize * 6;
+
+// The BVH is split into the sub-trees at this depth for the task threads
+static const uint64 TaskRootDepth = 6;
+
+static Float3 ComponentMin(const Float3& a, const Float3& b)
+{
+    return Float3(Min(a.x, b.x), Min(a.y, b.y), Min(a.z, b.z));
+}
+
+static Float3 ComponentMax(const Float3& a, const Float3& b)
+{
+    return Float3(Max(a.x, b.x), Max(a.y, b.y), Max(a.z, b.z));
+}
+
+// A frustum's planes with each component replicated across an SSE register
+struct SIMDFrustum
+{
+    __m128 NX[CullingFrustum::MaxPlanes];
+    __m128 NY[CullingFrustum::MaxPlanes];
+    __m128 NZ[CullingFrustum::MaxPlanes];
+    __m128 W[CullingFrustum::MaxPlanes];
+    __m128 AbsNX[CullingFrustum::MaxPlanes];
+    __m128 AbsNY[CullingFrustum::MaxPlanes];
+    __m128 AbsNZ[CullingFrustum::MaxPlanes];
+    uint64 NumPlanes = 0;
+};
+
+struct FrustumCuller::CullContext
+{
+    const CullingFrustum* Frusta = nullptr;
+    const SIMDFrustum* SIMDFrusta = nullptr;
+    uint64* VisibilityMasks = nullptr;
+};
+
+enum class BoxTestResult
+{
+    Outside,
+    Intersecting,
+    Inside,
+};
+
+static BoxTestResult TestBox(const CullingFrustum& frustum, const Float3& center, const Float3& extents)
+{
+    BoxTestResult result = BoxTestResult::Inside;
+    for(uint64 planeIdx = 0; planeIdx < frustum.NumPlanes; ++planeIdx)
+    {
+        const Float4& plane = frustum.Planes[planeIdx];
+        const float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+        const float radius = std::abs(plane.x) * extents.x + std::abs(plane.y) * extents.y + std::abs(plane.z) * extents.z;
+        if(distance + radius < 0.0f)
+            return BoxTestResult::Outside;
+        if(distance - radius < 0.0f)
+            result = BoxTestResult::Intersecting;
+    }
+
+    return result;
+}
+
+// Returns a bit for each of the 8 boxes in the block that isn't outside of any plane
+static uint32 TestBlock(const float* block, const SIMDFrustum& frustum)
+{
+    const __m128 zero = _mm_setzero_ps();
+
+    uint32 outsideBits = 0;
+    for(uint64 half = 0; half < 2; ++half)
+    {
+        const float* lanes = block + half * 4;
+        const __m128 centerX = _mm_loadu_ps(lanes + 0 * FrustumCuller::BlockSize);
+        const __m128 centerY = _mm_loadu_ps(lanes + 1 * FrustumCuller::BlockSize);
+        const __m128 centerZ = _mm_loadu_ps(lanes + 2 * FrustumCuller::BlockSize);
+        const __m128 extentX = _mm_loadu_ps(lanes + 3 * FrustumCuller::BlockSize);
+        const __m128 extentY = _mm_loadu_ps(lanes + 4 * FrustumCuller::BlockSize);
+        const __m128 extentZ = _mm_loadu_ps(lanes + 5 * FrustumCuller::BlockSize);
+
+        __m128 outside = zero;
+        for(uint64 planeIdx = 0; planeIdx < frustum.NumPlanes; ++planeIdx)
+        {
+            __m128 distance = _mm_add_ps(_mm_mul_ps(centerX, frustum.NX[planeIdx]), frustum.W[planeIdx]);
+            distance = _mm_add_ps(distance, _mm_mul_ps(centerY, frustum.NY[planeIdx]));
+            distance = _mm_add_ps(distance, _mm_mul_ps(centerZ, frustum.NZ[planeIdx]));
+
+            __m128 radius = _mm_mul_ps(extentX, frustum.AbsNX[planeIdx]);
+            radius = _mm_add_ps(radius, _mm_mul_ps(extentY, frustum.AbsNY[planeIdx]));
+            radius = _mm_add_ps(radius, _mm_mul_ps(extentZ, frustum.AbsNZ[planeIdx]));
+
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), zero));
+        }
+
+        outsideBits |= uint32(_mm_movemask_ps(outside)) << (half * 4);
+    }
+
+    return ~outsideBits & 0xFF;
+}
+
+CullingFrustum CullingFrustum::FromViewProjection(const Float4x4& m, bool includeNearPlane)
+{
+    // Gribb/Hartmann plane extraction for row vectors and a [0, 1] depth range
+    const Float4 col0 = Float4(m._11, m._21, m._31, m._41);
+    const Float4 col1 = Float4(m._12, m._22, m._32, m._42);
+    const Float4 col2 = Float4(m._13, m._23, m._33, m._43);
+    const Float4 col3 = Float4(m._14, m._24, m._34, m._44);
+
+    CullingFrustum frustum;
+    frustum.Planes[frustum.NumPlanes++] = col3 + col0;
+    frustum.Planes[frustum.NumPlanes++] = col3 - col0;
+    frustum.Planes[frustum.NumPlanes++] = col3 + col1;
+    frustum.Planes[frustum.NumPlanes++] = col3 - col1;
+    frustum.Planes[frustum.NumPlanes++] = col3 - col2;
+    if(includeNearPlane)
+        frustum.Planes[frustum.NumPlanes++] = col2;
+
+    for(uint64 i = 0; i < frustum.NumPlanes; ++i)
+    {
+        Float4& plane = frustum.Planes[i];
+        const float length = Float3::Length(Float3(plane.x, plane.y, plane.z));
+        if(length > 0.0f)
+            plane = Float4(plane.x / length, plane.y / length, plane.z / length, plane.w / length);
+    }
+
+    return frustum;
+}
+
+void FrustumCuller::Initialize(const DirectX::BoundingBox* boxes, uint64 boxCount, bool buildBVH)
+{
+    Shutdown();
+
+    numBoxes = boxCount;
+    if(numBoxes == 0)
+        return;
+
+    Assert_(numBoxes <= UINT32_MAX);
+
+    if(buildBVH)
+    {
+        Array<uint32> boxOrder(numBoxes);
+        for(uint64 i = 0; i < numBoxes; ++i)
+            boxOrder[i] = uint32(i);
+
+        GrowableList<Node> buildNodes;
+        GrowableList<uint32> leafStarts;
+        BuildNode(boxes, boxOrder, 0, uint32(numBoxes), buildNodes, leafStarts);
+
+        nodes.Init(buildNodes.Count());
+        for(uint64 i = 0; i < buildNodes.Count(); ++i)
+            nodes[i] = buildNodes[i];
+
+        // Every leaf gets its own block, so that the leaves can be tested without gathering their boxes
+        numBlocks = leafStarts.Count();
+        blockData.Init(numBlocks * BlockFloats, 0.0f);
+        blockBoxIndices.Init(numBlocks * BlockSize, uint32(-1));
+        blockCounts.Init(numBlocks, 0);
+        for(uint64 nodeIdx = 0; nodeIdx < nodes.Size(); ++nodeIdx)
+        {
+            const Node& node = nodes[nodeIdx];
+            if(node.IsLeaf() == false)
+                continue;
+
+            const uint32 start = leafStarts[node.BlockIdx];
+            const uint32 end = node.BlockIdx + 1 < numBlocks ? leafStarts[node.BlockIdx + 1] : uint32(numBoxes);
+            SetBlock(node.BlockIdx, boxes, &boxOrder[start], end - start);
+        }
+
+        // Split the tree into enough sub-trees to keep all of the task threads busy
+        GrowableList<uint32> roots;
+        CollectTaskRoots(0, TaskRootDepth, roots);
+        taskRoots.Init(roots.Count());
+        for(uint64 i = 0; i < roots.Count(); ++i)
+            taskRoots[i] = roots[i];
+    }
+    else
+    {
+        numBlocks = (numBoxes + BlockSize - 1) / BlockSize;
+        blockData.Init(numBlocks * BlockFloats, 0.0f);
+        blockBoxIndices.Init(numBlocks * BlockSize, uint32(-1));
+        blockCounts.Init(numBlocks, 0);
+
+        uint32 boxIndices[BlockSize] = { };
+        for(uint64 blockIdx = 0; blockIdx < numBlocks; ++blockIdx)
+        {
+            const uint64 start = blockIdx * BlockSize;
+            const uint64 count = Min(numBoxes - start, BlockSize);
+            for(uint64 i = 0; i < count; ++i)
+                boxIndices[i] = uint32(start + i);
+            SetBlock(blockIdx, boxes, boxIndices, count);
+        }
+    }
+}
+
+void FrustumCuller::Shutdown()
+{
+    numBoxes = 0;
+    numBlocks = 0;
+    blockData.Shutdown();
+    blockBoxIndices.Shutdown();
+    blockCounts.Shutdown();
+    nodes.Shutdown();
+    taskRoots.Shutdown();
+}
+
+// Builds the tree by splitting at the median centroid along the widest axis, which keeps the leaves between
+// half full and full. Returns the index of the new node.
+uint32 FrustumCuller::BuildNode(const DirectX::BoundingBox* boxes, Array<uint32>& boxOrder, uint32 start, uint32 end,
+                                GrowableList<Node>& buildNodes, GrowableList<uint32>& leafStarts)
+{
+    Float3 boundsMin = Float3(FloatMax, FloatMax, FloatMax);
+    Float3 boundsMax = Float3(-FloatMax, -FloatMax, -FloatMax);
+    Float3 centroidMin = boundsMin;
+    Float3 centroidMax = boundsMax;
+    for(uint32 i = start; i < end; ++i)
+    {
+        const DirectX::BoundingBox& box = boxes[boxOrder[i]];
+        const Float3 center = Float3(box.Center);
+        const Float3 extents = Float3(box.Extents);
+        boundsMin = ComponentMin(boundsMin, center - extents);
+        boundsMax = ComponentMax(boundsMax, center + extents);
+        centroidMin = ComponentMin(centroidMin, center);
+        centroidMax = ComponentMax(centroidMax, center);
+    }
+
+    Node node;
+    node.Center = (boundsMin + boundsMax) * 0.5f;
+    node.Extents = (boundsMax - boundsMin) * 0.5f;
+    if(end - start <= BlockSize)
+        node.BlockIdx = uint32(leafStarts.Add(start));
+
+    const uint32 nodeIdx = uint32(buildNodes.Add(node));
+    if(node.IsLeaf())
+        return nodeIdx;
+
+    const Float3 centroidExtent = centroidMax - centroidMin;
+    uint32 splitAxis = 0;
+    if(centroidExtent.y > centroidExtent[splitAxis])
+        splitAxis = 1;
+    if(centroidExtent.z > centroidExtent[splitAxis])
+        splitAxis = 2;
+
+    const uint32 mid = start + (end - start) / 2;
+    std::nth_element(&boxOrder[start], &boxOrder[mid], &boxOrder[0] + end, [&](uint32 a, uint32 b)
+    {
+        const float centerA = splitAxis == 0 ? boxes[a].Center.x : (splitAxis == 1 ? boxes[a].Center.y : boxes[a].Center.z);
+        const float centerB = splitAxis == 0 ? boxes[b].Center.x : (splitAxis == 1 ? boxes[b].Center.y : boxes[b].Center.z);
+        return centerA < centerB;
+    });
+
+    BuildNode(boxes, boxOrder, start, mid, buildNodes, leafStarts);
+    const uint32 rightChild = BuildNode(boxes, boxOrder, mid, end, buildNodes, leafStarts);
+    buildNodes[nodeIdx].RightChild = rightChild;
+
+    return nodeIdx;
+}
+
+void FrustumCuller::CollectTaskRoots(uint32 nodeIdx, uint64 depth, GrowableList<uint32>& roots) const
+{
+    const Node& node = nodes[nodeIdx];
+    if(depth == 0 || node.IsLeaf())
+    {
+        roots.Add(nodeIdx);
+        return;
+    }
+
+    CollectTaskRoots(nodeIdx + 1, depth - 1, roots);
+    CollectTaskRoots(node.RightChild, depth - 1, roots);
+}
+
+void FrustumCuller::SetBlock(uint64 blockIdx, const DirectX::BoundingBox* boxes, const uint32* boxIndices, uint64 count)
+{
+    Assert_(count <= BlockSize);
+
+    float* block = &blockData[blockIdx * BlockFloats];
+    for(uint64 lane = 0; lane < count; ++lane)
+    {
+        const DirectX::BoundingBox& box = boxes[boxIndices[lane]];
+        block[0 * BlockSize + lane] = box.Center.x;
+        block[1 * BlockSize + lane] = box.Center.y;
+        block[2 * BlockSize + lane] = box.Center.z;
+        block[3 * BlockSize + lane] = box.Extents.x;
+        block[4 * BlockSize + lane] = box.Extents.y;
+        block[5 * BlockSize + lane] = box.Extents.z;
+        blockBoxIndices[blockIdx * BlockSize + lane] = boxIndices[lane];
+    }
+
+    blockCounts[blockIdx] = uint8(count);
+}
+
+void FrustumCuller::CullViews(const CullingFrustum* frusta, uint64 numViews, uint64* visibilityMasks, bool multithreaded) const
+{
+    Assert_(numViews <= MaxViews);
+    if(numBoxes == 0)
+        return;
+
+    // Boxes in nodes that get rejected are never visited
+    memset(visibilityMasks, 0, numBoxes * sizeof(uint64));
+    if(numViews == 0)
+        return;
+
+    Array<SIMDFrustum> simdFrusta(numViews);
+    for(uint64 viewIdx = 0; viewIdx < numViews; ++viewIdx)
+    {
+        const CullingFrustum& frustum = frusta[viewIdx];
+        SIMDFrustum& simdFrustum = simdFrusta[viewIdx];
+        simdFrustum.NumPlanes = frustum.NumPlanes;
+        for(uint64 planeIdx = 0; planeIdx < frustum.NumPlanes; ++planeIdx)
+        {
+            const Float4& plane = frustum.Planes[planeIdx];
+            simdFrustum.NX[planeIdx] = _mm_set1_ps(plane.x);
+            simdFrustum.NY[planeIdx] = _mm_set1_ps(plane.y);
+            simdFrustum.NZ[planeIdx] = _mm_set1_ps(plane.z);
+            simdFrustum.W[planeIdx] = _mm_set1_ps(plane.w);
+            simdFrustum.AbsNX[planeIdx] = _mm_set1_ps(std::abs(plane.x));
+            simdFrustum.AbsNY[planeIdx] = _mm_set1_ps(std::abs(plane.y));
+            simdFrustum.AbsNZ[planeIdx] = _mm_set1_ps(std::abs(plane.z));
+        }
+    }
+
+    CullContext context;
+    context.Frusta = frusta;
+    context.SIMDFrusta = simdFrusta.Data();
+    context.VisibilityMasks = visibilityMasks;
+
+    const uint64 allViews = numViews == MaxViews ? uint64(-1) : (1ull << numViews) - 1;
+    if(HasBVH())
+    {
+        if(multithreaded)
+        {
+            Tasks::ParallelFor(taskRoots.Size(), [&](uint64 start, uint64 end, uint32 threadNum)
+            {
+                for(uint64 i = start; i < end; ++i)
+                    CullNode(context, taskRoots[i], allViews, 0);
+            });
+        }
+        else
+        {
+            CullNode(context, 0, allViews, 0);
+        }
+    }
+    else
+    {
+        if(multithreaded)
+        {
+            Tasks::ParallelFor(numBlocks, [&](uint64 start, uint64 end, uint32 threadNum)
+            {
+                for(uint64 blockIdx = start; blockIdx < end; ++blockIdx)
+                    CullBlock(context, blockIdx, allViews, 0);
+            }, 256);
+        }
+        else
+        {
+            for(uint64 blockIdx = 0; blockIdx < numBlocks; ++blockIdx)
+                CullBlock(context, blockIdx, allViews, 0);
+        }
+    }
+}
+
+// Tests a node against the views that its parent intersected. Views that fully contain the node skip the
+// tests for everything below it, and the node is skipped entirely once no views are left.
+void FrustumCuller::CullNode(const CullContext& context, uint32 nodeIdx, uint64 activeViews, uint64 insideViews) const
+{
+    const Node& node = nodes[nodeIdx];
+
+    uint64 intersectingViews = 0;
+    for(uint64 viewIdx = 0; viewIdx < MaxViews && (activeViews >> viewIdx) != 0; ++viewIdx)
+    {
+        const uint64 viewBit = 1ull << viewIdx;
+        if((activeViews & viewBit) == 0)
+            continue;
+
+        const BoxTestResult result = TestBox(context.Frusta[viewIdx], node.Center, node.Extents);
+        if(result == BoxTestResult::Inside)
+            insideViews |= viewBit;
+        else if(result == BoxTestResult::Intersecting)
+            intersectingViews |= viewBit;
+    }
+
+    if((intersectingViews | insideViews) == 0)
+        return;
+
+    if(node.IsLeaf())
+    {
+        CullBlock(context, node.BlockIdx, intersectingViews, insideViews);
+        return;
+    }
+
+    CullNode(context, nodeIdx + 1, intersectingViews, insideViews);
+    CullNode(context, node.RightChild, intersectingViews, insideViews);
+}
+
+void FrustumCuller::CullBlock(const CullContext& context, uint64 blockIdx, uint64 activeViews, uint64 insideViews) const
+{
+    const float* block = &blockData[blockIdx * BlockFloats];
+
+    uint64 laneMasks[BlockSize] = { };
+    for(uint64 lane = 0; lane < BlockSize; ++lane)
+        laneMasks[lane] = insideViews;
+
+    for(uint64 viewIdx = 0; viewIdx < MaxViews && (activeViews >> viewIdx) != 0; ++viewIdx)
+    {
+        const uint64 viewBit = 1ull << viewIdx;
+        if((activeViews & viewBit) == 0)
+            continue;
+
+        const uint32 visibleLanes = TestBlock(block, context.SIMDFrusta[viewIdx]);
+        for(uint64 lane = 0; lane < BlockSize; ++lane)
+            laneMasks[lane] |= (visibleLanes >> lane) & 1 ? viewBit : 0;
+    }
+
+    const uint64 count = blockCounts[blockIdx];
+    for(uint64 lane = 0; lane < count; ++lane)
+        context.VisibilityMasks[blockBoxIndices[blockIdx * BlockSize + lane]] = laneMasks[lane];
+}
+
+uint64 FrustumCuller::GatherVisible(const uint64* visibilityMasks, uint64 boxCount, uint64 viewIdx, uint32* visibleIndices)
+{
+    const uint64 viewBit = 1ull << viewIdx;
+
+    uint64 numVisible = 0;
+    for(uint64 i = 0; i < boxCount; ++i)
+    {
+        if(visibilityMasks[i] & viewBit)
+            visibleIndices[numVisible++] = uint32(i);
+    }
+
+    return numVisible;
+}
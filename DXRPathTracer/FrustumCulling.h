@@ -0,0 +1,104 @@
+//=================================================================================================
+//
+//  DXR Path Tracer
+//  by MJP
+//  http://mynameismjp.wordpress.com/
+//
+//  All code and content licensed under the MIT license
+//
+//=================================================================================================
+
+#pragma once
+
+#include <PCH.h>
+
+#include <Containers.h>
+#include <SF12_Math.h>
+
+using namespace SampleFramework12;
+
+// Plane equations for a view volume, with the normals pointing inwards
+struct CullingFrustum
+{
+    static const uint64 MaxPlanes = 6;
+
+    Float4 Planes[MaxPlanes];
+    uint64 NumPlanes = 0;
+
+    // Extracts the planes from a view * projection matrix. Leaving out the near plane keeps the shadow casters
+    // behind an orthographic shadow camera, which get clamped to the near plane when rendering.
+    static CullingFrustum FromViewProjection(const Float4x4& viewProjection, bool includeNearPlane = true);
+
+    bool IntersectsSphere(const Float3& center, float radius) const
+    {
+        for(uint64 i = 0; i < NumPlanes; ++i)
+        {
+            const Float4& plane = Planes[i];
+            if(plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w < -radius)
+                return false;
+        }
+
+        return true;
+    }
+};
+
+// Frustum culls a fixed set of bounding boxes against any number of views in a single pass over the data.
+// The boxes are stored as SoA in blocks of 8, and each plane is tested against a whole block at once with a
+// pair of SSE registers. An optional BVH with one block per leaf can accept or reject whole groups of boxes,
+// in which case the sub-trees below the top few levels are spread across the task threads.
+class FrustumCuller
+{
+
+public:
+
+    static const uint64 BlockSize = 8;
+    static const uint64 MaxViews = 64;
+
+    void Initialize(const DirectX::BoundingBox* boxes, uint64 boxCount, bool buildBVH);
+    void Shutdown();
+
+    // Sets bit N of visibilityMasks[i] if box i intersects frusta[N], and clears the rest
+    void CullViews(const CullingFrustum* frusta, uint64 numViews, uint64* visibilityMasks, bool multithreaded = true) const;
+
+    // Writes out the indices of the boxes that are visible in a single view, in ascending order
+    static uint64 GatherVisible(const uint64* visibilityMasks, uint64 boxCount, uint64 viewIdx, uint32* visibleIndices);
+
+    uint64 NumBoxes() const { return numBoxes; }
+    uint64 NumBlocks() const { return numBlocks; }
+    uint64 NumBVHNodes() const { return nodes.Size(); }
+    bool HasBVH() const { return nodes.Size() > 0; }
+
+protected:
+
+    struct Node
+    {
+        Float3 Center;
+        Float3 Extents;
+        uint32 RightChild = 0;
+        uint32 BlockIdx = uint32(-1);
+
+        bool IsLeaf() const { return BlockIdx != uint32(-1); }
+    };
+
+    struct CullContext;
+
+    uint32 BuildNode(const DirectX::BoundingBox* boxes, Array<uint32>& boxOrder, uint32 start, uint32 end,
+                     GrowableList<Node>& buildNodes, GrowableList<uint32>& leafStarts);
+    void CollectTaskRoots(uint32 nodeIdx, uint64 depth, GrowableList<uint32>& roots) const;
+    void SetBlock(uint64 blockIdx, const DirectX::BoundingBox* boxes, const uint32* boxIndices, uint64 count);
+
+    void CullNode(const CullContext& context, uint32 nodeIdx, uint64 activeViews, uint64 insideViews) const;
+    void CullBlock(const CullContext& context, uint64 blockIdx, uint64 activeViews, uint64 insideViews) const;
+
+    uint64 numBoxes = 0;
+    uint64 numBlocks = 0;
+
+    // Per block: the centers and extents as 6 streams of BlockSize floats, and the box index of each lane
+    Array<float> blockData;
+    Array<uint32> blockBoxIndices;
+    Array<uint8> blockCounts;
+
+    // The left child of an interior node immediately follows it
+    Array<Node> nodes;
+    Array<uint32> taskRoots;
+};
@@ -0,0 +1,265 @@
+//=================================================================================================
+//
+//  DXR Path Tracer
+//  by MJP
+//  http://mynameismjp.wordpress.com/
+//
+//  All code and content licensed under the MIT license
+//
+//=================================================================================================
+
+#include <PCH.h>
+
+#include "LightBVH.h"
+
+static const uint64 NumSplitBuckets = 12;
+
+static Float3 ComponentMin(const Float3& a, const Float3& b)
+{
+    return Float3(Min(a.x, b.x), Min(a.y, b.y), Min(a.z, b.z));
+}
+
+static Float3 ComponentMax(const Float3& a, const Float3& b)
+{
+    return Float3(Max(a.x, b.x), Max(a.y, b.y), Max(a.z, b.z));
+}
+
+static float SurfaceArea(const Float3& boundsMin, const Float3& boundsMax)
+{
+    const Float3 extent = boundsMax - boundsMin;
+    return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+// Measure of the solid angle that a cone of normals + emission angle can illuminate
+static float OrientationMeasure(float thetaO, float thetaE)
+{
+    const float thetaW = Min(thetaO + thetaE, Pi);
+    const float cosThetaO = std::cos(thetaO);
+    const float sinThetaO = std::sin(thetaO);
+    return 2.0f * Pi * (1.0f - cosThetaO) +
+           Pi * 0.5f * (2.0f * thetaW * sinThetaO - std::cos(thetaO - 2.0f * thetaW) - 2.0f * thetaO * sinThetaO + cosThetaO);
+}
+
+LightBVH::LightBounds LightBVH::LightBounds::Union(const LightBounds& a, const LightBounds& b)
+{
+    if(a.Valid() == false)
+        return b;
+    if(b.Valid() == false)
+        return a;
+
+    LightBounds result;
+    result.BoundsMin = ComponentMin(a.BoundsMin, b.BoundsMin);
+    result.BoundsMax = ComponentMax(a.BoundsMax, b.BoundsMax);
+    result.Power = a.Power + b.Power;
+    result.MaxRange = Max(a.MaxRange, b.MaxRange);
+    result.ThetaE = Max(a.ThetaE, b.ThetaE);
+
+    // Merge the normal cones, starting from the wider of the two
+    const LightBounds& wide = a.ThetaO >= b.ThetaO ? a : b;
+    const LightBounds& narrow = a.ThetaO >= b.ThetaO ? b : a;
+    const float cosThetaD = Clamp(Float3::Dot(wide.ConeAxis, narrow.ConeAxis), -1.0f, 1.0f);
+    const float thetaD = std::acos(cosThetaD);
+
+    if(Min(thetaD + narrow.ThetaO, Pi) <= wide.ThetaO)
+    {
+        result.ConeAxis = wide.ConeAxis;
+        result.ThetaO = wide.ThetaO;
+        return result;
+    }
+
+    const float thetaO = (wide.ThetaO + thetaD + narrow.ThetaO) * 0.5f;
+    if(thetaO >= Pi)
+    {
+        result.ConeAxis = wide.ConeAxis;
+        result.ThetaO = Pi;
+        return result;
+    }
+
+    // Rotate the wide cone's axis towards the narrow one so that the new cone covers both
+    const float thetaR = thetaO - wide.ThetaO;
+    Float3 ortho = narrow.ConeAxis - wide.ConeAxis * cosThetaD;
+    if(Float3::Length(ortho) < 0.00001f)
+        ortho = Float3::Perpendicular(wide.ConeAxis);
+    ortho = Float3::Normalize(ortho);
+
+    result.ConeAxis = Float3::Normalize(wide.ConeAxis * std::cos(thetaR) + ortho * std::sin(thetaR));
+    result.ThetaO = thetaO;
+    return result;
+}
+
+void LightBVH::Build(const SpotLight* lights, uint64 lightCount)
+{
+    lightBounds.Init(lightCount);
+    for(uint64 i = 0; i < lightCount; ++i)
+    {
+        const SpotLight& light = lights[i];
+
+        // SpotLight::Direction points back towards the light, and AngularAttenuationY is the cosine of the outer angle
+        LightBounds& bounds = lightBounds[i];
+        bounds.BoundsMin = light.Position;
+        bounds.BoundsMax = light.Position;
+        bounds.ConeAxis = Float3::Normalize(-light.Direction);
+        bounds.ThetaO = 0.0f;
+        bounds.ThetaE = std::acos(Clamp(light.AngularAttenuationY, -1.0f, 1.0f));
+        bounds.MaxRange = light.Range;
+
+        const float luminance = Float3::Dot(light.Intensity, Float3(0.2126f, 0.7152f, 0.0722f));
+        bounds.Power = luminance * 2.0f * Pi * (1.0f - light.AngularAttenuationY);
+    }
+
+    BuildTree();
+}
+
+void LightBVH::Build(const EmissiveTriangle* triangles, uint64 triangleCount)
+{
+    lightBounds.Init(triangleCount);
+    for(uint64 i = 0; i < triangleCount; ++i)
+    {
+        const EmissiveTriangle& triangle = triangles[i];
+
+        LightBounds& bounds = lightBounds[i];
+        bounds.BoundsMin = ComponentMin(triangle.Position0, ComponentMin(triangle.Position1, triangle.Position2));
+        bounds.BoundsMax = ComponentMax(triangle.Position0, ComponentMax(triangle.Position1, triangle.Position2));
+
+        // Emissive triangles emit from both sides, so the normal cone covers the whole sphere
+        bounds.ConeAxis = Float3::Normalize(Float3::Cross(triangle.Position1 - triangle.Position0, triangle.Position2 - triangle.Position0));
+        bounds.ThetaO = Pi;
+        bounds.ThetaE = Pi * 0.5f;
+        bounds.MaxRange = FloatMax;
+        bounds.Power = triangle.Power;
+    }
+
+    BuildTree();
+}
+
+void LightBVH::BuildTree()
+{
+    nodes.Shutdown();
+    numLights = 0;
+    depth = 0;
+
+    // Lights that can't emit anything are left out of the tree entirely, so they're never sampled
+    lightOrder.Init(lightBounds.Size());
+    for(uint64 i = 0; i < lightBounds.Size(); ++i)
+        if(lightBounds[i].Valid())
+            lightOrder[numLights++] = uint32(i);
+
+    if(numLights > 0)
+    {
+        buildNodes.Init(numLights * 2);
+        BuildNode(0, uint32(numLights), 1);
+
+        nodes.Init(buildNodes.Count());
+        for(uint64 i = 0; i < buildNodes.Count(); ++i)
+            nodes[i] = buildNodes[i];
+
+        buildNodes.Shutdown();
+    }
+
+    lightBounds.Shutdown();
+    lightOrder.Shutdown();
+}
+
+uint32 LightBVH::BuildNode(uint32 start, uint32 end, uint64 nodeDepth)
+{
+    depth = Max(depth, nodeDepth);
+
+    LightBounds nodeBounds;
+    Float3 centroidMin = Float3(FloatMax, FloatMax, FloatMax);
+    Float3 centroidMax = Float3(-FloatMax, -FloatMax, -FloatMax);
+    for(uint32 i = start; i < end; ++i)
+    {
+        const LightBounds& bounds = lightBounds[lightOrder[i]];
+        nodeBounds = LightBounds::Union(nodeBounds, bounds);
+
+        const Float3 centroid = bounds.Centroid();
+        centroidMin = ComponentMin(centroidMin, centroid);
+        centroidMax = ComponentMax(centroidMax, centroid);
+    }
+
+    LightBVHNode newNode;
+    newNode.BoundsMin = nodeBounds.BoundsMin;
+    newNode.BoundsMax = nodeBounds.BoundsMax;
+    newNode.ConeAxis = nodeBounds.ConeAxis;
+    newNode.ConeThetaO = nodeBounds.ThetaO;
+    newNode.ConeThetaE = nodeBounds.ThetaE;
+    newNode.Power = nodeBounds.Power;
+    newNode.MaxRange = nodeBounds.MaxRange;
+    newNode.PadTo64Bytes = 0;
+    newNode.IsLeaf = end - start == 1 ? 1 : 0;
+    newNode.ChildOrLightIdx = lightOrder[start];
+
+    const uint32 nodeIdx = uint32(buildNodes.Add(newNode));
+    if(newNode.IsLeaf)
+        return nodeIdx;
+
+    // Pick the split with the lowest surface area orientation heuristic (SAOH) cost, using buckets along each axis
+    const Float3 nodeExtent = nodeBounds.BoundsMax - nodeBounds.BoundsMin;
+    const float maxExtent = Max(nodeExtent.x, Max(nodeExtent.y, nodeExtent.z));
+    const Float3 centroidExtent = centroidMax - centroidMin;
+
+    float bestCost = FloatMax;
+    uint32 bestAxis = uint32(-1);
+    uint64 bestSplit = 0;
+    for(uint32 axis = 0; axis < 3; ++axis)
+    {
+        if(centroidExtent[axis] <= 0.0f)
+            continue;
+
+        LightBounds buckets[NumSplitBuckets];
+        for(uint32 i = start; i < end; ++i)
+        {
+            const LightBounds& bounds = lightBounds[lightOrder[i]];
+            const float t = (bounds.Centroid()[axis] - centroidMin[axis]) / centroidExtent[axis];
+            const uint64 bucketIdx = Min<uint64>(uint64(t * NumSplitBuckets), NumSplitBuckets - 1);
+            buckets[bucketIdx] = LightBounds::Union(buckets[bucketIdx], bounds);
+        }
+
+        // Favor splitting along the longest axis of the node's bounds
+        const float regularization = nodeExtent[axis] > 0.0f ? maxExtent / nodeExtent[axis] : 1.0f;
+
+        for(uint64 split = 1; split < NumSplitBuckets; ++split)
+        {
+            LightBounds left;
+            LightBounds right;
+            for(uint64 i = 0; i < split; ++i)
+                left = LightBounds::Union(left, buckets[i]);
+            for(uint64 i = split; i < NumSplitBuckets; ++i)
+                right = LightBounds::Union(right, buckets[i]);
+
+            if(left.Valid() == false || right.Valid() == false)
+                continue;
+
+            const float cost = regularization *
+                               (left.Power * OrientationMeasure(left.ThetaO, left.ThetaE) * SurfaceArea(left.BoundsMin, left.BoundsMax) +
+                                right.Power * OrientationMeasure(right.ThetaO, right.ThetaE) * SurfaceArea(right.BoundsMin, right.BoundsMax));
+            if(cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = split;
+            }
+        }
+    }
+
+    uint32 mid = start + (end - start) / 2;
+    if(bestAxis != uint32(-1))
+    {
+        const uint32* partitionEnd = std::partition(lightOrder.Data() + start, lightOrder.Data() + end, [&](uint32 lightIdx)
+        {
+            const float t = (lightBounds[lightIdx].Centroid()[bestAxis] - centroidMin[bestAxis]) / centroidExtent[bestAxis];
+            return Min<uint64>(uint64(t * NumSplitBuckets), NumSplitBuckets - 1) < bestSplit;
+        });
+        mid = uint32(partitionEnd - lightOrder.Data());
+    }
+
+    if(mid == start || mid == end)
+        mid = start + (end - start) / 2;
+
+    // The first child always directly follows its parent, so only the second child needs to be stored.
+    // This goes through the index since adding children can grow the node list.
+    BuildNode(start, mid, nodeDepth + 1);
+    buildNodes[nodeIdx].ChildOrLightIdx = BuildNode(mid, end, nodeDepth + 1);
+
+    return nodeIdx;
+}
@@ -0,0 +1,65 @@
+//=================================================================================================
+//
+//  DXR Path Tracer
+//  by MJP
+//  http://mynameismjp.wordpress.com/
+//
+//  All code and content licensed under the MIT license
+//
+//=================================================================================================
+
+#pragma once
+
+#include <PCH.h>
+
+#include <Containers.h>
+
+#include "AppSettings.h"
+#include "SharedTypes.h"
+
+using namespace SampleFramework12;
+
+// Binary BVH over spot lights or emissive triangles with a bounding box, bounding cone, and total power
+// per node, based on "Importance Sampling of Many Lights with Adaptive Tree Splitting" [Conty Estevez and Kulla 2018].
+// The flattened nodes are traversed stochastically in LightBVH.hlsl to pick a light with a known PDF.
+class LightBVH
+{
+
+public:
+
+    void Build(const SpotLight* lights, uint64 numLights);
+    void Build(const EmissiveTriangle* triangles, uint64 numTriangles);
+
+    const Array<LightBVHNode>& Nodes() const { return nodes; }
+    uint64 NumNodes() const { return nodes.Size(); }
+    uint64 NumLights() const { return numLights; }
+    uint64 Depth() const { return depth; }
+
+protected:
+
+    struct LightBounds
+    {
+        Float3 BoundsMin = Float3(FloatMax, FloatMax, FloatMax);
+        Float3 BoundsMax = Float3(-FloatMax, -FloatMax, -FloatMax);
+        Float3 ConeAxis = Float3(0.0f, 0.0f, 1.0f);
+        float ThetaO = 0.0f;
+        float ThetaE = 0.0f;
+        float Power = 0.0f;
+        float MaxRange = 0.0f;
+
+        bool Valid() const { return Power > 0.0f; }
+        Float3 Centroid() const { return (BoundsMin + BoundsMax) * 0.5f; }
+
+        static LightBounds Union(const LightBounds& a, const LightBounds& b);
+    };
+
+    void BuildTree();
+    uint32 BuildNode(uint32 start, uint32 end, uint64 nodeDepth);
+
+    Array<LightBounds> lightBounds;
+    Array<uint32> lightOrder;
+    GrowableList<LightBVHNode> buildNodes;
+    Array<LightBVHNode> nodes;
+    uint64 numLights = 0;
+    uint64 depth = 0;
+};
@@ -0,0 +1,110 @@
+//=================================================================================================
+//
+//  DXR Path Tracer
+//  by MJP
+//  http://mynameismjp.wordpress.com/
+//
+//  All code and content licensed under the MIT license
+//
+//=================================================================================================
+
+#ifndef LIGHTBVH_HLSL_
+#define LIGHTBVH_HLSL_
+
+#include <Constants.hlsl>
+
+// Expects SharedTypes.h to already be included for LightBVHNode, since it has no include guard in HLSL
+
+// Conservative estimate of how much light a BVH node can deliver to a shading point, following
+// "Importance Sampling of Many Lights with Adaptive Tree Splitting" [Conty Estevez and Kulla 2018].
+// This must never return 0 for a node containing a light that can actually reach the point,
+// otherwise that light can never be sampled and the estimate becomes biased.
+float LightBVHNodeImportance(in float3 position, in float3 normal, in LightBVHNode node)
+{
+    // Every light in the node is out of range if the closest point of its bounds is
+    const float3 closestPoint = clamp(position, node.BoundsMin, node.BoundsMax);
+    if(length(closestPoint - position) >= node.MaxRange)
+        return 0.0f;
+
+    const float3 center = (node.BoundsMin + node.BoundsMax) * 0.5f;
+    const float radius = length(node.BoundsMax - node.BoundsMin) * 0.5f;
+
+    float3 toCenter = center - position;
+    const float distSq = dot(toCenter, toCenter);
+    const float dist = sqrt(distSq);
+
+    // Matches the (d^2 + 1) falloff used when shading spot lights, clamped so that large nodes
+    // close to the shading point don't dominate their siblings
+    const float falloff = 1.0f / (max(distSq, radius * radius) + 1.0f);
+
+    // No meaningful orientation bounds when we're inside the node's bounding sphere
+    if(dist <= radius)
+        return node.Power * falloff;
+
+    toCenter /= dist;
+    const float thetaU = asin(saturate(radius / dist));
+
+    // Angle between the emission cone and the direction towards the shading point
+    const float theta = acos(clamp(dot(node.ConeAxis, -toCenter), -1.0f, 1.0f));
+    const float thetaPrime = max(theta - node.ConeThetaO - thetaU, 0.0f);
+    if(thetaPrime >= node.ConeThetaE)
+        return 0.0f;
+
+    // Angle between the surface normal and the direction towards the lights
+    const float thetaI = acos(clamp(dot(normal, toCenter), -1.0f, 1.0f));
+    const float thetaIPrime = max(thetaI - thetaU, 0.0f);
+    if(thetaIPrime >= Pi_2)
+        return 0.0f;
+
+    return node.Power * cos(thetaPrime) * cos(thetaIPrime) * falloff;
+}
+
+// Stochastically walks the light BVH from the root, picking a child proportional to its importance
+// at every level and re-using the random number. Returns false if no light can reach the point.
+bool SampleLightBVH(in StructuredBuffer<LightBVHNode> nodes, in float3 position, in float3 normal, in float u,
+                    out uint lightIdx, out float pdf)
+{
+    lightIdx = 0;
+    pdf = 0.0f;
+
+    uint nodeIdx = 0;
+    LightBVHNode node = nodes[0];
+    float nodePdf = 1.0f;
+
+    [loop]
+    while(node.IsLeaf == 0)
+    {
+        const uint firstChildIdx = nodeIdx + 1;
+        const uint secondChildIdx = node.ChildOrLightIdx;
+        const LightBVHNode firstChild = nodes[firstChildIdx];
+        const LightBVHNode secondChild = nodes[secondChildIdx];
+
+        const float firstImportance = LightBVHNodeImportance(position, normal, firstChild);
+        const float secondImportance = LightBVHNodeImportance(position, normal, secondChild);
+        const float totalImportance = firstImportance + secondImportance;
+        if(totalImportance <= 0.0f)
+            return false;
+
+        const float firstProbability = firstImportance / totalImportance;
+        if(u < firstProbability)
+        {
+            u = min(u / firstProbability, 1.0f - FP32Epsilon);
+            nodePdf *= firstProbability;
+            nodeIdx = firstChildIdx;
+            node = firstChild;
+        }
+        else
+        {
+            u = min((u - firstProbability) / (1.0f - firstProbability), 1.0f - FP32Epsilon);
+            nodePdf *= 1.0f - firstProbability;
+            nodeIdx = secondChildIdx;
+            node = secondChild;
+        }
+    }
+
+    lightIdx = node.ChildOrLightIdx;
+    pdf = nodePdf;
+    return true;
+}
+
+#endif // LIGHTBVH_HLSL_
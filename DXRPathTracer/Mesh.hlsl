@@ -144,8 +144,8 @@ float4 PSForward(in PSInput input) : SV_Target0
     Texture2D AlbedoMap = ResourceDescriptorHeap[material.Albedo];
 
     #if AlphaTest_
-        Texture2D OpacityMap = ResourceDescriptorHeap[material.Opacity];
-        if(OpacityMap.Sample(AnisoSampler, input.UV).x < 0.35f)
+        Texture2D OpacityMap = ResourceDescriptorHeap[material.RoughnessMetallicOpacity];
+        if(OpacityMap.Sample(AnisoSampler, input.UV).z < 0.35f)
             discard;
     #endif
 
@@ -170,8 +170,7 @@ float4 PSForward(in PSInput input) : SV_Target0
         float3x3 tangentFrame = float3x3(tangentWS, bitangentWS, vtxNormalWS);
 
         Texture2D NormalMap = ResourceDescriptorHeap[material.Normal];
-        Texture2D RoughnessMap = ResourceDescriptorHeap[material.Roughness];
-        Texture2D MetallicMap = ResourceDescriptorHeap[material.Metallic];
+        Texture2D RoughnessMetallicMap = ResourceDescriptorHeap[material.RoughnessMetallicOpacity];
         Texture2D EmissiveMap = ResourceDescriptorHeap[material.Emissive];
 
         ShadingInput shadingInput;
@@ -183,8 +182,9 @@ float4 PSForward(in PSInput input) : SV_Target0
         shadingInput.TangentFrame = tangentFrame;
         shadingInput.AlbedoMap = AlbedoMap.Sample(AnisoSampler, input.UV);
         shadingInput.NormalMap = NormalMap.Sample(AnisoSampler, input.UV).xy;
-        shadingInput.RoughnessMap = RoughnessMap.Sample(AnisoSampler, input.UV).x;
-        shadingInput.MetallicMap = MetallicMap.Sample(AnisoSampler, input.UV).x;
+        const float2 roughnessMetallic = RoughnessMetallicMap.Sample(AnisoSampler, input.UV).xy;
+        shadingInput.RoughnessMap = roughnessMetallic.x;
+        shadingInput.MetallicMap = roughnessMetallic.y;
         shadingInput.EmissiveMap = EmissiveMap.Sample(AnisoSampler, input.UV).xyz;
         shadingInput.SpotLightClusterBuffer = RawBufferTable[SRVIndices.SpotLightClusterBufferIdx];
         shadingInput.AnisoSampler = AnisoSampler;
@@ -17,8 +17,12 @@
 #include <Graphics/ShaderCompilation.h>
 #include <Graphics/Skybox.h>
 #include <Graphics/Profiler.h>
+#include <Graphics/MeshOptimizer.h>
+#include <Tasks.h>
+#include <Timer.h>
 
 #include "AppSettings.h"
+#include "ProbeGrid.h"
 
 // Constants
 static const uint64 SunShadowMapSize = 2048;
@@ -47,50 +51,99 @@ struct MeshVSConstants
     float FarClip = 0.0f;
 };
 
-// Frustum culls meshes, and produces a buffer of visible mesh indices
-static uint64 CullMeshes(const Camera& camera, const Array<DirectX::BoundingBox>& boundingBoxes, Array<uint32>& drawIndices)
+// Turns the meshes that passed frustum culling into index ranges to draw. Meshes and meshlets whose bounding boxes
+// fail the occlusion test are skipped. With meshlet culling enabled, each meshlet is tested against the frustum and
+// its normal cone, and runs of visible meshlets are merged into a single range. Meshes without meshlets draw all of
+// their parts.
+template<typename TFrustumTest, typename TBackfaceTest, typename TOcclusionTest>
+static uint64 BuildDrawRanges(const Model& model, uint64 numVisibleMeshes, const uint32* meshIndices, bool cullMeshlets,
+                              TFrustumTest frustumTest, TBackfaceTest backfaceTest, TOcclusionTest occlusionTest,
+                              MeshDrawRange* drawRanges, MeshletCullStats& stats)
 {
-    DirectX::BoundingFrustum frustum(camera.ProjectionMatrix().ToSIMD());
-    frustum.Transform(frustum, 1.0f, camera.Orientation().ToSIMD(), camera.Position().ToSIMD());
+    const Array<Meshlet>& meshlets = model.Meshlets();
 
-    uint64 numVisible = 0;
-    const uint64 numMeshes = boundingBoxes.Size();
-    for(uint64 i = 0; i < numMeshes; ++i)
+    uint64 numRanges = 0;
+    for(uint64 i = 0; i < numVisibleMeshes; ++i)
     {
-        if(frustum.Intersects(boundingBoxes[i]))
-            drawIndices[numVisible++] = uint32(i);
-    }
+        const uint32 meshIdx = meshIndices[i];
+        const Mesh& mesh = model.Meshes()[meshIdx];
+        stats.NumMeshes += 1;
+        stats.NumTriangles += mesh.NumIndices() / 3;
 
-    return numVisible;
-}
+        if(occlusionTest(mesh.AABBMin(), mesh.AABBMax()) == false)
+        {
+            ++stats.NumMeshesOccluded;
+            stats.NumTrianglesCulled += mesh.NumIndices() / 3;
+            stats.NumTrianglesOccluded += mesh.NumIndices() / 3;
+            continue;
+        }
 
-// Frustum culls meshes for an orthographic projection, and produces a buffer of visible mesh indices
-static uint64 CullMeshesOrthographic(const OrthographicCamera& camera, bool ignoreNearZ, const Array<DirectX::BoundingBox>& boundingBoxes, Array<uint32>& drawIndices)
-{
-    Float3 mins = Float3(camera.MinX(), camera.MinY(), camera.NearClip());
-    Float3 maxes = Float3(camera.MaxX(), camera.MaxY(), camera.FarClip());
-    if(ignoreNearZ)
-        mins.z = -10000.0f;
-
-    Float3 extents = (maxes - mins) / 2.0f;
-    Float3 center = mins + extents;
-    center = Float3::Transform(center, camera.Orientation());
-    center += camera.Position();
-
-    DirectX::BoundingOrientedBox obb;
-    obb.Extents = extents.ToXMFLOAT3();
-    obb.Center = center.ToXMFLOAT3();
-    obb.Orientation = camera.Orientation().ToXMFLOAT4();
-
-    uint64 numVisible = 0;
-    const uint64 numMeshes = boundingBoxes.Size();
-    for(uint64 i = 0; i < numMeshes; ++i)
-    {
-        if(obb.Intersects(boundingBoxes[i]))
-            drawIndices[numVisible++] = uint32(i);
+        if(cullMeshlets == false || mesh.NumMeshlets() == 0)
+        {
+            for(uint64 partIdx = 0; partIdx < mesh.NumMeshParts(); ++partIdx)
+            {
+                const MeshPart& part = mesh.MeshParts()[partIdx];
+                MeshDrawRange& range = drawRanges[numRanges++];
+                range.MeshIdx = meshIdx;
+                range.PartIdx = uint32(partIdx);
+                range.IndexStart = part.IndexStart;
+                range.IndexCount = part.IndexCount;
+            }
+
+            continue;
+        }
+
+        // Meshlets are only built for single-part meshes, and their triangles are contiguous in the index buffer
+        Assert_(mesh.NumMeshParts() == 1);
+        bool extendRange = false;
+        const uint64 meshletEnd = uint64(mesh.MeshletOffset()) + mesh.NumMeshlets();
+        for(uint64 meshletIdx = mesh.MeshletOffset(); meshletIdx < meshletEnd; ++meshletIdx)
+        {
+            const Meshlet& meshlet = meshlets[meshletIdx];
+            ++stats.NumMeshlets;
+
+            bool culled = false;
+            if(frustumTest(meshlet) == false)
+            {
+                ++stats.NumFrustumCulled;
+                culled = true;
+            }
+            else if(backfaceTest(meshlet))
+            {
+                ++stats.NumBackfaceCulled;
+                culled = true;
+            }
+            else if(occlusionTest(meshlet.AABBMin, meshlet.AABBMax) == false)
+            {
+                ++stats.NumMeshletsOccluded;
+                stats.NumTrianglesOccluded += meshlet.TriangleCount;
+                culled = true;
+            }
+
+            if(culled)
+            {
+                stats.NumTrianglesCulled += meshlet.TriangleCount;
+                extendRange = false;
+                continue;
+            }
+
+            if(extendRange)
+            {
+                drawRanges[numRanges - 1].IndexCount += meshlet.TriangleCount * 3;
+            }
+            else
+            {
+                MeshDrawRange& range = drawRanges[numRanges++];
+                range.MeshIdx = meshIdx;
+                range.PartIdx = 0;
+                range.IndexStart = meshlet.IndexStart;
+                range.IndexCount = meshlet.TriangleCount * 3;
+                extendRange = true;
+            }
+        }
     }
 
-    return numVisible;
+    return numRanges;
 }
 
 MeshRenderer::MeshRenderer()
@@ -100,14 +153,47 @@ MeshRenderer::MeshRenderer()
 void MeshRenderer::LoadShaders()
 {
     // Load the mesh shaders
-    meshDepthVS = CompileFromFile(L"DepthOnly.hlsl", "VS", ShaderType::Vertex);
+    ShaderCompileBatch shaderBatch;
+    shaderBatch.Add(meshDepthVS, L"DepthOnly.hlsl", "VS", ShaderType::Vertex);
 
     CompileOptions opts;
-    meshVS = CompileFromFile(L"Mesh.hlsl", "VS", ShaderType::Vertex, opts);
-    meshPS = CompileFromFile(L"Mesh.hlsl", "PSForward", ShaderType::Pixel, opts);
+    shaderBatch.Add(meshVS, L"Mesh.hlsl", "VS", ShaderType::Vertex, opts);
+    shaderBatch.Add(meshPS, L"Mesh.hlsl", "PSForward", ShaderType::Pixel, opts);
 
     opts.Add("AlphaTest_", 1);
-    meshAlphaTestPS = CompileFromFile(L"Mesh.hlsl", "PSForward", ShaderType::Pixel, opts);
+    shaderBatch.Add(meshAlphaTestPS, L"Mesh.hlsl", "PSForward", ShaderType::Pixel, opts);
+
+    shaderBatch.Compile();
+}
+
+// Fills out drawRanges with the meshes that CullViews found for a view, culling their meshlets against the same frustum.
+// Only the main view has an occlusion buffer.
+uint64 MeshRenderer::CullDrawRanges(uint64 viewIdx, const Camera& camera, MeshletCullStats& stats)
+{
+    Assert_(viewIdx < numCullViews);
+    const CullingFrustum& frustum = viewFrusta[viewIdx];
+    const uint32* visibleMeshes = viewVisibleMeshes.Data() + viewIdx * model->Meshes().Size();
+    auto frustumTest = [&](const Meshlet& meshlet) { return frustum.IntersectsSphere(meshlet.SphereCenter, meshlet.SphereRadius); };
+
+    const bool testOcclusion = viewIdx == 0 && mainPassOcclusion;
+    auto occlusionTest = [&](const Float3& boxMin, const Float3& boxMax)
+    {
+        return testOcclusion == false || occlusionCuller.TestBox(boxMin, boxMax);
+    };
+
+    // Every triangle is viewed from the same direction with an orthographic projection
+    if(camera.IsOrthographic())
+    {
+        const Float3 viewDirection = camera.Forward();
+        auto backfaceTest = [&](const Meshlet& meshlet) { return MeshletBackfacingOrthographic(meshlet, viewDirection); };
+        return BuildDrawRanges(*model, viewNumVisible[viewIdx], visibleMeshes, AppSettings::UseMeshletCulling,
+                               frustumTest, backfaceTest, occlusionTest, drawRanges.Data(), stats);
+    }
+
+    const Float3 viewPosition = camera.Position();
+    auto backfaceTest = [&](const Meshlet& meshlet) { return MeshletBackfacing(meshlet, viewPosition); };
+    return BuildDrawRanges(*model, viewNumVisible[viewIdx], visibleMeshes, AppSettings::UseMeshletCulling,
+                           frustumTest, backfaceTest, occlusionTest, drawRanges.Data(), stats);
 }
 
 // Loads resources
@@ -116,9 +202,20 @@ void MeshRenderer::Initialize(const Model* model_)
     model = model_;
 
     const uint64 numMeshes = model->Meshes().Size();
-    meshBoundingBoxes.Init(numMeshes);
-    frustumCulledIndices.Init(numMeshes, uint32(-1));
+    meshVisibilityMasks.Init(numMeshes, 0);
+    viewVisibleMeshes.Init(numMeshes * MaxCullViews, uint32(-1));
+
+    // Worst case is one range for every other meshlet, or one range per part for meshes without meshlets
+    uint64 maxDrawRanges = 0;
+    for(uint64 i = 0; i < numMeshes; ++i)
+    {
+        const Mesh& mesh = model->Meshes()[i];
+        maxDrawRanges += Max<uint64>(mesh.NumMeshlets(), mesh.NumMeshParts());
+    }
+    drawRanges.Init(maxDrawRanges);
+
     meshZDepths.Init(numMeshes, FloatMax);
+    Array<DirectX::BoundingBox> meshBoundingBoxes(numMeshes);
     for(uint64 i = 0; i < numMeshes; ++i)
     {
         const Mesh& mesh = model->Meshes()[i];
@@ -129,6 +226,9 @@ void MeshRenderer::Initialize(const Model* model_)
         boundingBox.Extents = extents.ToXMFLOAT3();
     }
 
+    meshCuller.Initialize(meshBoundingBoxes.Data(), numMeshes, true);
+    occlusionCuller.Initialize();
+
     LoadShaders();
 
     {
@@ -167,13 +267,8 @@ void MeshRenderer::Initialize(const Model* model_)
 
             matIndices.Albedo = material.Textures[uint64(MaterialTextures::Albedo)]->SRV;
             matIndices.Normal = material.Textures[uint64(MaterialTextures::Normal)]->SRV;
-            matIndices.Roughness = material.Textures[uint64(MaterialTextures::Roughness)]->SRV;
-            matIndices.Metallic = material.Textures[uint64(MaterialTextures::Metallic)]->SRV;
+            matIndices.RoughnessMetallicOpacity = material.Textures[uint64(MaterialTextures::Roughness)]->SRV;
             matIndices.Emissive = material.Textures[uint64(MaterialTextures::Emissive)]->SRV;
-
-            // Opacity is optional
-            const Texture* opacity = material.Textures[uint64(MaterialTextures::Opacity)];
-            matIndices.Opacity = opacity ? opacity->SRV : uint32(-1);
         }
 
         StructuredBufferInit sbInit;
@@ -288,6 +383,9 @@ void MeshRenderer::Shutdown()
     materialBuffer.Shutdown();
     DX12::Release(mainPassRootSignature);
     DX12::Release(depthRootSignature);
+    meshCuller.Shutdown();
+    occlusionTask.Wait();
+    occlusionCuller.Shutdown();
 }
 
 void MeshRenderer::CreatePSOs(DXGI_FORMAT mainRTFormat, DXGI_FORMAT depthFormat, uint32 numMSAASamples)
@@ -323,10 +421,10 @@ void MeshRenderer::CreatePSOs(DXGI_FORMAT mainRTFormat, DXGI_FORMAT depthFormat,
     }
 
     {
-        // Depth-only PSO
+        // Depth-only PSO, which only reads from the position stream
         D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc = {};
         psoDesc.pRootSignature = depthRootSignature;
-        psoDesc.VS = meshVS.ByteCode();
+        psoDesc.VS = meshDepthVS.ByteCode();
         psoDesc.RasterizerState = DX12::GetRasterizerState(RasterizerState::BackFaceCull);
         psoDesc.BlendState = DX12::GetBlendState(BlendState::Disabled);
         psoDesc.DepthStencilState = DX12::GetDepthState(DepthState::WritesEnabled);
@@ -336,8 +434,8 @@ void MeshRenderer::CreatePSOs(DXGI_FORMAT mainRTFormat, DXGI_FORMAT depthFormat,
         psoDesc.DSVFormat = depthFormat;
         psoDesc.SampleDesc.Count = numMSAASamples;
         psoDesc.SampleDesc.Quality = numMSAASamples > 1 ? DX12::StandardMSAAPattern : 0;
-        psoDesc.InputLayout.NumElements = uint32(Model::NumInputElements());
-        psoDesc.InputLayout.pInputElementDescs = Model::InputElements();
+        psoDesc.InputLayout.NumElements = uint32(Model::NumPositionInputElements());
+        psoDesc.InputLayout.pInputElementDescs = Model::PositionInputElements();
         DXCall(device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&depthPSO)));
 
         // Spotlight shadow depth PSO
@@ -370,8 +468,18 @@ void MeshRenderer::RenderMainPass(ID3D12GraphicsCommandList* cmdList, const Came
 {
     PIXMarker marker(cmdList, "Mesh Rendering");
 
-    const uint64 numVisible = CullMeshes(camera, meshBoundingBoxes, frustumCulledIndices);
-    const uint32* meshDrawIndices = frustumCulledIndices.Data();
+    occlusionWaitTime = 0.0;
+    if(mainPassOcclusion)
+    {
+        CPUProfileBlock cpuProfileBlock("Occlusion Culling Wait");
+        Timer waitTimer;
+        occlusionTask.Wait();
+        waitTimer.Update();
+        occlusionWaitTime = waitTimer.ElapsedMillisecondsD();
+    }
+
+    mainPassCullStats = MeshletCullStats();
+    const uint64 numRanges = CullDrawRanges(0, camera, mainPassCullStats);
 
     cmdList->SetGraphicsRootSignature(mainPassRootSignature);
     cmdList->SetPipelineState(mainPassPSO);
@@ -402,6 +510,15 @@ void MeshRenderer::RenderMainPass(ID3D12GraphicsCommandList* cmdList, const Came
     psConstants.NearClip = camera.NearClip();
     psConstants.FarClip = camera.FarClip();
 
+    if(mainPassData.ProbeGrid != nullptr && mainPassData.ProbeGrid->Valid())
+    {
+        const ProbeGridLayout& gridLayout = mainPassData.ProbeGrid->Layout();
+        psConstants.ProbeGridOrigin = gridLayout.Origin;
+        psConstants.ProbeGridSpacing = gridLayout.Spacing;
+        psConstants.ProbeGridDims = gridLayout.Dims;
+        psConstants.ProbeGridIdx = mainPassData.ProbeGrid->GridTexture().SRV;
+    }
+
     psConstants.SkySH = mainPassData.SkyCache->SH;
     DX12::BindTempConstantBuffer(cmdList, psConstants, MainPass_PSCBuffer, CmdListMode::Graphics);
 
@@ -429,63 +546,64 @@ void MeshRenderer::RenderMainPass(ID3D12GraphicsCommandList* cmdList, const Came
 
     DX12::BindTempConstantBuffer(cmdList, psSRVs, MainPass_SRVIndices, CmdListMode::Graphics);
 
-    // Bind vertices and indices
+    // Bind vertices. Index buffer views are bound per mesh, since the index width varies per mesh.
     D3D12_VERTEX_BUFFER_VIEW vbView;
-    D3D12_INDEX_BUFFER_VIEW ibView;
+    const Array<Mesh>* drawMeshes = nullptr;
 
     // 检查是否存在由 xatlas 生成的光照贴图专用几何体
     if (AppSettings::EnableLightMapRender.Value() && model->GetLightmappedVertexCount() > 0)
     {
         // 如果存在，就使用这些包含正确 LightmapUV 的新缓冲区
         vbView = model->GetLightmappedVertexBuffer().VBView();
-        ibView = model->GetLightmappedIndexBuffer().IBView();
+        drawMeshes = &model->GetLightmappedMeshes();
     }
     else
     {
         // 如果不存在（例如，对于一些没有经过 xatlas 处理的简单模型），则回退到原始缓冲区
         vbView = model->VertexBuffer().VBView();
-        ibView = model->IndexBuffer().IBView();
+        drawMeshes = &model->Meshes();
     }
 
 
     cmdList->IASetVertexBuffers(0, 1, &vbView);
-    cmdList->IASetIndexBuffer(&ibView);
 
-    // Draw all visible meshes
+    // Draw all visible ranges. The lightmapped meshes keep the triangle order and meshlets of the regular ones.
     uint32 currMaterial = uint32(-1);
-    for(uint64 i = 0; i < numVisible; ++i)
+    uint32 currMesh = uint32(-1);
+    for(uint64 i = 0; i < numRanges; ++i)
     {
-        uint64 meshIdx = meshDrawIndices[i];
-        const Mesh& mesh = model->Meshes()[meshIdx];
-
-        // Draw all parts
-        for(uint64 partIdx = 0; partIdx < mesh.NumMeshParts(); ++partIdx)
+        const MeshDrawRange& range = drawRanges[i];
+        const Mesh& mesh = (*drawMeshes)[range.MeshIdx];
+        if(range.MeshIdx != currMesh)
         {
-            const MeshPart& part = mesh.MeshParts()[partIdx];
-            if(part.MaterialIdx != currMaterial)
-            {
-                cmdList->SetGraphicsRoot32BitConstant(MainPass_MatIndexCBuffer, part.MaterialIdx, 0);
-                currMaterial = part.MaterialIdx;
-            }
+            cmdList->IASetIndexBuffer(mesh.IBView());
+            currMesh = range.MeshIdx;
+        }
 
-            ID3D12PipelineState* newPSO = mainPassPSO;
-            const MeshMaterial& material = model->Materials()[part.MaterialIdx];
-            if(material.Textures[uint64(MaterialTextures::Opacity)] != nullptr)
-                newPSO = mainPassAlphaTestPSO;
+        const MeshPart& part = mesh.MeshParts()[range.PartIdx];
+        if(part.MaterialIdx != currMaterial)
+        {
+            cmdList->SetGraphicsRoot32BitConstant(MainPass_MatIndexCBuffer, part.MaterialIdx, 0);
+            currMaterial = part.MaterialIdx;
+        }
 
-            if(currPSO != newPSO)
-            {
-                cmdList->SetPipelineState(newPSO);
-                currPSO = newPSO;
-            }
+        ID3D12PipelineState* newPSO = mainPassPSO;
+        const MeshMaterial& material = model->Materials()[part.MaterialIdx];
+        if(material.Textures[uint64(MaterialTextures::Opacity)] != nullptr)
+            newPSO = mainPassAlphaTestPSO;
 
-            cmdList->DrawIndexedInstanced(part.IndexCount, 1, mesh.IndexOffset() + part.IndexStart, mesh.VertexOffset(), 0);
+        if(currPSO != newPSO)
+        {
+            cmdList->SetPipelineState(newPSO);
+            currPSO = newPSO;
         }
+
+        cmdList->DrawIndexedInstanced(range.IndexCount, 1, range.IndexStart, mesh.VertexOffset(), 0);
     }
 }
 
 // Renders all meshes using depth-only rendering
-void MeshRenderer::RenderDepth(ID3D12GraphicsCommandList* cmdList, const Camera& camera, ID3D12PipelineState* pso, uint64 numVisible, const uint32* meshDrawIndices)
+void MeshRenderer::RenderDepth(ID3D12GraphicsCommandList* cmdList, const Camera& camera, ID3D12PipelineState* pso, uint64 numRanges, const MeshDrawRange* ranges)
 {
     cmdList->SetGraphicsRootSignature(depthRootSignature);
     cmdList->SetPipelineState(pso);
@@ -500,49 +618,109 @@ void MeshRenderer::RenderDepth(ID3D12GraphicsCommandList* cmdList, const Camera&
     vsConstants.WorldViewProjection = world * camera.ViewProjectionMatrix();
     DX12::BindTempConstantBuffer(cmdList, vsConstants, 0, CmdListMode::Graphics);
 
-    // Bind vertices and indices
-    D3D12_VERTEX_BUFFER_VIEW vbView = model->VertexBuffer().VBView();
-    D3D12_INDEX_BUFFER_VIEW ibView = model->IndexBuffer().IBView();
+    // Bind the position-only vertices, their indices are bound per mesh
+    D3D12_VERTEX_BUFFER_VIEW vbView = model->PositionBuffer().VBView();
     cmdList->IASetVertexBuffers(0, 1, &vbView);
-    cmdList->IASetIndexBuffer(&ibView);
 
-    // Draw all meshes
-    for(uint64 i = 0; i < numVisible; ++i)
+    // Draw all visible ranges
+    uint32 currMesh = uint32(-1);
+    for(uint64 i = 0; i < numRanges; ++i)
     {
-        uint64 meshIdx = meshDrawIndices[i];
-        const Mesh& mesh = model->Meshes()[meshIdx];
+        const MeshDrawRange& range = ranges[i];
+        const Mesh& mesh = model->Meshes()[range.MeshIdx];
+        if(range.MeshIdx != currMesh)
+        {
+            cmdList->IASetIndexBuffer(mesh.PositionIBView());
+            currMesh = range.MeshIdx;
+        }
 
-        // Draw the whole mesh
-        cmdList->DrawIndexedInstanced(mesh.NumIndices(), 1, mesh.IndexOffset(), mesh.VertexOffset(), 0);
+        cmdList->DrawIndexedInstanced(range.IndexCount, 1, range.IndexStart, mesh.PositionOffset(), 0);
     }
 }
 
-// Renders all meshes using depth-only rendering for a sun shadow map
-void MeshRenderer::RenderSunShadowDepth(ID3D12GraphicsCommandList* cmdList, const OrthographicCamera& camera)
+// Frustum culls the meshes for the main view, the sun cascades and the spot light shadows in a single pass
+void MeshRenderer::CullViews(const Camera& camera, bool sunShadows, bool spotLightShadows)
 {
-    const uint64 numVisible = CullMeshesOrthographic(camera, true, meshBoundingBoxes, frustumCulledIndices);
-    RenderDepth(cmdList, camera, sunShadowPSO, numVisible, frustumCulledIndices.Data());
-}
+    StaticAssert_(MaxCullViews <= FrustumCuller::MaxViews);
+    CPUProfileBlock cpuProfileBlock("Frustum Culling");
 
-void MeshRenderer::RenderSpotLightShadowDepth(ID3D12GraphicsCommandList* cmdList, const Camera& camera)
-{
-    const uint64 numVisible = CullMeshes(camera, meshBoundingBoxes, frustumCulledIndices);
-    RenderDepth(cmdList, camera, spotLightShadowPSO, numVisible, frustumCulledIndices.Data());
+    numCullViews = 0;
+    viewFrusta[numCullViews++] = CullingFrustum::FromViewProjection(camera.ViewProjectionMatrix());
+
+    // Get the occluders rasterizing right away, so that they overlap with the rest of the culling and the shadow
+    // map command recording. The projection's X and Y scales give the aspect ratio for any camera type.
+    mainPassOcclusion = AppSettings::UseOcclusionCulling;
+    if(mainPassOcclusion)
+    {
+        const Float4x4 viewProjection = camera.ViewProjectionMatrix();
+        const CullingFrustum frustum = viewFrusta[0];
+        const float aspectRatio = camera.ProjectionMatrix()._22 / camera.ProjectionMatrix()._11;
+        const uint64 maxOccluderTriangles = uint64(AppSettings::MaxOccluderTriangles);
+        occlusionTask.Start([this, viewProjection, aspectRatio, frustum, maxOccluderTriangles]()
+        {
+            occlusionCuller.RenderOccluders(*model, viewProjection, aspectRatio, frustum, maxOccluderTriangles);
+        });
+    }
+
+    sunShadowViewStart = numCullViews;
+    if(sunShadows)
+    {
+        ShadowHelper::PrepareCascades(AppSettings::SunDirection, SunShadowMapSize, true, camera, sunShadowConstants.Base, sunShadowCameras);
+
+        // Casters between the sun and a cascade are kept, since they get clamped to the near plane
+        for(uint64 cascadeIdx = 0; cascadeIdx < NumCascades; ++cascadeIdx)
+            viewFrusta[numCullViews++] = CullingFrustum::FromViewProjection(sunShadowCameras[cascadeIdx].ViewProjectionMatrix(), false);
+    }
+
+    spotLightViewStart = numCullViews;
+    numSpotLightShadows = 0;
+    if(spotLightShadows)
+    {
+        const Array<ModelSpotLight>& spotLights = model->SpotLights();
+        numSpotLightShadows = Min<uint64>(spotLights.Size(), AppSettings::MaxLightClamp);
+        for(uint64 i = 0; i < numSpotLightShadows; ++i)
+        {
+            const ModelSpotLight& light = spotLights[i];
+
+            PerspectiveCamera& shadowCamera = spotLightShadowCameras[i];
+            shadowCamera.Initialize(1.0f, light.AngularAttenuation.y, AppSettings::SpotShadowNearClip, AppSettings::SpotLightRange);
+            shadowCamera.SetPosition(light.Position);
+            shadowCamera.SetOrientation(light.Orientation);
+
+            Float4x4 shadowMatrix = shadowCamera.ViewProjectionMatrix() * ShadowHelper::ShadowScaleOffsetMatrix;
+            spotLightShadowMatrices[i] = Float4x4::Transpose(shadowMatrix);
+
+            viewFrusta[numCullViews++] = CullingFrustum::FromViewProjection(shadowCamera.ViewProjectionMatrix());
+        }
+    }
+
+    meshCuller.CullViews(viewFrusta, numCullViews, meshVisibilityMasks.Data());
+
+    // The per-view lists keep the meshes in their original order
+    const uint64 numMeshes = model->Meshes().Size();
+    Tasks::ParallelFor(numCullViews, [&](uint64 start, uint64 end, uint32 threadNum)
+    {
+        for(uint64 viewIdx = start; viewIdx < end; ++viewIdx)
+            viewNumVisible[viewIdx] = FrustumCuller::GatherVisible(meshVisibilityMasks.Data(), numMeshes, viewIdx,
+                                                                   viewVisibleMeshes.Data() + viewIdx * numMeshes);
+    });
 }
 
 // Renders meshes using cascaded shadow mapping
-void MeshRenderer::RenderSunShadowMap(ID3D12GraphicsCommandList* cmdList, const Camera& camera)
+void MeshRenderer::RenderSunShadowMap(ID3D12GraphicsCommandList* cmdList)
 {
     PIXMarker marker(cmdList, L"Sun Shadow Map Rendering");
     CPUProfileBlock cpuProfileBlock("Sun Shadow Map Rendering");
     ProfileBlock profileBlock(cmdList, "Sun Shadow Map Rendering");
 
-    OrthographicCamera cascadeCameras[NumCascades];
-    ShadowHelper::PrepareCascades(AppSettings::SunDirection, SunShadowMapSize, true, camera, sunShadowConstants.Base, cascadeCameras);
+    Assert_(spotLightViewStart - sunShadowViewStart == NumCascades);
 
     // Transition all of the cascade array slices to a writable state
     sunDepthMap.MakeWritable(cmdList);
 
+    // The stats are summed over all cascades
+    sunShadowCullStats = MeshletCullStats();
+
     // Render the meshes to each cascade
     for(uint64 cascadeIdx = 0; cascadeIdx < NumCascades; ++cascadeIdx)
     {
@@ -556,19 +734,22 @@ void MeshRenderer::RenderSunShadowMap(ID3D12GraphicsCommandList* cmdList, const
         cmdList->OMSetRenderTargets(0, nullptr, false, &dsv);
         cmdList->ClearDepthStencilView(dsv, D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
 
-        // Draw the mesh with depth only, using the new shadow camera
-        OrthographicCamera& cascadeCam = cascadeCameras[cascadeIdx];
-        RenderSunShadowDepth(cmdList, cascadeCam);
+        // Draw the mesh with depth only, using the cascade's shadow camera
+        const OrthographicCamera& cascadeCam = sunShadowCameras[cascadeIdx];
+        const uint64 numRanges = CullDrawRanges(sunShadowViewStart + cascadeIdx, cascadeCam, sunShadowCullStats);
+        RenderDepth(cmdList, cascadeCam, sunShadowPSO, numRanges, drawRanges.Data());
     }
 
     sunDepthMap.MakeReadable(cmdList);
 }
 
 // Render shadows for all spot lights
-void MeshRenderer::RenderSpotLightShadowMap(ID3D12GraphicsCommandList* cmdList, const Camera& camera)
+void MeshRenderer::RenderSpotLightShadowMap(ID3D12GraphicsCommandList* cmdList)
 {
-    const Array<ModelSpotLight>& spotLights = model->SpotLights();
-    const uint64 numSpotLights = Min<uint64>(spotLights.Size(), AppSettings::MaxLightClamp);
+    // The stats are summed over all lights
+    spotLightShadowCullStats = MeshletCullStats();
+
+    const uint64 numSpotLights = numSpotLightShadows;
     if(numSpotLights == 0)
         return;
 
@@ -591,18 +772,11 @@ void MeshRenderer::RenderSpotLightShadowMap(ID3D12GraphicsCommandList* cmdList,
         cmdList->OMSetRenderTargets(0, nullptr, false, &dsv);
         cmdList->ClearDepthStencilView(dsv, D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
 
-        const ModelSpotLight& light = spotLights[i];
-
-        // Draw the mesh with depth only, using the new shadow camera
-        PerspectiveCamera shadowCamera;
-        shadowCamera.Initialize(1.0f, light.AngularAttenuation.y, AppSettings::SpotShadowNearClip, AppSettings::SpotLightRange);
-        shadowCamera.SetPosition(light.Position);
-        shadowCamera.SetOrientation(light.Orientation);
-        RenderSpotLightShadowDepth(cmdList, shadowCamera);
-
-        Float4x4 shadowMatrix = shadowCamera.ViewProjectionMatrix() * ShadowHelper::ShadowScaleOffsetMatrix;
-        spotLightShadowMatrices[i] = Float4x4::Transpose(shadowMatrix);
+        // Draw the mesh with depth only, using the shadow camera that CullViews set up
+        const PerspectiveCamera& shadowCamera = spotLightShadowCameras[i];
+        const uint64 numRanges = CullDrawRanges(spotLightViewStart + i, shadowCamera, spotLightShadowCullStats);
+        RenderDepth(cmdList, shadowCamera, spotLightShadowPSO, numRanges, drawRanges.Data());
     }
 
     spotLightDepthMap.MakeReadable(cmdList);
-}
\ No newline at end of file
+}
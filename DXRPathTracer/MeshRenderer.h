@@ -19,9 +19,12 @@
 #include <Graphics/ShadowHelper.h>
 #include <Graphics/SH.h>
 #include <Graphics/PostProcessHelper.h>
+#include <Tasks.h>
 
 #include "AppSettings.h"
 #include "SharedTypes.h"
+#include "FrustumCulling.h"
+#include "OcclusionCulling.h"
 
 using namespace SampleFramework12;
 
@@ -30,12 +33,15 @@ namespace SampleFramework12
     struct SkyCache;
 }
 
+class ProbeGrid;
+
 struct MainPassData
 {
     const SkyCache* SkyCache = nullptr;
     const ConstantBuffer* SpotLightBuffer = nullptr;
     const RawBuffer* SpotLightClusterBuffer = nullptr;
     const RenderTexture* BakedLightMap = nullptr;
+    const ProbeGrid* ProbeGrid = nullptr;
 };
 
 struct ShadingConstants
@@ -51,9 +57,37 @@ struct ShadingConstants
     float NearClip = 0.0f;
     float FarClip = 0.0f;
 
+    Float4Align Float3 ProbeGridOrigin;
+    float ProbeGridSpacing = 1.0f;
+    Float4Align Uint3 ProbeGridDims;
+    uint32 ProbeGridIdx = uint32(-1);
+
     Float4Align ShaderSH9Color SkySH;
 };
 
+// Per-view results of culling the meshes that passed the mesh-level frustum test, and their meshlets
+struct MeshletCullStats
+{
+    uint64 NumMeshes = 0;
+    uint64 NumMeshesOccluded = 0;
+    uint64 NumMeshletsOccluded = 0;
+    uint64 NumMeshlets = 0;
+    uint64 NumFrustumCulled = 0;
+    uint64 NumBackfaceCulled = 0;
+    uint64 NumTriangles = 0;
+    uint64 NumTrianglesCulled = 0;
+    uint64 NumTrianglesOccluded = 0;
+};
+
+// A contiguous range of indices from one part of a mesh
+struct MeshDrawRange
+{
+    uint32 MeshIdx = 0;
+    uint32 PartIdx = 0;
+    uint32 IndexStart = 0;
+    uint32 IndexCount = 0;
+};
+
 class MeshRenderer
 {
 
@@ -68,21 +102,32 @@ public:
     void CreatePSOs(DXGI_FORMAT mainRTFormat, DXGI_FORMAT depthFormat, uint32 numMSAASamples);
     void DestroyPSOs();
 
-    void RenderMainPass(ID3D12GraphicsCommandList* cmdList, const Camera& camera, const MainPassData& mainPassData);
+    // Sets up the shadow cameras and frustum culls the meshes for the main view and every shadow view in one pass.
+    // This needs to be called before rendering the shadow maps and the main pass. With occlusion culling enabled
+    // it also starts rasterizing the occluders for the main view on a task thread, which the main pass waits on.
+    void CullViews(const Camera& camera, bool sunShadows, bool spotLightShadows);
 
-    void RenderSunShadowDepth(ID3D12GraphicsCommandList* cmdList, const OrthographicCamera& camera);
-    void RenderSpotLightShadowDepth(ID3D12GraphicsCommandList* cmdList, const Camera& camera);
+    void RenderMainPass(ID3D12GraphicsCommandList* cmdList, const Camera& camera, const MainPassData& mainPassData);
 
-    void RenderSunShadowMap(ID3D12GraphicsCommandList* cmdList, const Camera& camera);
-    void RenderSpotLightShadowMap(ID3D12GraphicsCommandList* cmdList, const Camera& camera);
+    void RenderSunShadowMap(ID3D12GraphicsCommandList* cmdList);
+    void RenderSpotLightShadowMap(ID3D12GraphicsCommandList* cmdList);
 
     const Float4x4* SpotLightShadowMatrices() const { return spotLightShadowMatrices; }
     const StructuredBuffer& MaterialBuffer() const { return materialBuffer; }
 
+    const MeshletCullStats& MainPassCullStats() const { return mainPassCullStats; }
+    const MeshletCullStats& SunShadowCullStats() const { return sunShadowCullStats; }
+    const MeshletCullStats& SpotLightShadowCullStats() const { return spotLightShadowCullStats; }
+    const OcclusionStats& MainPassOcclusionStats() const { return occlusionCuller.Stats(); }
+    double OcclusionWaitTime() const { return occlusionWaitTime; }
+
 protected:
 
+    static const uint64 MaxCullViews = 1 + NumCascades + AppSettings::MaxSpotLights;
+
     void LoadShaders();
-    void RenderDepth(ID3D12GraphicsCommandList* cmdList, const Camera& camera, ID3D12PipelineState* pso, uint64 numVisible, const uint32* meshDrawIndices);
+    uint64 CullDrawRanges(uint64 viewIdx, const Camera& camera, MeshletCullStats& stats);
+    void RenderDepth(ID3D12GraphicsCommandList* cmdList, const Camera& camera, ID3D12PipelineState* pso, uint64 numRanges, const MeshDrawRange* drawRanges);
 
     const Model* model = nullptr;
 
@@ -105,9 +150,30 @@ protected:
     ID3D12PipelineState* spotLightShadowPSO = nullptr;
     ID3D12RootSignature* depthRootSignature = nullptr;
 
-    Array<DirectX::BoundingBox> meshBoundingBoxes;
-    Array<uint32> frustumCulledIndices;
+    FrustumCuller meshCuller;
+    Array<uint64> meshVisibilityMasks;
+    Array<uint32> viewVisibleMeshes;
+    CullingFrustum viewFrusta[MaxCullViews];
+    uint64 viewNumVisible[MaxCullViews] = { };
+    uint64 numCullViews = 0;
+    uint64 sunShadowViewStart = 0;
+    uint64 spotLightViewStart = 0;
+    uint64 numSpotLightShadows = 0;
+
+    OcclusionCuller occlusionCuller;
+    AsyncTask occlusionTask;
+    bool mainPassOcclusion = false;
+    double occlusionWaitTime = 0.0;
+
+    OrthographicCamera sunShadowCameras[NumCascades];
+    PerspectiveCamera spotLightShadowCameras[AppSettings::MaxSpotLights];
+
+    Array<MeshDrawRange> drawRanges;
     Array<float> meshZDepths;
 
     SunShadowConstantsDepthMap sunShadowConstants;
+
+    MeshletCullStats mainPassCullStats;
+    MeshletCullStats sunShadowCullStats;
+    MeshletCullStats spotLightShadowCullStats;
 };
\ No newline at end of file
@@ -0,0 +1,403 @@
+//=================================================================================================
+//
+//  DXR Path Tracer
+//  by MJP
+//  http://mynameismjp.wordpress.com/
+//
+//  All code and content licensed under the MIT license
+//
+//=================================================================================================
+
+#include <PCH.h>
+
+#include <Timer.h>
+#include <Utility.h>
+
+#include "OcclusionCulling.h"
+
+// Occluders must cover at least this fraction of the screen with their bounding box
+static const float MinOccluderScreenArea = 0.01f;
+static const uint64 MaxOccluders = 64;
+
+// Tiles per side of a cell in the coarse depth buffer
+static const uint32 CoarseTileSize = 4;
+
+// Vertices closer than this are treated as crossing the near plane
+static const float MinClipW = 1e-4f;
+
+static const uint64 FullTileMask = uint64(-1);
+
+struct OccluderCandidate
+{
+    uint32 MeshIdx = 0;
+    float ScreenArea = 0.0f;
+};
+
+// Projects a point to pixel coordinates with the post-projection Z, returning false if it's in front of the near plane
+static bool ProjectPoint(const Float3& position, const Float4x4& viewProjection, float width, float height, Float3& screenPos)
+{
+    const Float4x4& m = viewProjection;
+    const float x = position.x * m._11 + position.y * m._21 + position.z * m._31 + m._41;
+    const float y = position.x * m._12 + position.y * m._22 + position.z * m._32 + m._42;
+    const float z = position.x * m._13 + position.y * m._23 + position.z * m._33 + m._43;
+    const float w = position.x * m._14 + position.y * m._24 + position.z * m._34 + m._44;
+    if(w < MinClipW)
+        return false;
+
+    const float invW = 1.0f / w;
+    screenPos.x = (x * invW * 0.5f + 0.5f) * width;
+    screenPos.y = (0.5f - y * invW * 0.5f) * height;
+    screenPos.z = z * invW;
+    return true;
+}
+
+void OcclusionCuller::Initialize(uint32 bufferWidth)
+{
+    Assert_(bufferWidth > 0 && bufferWidth % TileSize == 0);
+    width = bufferWidth;
+    height = 0;
+}
+
+void OcclusionCuller::Shutdown()
+{
+    tiles.Shutdown();
+    coarseDepth.Shutdown();
+    screenPositions.Shutdown();
+    height = 0;
+}
+
+void OcclusionCuller::Resize(uint32 newHeight)
+{
+    Assert_(newHeight % TileSize == 0);
+    height = newHeight;
+    numTilesX = width / TileSize;
+    numTilesY = height / TileSize;
+    tiles.Init(numTilesX * numTilesY);
+
+    numCoarseX = (numTilesX + CoarseTileSize - 1) / CoarseTileSize;
+    numCoarseY = (numTilesY + CoarseTileSize - 1) / CoarseTileSize;
+    coarseDepth.Init(numCoarseX * numCoarseY);
+}
+
+void OcclusionCuller::Clear()
+{
+    Tile clearTile;
+    tiles.Fill(clearTile);
+    coarseDepth.Fill(1.0f);
+}
+
+OcclusionCuller::ScreenBounds OcclusionCuller::ProjectBox(const Float3& boxMin, const Float3& boxMax) const
+{
+    ScreenBounds bounds;
+    bounds.Min = Float2(FloatMax, FloatMax);
+    bounds.Max = Float2(-FloatMax, -FloatMax);
+    bounds.ZMin = FloatMax;
+
+    for(uint64 cornerIdx = 0; cornerIdx < 8; ++cornerIdx)
+    {
+        const Float3 corner = Float3((cornerIdx & 1) ? boxMax.x : boxMin.x,
+                                     (cornerIdx & 2) ? boxMax.y : boxMin.y,
+                                     (cornerIdx & 4) ? boxMax.z : boxMin.z);
+        Float3 screenPos;
+        if(ProjectPoint(corner, viewProjection, float(width), float(height), screenPos) == false)
+        {
+            bounds.CrossesNearPlane = true;
+            return bounds;
+        }
+
+        bounds.Min.x = Min(bounds.Min.x, screenPos.x);
+        bounds.Min.y = Min(bounds.Min.y, screenPos.y);
+        bounds.Max.x = Max(bounds.Max.x, screenPos.x);
+        bounds.Max.y = Max(bounds.Max.y, screenPos.y);
+        bounds.ZMin = Min(bounds.ZMin, screenPos.z);
+    }
+
+    return bounds;
+}
+
+void OcclusionCuller::RenderOccluders(const Model& model, const Float4x4& viewProj, float aspectRatio,
+                                      const CullingFrustum& frustum, uint64 maxOccluderTriangles)
+{
+    Timer timer;
+
+    const uint32 newHeight = AlignTo(Max(uint32(width / aspectRatio + 0.5f), TileSize), TileSize);
+    if(newHeight != height)
+        Resize(newHeight);
+
+    viewProjection = viewProj;
+    Clear();
+    stats = OcclusionStats();
+
+    // Rank the opaque meshes by how much of the screen their bounds cover. Anything crossing the near plane
+    // is surrounding the camera, so it counts as covering the whole screen.
+    const Array<Mesh>& meshes = model.Meshes();
+    const float screenArea = float(width) * float(height);
+    GrowableList<OccluderCandidate> candidates(meshes.Size());
+    for(uint64 meshIdx = 0; meshIdx < meshes.Size(); ++meshIdx)
+    {
+        const Mesh& mesh = meshes[meshIdx];
+        if(mesh.NumIndices() / 3 > maxOccluderTriangles)
+            continue;
+
+        bool alphaTested = false;
+        for(uint64 partIdx = 0; partIdx < mesh.NumMeshParts(); ++partIdx)
+        {
+            const MeshMaterial& material = model.Materials()[mesh.MeshParts()[partIdx].MaterialIdx];
+            alphaTested |= material.Textures[uint64(MaterialTextures::Opacity)] != nullptr;
+        }
+
+        if(alphaTested)
+            continue;
+
+        const Float3 center = (mesh.AABBMin() + mesh.AABBMax()) * 0.5f;
+        const float radius = Float3::Length(mesh.AABBMax() - center);
+        if(frustum.IntersectsSphere(center, radius) == false)
+            continue;
+
+        const ScreenBounds bounds = ProjectBox(mesh.AABBMin(), mesh.AABBMax());
+        float area = 1.0f;
+        if(bounds.CrossesNearPlane == false)
+        {
+            const float areaX = Clamp(bounds.Max.x, 0.0f, float(width)) - Clamp(bounds.Min.x, 0.0f, float(width));
+            const float areaY = Clamp(bounds.Max.y, 0.0f, float(height)) - Clamp(bounds.Min.y, 0.0f, float(height));
+            area = (areaX * areaY) / screenArea;
+        }
+
+        if(area < MinOccluderScreenArea)
+            continue;
+
+        OccluderCandidate candidate;
+        candidate.MeshIdx = uint32(meshIdx);
+        candidate.ScreenArea = area;
+        candidates.Add(candidate);
+    }
+
+    if(candidates.Count() > 1)
+    {
+        std::sort(&candidates[0], &candidates[0] + candidates.Count(), [](const OccluderCandidate& a, const OccluderCandidate& b)
+        {
+            return a.ScreenArea > b.ScreenArea;
+        });
+    }
+
+    for(uint64 i = 0; i < candidates.Count() && stats.NumOccluders < MaxOccluders; ++i)
+    {
+        const Mesh& mesh = meshes[candidates[i].MeshIdx];
+        const uint64 numTriangles = mesh.NumIndices() / 3;
+        if(stats.NumOccluderTriangles + numTriangles > maxOccluderTriangles)
+            continue;
+
+        RasterizeMesh(model, mesh);
+        stats.NumOccluders += 1;
+        stats.NumOccluderTriangles += numTriangles;
+    }
+
+    BuildHierarchy();
+
+    timer.Update();
+    stats.RasterizeTime = timer.ElapsedMillisecondsD();
+}
+
+void OcclusionCuller::RasterizeMesh(const Model& model, const Mesh& mesh)
+{
+    if(screenPositions.Size() < mesh.NumPositions())
+        screenPositions.Init(mesh.NumPositions());
+
+    const Float3* positions = model.Positions() + mesh.PositionOffset();
+    for(uint64 i = 0; i < mesh.NumPositions(); ++i)
+    {
+        if(ProjectPoint(positions[i], viewProjection, float(width), float(height), screenPositions[i]) == false)
+            screenPositions[i].z = -1.0f;
+    }
+
+    // Triangles that cross the near plane are dropped instead of clipped, which only costs some occlusion
+    const uint64 numIndices = mesh.NumIndices();
+    for(uint64 i = 0; i < numIndices; i += 3)
+    {
+        const Float3& v0 = screenPositions[mesh.PositionIndex(i + 0)];
+        const Float3& v1 = screenPositions[mesh.PositionIndex(i + 1)];
+        const Float3& v2 = screenPositions[mesh.PositionIndex(i + 2)];
+        if(v0.z < 0.0f || v1.z < 0.0f || v2.z < 0.0f)
+            continue;
+
+        RasterizeTriangle(v0, v1, v2);
+    }
+}
+
+void OcclusionCuller::RasterizeTriangle(const Float3& v0, const Float3& v1, const Float3& v2)
+{
+    // Front faces are clockwise on screen, which has a positive area with Y pointing down
+    const float area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+    if(area <= 0.0f)
+        return;
+
+    // Only the pixels with their centers inside the bounding box can be covered
+    const int32 pixelMinX = Max(int32(std::ceil(Min(v0.x, Min(v1.x, v2.x)) - 0.5f)), 0);
+    const int32 pixelMinY = Max(int32(std::ceil(Min(v0.y, Min(v1.y, v2.y)) - 0.5f)), 0);
+    const int32 pixelMaxX = Min(int32(std::floor(Max(v0.x, Max(v1.x, v2.x)) - 0.5f)), int32(width) - 1);
+    const int32 pixelMaxY = Min(int32(std::floor(Max(v0.y, Max(v1.y, v2.y)) - 0.5f)), int32(height) - 1);
+    if(pixelMinX > pixelMaxX || pixelMinY > pixelMaxY)
+        return;
+
+    // Edge functions in the form A * x + B * y + C, which are positive on the inside of the triangle
+    const Float3* verts[3] = { &v0, &v1, &v2 };
+    float edgeA[3] = { };
+    float edgeB[3] = { };
+    float edgeC[3] = { };
+    for(uint64 edgeIdx = 0; edgeIdx < 3; ++edgeIdx)
+    {
+        const Float3& a = *verts[edgeIdx];
+        const Float3& b = *verts[(edgeIdx + 1) % 3];
+        edgeA[edgeIdx] = a.y - b.y;
+        edgeB[edgeIdx] = b.x - a.x;
+        edgeC[edgeIdx] = -(edgeA[edgeIdx] * a.x + edgeB[edgeIdx] * a.y);
+    }
+
+    // Depth is linear in screen space, so the farthest point of the triangle within a tile is at one of the tile's
+    // corners or one of the vertices
+    const float dzdx = ((v1.z - v0.z) * (v2.y - v0.y) - (v2.z - v0.z) * (v1.y - v0.y)) / area;
+    const float dzdy = ((v2.z - v0.z) * (v1.x - v0.x) - (v1.z - v0.z) * (v2.x - v0.x)) / area;
+    const float maxVertexZ = Max(v0.z, Max(v1.z, v2.z));
+    const float tileDZ = Max(dzdx, 0.0f) * TileSize + Max(dzdy, 0.0f) * TileSize;
+
+    const __m128 laneOffsetsLo = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    const __m128 laneOffsetsHi = _mm_setr_ps(4.5f, 5.5f, 6.5f, 7.5f);
+    const __m128 zero = _mm_setzero_ps();
+
+    const uint32 tileMinX = uint32(pixelMinX) / TileSize;
+    const uint32 tileMinY = uint32(pixelMinY) / TileSize;
+    const uint32 tileMaxX = uint32(pixelMaxX) / TileSize;
+    const uint32 tileMaxY = uint32(pixelMaxY) / TileSize;
+    for(uint32 tileY = tileMinY; tileY <= tileMaxY; ++tileY)
+    {
+        const float y = float(tileY * TileSize);
+        for(uint32 tileX = tileMinX; tileX <= tileMaxX; ++tileX)
+        {
+            Tile& tile = tiles[tileY * numTilesX + tileX];
+            const float x = float(tileX * TileSize);
+
+            // Take the depth at the tile corner with the smallest X and Y, and step to the farthest corner
+            const float cornerZ = v0.z + dzdx * (x - v0.x) + dzdy * (y - v0.y);
+            const float triangleZMax = Min(cornerZ + tileDZ, maxVertexZ);
+            if(triangleZMax >= tile.ZMax1)
+                continue;
+
+            __m128 edgeLo[3];
+            __m128 edgeHi[3];
+            __m128 edgeStepY[3];
+            for(uint64 edgeIdx = 0; edgeIdx < 3; ++edgeIdx)
+            {
+                const __m128 a = _mm_set1_ps(edgeA[edgeIdx]);
+                const __m128 rowStart = _mm_set1_ps(edgeA[edgeIdx] * x + edgeB[edgeIdx] * (y + 0.5f) + edgeC[edgeIdx]);
+                edgeLo[edgeIdx] = _mm_add_ps(_mm_mul_ps(a, laneOffsetsLo), rowStart);
+                edgeHi[edgeIdx] = _mm_add_ps(_mm_mul_ps(a, laneOffsetsHi), rowStart);
+                edgeStepY[edgeIdx] = _mm_set1_ps(edgeB[edgeIdx]);
+            }
+
+            uint64 coverage = 0;
+            for(uint64 row = 0; row < TileSize; ++row)
+            {
+                __m128 insideLo = _mm_and_ps(_mm_cmpge_ps(edgeLo[0], zero), _mm_cmpge_ps(edgeLo[1], zero));
+                insideLo = _mm_and_ps(insideLo, _mm_cmpge_ps(edgeLo[2], zero));
+                __m128 insideHi = _mm_and_ps(_mm_cmpge_ps(edgeHi[0], zero), _mm_cmpge_ps(edgeHi[1], zero));
+                insideHi = _mm_and_ps(insideHi, _mm_cmpge_ps(edgeHi[2], zero));
+
+                const uint64 rowBits = uint64(_mm_movemask_ps(insideLo)) | (uint64(_mm_movemask_ps(insideHi)) << 4);
+                coverage |= rowBits << (row * TileSize);
+
+                for(uint64 edgeIdx = 0; edgeIdx < 3; ++edgeIdx)
+                {
+                    edgeLo[edgeIdx] = _mm_add_ps(edgeLo[edgeIdx], edgeStepY[edgeIdx]);
+                    edgeHi[edgeIdx] = _mm_add_ps(edgeHi[edgeIdx], edgeStepY[edgeIdx]);
+                }
+            }
+
+            if(coverage != 0)
+                UpdateTile(tile, coverage, triangleZMax);
+        }
+    }
+}
+
+void OcclusionCuller::UpdateTile(Tile& tile, uint64 coverage, float triangleZMax)
+{
+    // Throw away the working layer when the new triangle is much closer to the camera than it is, since merging
+    // them would make the working layer too far away to ever be useful
+    const float distanceToReference = tile.ZMax1 - tile.ZMax0;
+    const float distanceToTriangle = tile.ZMax0 - triangleZMax;
+    if(tile.Mask != 0 && distanceToTriangle > distanceToReference)
+    {
+        tile.Mask = 0;
+        tile.ZMax0 = 0.0f;
+    }
+
+    tile.Mask |= coverage;
+    tile.ZMax0 = Max(tile.ZMax0, triangleZMax);
+
+    // Once the whole tile is covered the working layer becomes the new reference
+    if(tile.Mask == FullTileMask)
+    {
+        tile.ZMax1 = tile.ZMax0;
+        tile.Mask = 0;
+        tile.ZMax0 = 0.0f;
+    }
+}
+
+void OcclusionCuller::BuildHierarchy()
+{
+    for(uint32 coarseY = 0; coarseY < numCoarseY; ++coarseY)
+    {
+        for(uint32 coarseX = 0; coarseX < numCoarseX; ++coarseX)
+        {
+            const uint32 tileEndX = Min((coarseX + 1) * CoarseTileSize, numTilesX);
+            const uint32 tileEndY = Min((coarseY + 1) * CoarseTileSize, numTilesY);
+            float maxDepth = 0.0f;
+            for(uint32 tileY = coarseY * CoarseTileSize; tileY < tileEndY; ++tileY)
+                for(uint32 tileX = coarseX * CoarseTileSize; tileX < tileEndX; ++tileX)
+                    maxDepth = Max(maxDepth, tiles[tileY * numTilesX + tileX].ZMax1);
+
+            coarseDepth[coarseY * numCoarseX + coarseX] = maxDepth;
+        }
+    }
+}
+
+bool OcclusionCuller::TestBox(const Float3& boxMin, const Float3& boxMax) const
+{
+    if(height == 0)
+        return true;
+
+    const ScreenBounds bounds = ProjectBox(boxMin, boxMax);
+    if(bounds.CrossesNearPlane)
+        return true;
+
+    // Every tile that the bounds touch must have its reference depth in front of the closest point of the box
+    const int32 pixelMinX = Max(int32(std::floor(bounds.Min.x)), 0);
+    const int32 pixelMinY = Max(int32(std::floor(bounds.Min.y)), 0);
+    const int32 pixelMaxX = Min(int32(std::floor(bounds.Max.x)), int32(width) - 1);
+    const int32 pixelMaxY = Min(int32(std::floor(bounds.Max.y)), int32(height) - 1);
+    if(pixelMinX > pixelMaxX || pixelMinY > pixelMaxY)
+        return true;
+
+    const uint32 tileMinX = uint32(pixelMinX) / TileSize;
+    const uint32 tileMinY = uint32(pixelMinY) / TileSize;
+    const uint32 tileMaxX = uint32(pixelMaxX) / TileSize;
+    const uint32 tileMaxY = uint32(pixelMaxY) / TileSize;
+    for(uint32 coarseY = tileMinY / CoarseTileSize; coarseY <= tileMaxY / CoarseTileSize; ++coarseY)
+    {
+        for(uint32 coarseX = tileMinX / CoarseTileSize; coarseX <= tileMaxX / CoarseTileSize; ++coarseX)
+        {
+            if(bounds.ZMin > coarseDepth[coarseY * numCoarseX + coarseX])
+                continue;
+
+            const uint32 tileStartX = Max(coarseX * CoarseTileSize, tileMinX);
+            const uint32 tileStartY = Max(coarseY * CoarseTileSize, tileMinY);
+            const uint32 tileEndX = Min((coarseX + 1) * CoarseTileSize - 1, tileMaxX);
+            const uint32 tileEndY = Min((coarseY + 1) * CoarseTileSize - 1, tileMaxY);
+            for(uint32 tileY = tileStartY; tileY <= tileEndY; ++tileY)
+                for(uint32 tileX = tileStartX; tileX <= tileEndX; ++tileX)
+                    if(bounds.ZMin <= tiles[tileY * numTilesX + tileX].ZMax1)
+                        return true;
+        }
+    }
+
+    return false;
+}
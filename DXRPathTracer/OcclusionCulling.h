@@ -0,0 +1,100 @@
+//=================================================================================================
+//
+//  DXR Path Tracer
+//  by MJP
+//  http://mynameismjp.wordpress.com/
+//
+//  All code and content licensed under the MIT license
+//
+//=================================================================================================
+
+#pragma once
+
+#include <PCH.h>
+
+#include <Containers.h>
+#include <SF12_Math.h>
+#include <Graphics/Model.h>
+
+#include "FrustumCulling.h"
+
+using namespace SampleFramework12;
+
+struct OcclusionStats
+{
+    uint64 NumOccluders = 0;
+    uint64 NumOccluderTriangles = 0;
+    double RasterizeTime = 0.0;
+};
+
+// Low-resolution CPU depth buffer for occlusion culling, based on "Masked Software Occlusion Culling"
+// [Hasselgren et al. 2016]. Each 8x8 tile stores a reference depth that covers the whole tile, and a
+// working layer with a coverage mask and the farthest depth of the covered pixels. Triangles are merged
+// into the working layer, which replaces the reference layer once it covers the whole tile. The coverage
+// of a triangle is computed for a row of 8 pixels at a time with SSE.
+class OcclusionCuller
+{
+
+public:
+
+    static const uint32 TileSize = 8;
+    static const uint32 DefaultWidth = 320;
+
+    void Initialize(uint32 bufferWidth = DefaultWidth);
+    void Shutdown();
+
+    // Picks the meshes with the largest screen-space bounds that pass the frustum test as occluders, up to
+    // a budget of triangles, and rasterizes them. Alpha-tested meshes are never used as occluders.
+    void RenderOccluders(const Model& model, const Float4x4& viewProj, float aspectRatio,
+                         const CullingFrustum& frustum, uint64 maxOccluderTriangles);
+
+    // Returns false if the box is entirely behind the occluders
+    bool TestBox(const Float3& boxMin, const Float3& boxMax) const;
+
+    const OcclusionStats& Stats() const { return stats; }
+    uint32 Width() const { return width; }
+    uint32 Height() const { return height; }
+
+protected:
+
+    struct Tile
+    {
+        uint64 Mask = 0;
+        float ZMax0 = 0.0f;
+        float ZMax1 = 1.0f;
+    };
+
+    struct ScreenBounds
+    {
+        Float2 Min;
+        Float2 Max;
+        float ZMin = 0.0f;
+        bool CrossesNearPlane = false;
+    };
+
+    void Resize(uint32 newHeight);
+    void Clear();
+    ScreenBounds ProjectBox(const Float3& boxMin, const Float3& boxMax) const;
+    void RasterizeMesh(const Model& model, const Mesh& mesh);
+    void RasterizeTriangle(const Float3& v0, const Float3& v1, const Float3& v2);
+    void UpdateTile(Tile& tile, uint64 coverage, float triangleZMax);
+    void BuildHierarchy();
+
+    uint32 width = DefaultWidth;
+    uint32 height = 0;
+    uint32 numTilesX = 0;
+    uint32 numTilesY = 0;
+    Float4x4 viewProjection;
+
+    Array<Tile> tiles;
+
+    // The farthest reference depth of each 4x4 group of tiles, for rejecting large boxes early
+    Array<float> coarseDepth;
+    uint32 numCoarseX = 0;
+    uint32 numCoarseY = 0;
+
+    // Projected vertices of the current occluder, with a negative Z for the ones in front of the near plane
+    Array<Float3> screenPositions;
+
+    OcclusionStats stats;
+};
@@ -0,0 +1,253 @@
+//=================================================================================================
+//
+//  DXR Path Tracer
+//  by MJP
+//  http://mynameismjp.wordpress.com/
+//
+//  All code and content licensed under the MIT license
+//
+//=================================================================================================
+
+#include <PCH.h>
+
+#include <Timer.h>
+#include <Utility.h>
+#include <Graphics/Model.h>
+
+#include "OpacityClassification.h"
+
+// Triangles with larger footprints than this are assumed to be mixed instead of visiting every texel
+static const float MaxTexelsPerTriangle = 1024.0f * 1024.0f;
+
+static float EdgeFunction(const Float2& a, const Float2& b, const Float2& p)
+{
+    return (b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x);
+}
+
+static float LoadOpacityWrapped(const TextureData<Float4>& texData, float x, float y)
+{
+    int64 tx = int64(std::floor(x)) % int64(texData.Width);
+    int64 ty = int64(std::floor(y)) % int64(texData.Height);
+    if(tx < 0)
+        tx += texData.Width;
+    if(ty < 0)
+        ty += texData.Height;
+
+    // Opacity lives in the B channel of the packed roughness/metallic/opacity texture
+    return texData.Texels[uint64(ty) * texData.Width + uint64(tx)].z;
+}
+
+TriangleOpacity ClassifyTriangleOpacity(const TextureData<Float4>& opacityMap, Float2 uv0, Float2 uv1, Float2 uv2)
+{
+    // Rasterize the triangle in texel space, without wrapping, so that it can span multiple repeats of the texture.
+    // A bilinear sample reads the 2x2 texels around it, so the bounds grow by a texel in every direction.
+    const Float2 texSize = Float2(float(opacityMap.Width), float(opacityMap.Height));
+    const Float2 t0 = uv0 * texSize;
+    const Float2 t1 = uv1 * texSize;
+    const Float2 t2 = uv2 * texSize;
+
+    const float minX = std::floor(Min(t0.x, Min(t1.x, t2.x))) - 1.0f;
+    const float minY = std::floor(Min(t0.y, Min(t1.y, t2.y))) - 1.0f;
+    const float maxX = std::ceil(Max(t0.x, Max(t1.x, t2.x))) + 1.0f;
+    const float maxY = std::ceil(Max(t0.y, Max(t1.y, t2.y))) + 1.0f;
+    if((maxX - minX) * (maxY - minY) > MaxTexelsPerTriangle)
+        return TriangleOpacity::Mixed;
+
+    // Turns the edge functions into signed distances that are positive on the inside for either winding.
+    // Triangles that are degenerate in UV space just use every texel in their bounds.
+    const float signedArea = EdgeFunction(t0, t1, t2);
+    const float areaSign = signedArea < 0.0f ? -1.0f : 1.0f;
+    const float edgeLength0 = Float2::Length(t2 - t1);
+    const float edgeLength1 = Float2::Length(t0 - t2);
+    const float edgeLength2 = Float2::Length(t1 - t0);
+
+    // Any texel whose center is within sqrt(2) texels of the triangle can contribute to a bilinear sample inside of it
+    const float maxTexelDistance = std::sqrt(2.0f);
+
+    bool anyOpaque = false;
+    bool anyTransparent = false;
+    for(float y = minY + 0.5f; y < maxY; y += 1.0f)
+    {
+        for(float x = minX + 0.5f; x < maxX; x += 1.0f)
+        {
+            const Float2 p = Float2(x, y);
+            if(signedArea != 0.0f)
+            {
+                const float d0 = EdgeFunction(t1, t2, p) * areaSign / edgeLength0;
+                const float d1 = EdgeFunction(t2, t0, p) * areaSign / edgeLength1;
+                const float d2 = EdgeFunction(t0, t1, p) * areaSign / edgeLength2;
+                if(d0 < -maxTexelDistance || d1 < -maxTexelDistance || d2 < -maxTexelDistance)
+                    continue;
+            }
+
+            if(LoadOpacityWrapped(opacityMap, x, y) < AlphaTestThreshold)
+                anyTransparent = true;
+            else
+                anyOpaque = true;
+
+            if(anyOpaque && anyTransparent)
+                return TriangleOpacity::Mixed;
+        }
+    }
+
+    if(anyOpaque)
+        return TriangleOpacity::Opaque;
+    if(anyTransparent)
+        return TriangleOpacity::Transparent;
+
+    return TriangleOpacity::Mixed;
+}
+
+void OpacityClassification::Initialize(const Model& model)
+{
+    Shutdown();
+
+    Timer timer;
+
+    // Read back every distinct opacity texture once
+    const Array<MeshMaterial>& materials = model.Materials();
+    std::map<const Texture*, uint64> textureLookup;
+    GrowableList<TextureData<Float4>*> textureData;
+    Array<uint64> materialTextureData(materials.Size(), uint64(-1));
+    for(uint64 matIdx = 0; matIdx < materials.Size(); ++matIdx)
+    {
+        const Texture* opacityTexture = materials[matIdx].Textures[uint64(MaterialTextures::Opacity)];
+        if(opacityTexture == nullptr)
+            continue;
+
+        auto existing = textureLookup.find(opacityTexture);
+        if(existing != textureLookup.end())
+        {
+            materialTextureData[matIdx] = existing->second;
+            continue;
+        }
+
+        TextureData<Float4>* texData = new TextureData<Float4>();
+        GetTextureData(*opacityTexture, *texData);
+
+        const uint64 dataIdx = textureData.Add(texData);
+        textureLookup[opacityTexture] = dataIdx;
+        materialTextureData[matIdx] = dataIdx;
+    }
+
+    // Every mesh can have up to two geometries, each of which is padded out to a 4-byte boundary
+    const Array<Mesh>& meshes = model.Meshes();
+    uint64 maxIndexBytes = 0;
+    for(uint64 meshIdx = 0; meshIdx < meshes.Size(); ++meshIdx)
+        maxIndexBytes += uint64(meshes[meshIdx].NumIndices()) * meshes[meshIdx].IndexSize() + 2 * MeshIndexAlignment;
+
+    Array<uint8> indices(maxIndexBytes, 0);
+    Array<uint8> positionIndices(maxIndexBytes, 0);
+    uint64 numIndexBytes = 0;
+    GrowableList<OpacityGeometry> geometryList;
+    Array<TriangleOpacity> triangleOpacity;
+    for(uint64 meshIdx = 0; meshIdx < meshes.Size(); ++meshIdx)
+    {
+        // The ray tracing geometry assumes one part (and one material) per mesh
+        const Mesh& mesh = meshes[meshIdx];
+        Assert_(mesh.NumMeshParts() == 1);
+        const uint64 dataIdx = materialTextureData[mesh.MeshParts()[0].MaterialIdx];
+
+        const uint64 numTriangles = mesh.NumIndices() / 3;
+        triangleOpacity.Init(numTriangles);
+        for(uint64 triIdx = 0; triIdx < numTriangles; ++triIdx)
+        {
+            uint32 triIndices[3] = { };
+            Float2 triUVs[3];
+            for(uint64 i = 0; i < 3; ++i)
+            {
+                triIndices[i] = mesh.Index(triIdx * 3 + i);
+                triUVs[i] = model.Vertices()[triIndices[i] + mesh.VertexOffset()].UV;
+            }
+
+            if(dataIdx == uint64(-1))
+                triangleOpacity[triIdx] = TriangleOpacity::Opaque;
+            else
+                triangleOpacity[triIdx] = ClassifyTriangleOpacity(*textureData[dataIdx], triUVs[0], triUVs[1], triUVs[2]);
+
+            if(triangleOpacity[triIdx] == TriangleOpacity::Opaque)
+                ++numOpaque;
+            else if(triangleOpacity[triIdx] == TriangleOpacity::Transparent)
+                ++numTransparent;
+            else
+                ++numMixed;
+        }
+
+        // Group the opaque triangles followed by the mixed ones, leaving out the transparent triangles
+        for(uint64 pass = 0; pass < 2; ++pass)
+        {
+            const TriangleOpacity passOpacity = pass == 0 ? TriangleOpacity::Opaque : TriangleOpacity::Mixed;
+
+            numIndexBytes = AlignTo(numIndexBytes, MeshIndexAlignment);
+
+            OpacityGeometry geometry;
+            geometry.MeshIdx = uint32(meshIdx);
+            geometry.IndexByteOffset = uint32(numIndexBytes);
+            geometry.Opaque = passOpacity == TriangleOpacity::Opaque;
+
+            for(uint64 triIdx = 0; triIdx < numTriangles; ++triIdx)
+            {
+                if(triangleOpacity[triIdx] != passOpacity)
+                    continue;
+
+                for(uint64 i = 0; i < 3; ++i)
+                {
+                    const uint64 srcIdx = triIdx * 3 + i;
+                    if(mesh.IndexBufferType() == IndexType::Index16Bit)
+                    {
+                        *reinterpret_cast<uint16*>(&indices[numIndexBytes]) = uint16(mesh.Index(srcIdx));
+                        *reinterpret_cast<uint16*>(&positionIndices[numIndexBytes]) = uint16(mesh.PositionIndex(srcIdx));
+                    }
+                    else
+                    {
+                        *reinterpret_cast<uint32*>(&indices[numIndexBytes]) = mesh.Index(srcIdx);
+                        *reinterpret_cast<uint32*>(&positionIndices[numIndexBytes]) = mesh.PositionIndex(srcIdx);
+                    }
+                    numIndexBytes += mesh.IndexSize();
+                    ++geometry.IndexCount;
+                }
+            }
+
+            if(geometry.IndexCount > 0)
+                geometryList.Add(geometry);
+        }
+    }
+
+    for(uint64 i = 0; i < textureData.Count(); ++i)
+        delete textureData[i];
+
+    Assert_(geometryList.Count() > 0);
+    geometries.Init(geometryList.Count());
+    for(uint64 i = 0; i < geometryList.Count(); ++i)
+        geometries[i] = geometryList[i];
+
+    {
+        RawBufferInit rbInit;
+        rbInit.NumElements = AlignTo(numIndexBytes, MeshIndexAlignment) / RawBuffer::Stride;
+        rbInit.InitData = indices.Data();
+        rbInit.Name = L"RT Index Buffer";
+        indexBuffer.Initialize(rbInit);
+
+        rbInit.InitData = positionIndices.Data();
+        rbInit.Name = L"RT Position Index Buffer";
+        positionIndexBuffer.Initialize(rbInit);
+    }
+
+    initialized = true;
+
+    timer.Update();
+    WriteLog("Classified triangles against the alpha test in %.2f ms: %llu opaque, %llu transparent, %llu mixed (%llu geometries)",
+             timer.ElapsedMillisecondsD(), numOpaque, numTransparent, numMixed, geometries.Size());
+}
+
+void OpacityClassification::Shutdown()
+{
+    initialized = false;
+    geometries.Shutdown();
+    indexBuffer.Shutdown();
+    positionIndexBuffer.Shutdown();
+
+    numOpaque = 0;
+    numTransparent = 0;
+    numMixed = 0;
+}
@@ -0,0 +1,89 @@
+//=================================================================================================
+//
+//  DXR Path Tracer
+//  by MJP
+//  http://mynameismjp.wordpress.com/
+//
+//  All code and content licensed under the MIT license
+//
+//=================================================================================================
+
+#pragma once
+
+#include <PCH.h>
+
+#include <Containers.h>
+#include <Graphics/GraphicsTypes.h>
+#include <Graphics/Textures.h>
+
+using namespace SampleFramework12;
+
+namespace SampleFramework12
+{
+    class Model;
+}
+
+// Must match the threshold used by the any-hit shaders in RayTrace.hlsl and Baking.hlsl
+static const float AlphaTestThreshold = 0.35f;
+
+enum class TriangleOpacity : uint8
+{
+    Opaque = 0,
+    Transparent,
+    Mixed,
+};
+
+// Conservatively classifies a triangle against the alpha test by visiting every texel that a
+// bilinear sample from inside of the triangle's UV footprint could touch
+TriangleOpacity ClassifyTriangleOpacity(const TextureData<Float4>& opacityMap, Float2 uv0, Float2 uv1, Float2 uv2);
+
+// A contiguous range of triangles from a single mesh that becomes one DXR geometry desc. The
+// indices have the same width as the mesh's own indices, and start on a 4-byte boundary.
+struct OpacityGeometry
+{
+    uint32 MeshIdx = 0;
+    uint32 IndexByteOffset = 0;
+    uint32 IndexCount = 0;
+    bool32 Opaque = false;
+};
+
+// Splits the meshes of a model by how their triangles respond to the alpha test, so that only
+// triangles that are partially cut out need to run an any-hit shader during ray tracing. Fully
+// opaque triangles are grouped into their own opaque geometry, and fully transparent triangles
+// are dropped from the acceleration structure entirely.
+class OpacityClassification
+{
+
+public:
+
+    // Reads back the opacity textures of the model, so this needs to happen before the first frame is submitted
+    void Initialize(const Model& model);
+    void Shutdown();
+
+    bool Initialized() const { return initialized; }
+
+    const Array<OpacityGeometry>& Geometries() const { return geometries; }
+    uint64 NumGeometries() const { return geometries.Size(); }
+
+    // Triangles re-ordered so that the triangles of each geometry are contiguous, using indices
+    // that are relative to the vertex offset of their mesh
+    const RawBuffer& IndexBuffer() const { return indexBuffer; }
+
+    // The same triangles with indices into the model's position-only stream, for building the acceleration structure
+    const RawBuffer& PositionIndexBuffer() const { return positionIndexBuffer; }
+
+    uint64 NumOpaqueTriangles() const { return numOpaque; }
+    uint64 NumTransparentTriangles() const { return numTransparent; }
+    uint64 NumMixedTriangles() const { return numMixed; }
+
+protected:
+
+    bool initialized = false;
+    Array<OpacityGeometry> geometries;
+    RawBuffer indexBuffer;
+    RawBuffer positionIndexBuffer;
+
+    uint64 numOpaque = 0;
+    uint64 numTransparent = 0;
+    uint64 numMixed = 0;
+};
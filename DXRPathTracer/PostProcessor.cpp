@@ -19,11 +19,13 @@ void PostProcessor::Initialize()
     helper.Initialize();
 
     // Load the shaders
-    toneMap = CompileFromFile(L"PostProcessing.hlsl", "ToneMap", ShaderType::Pixel);
-    scale = CompileFromFile(L"PostProcessing.hlsl", "Scale", ShaderType::Pixel);
-    blurH = CompileFromFile(L"PostProcessing.hlsl", "BlurH", ShaderType::Pixel);
-    blurV = CompileFromFile(L"PostProcessing.hlsl", "BlurV", ShaderType::Pixel);
-    bloom = CompileFromFile(L"PostProcessing.hlsl", "Bloom", ShaderType::Pixel);
+    ShaderCompileBatch shaderBatch;
+    shaderBatch.Add(toneMap, L"PostProcessing.hlsl", "ToneMap", ShaderType::Pixel);
+    shaderBatch.Add(scale, L"PostProcessing.hlsl", "Scale", ShaderType::Pixel);
+    shaderBatch.Add(blurH, L"PostProcessing.hlsl", "BlurH", ShaderType::Pixel);
+    shaderBatch.Add(blurV, L"PostProcessing.hlsl", "BlurV", ShaderType::Pixel);
+    shaderBatch.Add(bloom, L"PostProcessing.hlsl", "Bloom", ShaderType::Pixel);
+    shaderBatch.Compile();
 }
 
 void PostProcessor::Shutdown()
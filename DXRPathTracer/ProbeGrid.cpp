@@ -0,0 +1,479 @@
+//=================================================================================================
+//
+//  DXR Path Tracer
+//  by MJP
+//  http://mynameismjp.wordpress.com/
+//
+//  All code and content licensed under the MIT license
+//
+//=================================================================================================
+
+#include <PCH.h>
+
+#include <Tasks.h>
+#include <Graphics/Model.h>
+#include <Graphics/Sampling.h>
+
+#include "ProbeGrid.h"
+
+static const Float3 LuminanceWeights = Float3(0.2126f, 0.7152f, 0.0722f);
+
+static Float3 ComponentMin(const Float3& a, const Float3& b)
+{
+    return Float3(Min(a.x, b.x), Min(a.y, b.y), Min(a.z, b.z));
+}
+
+static Float3 ComponentMax(const Float3& a, const Float3& b)
+{
+    return Float3(Max(a.x, b.x), Max(a.y, b.y), Max(a.z, b.z));
+}
+
+// == ProbeGridLayout =============================================================================
+
+void ProbeGridLayout::Initialize(const Float3& aabbMin, const Float3& aabbMax, float spacing, uint64 maxProbes)
+{
+    Assert_(maxProbes > 0);
+
+    const Float3 extent = aabbMax - aabbMin;
+    Spacing = Max(spacing, 0.01f);
+
+    while(true)
+    {
+        // Probes sit in the center of each grid cell so that they don't end up on the scene's outer walls
+        Dims.x = Max(uint32(std::ceil(extent.x / Spacing)), 1u);
+        Dims.y = Max(uint32(std::ceil(extent.y / Spacing)), 1u);
+        Dims.z = Max(uint32(std::ceil(extent.z / Spacing)), 1u);
+        if(NumProbes() <= maxProbes)
+            break;
+
+        Spacing *= 1.05f;
+    }
+
+    if(Spacing != spacing)
+        WriteLog("Probe grid spacing increased from %.3f to %.3f to stay within %llu probes", spacing, Spacing, maxProbes);
+
+    const Float3 gridSize = Float3(float(Dims.x - 1), float(Dims.y - 1), float(Dims.z - 1)) * Spacing;
+    Origin = (aabbMin + aabbMax) * 0.5f - gridSize * 0.5f;
+}
+
+Float3 ProbeGridLayout::ProbePosition(uint64 probeIdx) const
+{
+    const uint64 x = probeIdx % Dims.x;
+    const uint64 y = (probeIdx / Dims.x) % Dims.y;
+    const uint64 z = probeIdx / (uint64(Dims.x) * Dims.y);
+    return Origin + Float3(float(x), float(y), float(z)) * Spacing;
+}
+
+// == ProbeBakeScene ==============================================================================
+
+void ProbeBakeScene::Initialize(const Model& model)
+{
+    const Array<Mesh>& meshes = model.Meshes();
+
+    uint64 numVertices = 0;
+    uint64 numIndices = 0;
+    for(uint64 meshIdx = 0; meshIdx < meshes.Size(); ++meshIdx)
+    {
+        numVertices = Max<uint64>(numVertices, meshes[meshIdx].VertexOffset() + meshes[meshIdx].NumVertices());
+        numIndices += meshes[meshIdx].NumIndices();
+    }
+
+    Positions.Init(numVertices);
+    Normals.Init(numVertices);
+    const MeshVertex* vertices = model.Vertices();
+    for(uint64 i = 0; i < numVertices; ++i)
+    {
+        Positions[i] = vertices[i].Position;
+        Normals[i] = vertices[i].Normal;
+    }
+
+    // Indices are stored relative to each mesh's vertex range, so rebase them to be global
+    Indices.Init(numIndices);
+    uint64 dstIdx = 0;
+    for(uint64 meshIdx = 0; meshIdx < meshes.Size(); ++meshIdx)
+    {
+        const Mesh& mesh = meshes[meshIdx];
+        for(uint64 i = 0; i < mesh.NumIndices(); ++i)
+            Indices[dstIdx++] = mesh.Index(i) + mesh.VertexOffset();
+    }
+
+    AABBMin = model.AABBMin();
+    AABBMax = model.AABBMax();
+}
+
+void ProbeBakeScene::Initialize(const Float3* positions, const Float3* normals, uint64 numVertices, const uint32* indices, uint64 numIndices)
+{
+    Assert_(numIndices % 3 == 0);
+
+    Positions.Init(numVertices);
+    Normals.Init(numVertices);
+    memcpy(Positions.Data(), positions, numVertices * sizeof(Float3));
+    memcpy(Normals.Data(), normals, numVertices * sizeof(Float3));
+
+    Indices.Init(numIndices);
+    memcpy(Indices.Data(), indices, numIndices * sizeof(uint32));
+
+    AABBMin = Float3(FloatMax, FloatMax, FloatMax);
+    AABBMax = Float3(-FloatMax, -FloatMax, -FloatMax);
+    for(uint64 i = 0; i < numVertices; ++i)
+    {
+        AABBMin = ComponentMin(AABBMin, positions[i]);
+        AABBMax = ComponentMax(AABBMax, positions[i]);
+    }
+}
+
+// == CPU ray tracing =============================================================================
+
+struct TriangleHit
+{
+    float T = FloatMax;
+    float U = 0.0f;
+    float V = 0.0f;
+    uint32 TriangleIdx = uint32(-1);
+};
+
+// Binary BVH over the scene's triangles, split on the median centroid along the widest axis
+class TriangleBVH
+{
+
+public:
+
+    void Build(const ProbeBakeScene& bakeScene)
+    {
+        scene = &bakeScene;
+
+        const uint64 numTriangles = scene->Indices.Size() / 3;
+        triangleOrder.Init(numTriangles);
+        centroids.Init(numTriangles);
+        for(uint64 triIdx = 0; triIdx < numTriangles; ++triIdx)
+        {
+            triangleOrder[triIdx] = uint32(triIdx);
+            centroids[triIdx] = (Vertex(triIdx, 0) + Vertex(triIdx, 1) + Vertex(triIdx, 2)) / 3.0f;
+        }
+
+        nodes.Init(numTriangles * 2 + 1);
+        if(numTriangles > 0)
+            BuildNode(0, uint32(numTriangles));
+
+        centroids.Shutdown();
+    }
+
+    bool Intersect(const Float3& origin, const Float3& dir, float tMax, TriangleHit& hit) const
+    {
+        return Traverse(origin, dir, tMax, false, hit);
+    }
+
+    bool Occluded(const Float3& origin, const Float3& dir, float tMax) const
+    {
+        TriangleHit hit;
+        return Traverse(origin, dir, tMax, true, hit);
+    }
+
+    Float3 Vertex(uint64 triIdx, uint64 vtxIdx) const
+    {
+        return scene->Positions[scene->Indices[triIdx * 3 + vtxIdx]];
+    }
+
+protected:
+
+    struct Node
+    {
+        Float3 BoundsMin;
+        uint32 Offset = 0;          // First triangle for leaves, second child for interior nodes
+        Float3 BoundsMax;
+        uint32 NumTriangles = 0;    // Zero for interior nodes
+    };
+
+    static const uint32 MaxLeafTriangles = 4;
+
+    uint32 BuildNode(uint32 start, uint32 end)
+    {
+        const uint32 nodeIdx = uint32(nodes.Count());
+        nodes.Add(Node());
+
+        Node node;
+        node.BoundsMin = Float3(FloatMax, FloatMax, FloatMax);
+        node.BoundsMax = Float3(-FloatMax, -FloatMax, -FloatMax);
+        Float3 centroidMin = node.BoundsMin;
+        Float3 centroidMax = node.BoundsMax;
+        for(uint32 i = start; i < end; ++i)
+        {
+            const uint32 triIdx = triangleOrder[i];
+            for(uint64 v = 0; v < 3; ++v)
+            {
+                node.BoundsMin = ComponentMin(node.BoundsMin, Vertex(triIdx, v));
+                node.BoundsMax = ComponentMax(node.BoundsMax, Vertex(triIdx, v));
+            }
+
+            centroidMin = ComponentMin(centroidMin, centroids[triIdx]);
+            centroidMax = ComponentMax(centroidMax, centroids[triIdx]);
+        }
+
+        const Float3 centroidExtent = centroidMax - centroidMin;
+        uint32 axis = 0;
+        if(centroidExtent.y > centroidExtent.x)
+            axis = 1;
+        if(centroidExtent.z > centroidExtent[axis])
+            axis = 2;
+
+        if(end - start <= MaxLeafTriangles || centroidExtent[axis] <= 0.0f)
+        {
+            node.Offset = start;
+            node.NumTriangles = end - start;
+            nodes[nodeIdx] = node;
+            return nodeIdx;
+        }
+
+        const uint32 mid = start + (end - start) / 2;
+        std::nth_element(triangleOrder.Data() + start, triangleOrder.Data() + mid, triangleOrder.Data() + end,
+                         [&](uint32 a, uint32 b) { return centroids[a][axis] < centroids[b][axis]; });
+
+        // The first child always immediately follows its parent
+        BuildNode(start, mid);
+        node.Offset = BuildNode(mid, end);
+        nodes[nodeIdx] = node;
+        return nodeIdx;
+    }
+
+    static bool IntersectBounds(const Node& node, const Float3& origin, const Float3& invDir, float tMax)
+    {
+        float tEnter = 0.0f;
+        float tExit = tMax;
+        for(uint32 axis = 0; axis < 3; ++axis)
+        {
+            float t0 = (node.BoundsMin[axis] - origin[axis]) * invDir[axis];
+            float t1 = (node.BoundsMax[axis] - origin[axis]) * invDir[axis];
+            if(t0 > t1)
+                Swap(t0, t1);
+            tEnter = Max(tEnter, t0);
+            tExit = Min(tExit, t1);
+        }
+
+        return tEnter <= tExit;
+    }
+
+    bool IntersectTriangle(uint32 triIdx, const Float3& origin, const Float3& dir, TriangleHit& hit) const
+    {
+        const Float3 v0 = Vertex(triIdx, 0);
+        const Float3 e1 = Vertex(triIdx, 1) - v0;
+        const Float3 e2 = Vertex(triIdx, 2) - v0;
+
+        const Float3 p = Float3::Cross(dir, e2);
+        const float det = Float3::Dot(e1, p);
+        if(std::abs(det) < 1e-12f)
+            return false;
+
+        const float invDet = 1.0f / det;
+        const Float3 s = origin - v0;
+        const float u = Float3::Dot(s, p) * invDet;
+        if(u < 0.0f || u > 1.0f)
+            return false;
+
+        const Float3 q = Float3::Cross(s, e1);
+        const float v = Float3::Dot(dir, q) * invDet;
+        if(v < 0.0f || u + v > 1.0f)
+            return false;
+
+        const float t = Float3::Dot(e2, q) * invDet;
+        if(t <= 0.0f || t >= hit.T)
+            return false;
+
+        hit.T = t;
+        hit.U = u;
+        hit.V = v;
+        hit.TriangleIdx = triIdx;
+        return true;
+    }
+
+    bool Traverse(const Float3& origin, const Float3& dir, float tMax, bool anyHit, TriangleHit& hit) const
+    {
+        if(nodes.Count() == 0)
+            return false;
+
+        const Float3 invDir = Float3(1.0f / dir.x, 1.0f / dir.y, 1.0f / dir.z);
+        hit.T = tMax;
+
+        uint32 stack[64];
+        uint32 stackSize = 0;
+        stack[stackSize++] = 0;
+
+        bool foundHit = false;
+        while(stackSize > 0)
+        {
+            const uint32 nodeIdx = stack[--stackSize];
+            const Node& node = nodes[nodeIdx];
+            if(IntersectBounds(node, origin, invDir, hit.T) == false)
+                continue;
+
+            if(node.NumTriangles > 0)
+            {
+                for(uint32 i = 0; i < node.NumTriangles; ++i)
+                {
+                    if(IntersectTriangle(triangleOrder[node.Offset + i], origin, dir, hit))
+                    {
+                        foundHit = true;
+                        if(anyHit)
+                            return true;
+                    }
+                }
+            }
+            else
+            {
+                Assert_(stackSize + 2 <= ArraySize_(stack));
+                stack[stackSize++] = node.Offset;
+                stack[stackSize++] = nodeIdx + 1;
+            }
+        }
+
+        return foundHit;
+    }
+
+    const ProbeBakeScene* scene = nullptr;
+    Array<uint32> triangleOrder;
+    Array<Float3> centroids;
+    GrowableList<Node> nodes;
+};
+
+void BakeProbeGridCPU(const ProbeBakeScene& scene, const ProbeBakeLighting& lighting, const ProbeGridLayout& layout,
+                      uint64 raysPerProbe, ProbeGridData& output)
+{
+    Assert_(raysPerProbe > 0);
+
+    TriangleBVH bvh;
+    bvh.Build(scene);
+
+    const uint64 numProbes = layout.NumProbes();
+    output.Layout = layout;
+    output.SH.Init(numProbes);
+    output.Validity.Init(numProbes);
+
+    // Every probe uses the same set of directions
+    Array<Float3> rayDirs(raysPerProbe);
+    for(uint64 rayIdx = 0; rayIdx < raysPerProbe; ++rayIdx)
+    {
+        const Float2 u = Hammersley2D(rayIdx, raysPerProbe);
+        rayDirs[rayIdx] = SampleDirectionSphere(u.x, u.y);
+    }
+
+    const Float3 sceneExtent = scene.AABBMax - scene.AABBMin;
+    const float rayBias = Max(Float3::Length(sceneExtent) * 0.00001f, 0.0001f);
+
+    Tasks::ParallelFor(numProbes, [&](uint64 start, uint64 end, uint32 threadNum)
+    {
+        for(uint64 probeIdx = start; probeIdx < end; ++probeIdx)
+        {
+            const Float3 probePos = layout.ProbePosition(probeIdx);
+
+            SH9Color sh;
+            uint64 numBackFaces = 0;
+            for(uint64 rayIdx = 0; rayIdx < raysPerProbe; ++rayIdx)
+            {
+                const Float3 rayDir = rayDirs[rayIdx];
+
+                TriangleHit hit;
+                if(bvh.Intersect(probePos, rayDir, FloatMax, hit) == false)
+                {
+                    sh += ProjectOntoSH9Color(rayDir, EvalSH9(rayDir, lighting.SkySH));
+                    continue;
+                }
+
+                const uint32 idx0 = scene.Indices[hit.TriangleIdx * 3 + 0];
+                const uint32 idx1 = scene.Indices[hit.TriangleIdx * 3 + 1];
+                const uint32 idx2 = scene.Indices[hit.TriangleIdx * 3 + 2];
+                Float3 normal = scene.Normals[idx0] * (1.0f - hit.U - hit.V) + scene.Normals[idx1] * hit.U + scene.Normals[idx2] * hit.V;
+                if(Float3::Length(normal) < 0.0001f)
+                    normal = Float3::Cross(scene.Positions[idx1] - scene.Positions[idx0], scene.Positions[idx2] - scene.Positions[idx0]);
+                normal = Float3::Normalize(normal);
+
+                if(Float3::Dot(normal, rayDir) > 0.0f)
+                {
+                    // Back faces contribute no light, and count towards marking the probe as invalid
+                    ++numBackFaces;
+                    continue;
+                }
+
+                // Single bounce: sky irradiance (without occlusion) plus shadowed sun irradiance
+                Float3 irradiance = EvalSH9Irradiance(normal, lighting.SkySH);
+                if(lighting.EnableSun)
+                {
+                    const float nDotL = Float3::Dot(normal, lighting.SunDirection);
+                    const Float3 hitPos = probePos + rayDir * hit.T + normal * rayBias;
+                    if(nDotL > 0.0f && bvh.Occluded(hitPos, lighting.SunDirection, FloatMax) == false)
+                        irradiance += lighting.SunIrradiance * nDotL;
+                }
+
+                sh += ProjectOntoSH9Color(rayDir, irradiance * (lighting.Albedo * InvPi));
+            }
+
+            sh *= (4.0f * Pi) / float(raysPerProbe);
+
+            output.SH[probeIdx] = sh;
+            output.Validity[probeIdx] = float(numBackFaces) <= ProbeBackFaceThreshold * float(raysPerProbe) ? 1.0f : 0.0f;
+        }
+    }, 4);
+}
+
+void UnpackProbeGridGPUBake(const ProbeGridLayout& layout, const Float4* bakeTexels, uint64 rowPitch, ProbeGridData& output)
+{
+    const uint64 numProbes = layout.NumProbes();
+    output.Layout = layout;
+    output.SH.Init(numProbes);
+    output.Validity.Init(numProbes);
+
+    const uint8* rowData = reinterpret_cast<const uint8*>(bakeTexels);
+    for(uint64 probeIdx = 0; probeIdx < numProbes; ++probeIdx)
+    {
+        const Float4* probeTexels = reinterpret_cast<const Float4*>(rowData + probeIdx * rowPitch);
+        for(uint64 i = 0; i < 9; ++i)
+            output.SH[probeIdx].Coefficients[i] = probeTexels[i].To3D();
+        output.Validity[probeIdx] = probeTexels[9].x <= ProbeBackFaceThreshold ? 1.0f : 0.0f;
+    }
+}
+
+// == ProbeGrid ===================================================================================
+
+void ProbeGrid::Shutdown()
+{
+    gridTexture.Shutdown();
+}
+
+void ProbeGrid::Compress(const ProbeGridData& data, Array<Half4>& texels)
+{
+    const uint64 numProbes = data.Layout.NumProbes();
+    Assert_(data.SH.Size() == numProbes);
+
+    // Probes are stored in x-major order, so TexelsPerProbe consecutive texels along x belong to one probe.
+    // L2 is stored as luminance only and gets its color back from L0 when decompressed in the shader.
+    texels.Init(numProbes * TexelsPerProbe);
+    for(uint64 probeIdx = 0; probeIdx < numProbes; ++probeIdx)
+    {
+        const SH9Color& sh = data.SH[probeIdx];
+        float l2[9] = { };
+        for(uint64 i = 4; i < 9; ++i)
+            l2[i] = Float3::Dot(sh[i], LuminanceWeights);
+
+        Half4* dst = &texels[probeIdx * TexelsPerProbe];
+        dst[0] = Half4(Float4(sh[0], data.Validity[probeIdx]));
+        dst[1] = Half4(Float4(sh[1], l2[4]));
+        dst[2] = Half4(Float4(sh[2], l2[5]));
+        dst[3] = Half4(Float4(sh[3], l2[6]));
+        dst[4] = Half4(l2[7], l2[8], 0.0f, 0.0f);
+    }
+}
+
+void ProbeGrid::Upload(const ProbeGridData& data)
+{
+    Array<Half4> texels;
+    Compress(data, texels);
+
+    layout = data.Layout;
+    Create3DTexture(gridTexture, layout.Dims.x * TexelsPerProbe, layout.Dims.y, layout.Dims.z, 1,
+                    DXGI_FORMAT_R16G16B16A16_FLOAT, texels.Data());
+    gridTexture.Resource->SetName(L"Probe Grid");
+
+    uint64 numValid = 0;
+    for(uint64 i = 0; i < data.Validity.Size(); ++i)
+        numValid += data.Validity[i] > 0.0f ? 1 : 0;
+    WriteLog("Uploaded %ux%ux%u probe grid (%llu of %llu probes valid, %.1f KB)", layout.Dims.x, layout.Dims.y, layout.Dims.z,
+             numValid, layout.NumProbes(), texels.MemorySize() / 1024.0f);
+}
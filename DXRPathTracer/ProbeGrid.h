@@ -0,0 +1,112 @@
+//=================================================================================================
+//
+//  DXR Path Tracer
+//  by MJP
+//  http://mynameismjp.wordpress.com/
+//
+//  All code and content licensed under the MIT license
+//
+//=================================================================================================
+
+#pragma once
+
+#include <PCH.h>
+
+#include <Containers.h>
+#include <Graphics/GraphicsTypes.h>
+#include <Graphics/Textures.h>
+#include <Graphics/SH.h>
+
+using namespace SampleFramework12;
+
+namespace SampleFramework12
+{
+    class Model;
+}
+
+// Regular grid of probes that covers an AABB. The grid is centered inside the AABB, so each probe sits in the middle
+// of a Spacing-sized cell instead of on the AABB's faces, and Origin is the position of probe (0, 0, 0).
+struct ProbeGridLayout
+{
+    Float3 Origin;
+    float Spacing = 1.0f;
+    Uint3 Dims = Uint3(0, 0, 0);
+
+    // Grows the spacing if needed so that the grid never exceeds maxProbes
+    void Initialize(const Float3& aabbMin, const Float3& aabbMax, float spacing, uint64 maxProbes);
+
+    uint64 NumProbes() const { return uint64(Dims.x) * Dims.y * Dims.z; }
+    Float3 ProbePosition(uint64 probeIdx) const;
+};
+
+// Plain triangle soup used for CPU baking, so that probes can be baked without a D3D12 device
+struct ProbeBakeScene
+{
+    Array<Float3> Positions;
+    Array<Float3> Normals;
+    Array<uint32> Indices;
+    Float3 AABBMin;
+    Float3 AABBMax;
+
+    void Initialize(const Model& model);
+    void Initialize(const Float3* positions, const Float3* normals, uint64 numVertices, const uint32* indices, uint64 numIndices);
+};
+
+struct ProbeBakeLighting
+{
+    SH9Color SkySH;
+    Float3 SunDirection = Float3(0.0f, 1.0f, 0.0f);
+    Float3 SunIrradiance;
+    bool EnableSun = true;
+
+    // The CPU baker doesn't have access to material textures, so surfaces use a constant albedo
+    float Albedo = 0.5f;
+};
+
+// Uncompressed bake results, one SH9Color of incoming radiance per probe
+struct ProbeGridData
+{
+    ProbeGridLayout Layout;
+    Array<SH9Color> SH;
+    Array<float> Validity;
+};
+
+// Probes that see back faces for more than this fraction of their rays are considered to be inside geometry
+static const float ProbeBackFaceThreshold = 0.25f;
+
+// Traces raysPerProbe rays from every probe on the task threads and projects the result onto SH
+void BakeProbeGridCPU(const ProbeBakeScene& scene, const ProbeBakeLighting& lighting, const ProbeGridLayout& layout,
+                      uint64 raysPerProbe, ProbeGridData& output);
+
+// Converts the output of the DXR probe bake (see ProbeRayGen in Baking.hlsl) into ProbeGridData
+void UnpackProbeGridGPUBake(const ProbeGridLayout& layout, const Float4* bakeTexels, uint64 rowPitch, ProbeGridData& output);
+
+class ProbeGrid
+{
+
+public:
+
+    // Keeps the DXR bake output within the maximum 2D texture height
+    static const uint64 MaxProbes = 16384;
+
+    // Compressed layout: L0 + validity, then L1 color with one L2 luminance coefficient each,
+    // and a final texel for the remaining two L2 luminance coefficients
+    static const uint64 TexelsPerProbe = 5;
+
+    // Uncompressed DXR bake output: 9 SH coefficients followed by the fraction of back face hits
+    static const uint64 BakeTexelsPerProbe = 10;
+
+    void Shutdown();
+
+    void Upload(const ProbeGridData& data);
+    static void Compress(const ProbeGridData& data, Array<Half4>& texels);
+
+    bool Valid() const { return gridTexture.Valid(); }
+    const Texture& GridTexture() const { return gridTexture; }
+    const ProbeGridLayout& Layout() const { return layout; }
+
+protected:
+
+    Texture gridTexture;
+    ProbeGridLayout layout;
+};
@@ -20,6 +20,8 @@
 
 #include "SharedTypes.h"
 #include "AppSettings.hlsl"
+#include "LightBVH.hlsl"
+#include "EmissiveLights.hlsl"
 
 struct RayTraceConstants
 {
@@ -41,6 +43,13 @@ struct RayTraceConstants
     uint MaterialBufferIdx;
     uint SkyTextureIdx;
     uint NumLights;
+    uint LightBufferIdx;
+    uint LightBVHBufferIdx;
+    uint NumBVHLights;
+    uint EmissiveTriangleBufferIdx;
+    uint EmissiveAliasTableIdx;
+    uint EmissiveBVHBufferIdx;
+    uint NumEmissiveTriangles;
 };
 
 struct LightConstants
@@ -68,6 +77,7 @@ struct PrimaryPayload
     uint PixelIdx;
     uint SampleSetIdx;
     bool IsDiffuse;
+    bool EmissiveSampled;
 };
 
 struct ShadowPayload
@@ -125,6 +135,7 @@ void RaygenShader()
     payload.PixelIdx = pixelIdx;
     payload.SampleSetIdx = sampleSetIdx;
     payload.IsDiffuse = false;
+    payload.EmissiveSampled = false;
 
     uint traceRayFlags = 0;
 
@@ -148,6 +159,108 @@ void RaygenShader()
     RenderTarget[pixelCoord] = float4(newValue, 1.0f);
 }
 
+// Computes the direct lighting from a single spot light, including a shadow ray
+static float3 ShadeSpotLight(in SpotLight spotLight, in float3 positionWS, in float3 normalWS, in float3 diffuseAlbedo, in float3 specularAlbedo,
+                             in float roughness, in float3 incomingRayOriginWS, in float3 msEnergyCompensation, in uint pathLength)
+{
+    float3 surfaceToLight = spotLight.Position - positionWS;
+    float distanceToLight = length(surfaceToLight);
+    surfaceToLight /= distanceToLight;
+    float angleFactor = saturate(dot(surfaceToLight, spotLight.Direction));
+    float angularAttenuation = smoothstep(spotLight.AngularAttenuationY, spotLight.AngularAttenuationX, angleFactor);
+
+    float d = distanceToLight / spotLight.Range;
+    float falloff = saturate(1.0f - (d * d * d * d));
+    falloff = (falloff * falloff) / (distanceToLight * distanceToLight + 1.0f);
+
+    angularAttenuation *= falloff;
+
+    if (angularAttenuation <= 0.0f)
+        return 0.0f;
+
+    // Shoot a shadow ray to see if the light is occluded
+    RayDesc ray;
+    ray.Origin = positionWS + normalWS * 0.01f;
+    ray.Direction = surfaceToLight;
+    ray.TMin = SpotShadowNearClip;
+    ray.TMax = distanceToLight - SpotShadowNearClip;
+
+    ShadowPayload payload;
+    payload.Visibility = 1.0f;
+
+    uint traceRayFlags = RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH;
+
+    // Stop using the any-hit shader once we've hit the max path length, since it's *really* expensive
+    if (pathLength > AppSettings.MaxAnyHitPathLength)
+        traceRayFlags = RAY_FLAG_FORCE_OPAQUE;
+
+    const uint hitGroupOffset = RayTypeShadow;
+    const uint hitGroupGeoMultiplier = NumRayTypes;
+    const uint missShaderIdx = RayTypeShadow;
+    TraceRay(Scene, traceRayFlags, 0xFFFFFFFF, hitGroupOffset, hitGroupGeoMultiplier, missShaderIdx, ray, payload);
+
+    float3 intensity = spotLight.Intensity * angularAttenuation;
+
+    return CalcLighting(normalWS, surfaceToLight, intensity, diffuseAlbedo, specularAlbedo,
+                        roughness, positionWS, incomingRayOriginWS, msEnergyCompensation) * payload.Visibility;
+}
+
+// Computes the direct lighting from a uniformly-sampled point on an emissive triangle, including a shadow ray.
+// The result still needs to be divided by the probability of having picked the triangle.
+static float3 ShadeEmissiveTriangle(in EmissiveTriangle emissiveTriangle, in float2 pointSample, in float3 positionWS, in float3 normalWS,
+                                    in float3 diffuseAlbedo, in float3 specularAlbedo, in float roughness, in float3 incomingRayOriginWS,
+                                    in float3 msEnergyCompensation, in uint pathLength)
+{
+    const float2 barycentrics = SampleTriangleBarycentrics(pointSample);
+    const float3 lightPos = emissiveTriangle.Position0 + (emissiveTriangle.Position1 - emissiveTriangle.Position0) * barycentrics.x +
+                            (emissiveTriangle.Position2 - emissiveTriangle.Position0) * barycentrics.y;
+    const float2 lightUV = emissiveTriangle.UV0 + (emissiveTriangle.UV1 - emissiveTriangle.UV0) * barycentrics.x +
+                           (emissiveTriangle.UV2 - emissiveTriangle.UV0) * barycentrics.y;
+    const float3 lightNormal = normalize(cross(emissiveTriangle.Position1 - emissiveTriangle.Position0, emissiveTriangle.Position2 - emissiveTriangle.Position0));
+
+    float3 surfaceToLight = lightPos - positionWS;
+    const float distSq = dot(surfaceToLight, surfaceToLight);
+    const float distanceToLight = sqrt(distSq);
+    surfaceToLight /= distanceToLight;
+
+    // Emissive surfaces emit from both sides, matching what the path tracer sees when it hits them
+    const float cosLight = abs(dot(lightNormal, surfaceToLight));
+    if(cosLight <= 0.0f || dot(normalWS, surfaceToLight) <= 0.0f)
+        return 0.0f;
+
+    Texture2D emissiveMap = ResourceDescriptorHeap[NonUniformResourceIndex(emissiveTriangle.EmissiveTextureIdx)];
+    const float3 emission = emissiveMap.SampleLevel(MeshSampler, lightUV, 0.0f).xyz;
+    if(all(emission <= 0.0f))
+        return 0.0f;
+
+    // Shoot a shadow ray to see if the light is occluded, stopping just short of the emitter itself
+    RayDesc ray;
+    ray.Origin = positionWS + normalWS * 0.01f;
+    ray.Direction = surfaceToLight;
+    ray.TMin = 0.00001f;
+    ray.TMax = distanceToLight * 0.999f;
+
+    ShadowPayload payload;
+    payload.Visibility = 1.0f;
+
+    uint traceRayFlags = RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH;
+
+    // Stop using the any-hit shader once we've hit the max path length, since it's *really* expensive
+    if (pathLength > AppSettings.MaxAnyHitPathLength)
+        traceRayFlags = RAY_FLAG_FORCE_OPAQUE;
+
+    const uint hitGroupOffset = RayTypeShadow;
+    const uint hitGroupGeoMultiplier = NumRayTypes;
+    const uint missShaderIdx = RayTypeShadow;
+    TraceRay(Scene, traceRayFlags, 0xFFFFFFFF, hitGroupOffset, hitGroupGeoMultiplier, missShaderIdx, ray, payload);
+
+    // Convert the area PDF (1 / Area) to solid angle, which turns the radiance into the irradiance from this sample
+    const float3 irradiance = emission * cosLight * emissiveTriangle.Area / distSq;
+
+    return CalcLighting(normalWS, surfaceToLight, irradiance, diffuseAlbedo, specularAlbedo,
+                        roughness, positionWS, incomingRayOriginWS, msEnergyCompensation) * payload.Visibility;
+}
+
 static float3 PathTrace(in MeshVertex hitSurface, in Material material, in PrimaryPayload inPayload)
 {
     if((!AppSettings.EnableDiffuse && !AppSettings.EnableSpecular) ||
@@ -185,8 +298,9 @@ static float3 PathTrace(in MeshVertex hitSurface, in Material material, in Prima
         baseColor = albedoMap.SampleLevel(MeshSampler, hitSurface.UV, 0.0f).xyz;
     }
 
-    Texture2D metallicMap = ResourceDescriptorHeap[NonUniformResourceIndex(material.Metallic)];
-    const float metallic = saturate((AppSettings.EnableWhiteFurnaceMode ? 1.0f : metallicMap.SampleLevel(MeshSampler, hitSurface.UV, 0.0f).x) * AppSettings.MetallicScale);
+    Texture2D roughnessMetallicMap = ResourceDescriptorHeap[NonUniformResourceIndex(material.RoughnessMetallicOpacity)];
+    const float2 roughnessMetallic = AppSettings.EnableWhiteFurnaceMode ? 1.0f : roughnessMetallicMap.SampleLevel(MeshSampler, hitSurface.UV, 0.0f).xy;
+    const float metallic = saturate(roughnessMetallic.y * AppSettings.MetallicScale);
 
     const bool enableDiffuse = (AppSettings.EnableDiffuse && metallic < 1.0f) || AppSettings.EnableWhiteFurnaceMode;
     const bool enableSpecular = (AppSettings.EnableSpecular && (AppSettings.EnableIndirectSpecular ? !(AppSettings.AvoidCausticPaths && inPayload.IsDiffuse) : (inPayload.PathLength == 1)));
@@ -194,8 +308,7 @@ static float3 PathTrace(in MeshVertex hitSurface, in Material material, in Prima
     if(enableDiffuse == false && enableSpecular == false)
         return 0.0f;
 
-    Texture2D roughnessMap = ResourceDescriptorHeap[NonUniformResourceIndex(material.Roughness)];
-    const float sqrtRoughness = saturate((AppSettings.EnableWhiteFurnaceMode ? 1.0f : roughnessMap.SampleLevel(MeshSampler, hitSurface.UV, 0.0f).x) * AppSettings.RoughnessScale);
+    const float sqrtRoughness = saturate(roughnessMetallic.x * AppSettings.RoughnessScale);
 
     const float3 diffuseAlbedo = lerp(baseColor, 0.0f, metallic) * (enableDiffuse ? 1.0f : 0.0f);
     const float3 specularAlbedo = lerp(0.03f, baseColor, metallic) * (enableSpecular ? 1.0f : 0.0f);
@@ -220,6 +333,10 @@ static float3 PathTrace(in MeshVertex hitSurface, in Material material, in Prima
     Texture2D emissiveMap = ResourceDescriptorHeap[NonUniformResourceIndex(material.Emissive)];
     float3 radiance = AppSettings.EnableWhiteFurnaceMode ? 0.0.xxx : emissiveMap.SampleLevel(MeshSampler, hitSurface.UV, 0.0f).xyz;
 
+    // The previous vertex already accounted for emissive surfaces through next-event estimation
+    if(inPayload.EmissiveSampled)
+        radiance = 0.0.xxx;
+
     //Apply sun light
     if(AppSettings.EnableSun && !AppSettings.EnableWhiteFurnaceMode)
     {
@@ -262,53 +379,63 @@ static float3 PathTrace(in MeshVertex hitSurface, in Material material, in Prima
     }
 
     // Apply spot lights
-    if (AppSettings.RenderLights)
+    if(AppSettings.RenderLights)
     {
-        //iterate all lights
-        for (uint spotLightIdx = 0; spotLightIdx < RayTraceCB.NumLights; spotLightIdx++)
+        if(AppSettings.UseLightBVH && RayTraceCB.NumBVHLights > 0)
         {
-            SpotLight spotLight = LightCBuffer.Lights[spotLightIdx];
-
-            float3 surfaceToLight = spotLight.Position - positionWS;
-            float distanceToLight = length(surfaceToLight);
-            surfaceToLight /= distanceToLight;
-            float angleFactor = saturate(dot(surfaceToLight, spotLight.Direction));
-            float angularAttenuation = smoothstep(spotLight.AngularAttenuationY, spotLight.AngularAttenuationX, angleFactor);
-
-            float d = distanceToLight / spotLight.Range;
-            float falloff = saturate(1.0f - (d * d * d * d));
-            falloff = (falloff * falloff) / (distanceToLight * distanceToLight + 1.0f);
+            // Pick a few lights by walking the light BVH, instead of shading every light in the scene
+            StructuredBuffer<SpotLight> lightBuffer = ResourceDescriptorHeap[RayTraceCB.LightBufferIdx];
+            StructuredBuffer<LightBVHNode> lightBVH = ResourceDescriptorHeap[RayTraceCB.LightBVHBufferIdx];
 
-            angularAttenuation *= falloff;
-
-            if (angularAttenuation > 0.0f)
+            const uint numLightSamples = uint(AppSettings.NumLightSamples);
+            for(uint sampleIdx = 0; sampleIdx < numLightSamples; ++sampleIdx)
             {
-                // Shoot a shadow ray to see if the sun is occluded
-                RayDesc ray;
-                ray.Origin = positionWS + normalWS * 0.01f;
-                ray.Direction = surfaceToLight;
-                ray.TMin = SpotShadowNearClip;
-                ray.TMax = distanceToLight - SpotShadowNearClip;
-
-                ShadowPayload payload;
-                payload.Visibility = 1.0f;
+                const float lightSample = SamplePoint(inPayload.PixelIdx, inPayload.SampleSetIdx).x;
 
-                uint traceRayFlags = RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH;
-
-                // Stop using the any-hit shader once we've hit the max path length, since it's *really* expensive
-                if (inPayload.PathLength > AppSettings.MaxAnyHitPathLength)
-                    traceRayFlags = RAY_FLAG_FORCE_OPAQUE;
+                uint spotLightIdx = 0;
+                float lightPdf = 0.0f;
+                if(SampleLightBVH(lightBVH, positionWS, normalWS, lightSample, spotLightIdx, lightPdf))
+                    radiance += ShadeSpotLight(lightBuffer[spotLightIdx], positionWS, normalWS, diffuseAlbedo, specularAlbedo, roughness,
+                                               incomingRayOriginWS, msEnergyCompensation, inPayload.PathLength) / (lightPdf * numLightSamples);
+            }
+        }
+        else
+        {
+            //iterate all lights
+            for (uint spotLightIdx = 0; spotLightIdx < RayTraceCB.NumLights; spotLightIdx++)
+                radiance += ShadeSpotLight(LightCBuffer.Lights[spotLightIdx], positionWS, normalWS, diffuseAlbedo, specularAlbedo, roughness,
+                                           incomingRayOriginWS, msEnergyCompensation, inPayload.PathLength);
+        }
+    }
 
-                const uint hitGroupOffset = RayTypeShadow;
-                const uint hitGroupGeoMultiplier = NumRayTypes;
-                const uint missShaderIdx = RayTypeShadow;
-                TraceRay(Scene, traceRayFlags, 0xFFFFFFFF, hitGroupOffset, hitGroupGeoMultiplier, missShaderIdx, ray, payload);
+    // Apply emissive triangles
+    const bool sampleEmissive = AppSettings.SampleEmissiveTriangles && RayTraceCB.NumEmissiveTriangles > 0 && !AppSettings.EnableWhiteFurnaceMode;
+    if(sampleEmissive)
+    {
+        StructuredBuffer<EmissiveTriangle> triangleBuffer = ResourceDescriptorHeap[RayTraceCB.EmissiveTriangleBufferIdx];
 
-                float3 intensity = spotLight.Intensity * angularAttenuation;
+        const uint numLightSamples = uint(AppSettings.NumLightSamples);
+        for(uint sampleIdx = 0; sampleIdx < numLightSamples; ++sampleIdx)
+        {
+            const float selectionSample = SamplePoint(inPayload.PixelIdx, inPayload.SampleSetIdx).x;
+            const float2 pointSample = SamplePoint(inPayload.PixelIdx, inPayload.SampleSetIdx);
 
-                radiance += CalcLighting(normalWS, surfaceToLight, intensity, diffuseAlbedo, specularAlbedo,
-                                         roughness, positionWS, incomingRayOriginWS, msEnergyCompensation) * payload.Visibility;
+            uint triangleIdx = 0;
+            float selectionPdf = 0.0f;
+            if(AppSettings.UseEmissiveBVH)
+            {
+                StructuredBuffer<LightBVHNode> emissiveBVH = ResourceDescriptorHeap[RayTraceCB.EmissiveBVHBufferIdx];
+                if(SampleLightBVH(emissiveBVH, positionWS, normalWS, selectionSample, triangleIdx, selectionPdf) == false)
+                    continue;
             }
+            else
+            {
+                StructuredBuffer<AliasTableEntry> aliasTable = ResourceDescriptorHeap[RayTraceCB.EmissiveAliasTableIdx];
+                triangleIdx = SampleAliasTable(aliasTable, RayTraceCB.NumEmissiveTriangles, selectionSample, selectionPdf);
+            }
+
+            radiance += ShadeEmissiveTriangle(triangleBuffer[triangleIdx], pointSample, positionWS, normalWS, diffuseAlbedo, specularAlbedo, roughness,
+                                              incomingRayOriginWS, msEnergyCompensation, inPayload.PathLength) / (selectionPdf * numLightSamples);
         }
     }
 
@@ -393,6 +520,7 @@ static float3 PathTrace(in MeshVertex hitSurface, in Material material, in Prima
         payload.PixelIdx = inPayload.PixelIdx;
         payload.SampleSetIdx = inPayload.SampleSetIdx;
         payload.IsDiffuse = (selector < 0.5f);
+        payload.EmissiveSampled = sampleEmissive;
         payload.Roughness = roughness;
 
         uint traceRayFlags = 0;
@@ -448,17 +576,29 @@ MeshVertex GetHitSurface(in HitAttributes attr, in uint geometryIdx)
     StructuredBuffer<GeometryInfo> geoInfoBuffer = ResourceDescriptorHeap[RayTraceCB.GeometryInfoBufferIdx];
     const GeometryInfo geoInfo = geoInfoBuffer[geometryIdx];
 
-    StructuredBuffer<MeshVertex> vtxBuffer = ResourceDescriptorHeap[RayTraceCB.VtxBufferIdx];
-    Buffer<uint> idxBuffer = ResourceDescriptorHeap[RayTraceCB.IdxBufferIdx];
+    ByteAddressBuffer idxBuffer = ResourceDescriptorHeap[RayTraceCB.IdxBufferIdx];
 
-    const uint primIdx = PrimitiveIndex();
-    const uint idx0 = idxBuffer[primIdx * 3 + geoInfo.IdxOffset + 0];
-    const uint idx1 = idxBuffer[primIdx * 3 + geoInfo.IdxOffset + 1];
-    const uint idx2 = idxBuffer[primIdx * 3 + geoInfo.IdxOffset + 2];
+    const uint3 triIndices = LoadTriangleIndices(idxBuffer, geoInfo.IdxByteOffset, PrimitiveIndex(), geoInfo.Index16Bit != 0);
+    const uint idx0 = triIndices.x;
+    const uint idx1 = triIndices.y;
+    const uint idx2 = triIndices.z;
 
-    const MeshVertex vtx0 = vtxBuffer[idx0 + geoInfo.VtxOffset];
-    const MeshVertex vtx1 = vtxBuffer[idx1 + geoInfo.VtxOffset];
-    const MeshVertex vtx2 = vtxBuffer[idx2 + geoInfo.VtxOffset];
+    // VtxBufferIdx points at the compressed vertex buffer when compressed vertices are enabled
+    MeshVertex vtx0, vtx1, vtx2;
+    if(AppSettings.UseCompressedVertices)
+    {
+        StructuredBuffer<CompressedMeshVertex> vtxBuffer = ResourceDescriptorHeap[RayTraceCB.VtxBufferIdx];
+        vtx0 = DecompressMeshVertex(vtxBuffer[idx0 + geoInfo.VtxOffset], geoInfo.QuantizationMin, geoInfo.QuantizationScale);
+        vtx1 = DecompressMeshVertex(vtxBuffer[idx1 + geoInfo.VtxOffset], geoInfo.QuantizationMin, geoInfo.QuantizationScale);
+        vtx2 = DecompressMeshVertex(vtxBuffer[idx2 + geoInfo.VtxOffset], geoInfo.QuantizationMin, geoInfo.QuantizationScale);
+    }
+    else
+    {
+        StructuredBuffer<MeshVertex> vtxBuffer = ResourceDescriptorHeap[RayTraceCB.VtxBufferIdx];
+        vtx0 = vtxBuffer[idx0 + geoInfo.VtxOffset];
+        vtx1 = vtxBuffer[idx1 + geoInfo.VtxOffset];
+        vtx2 = vtxBuffer[idx2 + geoInfo.VtxOffset];
+    }
 
     return BarycentricLerp(vtx0, vtx1, vtx2, barycentrics);
 }
@@ -489,8 +629,8 @@ void AnyHitShader(inout PrimaryPayload payload, in HitAttributes attr)
     const Material material = GetGeometryMaterial(GeometryIndex());
 
     // Standard alpha testing
-    Texture2D opacityMap = ResourceDescriptorHeap[NonUniformResourceIndex(material.Opacity)];
-    if(opacityMap.SampleLevel(MeshSampler, hitSurface.UV, 0.0f).x < 0.35f)
+    Texture2D opacityMap = ResourceDescriptorHeap[NonUniformResourceIndex(material.RoughnessMetallicOpacity)];
+    if(opacityMap.SampleLevel(MeshSampler, hitSurface.UV, 0.0f).z < 0.35f)
         IgnoreHit();
 }
 
@@ -501,8 +641,8 @@ void ShadowAnyHitShader(inout ShadowPayload payload, in HitAttributes attr)
     const Material material = GetGeometryMaterial(GeometryIndex());
 
     // Standard alpha testing
-    Texture2D opacityMap = ResourceDescriptorHeap[NonUniformResourceIndex(material.Opacity)];
-    if(opacityMap.SampleLevel(MeshSampler, hitSurface.UV, 0.0f).x < 0.35f)
+    Texture2D opacityMap = ResourceDescriptorHeap[NonUniformResourceIndex(material.RoughnessMetallicOpacity)];
+    if(opacityMap.SampleLevel(MeshSampler, hitSurface.UV, 0.0f).z < 0.35f)
         IgnoreHit();
 }
 
@@ -37,6 +37,11 @@ struct ShadingConstants
     float NearClip;
     float FarClip;
 
+    float3 ProbeGridOrigin;
+    float ProbeGridSpacing;
+    uint3 ProbeGridDims;
+    uint ProbeGridIdx;
+
     SH9Color SkySH;
 };
 
@@ -71,6 +76,74 @@ struct ShadingInput
     LightConstants LightCBuffer;
 };
 
+//-------------------------------------------------------------------------------------------------
+// Loads and decompresses the SH coefficients for a single probe (see ProbeGrid::Compress). L2 is
+// only stored as luminance, so the chroma of L0 is used to turn it back into color.
+//-------------------------------------------------------------------------------------------------
+SH9Color LoadProbeSH(in Texture3D gridTexture, in int3 probeCoord, out float validity)
+{
+    const int3 texelCoord = int3(probeCoord.x * 5, probeCoord.yz);
+    const float4 t0 = gridTexture[texelCoord + int3(0, 0, 0)];
+    const float4 t1 = gridTexture[texelCoord + int3(1, 0, 0)];
+    const float4 t2 = gridTexture[texelCoord + int3(2, 0, 0)];
+    const float4 t3 = gridTexture[texelCoord + int3(3, 0, 0)];
+    const float4 t4 = gridTexture[texelCoord + int3(4, 0, 0)];
+
+    const float3 chroma = t0.xyz / max(dot(t0.xyz, float3(0.2126f, 0.7152f, 0.0722f)), 0.0001f);
+
+    SH9Color sh;
+    sh.c[0] = t0.xyz;
+    sh.c[1] = t1.xyz;
+    sh.c[2] = t2.xyz;
+    sh.c[3] = t3.xyz;
+    sh.c[4] = chroma * t1.w;
+    sh.c[5] = chroma * t2.w;
+    sh.c[6] = chroma * t3.w;
+    sh.c[7] = chroma * t4.x;
+    sh.c[8] = chroma * t4.y;
+
+    validity = t0.w;
+    return sh;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Trilinearly interpolates the 8 probes surrounding a point, skipping probes that were marked
+// as being inside geometry. Returns false if none of the probes are valid.
+//-------------------------------------------------------------------------------------------------
+bool SampleProbeGridIrradiance(in float3 positionWS, in float3 normalWS, in ShadingConstants CBuffer, out float3 irradiance)
+{
+    irradiance = 0.0f;
+
+    Texture3D gridTexture = Tex3DTable[CBuffer.ProbeGridIdx];
+    const int3 maxCoord = int3(CBuffer.ProbeGridDims) - 1;
+    const float3 gridPos = clamp((positionWS - CBuffer.ProbeGridOrigin) / CBuffer.ProbeGridSpacing, 0.0f, float3(maxCoord));
+    const int3 baseCoord = min(int3(gridPos), maxCoord);
+    const float3 alpha = gridPos - baseCoord;
+
+    SH9Color sh = (SH9Color)0;
+    float weightSum = 0.0f;
+
+    [unroll]
+    for(uint i = 0; i < 8; ++i)
+    {
+        const int3 offset = int3(i & 1, (i >> 1) & 1, i >> 2);
+        const float3 trilinear = lerp(1.0f - alpha, alpha, float3(offset));
+
+        float validity = 0.0f;
+        const SH9Color probeSH = LoadProbeSH(gridTexture, min(baseCoord + offset, maxCoord), validity);
+
+        const float weight = trilinear.x * trilinear.y * trilinear.z * validity;
+        sh = SHAdd(sh, SHScale(probeSH, weight));
+        weightSum += weight;
+    }
+
+    if(weightSum <= 0.0001f)
+        return false;
+
+    irradiance = EvalSH9Irradiance(normalWS, SHScale(sh, 1.0f / weightSum));
+    return true;
+}
+
 //-------------------------------------------------------------------------------------------------
 // Calculates the full shading result for a single pixel. Note: some of the input textures
 // are passed directly to this function instead of through the ShadingInput struct in order to
@@ -227,8 +300,15 @@ float3 ShadePixel(in ShadingInput input, in Texture2DArray sunShadowMap,
 
     if(AppSettings.EnableIndirect)
     {
-        float3 ambient = EvalSH9Irradiance(normalWS, CBuffer.SkySH) * InvPi;
-        ambient *= 0.1f; // Darken the ambient since we don't have any sky occlusion
+        float3 irradiance = 0.0f;
+        const bool useProbeGrid = AppSettings.EnableProbeGrid && CBuffer.ProbeGridIdx != uint(-1);
+        if(useProbeGrid == false || SampleProbeGridIrradiance(positionWS, normalWS, CBuffer, irradiance) == false)
+        {
+            irradiance = EvalSH9Irradiance(normalWS, CBuffer.SkySH);
+            irradiance *= 0.1f; // Darken the ambient since we don't have any sky occlusion
+        }
+
+        float3 ambient = irradiance * InvPi;
         output += ambient * diffuseAlbedo;
     }
 
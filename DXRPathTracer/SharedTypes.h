@@ -31,9 +31,7 @@ struct Material
 {
     uint Albedo;
     uint Normal;
-    uint Roughness;
-    uint Metallic;
-    uint Opacity;
+    uint RoughnessMetallicOpacity;  // Packed into R, G and B, with opacity set to 1 for materials without a map
     uint Emissive;
 };
 
@@ -55,10 +53,57 @@ struct ClusterBounds
     uint2 ZBounds;
 };
 
+// Positions of CompressedMeshVertex are dequantized as (QuantizationMin + position * QuantizationScale).
+// Indices are 16-bit or 32-bit per geometry, starting at a 4-byte aligned offset in a raw index buffer.
 struct GeometryInfo
 {
     uint VtxOffset;
-    uint IdxOffset;
+    uint IdxByteOffset;
     uint MaterialIdx;
+    uint Index16Bit;
+    float3 QuantizationMin;
+    uint PadTo32Bytes;
+    float3 QuantizationScale;
+    uint PadTo48Bytes;
+};
+
+// Flattened light BVH node. Interior nodes store their second child, the first child always
+// directly follows its parent. Cone angles are in radians.
+struct LightBVHNode
+{
+    float3 BoundsMin;
+    uint ChildOrLightIdx;
+    float3 BoundsMax;
+    uint IsLeaf;
+    float3 ConeAxis;
+    float ConeThetaO;
+    float ConeThetaE;
+    float Power;
+    float MaxRange;
+    uint PadTo64Bytes;
+};
+
+// World-space emissive triangle extracted from the scene for next-event estimation. Power is the
+// total flux leaving both sides of the triangle, integrated from its emissive texture.
+struct EmissiveTriangle
+{
+    float3 Position0;
+    float Area;
+    float3 Position1;
+    uint EmissiveTextureIdx;
+    float3 Position2;
+    float Power;
+    float2 UV0;
+    float2 UV1;
+    float2 UV2;
+    float2 PadTo64Bytes;
+};
+
+// Entry of a Walker/Vose alias table. Pmf is the probability of sampling this entry overall.
+struct AliasTableEntry
+{
+    float Probability;
+    uint Alias;
+    float Pmf;
     uint PadTo16Bytes;
 };
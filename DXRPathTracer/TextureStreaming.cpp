@@ -0,0 +1,297 @@
+//=================================================================================================
+//
+//  DXR Path Tracer
+//  by MJP
+//  http://mynameismjp.wordpress.com/
+//
+//  All code and content licensed under the MIT license
+//
+//=================================================================================================
+
+#include <PCH.h>
+
+#include <Graphics/Textures.h>
+
+#include "TextureStreaming.h"
+
+// UV units per world unit over the triangles of a mesh part, from the ratio of their total areas
+static float MeshPartUVDensity(const Model& model, const Mesh& mesh, const MeshPart& part)
+{
+    const MeshVertex* vertices = model.Vertices();
+
+    double worldArea = 0.0;
+    double uvArea = 0.0;
+    for(uint64 triIdx = 0; triIdx < part.IndexCount / 3; ++triIdx)
+    {
+        MeshVertex triVertices[3];
+        for(uint64 i = 0; i < 3; ++i)
+        {
+            const uint32 idx = mesh.Index(part.IndexStart + triIdx * 3 + i);
+            triVertices[i] = vertices[idx + mesh.VertexOffset()];
+        }
+
+        const Float3 edge0 = triVertices[1].Position - triVertices[0].Position;
+        const Float3 edge1 = triVertices[2].Position - triVertices[0].Position;
+        worldArea += Float3::Length(Float3::Cross(edge0, edge1)) * 0.5;
+
+        const Float2 uvEdge0 = triVertices[1].UV - triVertices[0].UV;
+        const Float2 uvEdge1 = triVertices[2].UV - triVertices[0].UV;
+        uvArea += std::abs(uvEdge0.x * uvEdge1.y - uvEdge0.y * uvEdge1.x) * 0.5;
+    }
+
+    return worldArea > 0.0 ? float(std::sqrt(uvArea / worldArea)) : 0.0f;
+}
+
+void TextureStreamer::Initialize(uint64 budget)
+{
+    Shutdown();
+
+    manager.Initialize(this, budget);
+    textures.Init(256);
+    models.Init(8);
+    queuedLoads.Init(256);
+}
+
+void TextureStreamer::Shutdown()
+{
+    loadTask.Wait();
+    loads.Shutdown();
+    queuedLoads.Shutdown();
+
+    manager.Shutdown();
+    textures.Shutdown();
+
+    for(uint64 i = 0; i < models.Count(); ++i)
+        delete models[i];
+    models.Shutdown();
+    numReduced = 0;
+    residencyChanged = false;
+}
+
+void TextureStreamer::AddModel(const Model& model)
+{
+    for(uint64 i = 0; i < models.Count(); ++i)
+        if(models[i]->SourceModel == &model)
+            return;
+
+    StreamedModel* streamedModel = new StreamedModel();
+    streamedModel->SourceModel = &model;
+
+    const GrowableList<MaterialTexture*>& materialTextures = model.MaterialTextures();
+    streamedModel->TextureIndices.Init(materialTextures.Count(), uint32(-1));
+    for(uint64 i = 0; i < materialTextures.Count(); ++i)
+    {
+        MaterialTexture* matTexture = materialTextures[i];
+        const Texture& texture = matTexture->Texture;
+        if(texture.Valid() == false || texture.Cubemap || texture.ArraySize != 1 || texture.Depth != 1 || texture.NumMips <= 1)
+            continue;
+
+        StreamedTexture streamedTexture;
+        streamedTexture.MatTexture = matTexture;
+        streamedTexture.FullDesc = texture.Resource->GetDesc();
+
+        // Block compressed textures need their top mip to be a multiple of the block size
+        uint32 maxFirstMip = texture.NumMips - 1;
+        if(DirectX::IsCompressed(streamedTexture.FullDesc.Format))
+        {
+            maxFirstMip = 0;
+            while(maxFirstMip + 1 < texture.NumMips && ((texture.Width >> (maxFirstMip + 1)) % 4) == 0 &&
+                  ((texture.Height >> (maxFirstMip + 1)) % 4) == 0)
+                ++maxFirstMip;
+        }
+
+        textures.Add(streamedTexture);
+        streamedModel->TextureIndices[i] = manager.AddTexture(texture.Width, texture.Height, texture.NumMips, maxFirstMip);
+        Assert_(streamedModel->TextureIndices[i] == textures.Count() - 1);
+    }
+
+    uint64 numParts = 0;
+    for(uint64 meshIdx = 0; meshIdx < model.NumMeshes(); ++meshIdx)
+        numParts += model.Meshes()[meshIdx].NumMeshParts();
+
+    streamedModel->PartUVDensities.Init(numParts);
+    uint64 partIdx = 0;
+    for(uint64 meshIdx = 0; meshIdx < model.NumMeshes(); ++meshIdx)
+    {
+        const Mesh& mesh = model.Meshes()[meshIdx];
+        for(uint64 i = 0; i < mesh.NumMeshParts(); ++i)
+            streamedModel->PartUVDensities[partIdx++] = MeshPartUVDensity(model, mesh, mesh.MeshParts()[i]);
+    }
+
+    models.Add(streamedModel);
+}
+
+bool TextureStreamer::Update(const Model& model, const PerspectiveCamera& camera, float viewportHeight, uint64 budget)
+{
+    const StreamedModel* streamedModel = nullptr;
+    for(uint64 i = 0; i < models.Count() && streamedModel == nullptr; ++i)
+        if(models[i]->SourceModel == &model)
+            streamedModel = models[i];
+    Assert_(streamedModel != nullptr);
+
+    manager.SetBudget(budget);
+
+    const float projectionScale = viewportHeight / (2.0f * std::tan(camera.FieldOfView() * 0.5f));
+    const Array<MeshMaterial>& materials = model.Materials();
+    uint64 partIdx = 0;
+    for(uint64 meshIdx = 0; meshIdx < model.NumMeshes(); ++meshIdx)
+    {
+        const Mesh& mesh = model.Meshes()[meshIdx];
+        const float pixelsPerUnit = TextureResidencyManager::ProjectedPixelsPerUnit(mesh.AABBMin(), mesh.AABBMax(), camera.Position(),
+                                                                                    projectionScale, camera.NearClip());
+
+        for(uint64 i = 0; i < mesh.NumMeshParts(); ++i)
+        {
+            const MeshPart& part = mesh.MeshParts()[i];
+            const float uvDensity = streamedModel->PartUVDensities[partIdx++];
+            const MeshMaterial& material = materials[part.MaterialIdx];
+            for(uint64 texType = 0; texType < uint64(MaterialTextures::Count); ++texType)
+            {
+                const uint32 matTextureIdx = material.TextureIndices[texType];
+                if(matTextureIdx == uint32(-1) || streamedModel->TextureIndices[matTextureIdx] == uint32(-1))
+                    continue;
+
+                manager.RequestTexture(streamedModel->TextureIndices[matTextureIdx], uvDensity, pixelsPerUnit);
+            }
+        }
+    }
+
+    manager.Update();
+    ProcessStreamIns();
+
+    const bool changed = residencyChanged;
+    residencyChanged = false;
+    return changed;
+}
+
+bool TextureStreamer::RestoreFullResolution()
+{
+    // Loads that were started while streaming was on still need to be swapped in
+    if(numReduced > 0)
+    {
+        manager.SetBudget(uint64(-1));
+        for(uint32 i = 0; i < textures.Count(); ++i)
+            manager.RequestMip(i, 0);
+
+        manager.Update();
+    }
+
+    ProcessStreamIns();
+
+    const bool changed = residencyChanged;
+    residencyChanged = false;
+    return changed;
+}
+
+// Swaps in the textures from the last load task once it's done, and then starts a new one for whatever was queued
+// since. A texture whose target changed while it was loading gets whatever it needs now, since the file always has
+// every mip. Loads for textures that were streamed back out in the meantime are thrown away.
+void TextureStreamer::ProcessStreamIns()
+{
+    if(loadTask.Finished() == false)
+        return;
+
+    loadTask.Wait();
+
+    for(uint64 i = 0; i < loads.Size(); ++i)
+    {
+        StreamInLoad& load = loads[i];
+        StreamedTexture& streamedTexture = textures[load.TextureIdx];
+        MaterialTexture& matTexture = *streamedTexture.MatTexture;
+        streamedTexture.Loading = false;
+        if(streamedTexture.TargetMip >= streamedTexture.FirstMip)
+            continue;
+
+        if(FAILED(load.Result) || load.FileData.Metadata().mipLevels != streamedTexture.FullDesc.MipLevels)
+        {
+            WriteLog(L"Failed to stream in texture '%ls'", matTexture.Name.c_str());
+            manager.StreamInFailed(load.TextureIdx, streamedTexture.FirstMip);
+            if(streamedTexture.TargetMip == 0)
+                numReduced += 1;
+            streamedTexture.TargetMip = streamedTexture.FirstMip;
+            continue;
+        }
+
+        StreamTextureMips(matTexture.Texture, load.FileData, streamedTexture.TargetMip, matTexture.SRGB, matTexture.Name.c_str());
+        streamedTexture.FirstMip = streamedTexture.TargetMip;
+        residencyChanged = true;
+    }
+
+    loads.Shutdown();
+
+    uint64 numLoads = 0;
+    uint64 loadBytes = 0;
+    uint64 numDispatched = 0;
+    for(; numDispatched < queuedLoads.Count() && loadBytes < MaxLoadBytesPerTask; ++numDispatched)
+    {
+        StreamedTexture& streamedTexture = textures[queuedLoads[numDispatched]];
+        if(streamedTexture.TargetMip >= streamedTexture.FirstMip)
+        {
+            streamedTexture.Loading = false;
+            continue;
+        }
+
+        loadBytes += TextureMipChainSize(streamedTexture.FullDesc, 0);
+        ++numLoads;
+    }
+
+    if(numLoads > 0)
+    {
+        loads.Init(numLoads);
+        uint64 loadIdx = 0;
+        for(uint64 i = 0; i < numDispatched; ++i)
+        {
+            const uint32 textureIdx = queuedLoads[i];
+            if(textures[textureIdx].Loading == false)
+                continue;
+
+            loads[loadIdx].TextureIdx = textureIdx;
+            loads[loadIdx].MatTexture = textures[textureIdx].MatTexture;
+            ++loadIdx;
+        }
+        Assert_(loadIdx == numLoads);
+
+        loadTask.Start([this]()
+        {
+            for(uint64 i = 0; i < loads.Size(); ++i)
+                loads[i].Result = LoadMaterialTextureFile(*loads[i].MatTexture, loads[i].FileData);
+        });
+    }
+
+    if(numDispatched > 0)
+        queuedLoads.RemoveMultiple(0, numDispatched);
+}
+
+uint64 TextureStreamer::ResidentSize(uint32 textureIdx, uint32 firstMip)
+{
+    return TextureMipChainSize(textures[textureIdx].FullDesc, firstMip);
+}
+
+bool TextureStreamer::SetFirstResidentMip(uint32 textureIdx, uint32 firstMip)
+{
+    StreamedTexture& streamedTexture = textures[textureIdx];
+    MaterialTexture& matTexture = *streamedTexture.MatTexture;
+    if(firstMip == streamedTexture.TargetMip)
+        return true;
+
+    if(firstMip > streamedTexture.FirstMip)
+    {
+        DropTextureMips(matTexture.Texture, firstMip - streamedTexture.FirstMip, matTexture.Name.c_str());
+        streamedTexture.FirstMip = firstMip;
+        residencyChanged = true;
+    }
+    else if(firstMip < streamedTexture.FirstMip && streamedTexture.Loading == false)
+    {
+        // The manager counts the memory right away, and ProcessStreamIns() reverts it if the load fails
+        streamedTexture.Loading = true;
+        queuedLoads.Add(textureIdx);
+    }
+
+    if(streamedTexture.TargetMip == 0)
+        numReduced += 1;
+    if(firstMip == 0)
+        numReduced -= 1;
+    streamedTexture.TargetMip = firstMip;
+
+    return true;
+}
@@ -0,0 +1,96 @@
+//=================================================================================================
+//
+//  DXR Path Tracer
+//  by MJP
+//  http://mynameismjp.wordpress.com/
+//
+//  All code and content licensed under the MIT license
+//
+//=================================================================================================
+
+#pragma once
+
+#include <PCH.h>
+
+#include <Containers.h>
+#include <Tasks.h>
+#include <Graphics/Camera.h>
+#include <Graphics/Model.h>
+#include <Graphics/TextureResidency.h>
+
+using namespace SampleFramework12;
+
+// Streams the mips of material textures against a memory budget, using the residency manager to decide what each
+// texture needs. Every mesh part requests its material's textures with the UV density of its triangles and the
+// distance from the camera to the bounds of its mesh. Meshes outside of the view still make requests, since the
+// path tracer and the baker can see them through reflections and indirect lighting. The textures of every loaded
+// model stay registered, so scenes that aren't being shown are the first to give up their memory.
+//
+// Streaming in reloads the texture through the texture cache on a task thread, and the mips it needs are uploaded
+// once that finishes. Streaming out copies the remaining mips into a smaller texture on the GPU right away. Either
+// way the texture keeps its SRV index.
+class TextureStreamer : public TextureResidencyBackend
+{
+
+public:
+
+    void Initialize(uint64 budget);
+    void Shutdown();
+
+    // Registers the material textures of a model, unless it was already added
+    void AddModel(const Model& model);
+
+    // These return true if any texture changed resolution on the GPU
+    bool Update(const Model& model, const PerspectiveCamera& camera, float viewportHeight, uint64 budget);
+
+    // Streams every texture back to its full mip chain regardless of the budget, for when streaming is turned off.
+    // This is still limited to a bounded amount of data per frame.
+    bool RestoreFullResolution();
+
+    const TextureResidencyStats& Stats() const { return manager.Stats(); }
+
+    // TextureResidencyBackend
+    uint64 ResidentSize(uint32 textureIdx, uint32 firstMip) override;
+    bool SetFirstResidentMip(uint32 textureIdx, uint32 firstMip) override;
+
+protected:
+
+    struct StreamedTexture
+    {
+        MaterialTexture* MatTexture = nullptr;
+        D3D12_RESOURCE_DESC FullDesc = { };
+        uint32 FirstMip = 0;            // What's on the GPU
+        uint32 TargetMip = 0;           // What the residency manager asked for, which can be finer while it loads
+        bool Loading = false;
+    };
+
+    struct StreamInLoad
+    {
+        uint32 TextureIdx = uint32(-1);
+        const MaterialTexture* MatTexture = nullptr;    // Since the list of textures can grow while this loads
+        TextureFileData FileData;
+        HRESULT Result = S_OK;
+    };
+
+    // Limits how much file data a single load task reads, so that a large stream-in can't hold up the rest
+    static const uint64 MaxLoadBytesPerTask = 64 * 1024 * 1024;
+
+    void ProcessStreamIns();
+
+    struct StreamedModel
+    {
+        const Model* SourceModel = nullptr;
+        Array<uint32> TextureIndices;       // Residency index for each of the model's material textures
+        Array<float> PartUVDensities;       // For the mesh parts of every mesh, in order
+    };
+
+    TextureResidencyManager manager;
+    GrowableList<StreamedTexture> textures;
+    GrowableList<StreamedModel*> models;
+    uint64 numReduced = 0;
+    bool residencyChanged = false;
+
+    GrowableList<uint32> queuedLoads;
+    Array<StreamInLoad> loads;
+    AsyncTask loadTask;
+};
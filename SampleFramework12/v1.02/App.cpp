@@ -17,6 +17,7 @@
 #include "FileIO.h"
 #include "Settings.h"
 #include "ImGuiHelper.h"
+#include "Tasks.h"
 #include "ImGui/imgui.h"
 
 // AppSettings framework
@@ -169,6 +170,8 @@ void App::ParseCommandLine(const wchar* cmdLine)
 
 void App::Initialize_Internal()
 {
+    Tasks::Initialize();
+
     DX12::Initialize(minFeatureLevel, adapterIdx);
 
     window.SetClientArea(swapChain.Width(), swapChain.Height());
@@ -209,6 +212,8 @@ void App::Shutdown_Internal()
     Shutdown();
 
     DX12::Shutdown();
+
+    Tasks::Shutdown();
 }
 
 void App::Update_Internal()
@@ -0,0 +1,831 @@
+//=================================================================================================
+//
+//  MJP's DX12 Sample Framework
+//  http://mynameismjp.wordpress.com/
+//
+//  All code licensed under the MIT license
+//
+//=================================================================================================
+
+#include "PCH.h"
+
+#include "EXRWriter.h"
+#include "Assert.h"
+#include "Tasks.h"
+#include "TinyEXR.h"
+
+namespace SampleFramework12
+{
+
+static const uint32 EXRMagic = 20000630;
+static const uint32 EXRVersion = 2;
+static const uint32 EXRTiledFlag = 0x200;
+static const int ZIPLevel = 4;
+
+// Upper bound on the amount of Float4 rows that are buffered or compressed in one batch
+static const uint64 MaxBatchSize = 32 * 1024 * 1024;
+
+// Channels are stored in alphabetical order, so the components get written out as A, B, G, R
+static const char* ChannelNames[4] = { "A", "B", "G", "R" };
+static const uint32 ChannelComponents[4] = { 3, 2, 1, 0 };
+
+// == Header ======================================================================================
+
+template<typename T> static void AppendValue(std::vector<uint8>& data, const T& value)
+{
+    const uint8* bytes = reinterpret_cast<const uint8*>(&value);
+    data.insert(data.end(), bytes, bytes + sizeof(T));
+}
+
+static void AppendString(std::vector<uint8>& data, const char* str)
+{
+    data.insert(data.end(), str, str + strlen(str) + 1);
+}
+
+template<typename T> static std::vector<uint8> AttributeValue(const T& value)
+{
+    std::vector<uint8> data;
+    AppendValue(data, value);
+    return data;
+}
+
+static void AppendAttribute(std::vector<uint8>& header, const char* name, const char* type, const std::vector<uint8>& value)
+{
+    AppendString(header, name);
+    AppendString(header, type);
+    AppendValue(header, int32(value.size()));
+    header.insert(header.end(), value.begin(), value.end());
+}
+
+// == Packing =====================================================================================
+
+// Converts a block of pixels to the layout of an uncompressed chunk, where each line has all of the values for
+// the first channel followed by all of the values for the next channel, and so on
+static void PackPixels(const uint8* rows, uint64 rowPitch, uint32 x0, uint32 blockWidth, uint32 blockHeight,
+                       uint32 numChannels, EXRPixelType pixelType, uint8* dst)
+{
+    for(uint32 y = 0; y < blockHeight; ++y)
+    {
+        const Float4* srcRow = reinterpret_cast<const Float4*>(rows + y * rowPitch) + x0;
+        for(uint32 c = 4 - numChannels; c < 4; ++c)
+        {
+            const float* srcValues = &srcRow[0].x + ChannelComponents[c];
+            if(pixelType == EXRPixelType::Half)
+            {
+                DirectX::PackedVector::XMConvertFloatToHalfStream(reinterpret_cast<uint16*>(dst), sizeof(uint16),
+                                                                  srcValues, sizeof(Float4), blockWidth);
+                dst += blockWidth * sizeof(uint16);
+            }
+            else
+            {
+                float* dstValues = reinterpret_cast<float*>(dst);
+                for(uint32 x = 0; x < blockWidth; ++x)
+                    dstValues[x] = srcValues[x * 4];
+                dst += blockWidth * sizeof(float);
+            }
+        }
+    }
+}
+
+// == ZIP =========================================================================================
+
+// The bytes are split into two halves by even and odd position and delta encoded before being deflated, which
+// puts the similar high bytes of neighboring values next to each other
+static uint64 CompressZIP(const uint8* src, uint64 srcSize, Array<uint8>& dst)
+{
+    Array<uint8> reordered(srcSize);
+    const uint64 half = (srcSize + 1) / 2;
+    for(uint64 i = 0; i < srcSize; ++i)
+        reordered[(i & 1) ? half + i / 2 : i / 2] = src[i];
+
+    uint8 prev = reordered[0];
+    for(uint64 i = 1; i < srcSize; ++i)
+    {
+        const uint8 curr = reordered[i];
+        reordered[i] = uint8(int32(curr) - int32(prev) + 128);
+        prev = curr;
+    }
+
+    dst.Init(CompressZlibBound(srcSize));
+    return CompressZlib(dst.Data(), dst.Size(), reordered.Data(), srcSize, ZIPLevel);
+}
+
+// == PIZ =========================================================================================
+
+// The encoder side of OpenEXR's PIZ compression: the 16-bit values are remapped to a dense range, run through a
+// 2D Haar wavelet transform, and then Huffman coded. The layout of the output has to match the OpenEXR decoder
+// exactly, so the code below follows the structure of ImfPizCompressor.cpp, ImfWav.cpp and ImfHuf.cpp.
+
+static const uint32 PIZBitmapSize = 65536 / 8;
+
+static const int32 HufEncBits = 16;
+static const int32 HufEncSize = (1 << HufEncBits) + 1;
+static const int32 ShortZeroCodeRun = 59;
+static const int32 LongZeroCodeRun = 63;
+static const int32 ShortestLongRun = 2 + LongZeroCodeRun - ShortZeroCodeRun;
+static const int32 LongestLongRun = 255 + ShortestLongRun;
+
+static const int32 WaveletNBits = 16;
+static const int32 WaveletAOffset = 1 << (WaveletNBits - 1);
+static const int32 WaveletMOffset = 1 << (WaveletNBits - 1);
+static const int32 WaveletModMask = (1 << WaveletNBits) - 1;
+
+static void WaveletEncode14(uint16 a, uint16 b, uint16& l, uint16& h)
+{
+    const int16 as = int16(a);
+    const int16 bs = int16(b);
+
+    const int32 ms = (as + bs) >> 1;
+    const int32 ds = as - bs;
+
+    l = uint16(ms);
+    h = uint16(ds);
+}
+
+static void WaveletEncode16(uint16 a, uint16 b, uint16& l, uint16& h)
+{
+    const int32 ao = (a + WaveletAOffset) & WaveletModMask;
+    int32 m = (ao + b) >> 1;
+    const int32 d = ao - b;
+
+    if(d < 0)
+        m = (m + WaveletMOffset) & WaveletModMask;
+
+    l = uint16(m);
+    h = uint16(d & WaveletModMask);
+}
+
+// In-place 2D wavelet transform of an nx * ny block of values, where ox and oy are the distances between values
+// along x and y. The 14-bit variant is lossless for values up to 2^14 and compresses better.
+static void Wavelet2DEncode(uint16* data, uint32 nx, uint32 ox, uint32 ny, uint32 oy, uint16 maxValue)
+{
+    const bool w14 = maxValue < (1 << 14);
+    const uint32 n = Min(nx, ny);
+    uint32 p = 1;
+    uint32 p2 = 2;
+
+    while(p2 <= n)
+    {
+        uint16* py = data;
+        uint16* ey = data + oy * (ny - p2);
+        const uint32 oy1 = oy * p;
+        const uint32 oy2 = oy * p2;
+        const uint32 ox1 = ox * p;
+        const uint32 ox2 = ox * p2;
+        uint16 i00 = 0;
+        uint16 i01 = 0;
+        uint16 i10 = 0;
+        uint16 i11 = 0;
+
+        for(; py <= ey; py += oy2)
+        {
+            uint16* px = py;
+            uint16* ex = py + ox * (nx - p2);
+
+            for(; px <= ex; px += ox2)
+            {
+                uint16* p01 = px + ox1;
+                uint16* p10 = px + oy1;
+                uint16* p11 = p10 + ox1;
+
+                if(w14)
+                {
+                    WaveletEncode14(*px, *p01, i00, i01);
+                    WaveletEncode14(*p10, *p11, i10, i11);
+                    WaveletEncode14(i00, i10, *px, *p10);
+                    WaveletEncode14(i01, i11, *p01, *p11);
+                }
+                else
+                {
+                    WaveletEncode16(*px, *p01, i00, i01);
+                    WaveletEncode16(*p10, *p11, i10, i11);
+                    WaveletEncode16(i00, i10, *px, *p10);
+                    WaveletEncode16(i01, i11, *p01, *p11);
+                }
+            }
+
+            // Odd column
+            if(nx & p)
+            {
+                uint16* p10 = px + oy1;
+
+                if(w14)
+                    WaveletEncode14(*px, *p10, i00, *p10);
+                else
+                    WaveletEncode16(*px, *p10, i00, *p10);
+
+                *px = i00;
+            }
+        }
+
+        // Odd line
+        if(ny & p)
+        {
+            uint16* px = py;
+            uint16* ex = py + ox * (nx - p2);
+
+            for(; px <= ex; px += ox2)
+            {
+                uint16* p01 = px + ox1;
+
+                if(w14)
+                    WaveletEncode14(*px, *p01, i00, *p01);
+                else
+                    WaveletEncode16(*px, *p01, i00, *p01);
+
+                *px = i00;
+            }
+        }
+
+        p = p2;
+        p2 <<= 1;
+    }
+}
+
+// Per-thread working memory for PIZ, which is too big to allocate for every chunk
+struct PIZScratch
+{
+    Array<uint16> Words;
+    Array<uint16> LUT;
+    Array<int64> Frequencies;
+    Array<int64> Codes;
+    Array<int32> Links;
+    Array<int64*> Heap;
+
+    void Init()
+    {
+        if(LUT.Size() > 0)
+            return;
+
+        LUT.Init(65536);
+        Frequencies.Init(HufEncSize);
+        Codes.Init(HufEncSize);
+        Links.Init(HufEncSize);
+        Heap.Init(HufEncSize);
+    }
+};
+
+// Packs bits MSB-first, the way the OpenEXR Huffman decoder reads them
+struct BitWriter
+{
+    uint8* Out = nullptr;
+    uint64 Bits = 0;
+    int32 NumBits = 0;
+
+    void Write(int32 numBits, uint64 bits)
+    {
+        Bits = (Bits << numBits) | bits;
+        NumBits += numBits;
+
+        while(NumBits >= 8)
+        {
+            NumBits -= 8;
+            *Out++ = uint8(Bits >> NumBits);
+        }
+    }
+
+    // Codes store their length in the low 6 bits
+    void WriteCode(int64 code)
+    {
+        Write(int32(code & 63), uint64(code) >> 6);
+    }
+
+    void Flush()
+    {
+        if(NumBits > 0)
+            *Out++ = uint8(Bits << (8 - NumBits));
+        NumBits = 0;
+    }
+};
+
+// Turns the code lengths in the table into canonical codes, with the length stored in the low 6 bits
+static void HuffmanCanonicalCodes(int64* codes)
+{
+    int64 counts[59] = { };
+    for(int32 i = 0; i < HufEncSize; ++i)
+        counts[codes[i]] += 1;
+
+    int64 c = 0;
+    for(int32 i = 58; i > 0; --i)
+    {
+        const int64 nc = (c + counts[i]) >> 1;
+        counts[i] = c;
+        c = nc;
+    }
+
+    for(int32 i = 0; i < HufEncSize; ++i)
+    {
+        const int64 l = codes[i];
+        if(l > 0)
+            codes[i] = l | (counts[l]++ << 6);
+    }
+}
+
+// Builds the code table from the symbol frequencies, returning the range of symbols that are used. The symbol
+// after the last used one is added as the pseudo-symbol for runs of repeated symbols.
+static void HuffmanBuildCodes(PIZScratch& scratch, int32& minSymbol, int32& maxSymbol)
+{
+    int64* frequencies = scratch.Frequencies.Data();
+    int64* codes = scratch.Codes.Data();
+    int32* links = scratch.Links.Data();
+    int64** heap = scratch.Heap.Data();
+
+    minSymbol = 0;
+    while(frequencies[minSymbol] == 0)
+        ++minSymbol;
+
+    int32 numSymbols = 0;
+    maxSymbol = minSymbol;
+    for(int32 i = minSymbol; i < HufEncSize; ++i)
+    {
+        links[i] = i;
+        if(frequencies[i] != 0)
+        {
+            heap[numSymbols++] = &frequencies[i];
+            maxSymbol = i;
+        }
+    }
+
+    maxSymbol += 1;
+    frequencies[maxSymbol] = 1;
+    heap[numSymbols++] = &frequencies[maxSymbol];
+
+    auto heapCompare = [](const int64* a, const int64* b) { return *a > *b; };
+    std::make_heap(heap, heap + numSymbols, heapCompare);
+
+    // Repeatedly merge the two least frequent sets of symbols, adding a bit to the code length of every symbol in
+    // both of them. The sets are linked lists threaded through the links array.
+    memset(codes, 0, sizeof(int64) * HufEncSize);
+    while(numSymbols > 1)
+    {
+        std::pop_heap(heap, heap + numSymbols, heapCompare);
+        const int32 mm = int32(heap[--numSymbols] - frequencies);
+
+        std::pop_heap(heap, heap + numSymbols, heapCompare);
+        const int32 m = int32(heap[--numSymbols] - frequencies);
+
+        frequencies[m] += frequencies[mm];
+        std::push_heap(heap, heap + ++numSymbols, heapCompare);
+
+        for(int32 j = m; ; j = links[j])
+        {
+            codes[j] += 1;
+            Assert_(codes[j] <= 58);
+            if(links[j] == j)
+            {
+                links[j] = mm;
+                break;
+            }
+        }
+
+        for(int32 j = mm; ; j = links[j])
+        {
+            codes[j] += 1;
+            Assert_(codes[j] <= 58);
+            if(links[j] == j)
+                break;
+        }
+    }
+
+    HuffmanCanonicalCodes(codes);
+}
+
+// Writes out the code lengths, with runs of unused symbols collapsed
+static void HuffmanPackCodes(const int64* codes, int32 minSymbol, int32 maxSymbol, BitWriter& writer)
+{
+    for(; minSymbol <= maxSymbol; ++minSymbol)
+    {
+        const int64 length = codes[minSymbol] & 63;
+
+        if(length == 0)
+        {
+            int32 zeroRun = 1;
+            while(minSymbol < maxSymbol && zeroRun < LongestLongRun)
+            {
+                if((codes[minSymbol + 1] & 63) > 0)
+                    break;
+                ++minSymbol;
+                ++zeroRun;
+            }
+
+            if(zeroRun >= 2)
+            {
+                if(zeroRun >= ShortestLongRun)
+                {
+                    writer.Write(6, uint64(LongZeroCodeRun));
+                    writer.Write(8, uint64(zeroRun - ShortestLongRun));
+                }
+                else
+                {
+                    writer.Write(6, uint64(ShortZeroCodeRun + zeroRun - 2));
+                }
+                continue;
+            }
+        }
+
+        writer.Write(6, uint64(length));
+    }
+
+    writer.Flush();
+}
+
+static void HuffmanSendCode(int64 symbolCode, int32 runCount, int64 runCode, BitWriter& writer)
+{
+    // A run is only worth it if it's shorter than repeating the symbol
+    if((symbolCode & 63) + (runCode & 63) + 8 < (symbolCode & 63) * runCount)
+    {
+        writer.WriteCode(symbolCode);
+        writer.WriteCode(runCode);
+        writer.Write(8, uint64(runCount));
+    }
+    else
+    {
+        while(runCount-- >= 0)
+            writer.WriteCode(symbolCode);
+    }
+}
+
+// Huffman codes the values, returning the size of the output. dst needs enough room for the worst case, which
+// is bounded by HuffmanCompressBound().
+static uint64 HuffmanCompress(const uint16* values, uint64 numValues, uint8* dst, PIZScratch& scratch)
+{
+    if(numValues == 0)
+        return 0;
+
+    int64* frequencies = scratch.Frequencies.Data();
+    memset(frequencies, 0, sizeof(int64) * HufEncSize);
+    for(uint64 i = 0; i < numValues; ++i)
+        frequencies[values[i]] += 1;
+
+    int32 minSymbol = 0;
+    int32 maxSymbol = 0;
+    HuffmanBuildCodes(scratch, minSymbol, maxSymbol);
+    const int64* codes = scratch.Codes.Data();
+
+    // 20 byte header: symbol range, table size, and the number of bits of encoded data
+    uint8* tableStart = dst + 20;
+    BitWriter writer;
+    writer.Out = tableStart;
+    HuffmanPackCodes(codes, minSymbol, maxSymbol, writer);
+    uint8* dataStart = writer.Out;
+
+    const int64 runCode = codes[maxSymbol];
+    writer = BitWriter();
+    writer.Out = dataStart;
+
+    uint16 symbol = values[0];
+    int32 runCount = 0;
+    for(uint64 i = 1; i < numValues; ++i)
+    {
+        if(symbol == values[i] && runCount < 255)
+        {
+            ++runCount;
+        }
+        else
+        {
+            HuffmanSendCode(codes[symbol], runCount, runCode, writer);
+            runCount = 0;
+        }
+
+        symbol = values[i];
+    }
+    HuffmanSendCode(codes[symbol], runCount, runCode, writer);
+
+    const uint64 numDataBits = uint64(writer.Out - dataStart) * 8 + writer.NumBits;
+    writer.Flush();
+
+    const uint32 header[5] = { uint32(minSymbol), uint32(maxSymbol), uint32(dataStart - tableStart), uint32(numDataBits), 0 };
+    memcpy(dst, header, sizeof(header));
+
+    return uint64(writer.Out - dst);
+}
+
+static uint64 HuffmanCompressBound(uint64 numValues)
+{
+    // Header, 6 bits for every entry of the code table, and 58 bits for the longest possible code
+    return 20 + (HufEncSize * 6 + 7) / 8 + (numValues * 58 + 7) / 8;
+}
+
+static uint64 CompressPIZ(const uint8* src, uint64 srcSize, uint32 blockWidth, uint32 blockHeight, uint32 numChannels,
+                          uint32 wordsPerValue, PIZScratch& scratch, Array<uint8>& dst)
+{
+    // Each channel gets gathered into one contiguous block, since that's what the wavelet transform runs on
+    const uint64 numWords = srcSize / sizeof(uint16);
+    const uint64 lineWords = uint64(blockWidth) * wordsPerValue;
+    const uint64 channelWords = lineWords * blockHeight;
+    const uint16* srcWords = reinterpret_cast<const uint16*>(src);
+    scratch.Init();
+    if(scratch.Words.Size() < numWords)
+        scratch.Words.Init(numWords);
+    uint16* words = scratch.Words.Data();
+    for(uint32 y = 0; y < blockHeight; ++y)
+        for(uint32 c = 0; c < numChannels; ++c)
+            memcpy(&words[c * channelWords + y * lineWords], srcWords + (uint64(y) * numChannels + c) * lineWords,
+                   lineWords * sizeof(uint16));
+
+    // Figure out which values are actually used, with 0 always treated as unused
+    uint8 bitmap[PIZBitmapSize] = { };
+    for(uint64 i = 0; i < numWords; ++i)
+        bitmap[words[i] >> 3] |= uint8(1 << (words[i] & 7));
+    bitmap[0] &= uint8(~1);
+
+    uint16 minNonZero = uint16(PIZBitmapSize - 1);
+    uint16 maxNonZero = 0;
+    for(uint16 i = 0; i < PIZBitmapSize; ++i)
+    {
+        if(bitmap[i])
+        {
+            minNonZero = Min(minNonZero, i);
+            maxNonZero = Max(maxNonZero, i);
+        }
+    }
+
+    // Remap the used values to a dense range, which keeps the wavelet coefficients small
+    uint16* lut = scratch.LUT.Data();
+    uint32 numUsed = 0;
+    for(uint32 i = 0; i < 65536; ++i)
+    {
+        if(i == 0 || (bitmap[i >> 3] & (1 << (i & 7))))
+            lut[i] = uint16(numUsed++);
+        else
+            lut[i] = 0;
+    }
+
+    const uint16 maxValue = uint16(numUsed - 1);
+    for(uint64 i = 0; i < numWords; ++i)
+        words[i] = lut[words[i]];
+
+    for(uint32 c = 0; c < numChannels; ++c)
+        for(uint32 j = 0; j < wordsPerValue; ++j)
+            Wavelet2DEncode(&words[c * channelWords + j], blockWidth, wordsPerValue, blockHeight, uint32(lineWords), maxValue);
+
+    dst.Init(4 + PIZBitmapSize + 4 + HuffmanCompressBound(numWords));
+    uint8* out = dst.Data();
+    memcpy(out, &minNonZero, sizeof(uint16));
+    memcpy(out + 2, &maxNonZero, sizeof(uint16));
+    out += 4;
+
+    if(minNonZero <= maxNonZero)
+    {
+        memcpy(out, &bitmap[minNonZero], maxNonZero - minNonZero + 1);
+        out += maxNonZero - minNonZero + 1;
+    }
+
+    const uint64 huffmanSize = HuffmanCompress(words, numWords, out + 4, scratch);
+    const int32 huffmanSize32 = int32(huffmanSize);
+    memcpy(out, &huffmanSize32, sizeof(int32));
+    out += 4 + huffmanSize;
+
+    return uint64(out - dst.Data());
+}
+
+// == EXRWriter ===================================================================================
+
+void EXRWriter::Begin(const wchar* filePath, uint32 imageWidth, uint32 imageHeight, const EXRWriteSettings& writeSettings)
+{
+    Assert_(writing == false);
+    Assert_(imageWidth > 0 && imageHeight > 0);
+    Assert_(writeSettings.Tiled == false || writeSettings.TileSize > 0);
+
+    timer = Timer();
+    path = filePath;
+    settings = writeSettings;
+    width = imageWidth;
+    height = imageHeight;
+    numChannels = settings.WriteAlpha ? 4 : 3;
+
+    if(settings.Tiled)
+    {
+        chunkWidth = settings.TileSize;
+        chunkHeight = settings.TileSize;
+    }
+    else
+    {
+        chunkWidth = width;
+        if(settings.Compression == EXRCompression::PIZ)
+            chunkHeight = 32;
+        else if(settings.Compression == EXRCompression::ZIP)
+            chunkHeight = 16;
+        else
+            chunkHeight = 1;
+    }
+
+    chunksPerRow = (width + chunkWidth - 1) / chunkWidth;
+    const uint32 numChunkRows = (height + chunkHeight - 1) / chunkHeight;
+    const uint64 chunkRowSize = uint64(chunkHeight) * width * sizeof(Float4);
+    maxRowsPerBatch = uint32(Max<uint64>(MaxBatchSize / chunkRowSize, 1) * chunkHeight);
+
+    nextRow = 0;
+    nextChunk = 0;
+    numStagedRows = 0;
+    stats = EXRWriteStats();
+
+    std::vector<uint8> header;
+    AppendValue(header, EXRMagic);
+    AppendValue(header, EXRVersion | (settings.Tiled ? EXRTiledFlag : 0));
+
+    std::vector<uint8> channelList;
+    for(uint32 c = 4 - numChannels; c < 4; ++c)
+    {
+        AppendString(channelList, ChannelNames[c]);
+        AppendValue(channelList, uint32(settings.PixelType));
+        AppendValue(channelList, uint32(0));        // pLinear + 3 reserved bytes
+        AppendValue(channelList, int32(1));         // xSampling
+        AppendValue(channelList, int32(1));         // ySampling
+    }
+    channelList.push_back(0);
+
+    const int32 window[4] = { 0, 0, int32(width) - 1, int32(height) - 1 };
+    const float screenWindowCenter[2] = { 0.0f, 0.0f };
+
+    AppendAttribute(header, "channels", "chlist", channelList);
+    AppendAttribute(header, "compression", "compression", AttributeValue(uint8(settings.Compression)));
+    AppendAttribute(header, "dataWindow", "box2i", AttributeValue(window));
+    AppendAttribute(header, "displayWindow", "box2i", AttributeValue(window));
+    AppendAttribute(header, "lineOrder", "lineOrder", AttributeValue(uint8(0)));
+    AppendAttribute(header, "pixelAspectRatio", "float", AttributeValue(1.0f));
+    AppendAttribute(header, "screenWindowCenter", "v2f", AttributeValue(screenWindowCenter));
+    AppendAttribute(header, "screenWindowWidth", "float", AttributeValue(1.0f));
+
+    if(settings.Tiled)
+    {
+        std::vector<uint8> tileDesc;
+        AppendValue(tileDesc, uint32(chunkWidth));
+        AppendValue(tileDesc, uint32(chunkHeight));
+        AppendValue(tileDesc, uint8(0));            // One level, rounded down
+        AppendAttribute(header, "tiles", "tiledesc", tileDesc);
+    }
+
+    header.push_back(0);
+
+    // The offset table gets filled in at the end, once the size of every chunk is known
+    chunkOffsets.Init(uint64(chunksPerRow) * numChunkRows, 0);
+
+    file.Open(filePath, FileOpenMode::Write);
+    file.Write(header.size(), header.data());
+    offsetTablePosition = header.size();
+    file.Write(chunkOffsets.MemorySize(), chunkOffsets.Data());
+    fileOffset = offsetTablePosition + chunkOffsets.MemorySize();
+
+    writing = true;
+}
+
+void EXRWriter::WriteRows(const Float4* rows, uint64 numRows, uint64 rowPitch)
+{
+    Assert_(writing);
+    Assert_(nextRow + numRows <= height);
+
+    if(rowPitch == 0)
+        rowPitch = width * sizeof(Float4);
+
+    const uint8* src = reinterpret_cast<const uint8*>(rows);
+    while(numRows > 0)
+    {
+        if(numStagedRows == 0)
+        {
+            // Whole chunks can be compressed straight from the caller's rows, and so can the last partial chunk
+            uint64 directRows = (numRows / chunkHeight) * chunkHeight;
+            if(nextRow + numRows == height)
+                directRows = numRows;
+            directRows = Min<uint64>(directRows, maxRowsPerBatch);
+
+            if(directRows > 0)
+            {
+                CompressRows(src, rowPitch, uint32(directRows));
+                src += directRows * rowPitch;
+                numRows -= directRows;
+                nextRow += uint32(directRows);
+                continue;
+            }
+        }
+
+        // Anything else is buffered until there's a full batch of chunks, or the image is done
+        if(stagingRows.Size() == 0)
+            stagingRows.Init(uint64(maxRowsPerBatch) * width);
+
+        const uint32 numToStage = uint32(Min<uint64>(numRows, maxRowsPerBatch - numStagedRows));
+        for(uint32 i = 0; i < numToStage; ++i)
+            memcpy(&stagingRows[uint64(numStagedRows + i) * width], src + i * rowPitch, width * sizeof(Float4));
+
+        src += numToStage * rowPitch;
+        numRows -= numToStage;
+        nextRow += numToStage;
+        numStagedRows += numToStage;
+
+        if(numStagedRows == maxRowsPerBatch || nextRow == height)
+        {
+            CompressRows(reinterpret_cast<const uint8*>(stagingRows.Data()), width * sizeof(Float4), numStagedRows);
+            numStagedRows = 0;
+        }
+    }
+}
+
+void EXRWriter::CompressRows(const uint8* rows, uint64 rowPitch, uint32 numRows)
+{
+    const uint32 firstChunkRow = nextChunk / chunksPerRow;
+    const uint32 numChunkRows = (numRows + chunkHeight - 1) / chunkHeight;
+    const uint32 numChunks = numChunkRows * chunksPerRow;
+    Assert_(nextChunk + numChunks <= chunkOffsets.Size());
+
+    const uint32 bytesPerValue = settings.PixelType == EXRPixelType::Half ? 2 : 4;
+    const uint64 chunkHeaderSize = settings.Tiled ? 5 * sizeof(int32) : 2 * sizeof(int32);
+
+    Array<PIZScratch> pizScratch;
+    if(settings.Compression == EXRCompression::PIZ)
+        pizScratch.Init(Tasks::NumThreads());
+
+    Array<Array<uint8>> chunks(numChunks);
+    Array<uint64> uncompressedSizes(numChunks, 0);
+    Tasks::ParallelFor(numChunks, [&](uint64 start, uint64 end, uint32 threadNum)
+    {
+        for(uint64 chunkIdx = start; chunkIdx < end; ++chunkIdx)
+        {
+            const uint32 chunkRow = uint32(chunkIdx / chunksPerRow);
+            const uint32 chunkCol = uint32(chunkIdx % chunksPerRow);
+            const uint32 y0 = chunkRow * chunkHeight;
+            const uint32 x0 = chunkCol * chunkWidth;
+            const uint32 blockWidth = Min(chunkWidth, width - x0);
+            const uint32 blockHeight = Min(chunkHeight, numRows - y0);
+
+            const uint64 rawSize = uint64(blockWidth) * blockHeight * numChannels * bytesPerValue;
+            Array<uint8> raw(rawSize);
+            PackPixels(rows + y0 * rowPitch, rowPitch, x0, blockWidth, blockHeight, numChannels, settings.PixelType, raw.Data());
+            uncompressedSizes[chunkIdx] = rawSize;
+
+            Array<uint8> compressed;
+            uint64 compressedSize = 0;
+            if(settings.Compression == EXRCompression::ZIP)
+                compressedSize = CompressZIP(raw.Data(), rawSize, compressed);
+            else if(settings.Compression == EXRCompression::PIZ)
+                compressedSize = CompressPIZ(raw.Data(), rawSize, blockWidth, blockHeight, numChannels, bytesPerValue / 2,
+                                             pizScratch[threadNum], compressed);
+
+            // Readers expect the raw data for any chunk that didn't get smaller
+            const uint8* payload = compressed.Data();
+            if(compressedSize == 0 || compressedSize >= rawSize)
+            {
+                payload = raw.Data();
+                compressedSize = rawSize;
+            }
+
+            Array<uint8>& chunk = chunks[chunkIdx];
+            chunk.Init(chunkHeaderSize + compressedSize);
+            int32* chunkHeader = reinterpret_cast<int32*>(chunk.Data());
+            if(settings.Tiled)
+            {
+                chunkHeader[0] = int32(chunkCol);
+                chunkHeader[1] = int32(firstChunkRow + chunkRow);
+                chunkHeader[2] = 0;
+                chunkHeader[3] = 0;
+                chunkHeader[4] = int32(compressedSize);
+            }
+            else
+            {
+                chunkHeader[0] = int32((firstChunkRow + chunkRow) * chunkHeight);
+                chunkHeader[1] = int32(compressedSize);
+            }
+            memcpy(chunk.Data() + chunkHeaderSize, payload, compressedSize);
+        }
+    }, 1);
+
+    for(uint32 i = 0; i < numChunks; ++i)
+    {
+        chunkOffsets[nextChunk++] = fileOffset;
+        file.Write(chunks[i].Size(), chunks[i].Data());
+        fileOffset += chunks[i].Size();
+        stats.UncompressedSize += uncompressedSizes[i];
+    }
+
+    stats.NumChunks += numChunks;
+}
+
+EXRWriteStats EXRWriter::End()
+{
+    Assert_(writing);
+    Assert_(nextRow == height && numStagedRows == 0);
+    Assert_(nextChunk == chunkOffsets.Size());
+
+    file.Seek(offsetTablePosition);
+    file.Write(chunkOffsets.MemorySize(), chunkOffsets.Data());
+    file.Close();
+
+    chunkOffsets.Shutdown();
+    stagingRows.Shutdown();
+    writing = false;
+
+    timer.Update();
+    stats.FileSize = fileOffset;
+    stats.WriteTime = timer.ElapsedMillisecondsD();
+
+    return stats;
+}
+
+EXRWriteStats SaveEXR(const wchar* filePath, const Float4* texels, uint32 width, uint32 height, const EXRWriteSettings& settings)
+{
+    EXRWriter writer;
+    writer.Begin(filePath, width, height, settings);
+    writer.WriteRows(texels, height);
+    return writer.End();
+}
+
+}
@@ -0,0 +1,116 @@
+//=================================================================================================
+//
+//  MJP's DX12 Sample Framework
+//  http://mynameismjp.wordpress.com/
+//
+//  All code licensed under the MIT license
+//
+//=================================================================================================
+
+#pragma once
+
+#include "PCH.h"
+
+#include "Containers.h"
+#include "FileIO.h"
+#include "SF12_Math.h"
+#include "Timer.h"
+
+namespace SampleFramework12
+{
+
+// Values match the compression attribute in the EXR header
+enum class EXRCompression : uint32
+{
+    None = 0,
+    ZIP = 3,        // zlib over blocks of 16 scanlines, best for smooth data like lightmaps
+    PIZ = 4,        // Wavelet + Huffman over blocks of 32 scanlines, best for noisy data like path traced images
+};
+
+// Values match the pixel types in the EXR channel list
+enum class EXRPixelType : uint32
+{
+    Half = 1,
+    Float = 2,
+};
+
+// The defaults write the same files as the old TinyEXR path in SaveTextureAsEXR(): RGB stored as half with ZIP
+struct EXRWriteSettings
+{
+    EXRCompression Compression = EXRCompression::ZIP;
+    EXRPixelType PixelType = EXRPixelType::Half;
+    bool WriteAlpha = false;
+
+    // Tiled files store square tiles instead of scanline blocks, and rows are buffered one row of tiles at a time
+    bool Tiled = false;
+    uint32 TileSize = 64;
+};
+
+struct EXRWriteStats
+{
+    uint64 NumChunks = 0;
+    uint64 UncompressedSize = 0;
+    uint64 FileSize = 0;
+    double WriteTime = 0.0;     // In milliseconds, from Begin() to End()
+};
+
+// Writes an OpenEXR file a few rows at a time. Rows are grouped into chunks (scanline blocks or rows of tiles),
+// and every chunk that's ready gets packed and compressed on the task threads before being written out in order.
+// Only a bounded number of rows are buffered at once, and rows that cover whole chunks are compressed straight
+// from the caller's memory, so large images never need a second full copy.
+class EXRWriter
+{
+
+public:
+
+    void Begin(const wchar* filePath, uint32 width, uint32 height, const EXRWriteSettings& settings = EXRWriteSettings());
+
+    // Adds the next numRows rows of the image. rowPitch is the distance between rows in bytes, or 0 for rows
+    // that are tightly packed.
+    void WriteRows(const Float4* rows, uint64 numRows, uint64 rowPitch = 0);
+
+    // Writes out the remaining chunks and the offset table, and closes the file. Every row needs to have been
+    // written by this point.
+    EXRWriteStats End();
+
+    uint32 Width() const { return width; }
+    uint32 Height() const { return height; }
+    uint32 RowsWritten() const { return nextRow; }
+
+    // Number of rows in each chunk, which is how many rows get buffered before any of them can be compressed
+    uint32 ChunkHeight() const { return chunkHeight; }
+
+protected:
+
+    void CompressRows(const uint8* rows, uint64 rowPitch, uint32 numRows);
+
+    File file;
+    std::wstring path;
+    EXRWriteSettings settings;
+    uint32 width = 0;
+    uint32 height = 0;
+    uint32 numChannels = 0;
+    uint32 chunkHeight = 0;
+    uint32 chunkWidth = 0;
+    uint32 chunksPerRow = 0;
+    uint32 maxRowsPerBatch = 0;
+
+    uint32 nextRow = 0;
+    uint32 nextChunk = 0;
+    uint64 fileOffset = 0;
+    uint64 offsetTablePosition = 0;
+    Array<uint64> chunkOffsets;
+
+    Array<Float4> stagingRows;
+    uint32 numStagedRows = 0;
+
+    EXRWriteStats stats;
+    Timer timer;
+    bool writing = false;
+};
+
+// Writes out a whole image with an EXRWriter
+EXRWriteStats SaveEXR(const wchar* filePath, const Float4* texels, uint32 width, uint32 height,
+                      const EXRWriteSettings& settings = EXRWriteSettings());
+
+}
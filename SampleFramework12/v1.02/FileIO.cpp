@@ -230,6 +230,15 @@ void File::Write(uint64 size, const void* data) const
     Win32Call(WriteFile(fileHandle, data, static_cast<DWORD>(size), &bytesWritten, NULL));
 }
 
+void File::Seek(uint64 offset) const
+{
+    Assert_(fileHandle != INVALID_HANDLE_VALUE);
+
+    LARGE_INTEGER distance;
+    distance.QuadPart = int64(offset);
+    Win32Call(SetFilePointerEx(fileHandle, distance, NULL, FILE_BEGIN));
+}
+
 uint64 File::Size() const
 {
     Assert_(fileHandle != INVALID_HANDLE_VALUE);
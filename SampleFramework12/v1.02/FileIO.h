@@ -66,6 +66,9 @@ public:
     template<typename T> void Read(T& data) const;
     template<typename T> void Write(const T& data) const;
 
+    // Moves the read/write position to an absolute offset from the start of the file
+    void Seek(uint64 offset) const;
+
     // Accessors
     uint64 Size() const;
 };
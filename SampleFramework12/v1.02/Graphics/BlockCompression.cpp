@@ -0,0 +1,807 @@
+//=================================================================================================
+//
+//  MJP's DX12 Sample Framework
+//  http://mynameismjp.wordpress.com/
+//
+//  All code licensed under the MIT license
+//
+//=================================================================================================
+
+#include "PCH.h"
+
+#include "BlockCompression.h"
+#include "..\\Assert.h"
+#include "..\\Containers.h"
+#include "..\\SF12_Math.h"
+#include "..\\Tasks.h"
+#include "..\\Timer.h"
+
+namespace SampleFramework12
+{
+
+// Interpolation weights for 4-bit BC7 indices, out of 64
+static const uint32 BC7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// Interpolation weights for 2-bit BC7 indices, out of 64
+static const uint32 BC7Weights2Bit[4] = { 0, 21, 43, 64 };
+
+// How far each BC1 index lies between color0 and color1
+static const float BC1Weights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+
+// The texels of a single block, split into one stream per channel so that 4 texels can be processed at once
+struct BlockTexels
+{
+    float Channels[4][16];
+};
+
+static void LoadBlockTexels(const uint8* texels, BlockTexels& blockTexels)
+{
+    for(uint32 i = 0; i < 16; ++i)
+        for(uint32 c = 0; c < 4; ++c)
+            blockTexels.Channels[c][i] = float(texels[i * 4 + c]);
+}
+
+// Picks the closest palette entry for every texel using the first NumChannels channels, and returns the summed
+// squared error
+template<uint32 NumChannels> static float FindClosestEntries(const BlockTexels& blockTexels, const float palette[][4],
+                                                             uint32 numEntries, uint8* indices)
+{
+    __m128 totalError = _mm_setzero_ps();
+    for(uint32 group = 0; group < 4; ++group)
+    {
+        __m128 channels[NumChannels];
+        for(uint32 c = 0; c < NumChannels; ++c)
+            channels[c] = _mm_loadu_ps(&blockTexels.Channels[c][group * 4]);
+
+        __m128 bestError = _mm_set1_ps(FloatMax);
+        __m128i bestIndex = _mm_setzero_si128();
+        for(uint32 entryIdx = 0; entryIdx < numEntries; ++entryIdx)
+        {
+            __m128 error = _mm_setzero_ps();
+            for(uint32 c = 0; c < NumChannels; ++c)
+            {
+                const __m128 diff = _mm_sub_ps(channels[c], _mm_set1_ps(palette[entryIdx][c]));
+                error = _mm_add_ps(error, _mm_mul_ps(diff, diff));
+            }
+
+            const __m128i closer = _mm_castps_si128(_mm_cmplt_ps(error, bestError));
+            bestIndex = _mm_or_si128(_mm_andnot_si128(closer, bestIndex), _mm_and_si128(closer, _mm_set1_epi32(int32(entryIdx))));
+            bestError = _mm_min_ps(error, bestError);
+        }
+
+        totalError = _mm_add_ps(totalError, bestError);
+
+        alignas(16) int32 groupIndices[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(groupIndices), bestIndex);
+        for(uint32 i = 0; i < 4; ++i)
+            indices[group * 4 + i] = uint8(groupIndices[i]);
+    }
+
+    alignas(16) float errors[4];
+    _mm_store_ps(errors, totalError);
+    return errors[0] + errors[1] + errors[2] + errors[3];
+}
+
+// Finds the line through the block that best fits the texels, by running a few steps of power iteration on the
+// covariance matrix. The endpoints are where the texels project onto the ends of the line.
+template<uint32 NumChannels> static void PrincipalAxisEndpoints(const BlockTexels& blockTexels, float* endpoint0, float* endpoint1)
+{
+    float mean[NumChannels] = { };
+    for(uint32 c = 0; c < NumChannels; ++c)
+    {
+        for(uint32 i = 0; i < 16; ++i)
+            mean[c] += blockTexels.Channels[c][i];
+        mean[c] /= 16.0f;
+    }
+
+    float covariance[NumChannels][NumChannels] = { };
+    for(uint32 i = 0; i < 16; ++i)
+    {
+        for(uint32 a = 0; a < NumChannels; ++a)
+        {
+            const float da = blockTexels.Channels[a][i] - mean[a];
+            for(uint32 b = a; b < NumChannels; ++b)
+                covariance[a][b] += da * (blockTexels.Channels[b][i] - mean[b]);
+        }
+    }
+
+    // Starting from the column with the most variance keeps the first guess from being perpendicular to the answer
+    uint32 largestChannel = 0;
+    for(uint32 a = 0; a < NumChannels; ++a)
+    {
+        for(uint32 b = 0; b < a; ++b)
+            covariance[a][b] = covariance[b][a];
+        if(covariance[a][a] > covariance[largestChannel][largestChannel])
+            largestChannel = a;
+    }
+
+    float axis[NumChannels] = { };
+    for(uint32 c = 0; c < NumChannels; ++c)
+        axis[c] = covariance[c][largestChannel];
+
+    for(uint32 iteration = 0; iteration < 8; ++iteration)
+    {
+        float newAxis[NumChannels] = { };
+        float maxComponent = 0.0f;
+        for(uint32 a = 0; a < NumChannels; ++a)
+        {
+            for(uint32 b = 0; b < NumChannels; ++b)
+                newAxis[a] += covariance[a][b] * axis[b];
+            maxComponent = Max(maxComponent, std::abs(newAxis[a]));
+        }
+
+        if(maxComponent == 0.0f)
+            break;
+
+        for(uint32 c = 0; c < NumChannels; ++c)
+            axis[c] = newAxis[c] / maxComponent;
+    }
+
+    float axisLengthSq = 0.0f;
+    for(uint32 c = 0; c < NumChannels; ++c)
+        axisLengthSq += axis[c] * axis[c];
+
+    float minProjection = 0.0f;
+    float maxProjection = 0.0f;
+    if(axisLengthSq > 0.0f)
+    {
+        for(uint32 c = 0; c < NumChannels; ++c)
+            axis[c] /= std::sqrt(axisLengthSq);
+
+        minProjection = FloatMax;
+        maxProjection = -FloatMax;
+        for(uint32 i = 0; i < 16; ++i)
+        {
+            float projection = 0.0f;
+            for(uint32 c = 0; c < NumChannels; ++c)
+                projection += (blockTexels.Channels[c][i] - mean[c]) * axis[c];
+            minProjection = Min(minProjection, projection);
+            maxProjection = Max(maxProjection, projection);
+        }
+    }
+
+    for(uint32 c = 0; c < NumChannels; ++c)
+    {
+        endpoint0[c] = Clamp(mean[c] + axis[c] * minProjection, 0.0f, 255.0f);
+        endpoint1[c] = Clamp(mean[c] + axis[c] * maxProjection, 0.0f, 255.0f);
+    }
+}
+
+// Solves for the pair of endpoints that best reproduces the texels with a fixed set of interpolation weights.
+// Returns false when every texel uses the same weight, since there's no unique solution.
+template<uint32 NumChannels> static bool LeastSquaresEndpoints(const BlockTexels& blockTexels, const float* weights,
+                                                               float* endpoint0, float* endpoint1)
+{
+    float aa = 0.0f;
+    float ab = 0.0f;
+    float bb = 0.0f;
+    float ax[NumChannels] = { };
+    float bx[NumChannels] = { };
+    for(uint32 i = 0; i < 16; ++i)
+    {
+        const float b = weights[i];
+        const float a = 1.0f - b;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for(uint32 c = 0; c < NumChannels; ++c)
+        {
+            ax[c] += a * blockTexels.Channels[c][i];
+            bx[c] += b * blockTexels.Channels[c][i];
+        }
+    }
+
+    const float determinant = aa * bb - ab * ab;
+    if(std::abs(determinant) < 1e-6f)
+        return false;
+
+    const float invDeterminant = 1.0f / determinant;
+    for(uint32 c = 0; c < NumChannels; ++c)
+    {
+        endpoint0[c] = Clamp((ax[c] * bb - bx[c] * ab) * invDeterminant, 0.0f, 255.0f);
+        endpoint1[c] = Clamp((bx[c] * aa - ax[c] * ab) * invDeterminant, 0.0f, 255.0f);
+    }
+
+    return true;
+}
+
+// == BC1 =========================================================================================
+
+static uint16 QuantizeRGB565(const float* rgb)
+{
+    const uint32 r = uint32(rgb[0] * (31.0f / 255.0f) + 0.5f);
+    const uint32 g = uint32(rgb[1] * (63.0f / 255.0f) + 0.5f);
+    const uint32 b = uint32(rgb[2] * (31.0f / 255.0f) + 0.5f);
+    return uint16((r << 11) | (g << 5) | b);
+}
+
+static void ExpandRGB565(uint16 color, float* rgb)
+{
+    const uint32 r = (color >> 11) & 0x1F;
+    const uint32 g = (color >> 5) & 0x3F;
+    const uint32 b = color & 0x1F;
+    rgb[0] = float((r << 3) | (r >> 2));
+    rgb[1] = float((g << 2) | (g >> 4));
+    rgb[2] = float((b << 3) | (b >> 2));
+}
+
+// Picks the indices for a pair of endpoints in the 4 color mode, which requires color0 > color1. When both
+// endpoints are the same every texel uses color0, which decodes the same way in either mode.
+static float EvaluateBC1Endpoints(const BlockTexels& blockTexels, uint16& color0, uint16& color1, uint8* indices)
+{
+    if(color0 < color1)
+        std::swap(color0, color1);
+
+    float palette[4][4] = { };
+    ExpandRGB565(color0, palette[0]);
+    ExpandRGB565(color1, palette[1]);
+    for(uint32 c = 0; c < 3; ++c)
+    {
+        palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+        palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+    }
+
+    return FindClosestEntries<3>(blockTexels, palette, color0 == color1 ? 1 : 4, indices);
+}
+
+float EncodeBC1Block(const uint8* texels, uint8* block)
+{
+    BlockTexels blockTexels;
+    LoadBlockTexels(texels, blockTexels);
+
+    float endpoint0[3] = { };
+    float endpoint1[3] = { };
+    PrincipalAxisEndpoints<3>(blockTexels, endpoint0, endpoint1);
+
+    uint16 bestColor0 = QuantizeRGB565(endpoint1);
+    uint16 bestColor1 = QuantizeRGB565(endpoint0);
+    uint8 bestIndices[16] = { };
+    float bestError = EvaluateBC1Endpoints(blockTexels, bestColor0, bestColor1, bestIndices);
+
+    for(uint32 iteration = 0; iteration < 2 && bestError > 0.0f; ++iteration)
+    {
+        float weights[16] = { };
+        for(uint32 i = 0; i < 16; ++i)
+            weights[i] = BC1Weights[bestIndices[i]];
+
+        if(LeastSquaresEndpoints<3>(blockTexels, weights, endpoint0, endpoint1) == false)
+            break;
+
+        uint16 color0 = QuantizeRGB565(endpoint0);
+        uint16 color1 = QuantizeRGB565(endpoint1);
+        uint8 indices[16] = { };
+        const float error = EvaluateBC1Endpoints(blockTexels, color0, color1, indices);
+        if(error >= bestError)
+            break;
+
+        bestError = error;
+        bestColor0 = color0;
+        bestColor1 = color1;
+        memcpy(bestIndices, indices, sizeof(indices));
+    }
+
+    uint32 indexBits = 0;
+    for(uint32 i = 0; i < 16; ++i)
+        indexBits |= uint32(bestIndices[i]) << (i * 2);
+
+    block[0] = uint8(bestColor0 & 0xFF);
+    block[1] = uint8(bestColor0 >> 8);
+    block[2] = uint8(bestColor1 & 0xFF);
+    block[3] = uint8(bestColor1 >> 8);
+    memcpy(block + 4, &indexBits, sizeof(indexBits));
+
+    return bestError;
+}
+
+// == BC4/BC5 =====================================================================================
+
+// How far each BC4 index lies between red0 and red1, in the 8 value mode
+static const float BC4Weights[8] = { 0.0f, 1.0f, 1.0f / 7.0f, 2.0f / 7.0f, 3.0f / 7.0f, 4.0f / 7.0f, 5.0f / 7.0f, 6.0f / 7.0f };
+
+// Picks the indices for a pair of endpoints in the 8 value mode, which requires red0 > red1
+static float EvaluateBC4Endpoints(const BlockTexels& blockTexels, uint8& red0, uint8& red1, uint8* indices)
+{
+    if(red0 < red1)
+        std::swap(red0, red1);
+
+    float palette[8][4] = { };
+    for(uint32 i = 0; i < 8; ++i)
+        palette[i][0] = float(red0) + (float(red1) - float(red0)) * BC4Weights[i];
+
+    return FindClosestEntries<1>(blockTexels, palette, red0 == red1 ? 1 : 8, indices);
+}
+
+float EncodeBC4Block(const uint8* texels, uint32 channel, uint8* block)
+{
+    Assert_(channel < 4);
+
+    BlockTexels blockTexels;
+    uint8 bestRed0 = 0;
+    uint8 bestRed1 = 255;
+    for(uint32 i = 0; i < 16; ++i)
+    {
+        const uint8 value = texels[i * 4 + channel];
+        blockTexels.Channels[0][i] = float(value);
+        bestRed0 = Max(bestRed0, value);
+        bestRed1 = Min(bestRed1, value);
+    }
+
+    uint8 bestIndices[16] = { };
+    float bestError = EvaluateBC4Endpoints(blockTexels, bestRed0, bestRed1, bestIndices);
+
+    for(uint32 iteration = 0; iteration < 2 && bestError > 0.0f; ++iteration)
+    {
+        float weights[16] = { };
+        for(uint32 i = 0; i < 16; ++i)
+            weights[i] = BC4Weights[bestIndices[i]];
+
+        float endpoint0 = 0.0f;
+        float endpoint1 = 0.0f;
+        if(LeastSquaresEndpoints<1>(blockTexels, weights, &endpoint0, &endpoint1) == false)
+            break;
+
+        uint8 red0 = uint8(endpoint0 + 0.5f);
+        uint8 red1 = uint8(endpoint1 + 0.5f);
+        uint8 indices[16] = { };
+        const float error = EvaluateBC4Endpoints(blockTexels, red0, red1, indices);
+        if(error >= bestError)
+            break;
+
+        bestError = error;
+        bestRed0 = red0;
+        bestRed1 = red1;
+        memcpy(bestIndices, indices, sizeof(indices));
+    }
+
+    uint64 indexBits = 0;
+    for(uint32 i = 0; i < 16; ++i)
+        indexBits |= uint64(bestIndices[i]) << (i * 3);
+
+    block[0] = bestRed0;
+    block[1] = bestRed1;
+    for(uint32 i = 0; i < 6; ++i)
+        block[2 + i] = uint8(indexBits >> (i * 8));
+
+    return bestError;
+}
+
+float EncodeBC5Block(const uint8* texels, uint8* block)
+{
+    return EncodeBC4Block(texels, 0, block) + EncodeBC4Block(texels, 1, block + 8);
+}
+
+// == BC7 =========================================================================================
+
+struct BC7Endpoints
+{
+    uint32 Colors[2][4];
+    uint32 PBits[2];
+};
+
+// Rounds an endpoint to 7 bits per channel plus a p-bit that's shared by all channels, using whichever p-bit
+// ends up closer
+static void QuantizeBC7Endpoint(const float* endpoint, uint32* color, uint32& pBit)
+{
+    float bestError = FloatMax;
+    for(uint32 p = 0; p < 2; ++p)
+    {
+        uint32 quantized[4] = { };
+        float error = 0.0f;
+        for(uint32 c = 0; c < 4; ++c)
+        {
+            quantized[c] = uint32(Clamp((endpoint[c] - p) * 0.5f + 0.5f, 0.0f, 127.0f));
+            const float diff = float((quantized[c] << 1) | p) - endpoint[c];
+            error += diff * diff;
+        }
+
+        if(error < bestError)
+        {
+            bestError = error;
+            pBit = p;
+            memcpy(color, quantized, sizeof(quantized));
+        }
+    }
+}
+
+static void QuantizeBC7Endpoints(const float* endpoint0, const float* endpoint1, BC7Endpoints& endpoints)
+{
+    QuantizeBC7Endpoint(endpoint0, endpoints.Colors[0], endpoints.PBits[0]);
+    QuantizeBC7Endpoint(endpoint1, endpoints.Colors[1], endpoints.PBits[1]);
+}
+
+static float EvaluateBC7Endpoints(const BlockTexels& blockTexels, const BC7Endpoints& endpoints, uint8* indices)
+{
+    float palette[16][4] = { };
+    for(uint32 c = 0; c < 4; ++c)
+    {
+        const uint32 value0 = (endpoints.Colors[0][c] << 1) | endpoints.PBits[0];
+        const uint32 value1 = (endpoints.Colors[1][c] << 1) | endpoints.PBits[1];
+        for(uint32 i = 0; i < 16; ++i)
+            palette[i][c] = float(((64 - BC7Weights[i]) * value0 + BC7Weights[i] * value1 + 32) >> 6);
+    }
+
+    return FindClosestEntries<4>(blockTexels, palette, 16, indices);
+}
+
+// Writes bits in order from the least significant bit of the block
+struct BlockBitWriter
+{
+    uint64 Bits[2] = { };
+    uint32 Position = 0;
+
+    void Write(uint32 value, uint32 numBits)
+    {
+        for(uint32 i = 0; i < numBits; ++i, ++Position)
+            Bits[Position / 64] |= uint64((value >> i) & 1) << (Position % 64);
+    }
+};
+
+float EncodeBC7Block(const uint8* texels, uint8* block)
+{
+    BlockTexels blockTexels;
+    LoadBlockTexels(texels, blockTexels);
+
+    float endpoint0[4] = { };
+    float endpoint1[4] = { };
+    PrincipalAxisEndpoints<4>(blockTexels, endpoint0, endpoint1);
+
+    BC7Endpoints bestEndpoints = { };
+    QuantizeBC7Endpoints(endpoint0, endpoint1, bestEndpoints);
+    uint8 bestIndices[16] = { };
+    float bestError = EvaluateBC7Endpoints(blockTexels, bestEndpoints, bestIndices);
+
+    for(uint32 iteration = 0; iteration < 2 && bestError > 0.0f; ++iteration)
+    {
+        float weights[16] = { };
+        for(uint32 i = 0; i < 16; ++i)
+            weights[i] = BC7Weights[bestIndices[i]] / 64.0f;
+
+        if(LeastSquaresEndpoints<4>(blockTexels, weights, endpoint0, endpoint1) == false)
+            break;
+
+        BC7Endpoints endpoints = { };
+        QuantizeBC7Endpoints(endpoint0, endpoint1, endpoints);
+        uint8 indices[16] = { };
+        const float error = EvaluateBC7Endpoints(blockTexels, endpoints, indices);
+        if(error >= bestError)
+            break;
+
+        bestError = error;
+        bestEndpoints = endpoints;
+        memcpy(bestIndices, indices, sizeof(indices));
+    }
+
+    // The index of the first texel is stored without its top bit, so the endpoints get swapped if it's set. The
+    // weights are symmetric, so flipping the indices gives back exactly the same palette.
+    if(bestIndices[0] >= 8)
+    {
+        std::swap(bestEndpoints.Colors[0], bestEndpoints.Colors[1]);
+        std::swap(bestEndpoints.PBits[0], bestEndpoints.PBits[1]);
+        for(uint32 i = 0; i < 16; ++i)
+            bestIndices[i] = 15 - bestIndices[i];
+    }
+
+    BlockBitWriter writer;
+    writer.Write(1 << 6, 7);
+    for(uint32 c = 0; c < 4; ++c)
+    {
+        writer.Write(bestEndpoints.Colors[0][c], 7);
+        writer.Write(bestEndpoints.Colors[1][c], 7);
+    }
+
+    writer.Write(bestEndpoints.PBits[0], 1);
+    writer.Write(bestEndpoints.PBits[1], 1);
+    writer.Write(bestIndices[0], 3);
+    for(uint32 i = 1; i < 16; ++i)
+        writer.Write(bestIndices[i], 4);
+
+    Assert_(writer.Position == 128);
+    memcpy(block, writer.Bits, sizeof(writer.Bits));
+
+    return bestError;
+}
+
+// Mode 5 endpoints have no p-bits, and get expanded to 8 bits by repeating their top bits
+static uint32 ExpandBC7Endpoint(uint32 value, uint32 numBits)
+{
+    return numBits == 8 ? value : (value << (8 - numBits)) | (value >> (2 * numBits - 8));
+}
+
+template<uint32 NumChannels> static void QuantizeBC7Mode5Endpoint(const float* endpoint, uint32 numBits, uint32* quantized)
+{
+    const float maxValue = float((1 << numBits) - 1);
+    for(uint32 c = 0; c < NumChannels; ++c)
+        quantized[c] = uint32(Clamp(endpoint[c] * (maxValue / 255.0f) + 0.5f, 0.0f, maxValue));
+}
+
+template<uint32 NumChannels> static float EvaluateBC7Mode5Endpoints(const BlockTexels& blockTexels, const uint32 endpoints[2][4],
+                                                                   uint32 numBits, uint8* indices)
+{
+    float palette[4][4] = { };
+    for(uint32 c = 0; c < NumChannels; ++c)
+    {
+        const uint32 value0 = ExpandBC7Endpoint(endpoints[0][c], numBits);
+        const uint32 value1 = ExpandBC7Endpoint(endpoints[1][c], numBits);
+        for(uint32 i = 0; i < 4; ++i)
+            palette[i][c] = float(((64 - BC7Weights2Bit[i]) * value0 + BC7Weights2Bit[i] * value1 + 32) >> 6);
+    }
+
+    return FindClosestEntries<NumChannels>(blockTexels, palette, 4, indices);
+}
+
+// Fits one of the two halves of a mode 5 block, which is a pair of endpoints with 2-bit indices for either the
+// color channels or the alpha channel. The index of the first texel is stored without its top bit, so the endpoints
+// are swapped when it's set.
+template<uint32 NumChannels> static float FitBC7Mode5Endpoints(const BlockTexels& blockTexels, uint32 numBits,
+                                                              uint32 bestEndpoints[2][4], uint8* bestIndices)
+{
+    float endpoint0[NumChannels] = { };
+    float endpoint1[NumChannels] = { };
+    PrincipalAxisEndpoints<NumChannels>(blockTexels, endpoint0, endpoint1);
+
+    QuantizeBC7Mode5Endpoint<NumChannels>(endpoint0, numBits, bestEndpoints[0]);
+    QuantizeBC7Mode5Endpoint<NumChannels>(endpoint1, numBits, bestEndpoints[1]);
+    float bestError = EvaluateBC7Mode5Endpoints<NumChannels>(blockTexels, bestEndpoints, numBits, bestIndices);
+
+    for(uint32 iteration = 0; iteration < 2 && bestError > 0.0f; ++iteration)
+    {
+        float weights[16] = { };
+        for(uint32 i = 0; i < 16; ++i)
+            weights[i] = BC7Weights2Bit[bestIndices[i]] / 64.0f;
+
+        if(LeastSquaresEndpoints<NumChannels>(blockTexels, weights, endpoint0, endpoint1) == false)
+            break;
+
+        uint32 endpoints[2][4] = { };
+        QuantizeBC7Mode5Endpoint<NumChannels>(endpoint0, numBits, endpoints[0]);
+        QuantizeBC7Mode5Endpoint<NumChannels>(endpoint1, numBits, endpoints[1]);
+        uint8 indices[16] = { };
+        const float error = EvaluateBC7Mode5Endpoints<NumChannels>(blockTexels, endpoints, numBits, indices);
+        if(error >= bestError)
+            break;
+
+        bestError = error;
+        memcpy(bestEndpoints, endpoints, sizeof(endpoints));
+        memcpy(bestIndices, indices, sizeof(indices));
+    }
+
+    if(bestIndices[0] >= 2)
+    {
+        std::swap(bestEndpoints[0], bestEndpoints[1]);
+        for(uint32 i = 0; i < 16; ++i)
+            bestIndices[i] = 3 - bestIndices[i];
+    }
+
+    return bestError;
+}
+
+float EncodeBC7Mode5Block(const uint8* texels, uint8* block)
+{
+    BlockTexels sourceTexels;
+    LoadBlockTexels(texels, sourceTexels);
+
+    float bestError = FloatMax;
+    for(uint32 rotation = 0; rotation < 4; ++rotation)
+    {
+        // A rotation of N swaps channel N - 1 with alpha after decoding, so they get swapped the same way here
+        BlockTexels colorTexels = sourceTexels;
+        if(rotation > 0)
+            for(uint32 i = 0; i < 16; ++i)
+                std::swap(colorTexels.Channels[rotation - 1][i], colorTexels.Channels[3][i]);
+
+        BlockTexels alphaTexels = { };
+        memcpy(alphaTexels.Channels[0], colorTexels.Channels[3], sizeof(alphaTexels.Channels[0]));
+
+        uint32 colorEndpoints[2][4] = { };
+        uint32 alphaEndpoints[2][4] = { };
+        uint8 colorIndices[16] = { };
+        uint8 alphaIndices[16] = { };
+        const float error = FitBC7Mode5Endpoints<3>(colorTexels, 7, colorEndpoints, colorIndices) +
+                            FitBC7Mode5Endpoints<1>(alphaTexels, 8, alphaEndpoints, alphaIndices);
+        if(error >= bestError)
+            continue;
+
+        bestError = error;
+
+        BlockBitWriter writer;
+        writer.Write(1 << 5, 6);
+        writer.Write(rotation, 2);
+        for(uint32 c = 0; c < 3; ++c)
+        {
+            writer.Write(colorEndpoints[0][c], 7);
+            writer.Write(colorEndpoints[1][c], 7);
+        }
+
+        writer.Write(alphaEndpoints[0][0], 8);
+        writer.Write(alphaEndpoints[1][0], 8);
+        writer.Write(colorIndices[0], 1);
+        for(uint32 i = 1; i < 16; ++i)
+            writer.Write(colorIndices[i], 2);
+        writer.Write(alphaIndices[0], 1);
+        for(uint32 i = 1; i < 16; ++i)
+            writer.Write(alphaIndices[i], 2);
+
+        Assert_(writer.Position == 128);
+        memcpy(block, writer.Bits, sizeof(writer.Bits));
+    }
+
+    return bestError;
+}
+
+// == Textures ====================================================================================
+
+void BlockCompressionStats::Add(const BlockCompressionStats& other)
+{
+    if(other.NumTextures == 0)
+        return;
+
+    WorstPSNR = NumTextures > 0 ? Min(WorstPSNR, other.WorstPSNR) : other.WorstPSNR;
+    NumTextures += other.NumTextures;
+    NumBlocks += other.NumBlocks;
+    UncompressedSize += other.UncompressedSize;
+    CompressedSize += other.CompressedSize;
+    SquaredError += other.SquaredError;
+    NumErrorSamples += other.NumErrorSamples;
+    EncodeTime += other.EncodeTime;
+}
+
+double BlockCompressionStats::PSNR() const
+{
+    // Lossless textures count as 100 dB rather than infinity, so that they don't swamp an average
+    if(NumErrorSamples == 0 || SquaredError == 0.0)
+        return 100.0;
+
+    const double mse = SquaredError / NumErrorSamples;
+    return Min(10.0 * std::log10((255.0 * 255.0) / mse), 100.0);
+}
+
+double BlockCompressionStats::MegaTexelsPerSecond() const
+{
+    return EncodeTime > 0.0 ? (NumBlocks * 16.0) / (EncodeTime * 1000.0) : 0.0;
+}
+
+bool IsBlockCompressible(const DirectX::TexMetadata& metaData)
+{
+    return metaData.dimension == DirectX::TEX_DIMENSION_TEXTURE2D && DirectX::IsCompressed(metaData.format) == false &&
+           DirectX::IsTypeless(metaData.format) == false && DirectX::IsPlanar(metaData.format) == false &&
+           DirectX::IsVideo(metaData.format) == false && DirectX::BitsPerColor(metaData.format) <= 16 &&
+           metaData.width % 4 == 0 && metaData.height % 4 == 0;
+}
+
+HRESULT BlockCompress(const DirectX::ScratchImage& srcImage, DXGI_FORMAT format, DirectX::ScratchImage& dstImage,
+                      BlockCompressionStats* stats, uint32 bc7Mode)
+{
+    Assert_(bc7Mode == 5 || bc7Mode == 6);
+
+    Timer timer;
+
+    const DirectX::TexMetadata& metaData = srcImage.GetMetadata();
+    if(IsBlockCompressible(metaData) == false)
+        return E_INVALIDARG;
+
+    uint64 numChannels = 0;
+    if(format == DXGI_FORMAT_BC1_UNORM)
+        numChannels = 3;
+    else if(format == DXGI_FORMAT_BC4_UNORM)
+        numChannels = 1;
+    else if(format == DXGI_FORMAT_BC5_UNORM)
+        numChannels = 2;
+    else if(format == DXGI_FORMAT_BC7_UNORM)
+        numChannels = 4;
+    else
+        return E_INVALIDARG;
+
+    const uint64 blockSize = DirectX::BitsPerPixel(format) * 2;
+
+    // Every block is encoded from RGBA8, without touching the color space
+    const bool srgb = DirectX::IsSRGB(metaData.format);
+    const DXGI_FORMAT rgbaFormat = srgb ? DXGI_FORMAT_R8G8B8A8_UNORM_SRGB : DXGI_FORMAT_R8G8B8A8_UNORM;
+    const DirectX::ScratchImage* rgbaImage = &srcImage;
+    DirectX::ScratchImage convertedImage;
+    if(metaData.format != rgbaFormat)
+    {
+        HRESULT hr = DirectX::Convert(srcImage.GetImages(), srcImage.GetImageCount(), metaData, rgbaFormat,
+                                      DirectX::TEX_FILTER_DEFAULT, DirectX::TEX_THRESHOLD_DEFAULT, convertedImage);
+        if(FAILED(hr))
+            return hr;
+        rgbaImage = &convertedImage;
+    }
+
+    HRESULT hr = dstImage.Initialize2D(srgb ? DirectX::MakeSRGB(format) : format, metaData.width, metaData.height,
+                                       metaData.arraySize, metaData.mipLevels);
+    if(FAILED(hr))
+        return hr;
+
+    // Every row of blocks in every subresource gets split up across the task threads together, since the lower
+    // mips are too small to be worth splitting up on their own
+    struct BlockRow
+    {
+        const DirectX::Image* Src = nullptr;
+        const DirectX::Image* Dst = nullptr;
+        uint64 BlockY = 0;
+    };
+
+    GrowableList<BlockRow> blockRows;
+    uint64 numBlocks = 0;
+    Assert_(rgbaImage->GetImageCount() == dstImage.GetImageCount());
+    for(uint64 imageIdx = 0; imageIdx < dstImage.GetImageCount(); ++imageIdx)
+    {
+        BlockRow row;
+        row.Src = &rgbaImage->GetImages()[imageIdx];
+        row.Dst = &dstImage.GetImages()[imageIdx];
+
+        const uint64 numBlocksY = (row.Src->height + 3) / 4;
+        for(uint64 y = 0; y < numBlocksY; ++y)
+        {
+            row.BlockY = y;
+            blockRows.Add(row);
+        }
+
+        numBlocks += numBlocksY * ((row.Src->width + 3) / 4);
+    }
+
+    Array<double> rowErrors(blockRows.Count(), 0.0);
+    Tasks::ParallelFor(blockRows.Count(), [&](uint64 start, uint64 end, uint32 threadNum)
+    {
+        uint8 texels[64] = { };
+        for(uint64 rowIdx = start; rowIdx < end; ++rowIdx)
+        {
+            const BlockRow& row = blockRows[rowIdx];
+            const DirectX::Image& src = *row.Src;
+            uint8* dstBlock = row.Dst->pixels + row.BlockY * row.Dst->rowPitch;
+
+            double rowError = 0.0;
+            const uint64 numBlocksX = (src.width + 3) / 4;
+            for(uint64 blockX = 0; blockX < numBlocksX; ++blockX)
+            {
+                // Mips that are smaller than a block repeat their last row and column
+                for(uint64 y = 0; y < 4; ++y)
+                {
+                    const uint64 srcY = Min<uint64>(row.BlockY * 4 + y, src.height - 1);
+                    for(uint64 x = 0; x < 4; ++x)
+                    {
+                        const uint64 srcX = Min<uint64>(blockX * 4 + x, src.width - 1);
+                        memcpy(texels + (y * 4 + x) * 4, src.pixels + srcY * src.rowPitch + srcX * 4, 4);
+                    }
+                }
+
+                if(format == DXGI_FORMAT_BC1_UNORM)
+                    rowError += EncodeBC1Block(texels, dstBlock);
+                else if(format == DXGI_FORMAT_BC4_UNORM)
+                    rowError += EncodeBC4Block(texels, 0, dstBlock);
+                else if(format == DXGI_FORMAT_BC5_UNORM)
+                    rowError += EncodeBC5Block(texels, dstBlock);
+                else if(bc7Mode == 5)
+                    rowError += EncodeBC7Mode5Block(texels, dstBlock);
+                else
+                    rowError += EncodeBC7Block(texels, dstBlock);
+
+                dstBlock += blockSize;
+            }
+
+            rowErrors[rowIdx] = rowError;
+        }
+    }, 4);
+
+    if(stats != nullptr)
+    {
+        BlockCompressionStats textureStats;
+        textureStats.NumTextures = 1;
+        textureStats.NumBlocks = numBlocks;
+        textureStats.UncompressedSize = srcImage.GetPixelsSize();
+        textureStats.CompressedSize = dstImage.GetPixelsSize();
+        for(uint64 i = 0; i < rowErrors.Size(); ++i)
+            textureStats.SquaredError += rowErrors[i];
+        textureStats.NumErrorSamples = numBlocks * 16 * numChannels;
+        textureStats.WorstPSNR = textureStats.PSNR();
+
+        timer.Update();
+        textureStats.EncodeTime = timer.ElapsedMillisecondsD();
+
+        stats->Add(textureStats);
+    }
+
+    return S_OK;
+}
+
+}
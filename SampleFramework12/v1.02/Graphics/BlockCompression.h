@@ -0,0 +1,71 @@
+//=================================================================================================
+//
+//  MJP's DX12 Sample Framework
+//  http://mynameismjp.wordpress.com/
+//
+//  All code licensed under the MIT license
+//
+//=================================================================================================
+
+#pragma once
+
+#include "..\\PCH.h"
+
+namespace SampleFramework12
+{
+
+// How material textures get block compressed when they're loaded from an uncompressed source
+enum class BlockCompressionQuality : uint32
+{
+    Uncompressed = 0,
+    Fast,           // BC1 for color
+    High,           // BC7 for color
+
+    NumValues
+};
+
+struct BlockCompressionStats
+{
+    uint64 NumTextures = 0;
+    uint64 NumBlocks = 0;
+    uint64 UncompressedSize = 0;
+    uint64 CompressedSize = 0;
+
+    // Squared error summed over every encoded channel of every texel, in 8-bit units
+    double SquaredError = 0.0;
+    uint64 NumErrorSamples = 0;
+    double WorstPSNR = 0.0;
+
+    // In milliseconds, summed over all of the textures even when they were encoded at the same time
+    double EncodeTime = 0.0;
+
+    void Add(const BlockCompressionStats& other);
+
+    double PSNR() const;
+    double MegaTexelsPerSecond() const;
+};
+
+// BC1, BC4, BC5 and BC7 encoders that run over 4 texels at a time with SSE, with the blocks split up across the
+// task threads. The color formats pick their endpoints from the principal axis of the block and then refine them
+// with a least squares fit to the chosen indices. BC7 uses either mode 6 or mode 5. Mode 6 is a single RGBA subset
+// with 4-bit indices, which is a good fit for the smooth gradients in most material textures and keeps the encoder
+// fast, but every channel shares the same indices. Mode 5 gives one channel its own endpoints and 2-bit indices,
+// with the rest sharing another set, and the encoder picks whichever channel that works best for in each block.
+// That keeps unrelated masks that are packed into one texture from bleeding into each other.
+bool IsBlockCompressible(const DirectX::TexMetadata& metaData);
+
+// Compresses every mip and array slice of an uncompressed 2D texture. The top mip needs to be a multiple of 4
+// texels in both dimensions. sRGB sources produce the sRGB version of the format. bc7Mode is 5 or 6, and is only
+// used for BC7. This doesn't throw, so it's safe to call from the task threads.
+HRESULT BlockCompress(const DirectX::ScratchImage& srcImage, DXGI_FORMAT format, DirectX::ScratchImage& dstImage,
+                      BlockCompressionStats* stats = nullptr, uint32 bc7Mode = 6);
+
+// Single block encoders. The texels are 16 RGBA8 values in row-major order, and the return value is the squared
+// error of the encoded channels.
+float EncodeBC1Block(const uint8* texels, uint8* block);
+float EncodeBC4Block(const uint8* texels, uint32 channel, uint8* block);
+float EncodeBC5Block(const uint8* texels, uint8* block);
+float EncodeBC7Block(const uint8* texels, uint8* block);
+float EncodeBC7Mode5Block(const uint8* texels, uint8* block);
+
+}
@@ -0,0 +1,309 @@
+//=================================================================================================
+//
+//  MJP's DX12 Sample Framework
+//  http://mynameismjp.wordpress.com/
+//
+//  All code licensed under the MIT license
+//
+//=================================================================================================
+
+#include "PCH.h"
+
+#include "CubemapProjection.h"
+
+#include <mutex>
+
+#include "..\\Tasks.h"
+#include "..\\Utility.h"
+#include "Textures.h"
+
+using namespace DirectX;
+
+namespace SampleFramework12
+{
+
+static inline XMVECTOR LoadTexel(const Float3& texel)
+{
+    return XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(&texel));
+}
+
+static inline XMVECTOR LoadTexel(const Float4& texel)
+{
+    return XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&texel));
+}
+
+// Multiply-accumulates a contiguous range of texels against all of the basis tables. Texels are loaded
+// 4 at a time and transposed into R/G/B vectors, so that each lane handles a different texel.
+template<typename T> static void ProjectTexelRange(const T* texels, const float* basis, uint64 basisStride,
+                                                   uint64 start, uint64 end, Float3* outCoefficients)
+{
+    const uint64 NumCoefficients = CubemapProjectionPlan::NumCoefficients;
+
+    XMVECTOR sumR[NumCoefficients];
+    XMVECTOR sumG[NumCoefficients];
+    XMVECTOR sumB[NumCoefficients];
+    for(uint64 i = 0; i < NumCoefficients; ++i)
+        sumR[i] = sumG[i] = sumB[i] = XMVectorZero();
+
+    uint64 texelIdx = start;
+    for(; texelIdx + 4 <= end; texelIdx += 4)
+    {
+        XMMATRIX colors = XMMATRIX(LoadTexel(texels[texelIdx + 0]), LoadTexel(texels[texelIdx + 1]),
+                                   LoadTexel(texels[texelIdx + 2]), LoadTexel(texels[texelIdx + 3]));
+        colors = XMMatrixTranspose(colors);
+
+        for(uint64 i = 0; i < NumCoefficients; ++i)
+        {
+            const XMVECTOR b = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(basis + i * basisStride + texelIdx));
+            sumR[i] = XMVectorMultiplyAdd(b, colors.r[0], sumR[i]);
+            sumG[i] = XMVectorMultiplyAdd(b, colors.r[1], sumG[i]);
+            sumB[i] = XMVectorMultiplyAdd(b, colors.r[2], sumB[i]);
+        }
+    }
+
+    for(uint64 i = 0; i < NumCoefficients; ++i)
+    {
+        Float3 sum = Float3(XMVectorGetX(XMVectorSum(sumR[i])),
+                            XMVectorGetX(XMVectorSum(sumG[i])),
+                            XMVectorGetX(XMVectorSum(sumB[i])));
+
+        for(uint64 t = texelIdx; t < end; ++t)
+            sum += Float3(texels[t].x, texels[t].y, texels[t].z) * basis[i * basisStride + t];
+
+        outCoefficients[i] = sum;
+    }
+}
+
+void CubemapProjectionPlan::Initialize(uint32 resolution_)
+{
+    Assert_(resolution_ > 0);
+
+    Shutdown();
+
+    resolution = resolution_;
+    numTexels = uint64(resolution) * resolution * 6;
+
+    dirX.Init(numTexels);
+    dirY.Init(numTexels);
+    dirZ.Init(numTexels);
+    weights.Init(numTexels);
+    shBasis.Init(numTexels * NumCoefficients);
+    sgBasis.Init(numTexels * NumCoefficients);
+
+    GenerateUniformSGs(sgLobes, NumCoefficients, SGDistribution::Spherical);
+
+    const uint64 faceSize = uint64(resolution) * resolution;
+    Tasks::ParallelFor(6 * resolution, [&](uint64 start, uint64 end, uint32 threadNum)
+    {
+        for(uint64 row = start; row < end; ++row)
+        {
+            const uint64 face = row / resolution;
+            const uint64 y = row % resolution;
+
+            for(uint64 x = 0; x < resolution; ++x)
+            {
+                const uint64 idx = face * faceSize + y * resolution + x;
+                const Float3 dir = MapXYSToDirection(x, y, face, resolution, resolution);
+                dirX[idx] = dir.x;
+                dirY[idx] = dir.y;
+                dirZ[idx] = dir.z;
+
+                // Account for cubemap texel distribution
+                const float u = ((x + 0.5f) / resolution) * 2.0f - 1.0f;
+                const float v = ((y + 0.5f) / resolution) * 2.0f - 1.0f;
+                const float temp = 1.0f + u * u + v * v;
+                weights[idx] = 4.0f / (std::sqrt(temp) * temp);
+            }
+        }
+    });
+
+    double weightSum = 0.0;
+    for(uint64 i = 0; i < numTexels; ++i)
+        weightSum += weights[i];
+
+    const float weightScale = float((4.0 * Pi) / weightSum);
+
+    // Same weighting used by SolveSGs in projection mode, which treats the texels as uniformly
+    // distributed over the sphere
+    float sgFactor = (4.0f * Pi) / numTexels;
+    sgFactor *= Pi / 2.46373701f;
+
+    Tasks::ParallelFor(numTexels, [&](uint64 start, uint64 end, uint32 threadNum)
+    {
+        for(uint64 idx = start; idx < end; ++idx)
+        {
+            weights[idx] *= weightScale;
+
+            const Float3 dir = Direction(idx);
+            const SH9 sh = ProjectOntoSH9(dir);
+            for(uint64 i = 0; i < NumCoefficients; ++i)
+            {
+                shBasis[i * numTexels + idx] = sh.Coefficients[i] * weights[idx];
+
+                const float dot = Float3::Dot(dir, sgLobes[i].Axis);
+                const float sgWeight = dot > 0.0f ? std::exp((dot - 1.0f) * sgLobes[i].Sharpness) : 0.0f;
+                sgBasis[i * numTexels + idx] = sgWeight * sgFactor;
+            }
+        }
+    }, 1024);
+}
+
+void CubemapProjectionPlan::Shutdown()
+{
+    resolution = 0;
+    numTexels = 0;
+    dirX.Shutdown();
+    dirY.Shutdown();
+    dirZ.Shutdown();
+    weights.Shutdown();
+    shBasis.Shutdown();
+    sgBasis.Shutdown();
+}
+
+template<typename T> void CubemapProjectionPlan::Project(const T* const* cubemaps, uint64 numCubemaps, const Array<float>& basis,
+                                                         Float3* outCoefficients) const
+{
+    Assert_(Initialized());
+    Assert_(cubemaps != nullptr);
+    Assert_(outCoefficients != nullptr);
+
+    // Each cubemap is split into blocks of rows, and every block gets its own partial sum. The partial
+    // sums are then added up in order, so the result doesn't depend on which thread ran which block.
+    const uint64 blocksPerFace = (resolution + RowsPerBlock - 1) / RowsPerBlock;
+    const uint64 blocksPerCubemap = blocksPerFace * 6;
+    const uint64 numBlocks = blocksPerCubemap * numCubemaps;
+    const uint64 faceSize = uint64(resolution) * resolution;
+
+    Array<Float3> partialSums(numBlocks * NumCoefficients);
+    Tasks::ParallelFor(numBlocks, [&](uint64 start, uint64 end, uint32 threadNum)
+    {
+        for(uint64 blockIdx = start; blockIdx < end; ++blockIdx)
+        {
+            const uint64 cubemapIdx = blockIdx / blocksPerCubemap;
+            const uint64 face = (blockIdx % blocksPerCubemap) / blocksPerFace;
+            const uint64 rowStart = (blockIdx % blocksPerFace) * RowsPerBlock;
+            const uint64 rowEnd = Min<uint64>(rowStart + RowsPerBlock, resolution);
+
+            const uint64 texelStart = face * faceSize + rowStart * resolution;
+            const uint64 texelEnd = face * faceSize + rowEnd * resolution;
+            ProjectTexelRange(cubemaps[cubemapIdx], basis.Data(), numTexels, texelStart, texelEnd,
+                              &partialSums[blockIdx * NumCoefficients]);
+        }
+    });
+
+    for(uint64 cubemapIdx = 0; cubemapIdx < numCubemaps; ++cubemapIdx)
+    {
+        Float3* coefficients = &outCoefficients[cubemapIdx * NumCoefficients];
+        for(uint64 i = 0; i < NumCoefficients; ++i)
+            coefficients[i] = Float3(0.0f);
+
+        for(uint64 blockIdx = 0; blockIdx < blocksPerCubemap; ++blockIdx)
+        {
+            const Float3* blockSums = &partialSums[(cubemapIdx * blocksPerCubemap + blockIdx) * NumCoefficients];
+            for(uint64 i = 0; i < NumCoefficients; ++i)
+                coefficients[i] += blockSums[i];
+        }
+    }
+}
+
+SH9Color CubemapProjectionPlan::ProjectSH9(const Float3* texels) const
+{
+    SH9Color sh;
+    ProjectSH9Batch(&texels, 1, &sh);
+    return sh;
+}
+
+SH9Color CubemapProjectionPlan::ProjectSH9(const Float4* texels) const
+{
+    SH9Color sh;
+    ProjectSH9Batch(&texels, 1, &sh);
+    return sh;
+}
+
+SG9 CubemapProjectionPlan::ProjectSG9(const Float3* texels) const
+{
+    SG9 sg;
+    ProjectSG9Batch(&texels, 1, &sg);
+    return sg;
+}
+
+SG9 CubemapProjectionPlan::ProjectSG9(const Float4* texels) const
+{
+    SG9 sg;
+    ProjectSG9Batch(&texels, 1, &sg);
+    return sg;
+}
+
+void CubemapProjectionPlan::ProjectSH9Batch(const Float3* const* cubemaps, uint64 numCubemaps, SH9Color* outSH) const
+{
+    StaticAssert_(sizeof(SH9Color) == sizeof(Float3) * NumCoefficients);
+    Project(cubemaps, numCubemaps, shBasis, reinterpret_cast<Float3*>(outSH));
+}
+
+void CubemapProjectionPlan::ProjectSH9Batch(const Float4* const* cubemaps, uint64 numCubemaps, SH9Color* outSH) const
+{
+    StaticAssert_(sizeof(SH9Color) == sizeof(Float3) * NumCoefficients);
+    Project(cubemaps, numCubemaps, shBasis, reinterpret_cast<Float3*>(outSH));
+}
+
+template<typename T> void CubemapProjectionPlan::ProjectSG(const T* const* cubemaps, uint64 numCubemaps, SG9* outSG) const
+{
+    Array<Float3> amplitudes(numCubemaps * NumCoefficients);
+    Project(cubemaps, numCubemaps, sgBasis, amplitudes.Data());
+    for(uint64 cubemapIdx = 0; cubemapIdx < numCubemaps; ++cubemapIdx)
+    {
+        for(uint64 i = 0; i < NumCoefficients; ++i)
+        {
+            outSG[cubemapIdx].Lobes[i] = sgLobes[i];
+            outSG[cubemapIdx].Lobes[i].Amplitude = amplitudes[cubemapIdx * NumCoefficients + i];
+        }
+    }
+}
+
+void CubemapProjectionPlan::ProjectSG9Batch(const Float3* const* cubemaps, uint64 numCubemaps, SG9* outSG) const
+{
+    ProjectSG(cubemaps, numCubemaps, outSG);
+}
+
+void CubemapProjectionPlan::ProjectSG9Batch(const Float4* const* cubemaps, uint64 numCubemaps, SG9* outSG) const
+{
+    ProjectSG(cubemaps, numCubemaps, outSG);
+}
+
+static std::map<uint32, CubemapProjectionPlan*> sharedPlans;
+static std::mutex sharedPlansLock;
+
+const CubemapProjectionPlan& CubemapProjectionPlan::Get(uint32 resolution)
+{
+    {
+        std::lock_guard<std::mutex> lock(sharedPlansLock);
+        auto existing = sharedPlans.find(resolution);
+        if(existing != sharedPlans.end())
+            return *existing->second;
+    }
+
+    // Build the plan without holding the lock, since initialization runs on the task threads and
+    // a waiting thread can end up running another task that also asks for a plan
+    CubemapProjectionPlan* newPlan = new CubemapProjectionPlan();
+    newPlan->Initialize(resolution);
+
+    std::lock_guard<std::mutex> lock(sharedPlansLock);
+    CubemapProjectionPlan*& plan = sharedPlans[resolution];
+    if(plan == nullptr)
+        plan = newPlan;
+    else
+        delete newPlan;
+
+    return *plan;
+}
+
+void CubemapProjectionPlan::ReleaseSharedPlans()
+{
+    std::lock_guard<std::mutex> lock(sharedPlansLock);
+
+    for(auto& pair : sharedPlans)
+        delete pair.second;
+    sharedPlans.clear();
+}
+
+}
@@ -0,0 +1,80 @@
+//=================================================================================================
+//
+//  MJP's DX12 Sample Framework
+//  http://mynameismjp.wordpress.com/
+//
+//  All code licensed under the MIT license
+//
+//=================================================================================================
+
+#pragma once
+
+#include "..\\PCH.h"
+
+#include "..\\SF12_Math.h"
+#include "..\\Containers.h"
+#include "SH.h"
+#include "SG.h"
+
+namespace SampleFramework12
+{
+
+// Pre-computed tables for projecting cubemaps with a fixed resolution onto SH9 and SG9. The texel
+// directions, solid angle weights, and the weighted basis functions are stored as SoA tables, which
+// turns the projection into a SIMD multiply-accumulate that gets split across faces and rows.
+// Texels are expected in the same face-major order used by MapXYSToDirection and TextureData.
+class CubemapProjectionPlan
+{
+
+public:
+
+    static const uint64 NumCoefficients = 9;
+    static const uint64 RowsPerBlock = 32;
+
+    void Initialize(uint32 resolution);
+    void Shutdown();
+
+    bool Initialized() const { return resolution > 0; }
+    uint32 Resolution() const { return resolution; }
+    uint64 NumTexels() const { return numTexels; }
+
+    const float* DirX() const { return dirX.Data(); }
+    const float* DirY() const { return dirY.Data(); }
+    const float* DirZ() const { return dirZ.Data(); }
+    const float* Weights() const { return weights.Data(); }
+    Float3 Direction(uint64 texelIdx) const { return Float3(dirX[texelIdx], dirY[texelIdx], dirZ[texelIdx]); }
+
+    SH9Color ProjectSH9(const Float3* texels) const;
+    SH9Color ProjectSH9(const Float4* texels) const;
+    SG9 ProjectSG9(const Float3* texels) const;
+    SG9 ProjectSG9(const Float4* texels) const;
+
+    // Projects many cubemaps at once, for instance when baking a grid of light probes
+    void ProjectSH9Batch(const Float3* const* cubemaps, uint64 numCubemaps, SH9Color* outSH) const;
+    void ProjectSH9Batch(const Float4* const* cubemaps, uint64 numCubemaps, SH9Color* outSH) const;
+    void ProjectSG9Batch(const Float3* const* cubemaps, uint64 numCubemaps, SG9* outSG) const;
+    void ProjectSG9Batch(const Float4* const* cubemaps, uint64 numCubemaps, SG9* outSG) const;
+
+    // Returns a shared plan for the given resolution, which is created on first use
+    static const CubemapProjectionPlan& Get(uint32 resolution);
+    static void ReleaseSharedPlans();
+
+private:
+
+    template<typename T> void Project(const T* const* cubemaps, uint64 numCubemaps, const Array<float>& basis,
+                                      Float3* outCoefficients) const;
+    template<typename T> void ProjectSG(const T* const* cubemaps, uint64 numCubemaps, SG9* outSG) const;
+
+    uint32 resolution = 0;
+    uint64 numTexels = 0;
+
+    Array<float> dirX;
+    Array<float> dirY;
+    Array<float> dirZ;
+    Array<float> weights;       // Solid angle of each texel, normalized so that they sum to 4 * Pi
+    Array<float> shBasis;       // NumCoefficients x numTexels, pre-multiplied by the texel weight
+    Array<float> sgBasis;       // NumCoefficients x numTexels, pre-multiplied by the projection factor
+    SG sgLobes[NumCoefficients];
+};
+
+}
@@ -0,0 +1,485 @@
+//=================================================================================================
+//
+//  MJP's DX12 Sample Framework
+//  http://mynameismjp.wordpress.com/
+//
+//  All code licensed under the MIT license
+//
+//=================================================================================================
+
+#include "PCH.h"
+
+#include "MeshOptimizer.h"
+
+namespace SampleFramework12
+{
+
+// Builds the vertex -> triangle adjacency in a flattened list, where the triangles using vertex i are
+// adjacency[offsets[i]] through adjacency[offsets[i + 1] - 1]
+static void BuildTriangleAdjacency(const uint32* indices, uint64 numIndices, uint64 numVertices,
+                                   Array<uint32>& offsets, Array<uint32>& adjacency)
+{
+    Array<uint32> counts(numVertices, 0);
+    for(uint64 i = 0; i < numIndices; ++i)
+        ++counts[indices[i]];
+
+    offsets.Init(numVertices + 1, 0);
+    for(uint64 i = 0; i < numVertices; ++i)
+        offsets[i + 1] = offsets[i] + counts[i];
+
+    adjacency.Init(numIndices);
+    counts.Fill(0);
+    for(uint64 i = 0; i < numIndices; ++i)
+    {
+        const uint32 idx = indices[i];
+        adjacency[offsets[idx] + counts[idx]++] = uint32(i / 3);
+    }
+}
+
+VertexCacheStats AnalyzeVertexCache(const uint32* indices, uint64 numIndices, uint64 numVertices, uint32 cacheSize)
+{
+    VertexCacheStats stats;
+    if(numIndices < 3)
+        return stats;
+
+    // A vertex is in the FIFO if it was last added within the last cacheSize misses
+    Array<uint64> cacheTimeStamps(numVertices, 0);
+    Array<bool> referenced(numVertices, false);
+    uint64 numMisses = 0;
+    uint64 numReferenced = 0;
+    for(uint64 i = 0; i < numIndices; ++i)
+    {
+        const uint32 idx = indices[i];
+        Assert_(idx < numVertices);
+
+        if(referenced[idx] == false)
+        {
+            referenced[idx] = true;
+            ++numReferenced;
+        }
+
+        if(cacheTimeStamps[idx] == 0 || numMisses + 1 - cacheTimeStamps[idx] > cacheSize)
+        {
+            ++numMisses;
+            cacheTimeStamps[idx] = numMisses;
+        }
+    }
+
+    stats.ACMR = float(double(numMisses) / double(numIndices / 3));
+    stats.ATVR = float(double(numMisses) / double(numReferenced));
+    return stats;
+}
+
+void OptimizeVertexCache(const uint32* indices, uint64 numIndices, uint64 numVertices, uint32 cacheSize,
+                         uint32* outIndices, Array<uint32>& clusterStarts)
+{
+    const uint64 numTriangles = numIndices / 3;
+    clusterStarts.Shutdown();
+    if(numTriangles == 0)
+        return;
+
+    Array<uint32> adjacencyOffsets;
+    Array<uint32> adjacency;
+    BuildTriangleAdjacency(indices, numIndices, numVertices, adjacencyOffsets, adjacency);
+
+    Array<uint32> liveTriangles(numVertices);
+    for(uint64 i = 0; i < numVertices; ++i)
+        liveTriangles[i] = adjacencyOffsets[i + 1] - adjacencyOffsets[i];
+
+    Array<uint64> cacheTimeStamps(numVertices, 0);
+    Array<bool> emitted(numTriangles, false);
+    Array<uint32> deadEndStack(numIndices);
+    Array<uint32> candidates(numIndices);
+    GrowableList<uint32> clusterList;
+    uint64 deadEndStackSize = 0;
+    uint64 numOutIndices = 0;
+    uint64 timeStamp = cacheSize + 1;
+    uint64 cursor = 0;
+
+    // Finds a vertex that still has triangles left to emit, first from the dead-end stack of recently
+    // used vertices, and then by scanning through the input in order
+    auto skipDeadEnd = [&]() -> int64
+    {
+        while(deadEndStackSize > 0)
+        {
+            const uint32 vertex = deadEndStack[--deadEndStackSize];
+            if(liveTriangles[vertex] > 0)
+                return vertex;
+        }
+
+        while(cursor < numVertices)
+        {
+            if(liveTriangles[cursor] > 0)
+                return int64(cursor);
+            ++cursor;
+        }
+
+        return -1;
+    };
+
+    int64 fanningVertex = skipDeadEnd();
+    clusterList.Add(0);
+    while(fanningVertex >= 0)
+    {
+        // Emit all remaining triangles around the fanning vertex
+        uint64 numCandidates = 0;
+        const uint32 adjacencyStart = adjacencyOffsets[fanningVertex];
+        const uint32 adjacencyEnd = adjacencyOffsets[fanningVertex + 1];
+        for(uint32 adjIdx = adjacencyStart; adjIdx < adjacencyEnd; ++adjIdx)
+        {
+            const uint32 triIdx = adjacency[adjIdx];
+            if(emitted[triIdx])
+                continue;
+
+            for(uint64 i = 0; i < 3; ++i)
+            {
+                const uint32 vertex = indices[triIdx * 3 + i];
+                outIndices[numOutIndices++] = vertex;
+                deadEndStack[deadEndStackSize++] = vertex;
+                candidates[numCandidates++] = vertex;
+                --liveTriangles[vertex];
+
+                if(timeStamp - cacheTimeStamps[vertex] > cacheSize)
+                    cacheTimeStamps[vertex] = timeStamp++;
+            }
+
+            emitted[triIdx] = true;
+        }
+
+        // Pick the candidate that will still be in the cache after its remaining triangles are emitted,
+        // preferring the ones that were added to the cache the longest ago
+        int64 nextVertex = -1;
+        uint64 bestPriority = 0;
+        for(uint64 i = 0; i < numCandidates; ++i)
+        {
+            const uint32 vertex = candidates[i];
+            if(liveTriangles[vertex] == 0)
+                continue;
+
+            uint64 priority = 0;
+            if(timeStamp - cacheTimeStamps[vertex] + 2 * liveTriangles[vertex] <= cacheSize)
+                priority = timeStamp - cacheTimeStamps[vertex];
+
+            if(nextVertex == -1 || priority > bestPriority)
+            {
+                nextVertex = vertex;
+                bestPriority = priority;
+            }
+        }
+
+        // Jumping to a dead-end ends the current cluster, since the cache gets flushed
+        if(nextVertex == -1)
+        {
+            nextVertex = skipDeadEnd();
+            if(nextVertex >= 0 && numOutIndices < numIndices)
+                clusterList.Add(uint32(numOutIndices / 3));
+        }
+
+        fanningVertex = nextVertex;
+    }
+
+    Assert_(numOutIndices == numTriangles * 3);
+
+    clusterStarts.Init(clusterList.Count());
+    for(uint64 i = 0; i < clusterList.Count(); ++i)
+        clusterStarts[i] = clusterList[i];
+}
+
+void OptimizeOverdraw(const uint32* indices, uint64 numIndices, const Float3* positions, uint64 positionStride,
+                      const Array<uint32>& clusterStarts, uint32* outIndices)
+{
+    const uint64 numTriangles = numIndices / 3;
+    const uint64 numClusters = clusterStarts.Size();
+    if(numClusters <= 1)
+    {
+        memcpy(outIndices, indices, numIndices * sizeof(uint32));
+        return;
+    }
+
+    auto getPosition = [&](uint32 idx) -> const Float3&
+    {
+        return *reinterpret_cast<const Float3*>(reinterpret_cast<const uint8*>(positions) + idx * positionStride);
+    };
+
+    // Area-weighted centroid and normal of each cluster, and of the mesh as a whole
+    Array<Float3> clusterCentroids(numClusters);
+    Array<Float3> clusterNormals(numClusters);
+    Float3 meshCentroid;
+    float meshArea = 0.0f;
+    for(uint64 clusterIdx = 0; clusterIdx < numClusters; ++clusterIdx)
+    {
+        const uint64 triStart = clusterStarts[clusterIdx];
+        const uint64 triEnd = clusterIdx + 1 < numClusters ? clusterStarts[clusterIdx + 1] : numTriangles;
+
+        Float3 centroid;
+        Float3 normal;
+        float area = 0.0f;
+        for(uint64 triIdx = triStart; triIdx < triEnd; ++triIdx)
+        {
+            const Float3& p0 = getPosition(indices[triIdx * 3 + 0]);
+            const Float3& p1 = getPosition(indices[triIdx * 3 + 1]);
+            const Float3& p2 = getPosition(indices[triIdx * 3 + 2]);
+
+            const Float3 cross = Float3::Cross(p1 - p0, p2 - p0);
+            const float triArea = Float3::Length(cross) * 0.5f;
+            centroid += (p0 + p1 + p2) * (triArea / 3.0f);
+            normal += cross;
+            area += triArea;
+        }
+
+        meshCentroid += centroid;
+        meshArea += area;
+
+        clusterCentroids[clusterIdx] = area > 0.0f ? centroid / area : getPosition(indices[triStart * 3]);
+        clusterNormals[clusterIdx] = Float3::Length(normal) > 0.0f ? Float3::Normalize(normal) : Float3();
+    }
+
+    if(meshArea > 0.0f)
+        meshCentroid /= meshArea;
+
+    // Sort by how much each cluster faces outwards from the center of the mesh
+    Array<float> sortKeys(numClusters);
+    Array<uint32> clusterOrder(numClusters);
+    for(uint64 clusterIdx = 0; clusterIdx < numClusters; ++clusterIdx)
+    {
+        sortKeys[clusterIdx] = Float3::Dot(clusterCentroids[clusterIdx] - meshCentroid, clusterNormals[clusterIdx]);
+        clusterOrder[clusterIdx] = uint32(clusterIdx);
+    }
+
+    std::stable_sort(clusterOrder.Data(), clusterOrder.Data() + numClusters, [&](uint32 a, uint32 b)
+    {
+        return sortKeys[a] > sortKeys[b];
+    });
+
+    uint64 numOutIndices = 0;
+    for(uint64 i = 0; i < numClusters; ++i)
+    {
+        const uint64 clusterIdx = clusterOrder[i];
+        const uint64 triStart = clusterStarts[clusterIdx];
+        const uint64 triEnd = clusterIdx + 1 < numClusters ? clusterStarts[clusterIdx + 1] : numTriangles;
+        const uint64 clusterNumIndices = (triEnd - triStart) * 3;
+        memcpy(outIndices + numOutIndices, indices + triStart * 3, clusterNumIndices * sizeof(uint32));
+        numOutIndices += clusterNumIndices;
+    }
+
+    Assert_(numOutIndices == numTriangles * 3);
+}
+
+void OptimizeVertexFetch(uint32* indices, uint64 numIndices, uint64 numVertices, Array<uint32>& remap)
+{
+    Array<uint32> newIndices(numVertices, uint32(-1));
+    remap.Init(numVertices);
+
+    uint32 numUsed = 0;
+    for(uint64 i = 0; i < numIndices; ++i)
+    {
+        const uint32 oldIdx = indices[i];
+        if(newIndices[oldIdx] == uint32(-1))
+        {
+            newIndices[oldIdx] = numUsed;
+            remap[numUsed] = oldIdx;
+            ++numUsed;
+        }
+
+        indices[i] = newIndices[oldIdx];
+    }
+
+    for(uint64 oldIdx = 0; oldIdx < numVertices; ++oldIdx)
+    {
+        if(newIndices[oldIdx] == uint32(-1))
+            remap[numUsed++] = uint32(oldIdx);
+    }
+
+    Assert_(numUsed == numVertices);
+}
+
+void BuildMeshlets(uint32* indices, uint64 numIndices, const Float3* positions, uint64 positionStride, uint64 numVertices,
+                   uint32 maxVertices, uint32 maxTriangles, GrowableList<Meshlet>& meshlets,
+                   GrowableList<uint32>& meshletVertices, GrowableList<uint32>& meshletTriangles)
+{
+    Assert_(maxVertices >= 3 && maxVertices <= 256);
+    Assert_(maxTriangles > 0);
+
+    const uint64 numTriangles = numIndices / 3;
+    if(numTriangles == 0)
+        return;
+
+    auto getPosition = [&](uint32 idx) -> const Float3&
+    {
+        return *reinterpret_cast<const Float3*>(reinterpret_cast<const uint8*>(positions) + idx * positionStride);
+    };
+
+    auto triangleCentroid = [&](uint64 triIdx) -> Float3
+    {
+        return (getPosition(indices[triIdx * 3 + 0]) + getPosition(indices[triIdx * 3 + 1]) + getPosition(indices[triIdx * 3 + 2])) / 3.0f;
+    };
+
+    Array<uint32> adjacencyOffsets;
+    Array<uint32> adjacency;
+    BuildTriangleAdjacency(indices, numIndices, numVertices, adjacencyOffsets, adjacency);
+
+    // Slot of each vertex within the current meshlet, or -1 if it's not in the meshlet
+    Array<uint32> meshletSlots(numVertices, uint32(-1));
+    Array<bool> emitted(numTriangles, false);
+    Array<uint32> reordered(numIndices);
+    uint64 numReordered = 0;
+    uint64 cursor = 0;
+
+    Meshlet meshlet;
+    meshlet.VertexOffset = uint32(meshletVertices.Count());
+    meshlet.TriangleOffset = uint32(meshletTriangles.Count());
+    Float3 centroidSum;
+
+    auto finishMeshlet = [&]()
+    {
+        meshlet.AABBMin = Float3(FloatMax, FloatMax, FloatMax);
+        meshlet.AABBMax = Float3(-FloatMax, -FloatMax, -FloatMax);
+        for(uint64 i = 0; i < meshlet.VertexCount; ++i)
+        {
+            const uint32 vertex = meshletVertices[meshlet.VertexOffset + i];
+            const Float3& position = getPosition(vertex);
+            meshlet.AABBMin = Float3(Min(meshlet.AABBMin.x, position.x), Min(meshlet.AABBMin.y, position.y), Min(meshlet.AABBMin.z, position.z));
+            meshlet.AABBMax = Float3(Max(meshlet.AABBMax.x, position.x), Max(meshlet.AABBMax.y, position.y), Max(meshlet.AABBMax.z, position.z));
+            meshletSlots[vertex] = uint32(-1);
+        }
+
+        meshlet.SphereCenter = (meshlet.AABBMin + meshlet.AABBMax) * 0.5f;
+        meshlet.SphereRadius = 0.0f;
+        for(uint64 i = 0; i < meshlet.VertexCount; ++i)
+        {
+            const Float3& position = getPosition(meshletVertices[meshlet.VertexOffset + i]);
+            meshlet.SphereRadius = Max(meshlet.SphereRadius, Float3::Length(position - meshlet.SphereCenter));
+        }
+
+        // The cone contains the normals of every non-degenerate triangle, using the winding instead of
+        // the vertex normals since that's what determines whether a triangle gets backface culled
+        Float3 normalSum;
+        for(uint64 i = 0; i < meshlet.TriangleCount; ++i)
+        {
+            const uint32* triIndices = &reordered[meshlet.IndexStart + i * 3];
+            const Float3& p0 = getPosition(triIndices[0]);
+            const Float3 normal = Float3::Cross(getPosition(triIndices[1]) - p0, getPosition(triIndices[2]) - p0);
+            if(Float3::Length(normal) > 0.0f)
+                normalSum += Float3::Normalize(normal);
+        }
+
+        meshlet.ConeAxis = Float3(0.0f, 0.0f, 0.0f);
+        meshlet.ConeCutoff = 1.0f;
+        if(Float3::Length(normalSum) > 0.0f)
+        {
+            const Float3 axis = Float3::Normalize(normalSum);
+            float minDot = 1.0f;
+            for(uint64 i = 0; i < meshlet.TriangleCount; ++i)
+            {
+                const uint32* triIndices = &reordered[meshlet.IndexStart + i * 3];
+                const Float3& p0 = getPosition(triIndices[0]);
+                const Float3 normal = Float3::Cross(getPosition(triIndices[1]) - p0, getPosition(triIndices[2]) - p0);
+                if(Float3::Length(normal) > 0.0f)
+                    minDot = Min(minDot, Float3::Dot(axis, Float3::Normalize(normal)));
+            }
+
+            // Cones that span a hemisphere or more can never be entirely backfacing. Otherwise the cutoff
+            // is the sine of the cone's angle, so that the test is against the cone widened by 90 degrees.
+            if(minDot > 0.0f)
+            {
+                meshlet.ConeAxis = axis;
+                meshlet.ConeCutoff = std::sqrt(Max(1.0f - minDot * minDot, 0.0f));
+            }
+        }
+
+        meshlets.Add(meshlet);
+
+        meshlet = Meshlet();
+        meshlet.VertexOffset = uint32(meshletVertices.Count());
+        meshlet.TriangleOffset = uint32(meshletTriangles.Count());
+        meshlet.IndexStart = uint32(numReordered);
+        centroidSum = Float3(0.0f, 0.0f, 0.0f);
+    };
+
+    auto countNewVertices = [&](uint64 triIdx) -> uint32
+    {
+        uint32 numNew = 0;
+        for(uint64 i = 0; i < 3; ++i)
+            numNew += meshletSlots[indices[triIdx * 3 + i]] == uint32(-1) ? 1 : 0;
+        return numNew;
+    };
+
+    for(;;)
+    {
+        // Look for the connected triangle that adds the fewest vertices, breaking ties by distance
+        int64 nextTriangle = -1;
+        uint32 bestNumNew = 4;
+        float bestDistance = FloatMax;
+        if(meshlet.TriangleCount > 0)
+        {
+            const Float3 centroid = centroidSum / float(meshlet.TriangleCount);
+            for(uint64 i = 0; i < meshlet.VertexCount; ++i)
+            {
+                const uint32 vertex = meshletVertices[meshlet.VertexOffset + i];
+                for(uint32 adjIdx = adjacencyOffsets[vertex]; adjIdx < adjacencyOffsets[vertex + 1]; ++adjIdx)
+                {
+                    const uint32 triIdx = adjacency[adjIdx];
+                    if(emitted[triIdx])
+                        continue;
+
+                    const uint32 numNew = countNewVertices(triIdx);
+                    if(numNew > bestNumNew)
+                        continue;
+
+                    const float distance = Float3::Length(triangleCentroid(triIdx) - centroid);
+                    if(numNew < bestNumNew || distance < bestDistance)
+                    {
+                        nextTriangle = triIdx;
+                        bestNumNew = numNew;
+                        bestDistance = distance;
+                    }
+                }
+            }
+        }
+
+        if(nextTriangle < 0)
+        {
+            while(cursor < numTriangles && emitted[cursor])
+                ++cursor;
+            if(cursor == numTriangles)
+                break;
+
+            // A disconnected triangle only joins the current meshlet if it's mostly empty, since
+            // otherwise it would just make the bounds looser
+            nextTriangle = int64(cursor);
+            if(meshlet.TriangleCount > 0 && meshlet.TriangleCount >= maxTriangles / 4)
+                finishMeshlet();
+        }
+
+        const uint64 triIdx = uint64(nextTriangle);
+        if(meshlet.VertexCount + countNewVertices(triIdx) > maxVertices || meshlet.TriangleCount == maxTriangles)
+            finishMeshlet();
+
+        uint32 packedTriangle = 0;
+        for(uint64 i = 0; i < 3; ++i)
+        {
+            const uint32 vertex = indices[triIdx * 3 + i];
+            if(meshletSlots[vertex] == uint32(-1))
+            {
+                meshletSlots[vertex] = meshlet.VertexCount++;
+                meshletVertices.Add(vertex);
+            }
+
+            packedTriangle |= meshletSlots[vertex] << (i * 8);
+            reordered[numReordered++] = vertex;
+        }
+
+        meshletTriangles.Add(packedTriangle);
+        centroidSum += triangleCentroid(triIdx);
+        emitted[triIdx] = true;
+        ++meshlet.TriangleCount;
+    }
+
+    if(meshlet.TriangleCount > 0)
+        finishMeshlet();
+
+    Assert_(numReordered == numTriangles * 3);
+    memcpy(indices, reordered.Data(), numReordered * sizeof(uint32));
+}
+
+}
@@ -0,0 +1,96 @@
+//=================================================================================================
+//
+//  MJP's DX12 Sample Framework
+//  http://mynameismjp.wordpress.com/
+//
+//  All code licensed under the MIT license
+//
+//=================================================================================================
+
+#pragma once
+
+#include "..\\PCH.h"
+
+#include "..\\SF12_Math.h"
+#include "..\\Containers.h"
+
+namespace SampleFramework12
+{
+
+// Size of the FIFO post-transform cache that the optimizer targets and that the stats are measured with
+static const uint32 DefaultVertexCacheSize = 16;
+
+// Average cache miss ratio (misses per triangle) and average transform to vertex ratio
+// (misses per referenced vertex) from simulating a FIFO post-transform vertex cache
+struct VertexCacheStats
+{
+    float ACMR = 0.0f;
+    float ATVR = 0.0f;
+};
+
+VertexCacheStats AnalyzeVertexCache(const uint32* indices, uint64 numIndices, uint64 numVertices,
+                                    uint32 cacheSize = DefaultVertexCacheSize);
+
+// Re-orders triangles for vertex cache locality using Tipsify from "Fast Triangle Reordering for Vertex
+// Locality and Reduced Overdraw" [Sander et al. 2007]. The start of every cluster of triangles that was
+// emitted without jumping to a dead-end vertex is written to clusterStarts (in triangles).
+void OptimizeVertexCache(const uint32* indices, uint64 numIndices, uint64 numVertices, uint32 cacheSize,
+                         uint32* outIndices, Array<uint32>& clusterStarts);
+
+// Sorts the clusters produced by OptimizeVertexCache so that the ones facing away from the center of
+// the mesh are drawn first, since they're more likely to occlude the rest of the mesh. The vertex
+// cache locality within each cluster is preserved.
+void OptimizeOverdraw(const uint32* indices, uint64 numIndices, const Float3* positions, uint64 positionStride,
+                      const Array<uint32>& clusterStarts, uint32* outIndices);
+
+// Builds a remap table that orders vertices by their first use in the index buffer, and rewrites
+// the indices to match. remap[newIdx] is the old index of each vertex, and unused vertices go last.
+void OptimizeVertexFetch(uint32* indices, uint64 numIndices, uint64 numVertices, Array<uint32>& remap);
+
+// Meshlet limits that fit in the recommended mesh shader output sizes. 124 triangles keeps the
+// packed primitive indices of a meshlet under 128 entries.
+static const uint32 MaxMeshletVertices = 64;
+static const uint32 MaxMeshletTriangles = 124;
+
+// A small cluster of triangles with its own culling bounds. The vertices are indices into the mesh's
+// vertex range, and each triangle is 3 8-bit indices into the meshlet's vertices packed into a uint32.
+// The triangles are also contiguous in the mesh's index buffer starting at IndexStart, so that they
+// can be drawn without mesh shaders. A meshlet with ConeCutoff >= 1 can't be backface culled.
+struct Meshlet
+{
+    uint32 VertexOffset = 0;
+    uint32 VertexCount = 0;
+    uint32 TriangleOffset = 0;
+    uint32 TriangleCount = 0;
+    uint32 IndexStart = 0;
+
+    Float3 AABBMin;
+    Float3 AABBMax;
+    Float3 SphereCenter;
+    float SphereRadius = 0.0f;
+    Float3 ConeAxis;
+    float ConeCutoff = 1.0f;
+};
+
+// Splits a mesh into meshlets by greedily growing each one with the connected triangle that adds the fewest new
+// vertices, preferring triangles close to the meshlet's centroid. New meshlets start from the next unused triangle
+// in the input order, so running this after OptimizeVertexCache keeps most of its locality. The indices are
+// re-ordered in place so that the triangles of each meshlet are contiguous.
+void BuildMeshlets(uint32* indices, uint64 numIndices, const Float3* positions, uint64 positionStride, uint64 numVertices,
+                   uint32 maxVertices, uint32 maxTriangles, GrowableList<Meshlet>& meshlets,
+                   GrowableList<uint32>& meshletVertices, GrowableList<uint32>& meshletTriangles);
+
+// Returns true if every triangle in the meshlet faces away from a viewer at viewPosition
+inline bool MeshletBackfacing(const Meshlet& meshlet, const Float3& viewPosition)
+{
+    const Float3 toMeshlet = meshlet.SphereCenter - viewPosition;
+    return Float3::Dot(toMeshlet, meshlet.ConeAxis) >= meshlet.ConeCutoff * Float3::Length(toMeshlet) + meshlet.SphereRadius;
+}
+
+// Returns true if every triangle in the meshlet faces away from a viewer looking down viewDirection with a parallel projection
+inline bool MeshletBackfacingOrthographic(const Meshlet& meshlet, const Float3& viewDirection)
+{
+    return Float3::Dot(viewDirection, meshlet.ConeAxis) >= meshlet.ConeCutoff;
+}
+
+}
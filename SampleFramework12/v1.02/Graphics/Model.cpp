@@ -17,7 +17,9 @@
 #include "..\\Serialization.h"
 #include "..\\FileIO.h"
 #include "Textures.h"
+#include "..\\Tasks.h"
 #include <chrono>
+#include <unordered_map>
 #include <cstddef>
 
 #include <xatlas.h>
@@ -71,6 +73,11 @@ static const D3D12_INPUT_ELEMENT_DESC StandardInputElements[6] =
     { "TEXCOORD",  1, DXGI_FORMAT_R32G32_FLOAT,    0, offsetof(MeshVertex, LightmapUV), D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
 };
 
+static const D3D12_INPUT_ELEMENT_DESC PositionOnlyInputElements[1] =
+{
+    { "POSITION",  0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+};
+
 static const wchar* DefaultTextures[] =
 {
     L"..\\Content\\Textures\\DefaultBaseColor.dds",     // Albedo
@@ -101,58 +108,286 @@ static Float4x4 ConvertMatrix(const aiMatrix4x4& mat)
                     Float4(mat.d1, mat.d2, mat.d3, mat.d4));
 }
 
-void LoadMaterialResources(Array<MeshMaterial>& materials, const wstring& directory, bool32 forceSRGB,
-                           GrowableList<MaterialTexture*>& materialTextures)
+static uint32 PackUNorm16x2(float x, float y)
+{
+    const uint32 packedX = uint32(Round(Saturate(x) * 65535.0f));
+    const uint32 packedY = uint32(Round(Saturate(y) * 65535.0f));
+    return packedX | (packedY << 16);
+}
+
+static Float2 UnpackUNorm16x2(uint32 packed)
+{
+    return Float2(float(packed & 0xFFFF), float(packed >> 16)) / 65535.0f;
+}
+
+static uint32 PackSNorm16x2(float x, float y)
+{
+    const int32 packedX = int32(Round(Clamp(x, -1.0f, 1.0f) * 32767.0f));
+    const int32 packedY = int32(Round(Clamp(y, -1.0f, 1.0f) * 32767.0f));
+    return (uint32(packedX) & 0xFFFF) | (uint32(packedY) << 16);
+}
+
+static Float2 UnpackSNorm16x2(uint32 packed)
+{
+    const int16 x = int16(packed & 0xFFFF);
+    const int16 y = int16(packed >> 16);
+    return Float2(Max(x / 32767.0f, -1.0f), Max(y / 32767.0f, -1.0f));
+}
+
+// Maps a unit vector onto the octahedron, and then unfolds the octahedron onto the [-1, 1] square
+static Float2 OctEncode(Float3 n)
+{
+    n /= std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if(n.z >= 0.0f)
+        return Float2(n.x, n.y);
+
+    return Float2((1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+                  (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
+}
+
+static Float3 OctDecode(Float2 e)
+{
+    Float3 n = Float3(e.x, e.y, 1.0f - std::abs(e.x) - std::abs(e.y));
+    if(n.z < 0.0f)
+    {
+        n.x = (1.0f - std::abs(e.y)) * (e.x >= 0.0f ? 1.0f : -1.0f);
+        n.y = (1.0f - std::abs(e.x)) * (e.y >= 0.0f ? 1.0f : -1.0f);
+    }
+
+    return Float3::Normalize(n);
+}
+
+static float AngleBetweenDegrees(const Float3& a, const Float3& b)
+{
+    const float cosAngle = Float3::Dot(Float3::Normalize(a), Float3::Normalize(b));
+    return RadToDeg(std::acos(Clamp(cosAngle, -1.0f, 1.0f)));
+}
+
+CompressedMeshVertex CompressMeshVertex(const MeshVertex& vertex, const Float3& quantizationMin, const Float3& quantizationScale)
+{
+    uint32 quantized[3] = { };
+    for(uint32 i = 0; i < 3; ++i)
+    {
+        const float offset = vertex.Position[i] - quantizationMin[i];
+        if(quantizationScale[i] > 0.0f)
+            quantized[i] = uint32(Clamp(Round(offset / quantizationScale[i]), 0.0f, 65535.0f));
+    }
+
+    const Float3 normal = Float3::Normalize(vertex.Normal);
+    const Float3 tangent = Float3::Normalize(vertex.Tangent);
+    const bool flipBitangent = Float3::Dot(Float3::Cross(normal, tangent), vertex.Bitangent) < 0.0f;
+
+    const Float2 octNormal = OctEncode(normal);
+    const Float2 octTangent = OctEncode(tangent);
+
+    CompressedMeshVertex compressed;
+    compressed.PositionXY = quantized[0] | (quantized[1] << 16);
+    compressed.PositionZBitangentSign = quantized[2] | (flipBitangent ? (1u << 16) : 0u);
+    compressed.Normal = PackSNorm16x2(octNormal.x, octNormal.y);
+    compressed.Tangent = PackSNorm16x2(octTangent.x, octTangent.y);
+    compressed.UV = Half2(vertex.UV);
+    compressed.LightmapUV = PackUNorm16x2(vertex.LightmapUV.x, vertex.LightmapUV.y);
+
+    return compressed;
+}
+
+MeshVertex DecompressMeshVertex(const CompressedMeshVertex& vertex, const Float3& quantizationMin, const Float3& quantizationScale)
+{
+    const Float3 quantized = Float3(float(vertex.PositionXY & 0xFFFF), float(vertex.PositionXY >> 16),
+                                    float(vertex.PositionZBitangentSign & 0xFFFF));
+
+    MeshVertex decompressed;
+    decompressed.Position = quantizationMin + quantized * quantizationScale;
+    decompressed.Normal = OctDecode(UnpackSNorm16x2(vertex.Normal));
+    decompressed.Tangent = OctDecode(UnpackSNorm16x2(vertex.Tangent));
+    decompressed.Bitangent = Float3::Normalize(Float3::Cross(decompressed.Normal, decompressed.Tangent));
+    if(vertex.PositionZBitangentSign >> 16)
+        decompressed.Bitangent = -decompressed.Bitangent;
+    decompressed.UV = vertex.UV.ToFloat2();
+    decompressed.LightmapUV = UnpackUNorm16x2(vertex.LightmapUV);
+
+    return decompressed;
+}
+
+// Picks the block compressed format for each kind of material texture. Normal maps only need X and Y since the
+// shaders reconstruct Z. The packed roughness/metallic/opacity texture always uses BC7 mode 5 (see
+// AddMaterialTextures()). BC1 and BC7 mode 6 share one set of indices between every channel, which bleeds the
+// independent masks into each other and breaks the alpha test on the opacity channel. Mode 5 gives one channel of
+// each block its own indices, so the opacity mask stays separate whenever it has edges in a block. Roughness and
+// metallic still share indices in those blocks, but metallic is almost always constant across a block.
+static DXGI_FORMAT MaterialTextureFormat(MaterialTextures texType, BlockCompressionQuality quality)
+{
+    if(quality == BlockCompressionQuality::Uncompressed)
+        return DXGI_FORMAT_UNKNOWN;
+
+    if(texType == MaterialTextures::Normal)
+        return DXGI_FORMAT_BC5_UNORM;
+
+    if(IsPackedMaterialTexture(texType))
+        return DXGI_FORMAT_BC7_UNORM;
+
+    return quality == BlockCompressionQuality::High ? DXGI_FORMAT_BC7_UNORM : DXGI_FORMAT_BC1_UNORM;
+}
+
+// Resolves the path of a material texture, falling back to the default texture when it's missing
+static wstring MaterialTexturePath(const MeshMaterial& material, const wstring& directory, MaterialTextures texType)
+{
+    const wstring& name = material.TextureNames[uint64(texType)];
+    wstring path = directory + name;
+    if(name.length() == 0 || FileExists(path.c_str()) == false)
+        path = DefaultTextures[uint64(texType)];
+    return path;
+}
+
+HRESULT LoadMaterialTextureFile(const MaterialTexture& matTexture, TextureFileData& fileData)
 {
+    if(matTexture.Packed)
+        return LoadPackedTextureFile(matTexture.Packing, fileData, matTexture.Options);
+    else
+        return LoadTextureFile(matTexture.Name.c_str(), fileData, matTexture.Options);
+}
+
+// Points every material at an entry in materialTextures, adding entries for the unique paths that aren't in there
+// yet. The new entries get their cook options and packing, but nothing is loaded, and they're also returned in
+// pendingTextures. A texture that's shared between different kinds of maps gets the format of whichever one uses it
+// first, the same as with the sRGB flag. Roughness, metallic and opacity are packed into the R, G and B channels of
+// one texture, which is shared by every material with the same combination of source maps.
+static void AddMaterialTextures(Array<MeshMaterial>& materials, const wstring& directory, bool32 forceSRGB,
+                                BlockCompressionQuality compression, GrowableList<MaterialTexture*>& materialTextures,
+                                GrowableList<MaterialTexture*>& pendingTextures)
+{
+    std::unordered_map<wstring, uint32> textureLookup;
+    for(uint64 i = 0; i < materialTextures.Count(); ++i)
+        textureLookup[materialTextures[i]->Name] = uint32(i);
+
     const uint64 numMaterials = materials.Size();
     for(uint64 matIdx = 0; matIdx < numMaterials; ++matIdx)
     {
         MeshMaterial& material = materials[matIdx];
+
+        // The packed texture is keyed on all of its sources, which can't collide with a regular texture path
+        TexturePackingDesc packing;
+        packing.FillValues[2] = 255;
+        packing.SourcePaths[0] = MaterialTexturePath(material, directory, MaterialTextures::Roughness);
+        packing.SourcePaths[1] = MaterialTexturePath(material, directory, MaterialTextures::Metallic);
+        packing.SourcePaths[2] = MaterialTexturePath(material, directory, MaterialTextures::Opacity);
+        const wstring packedName = packing.SourcePaths[0] + L"|" + packing.SourcePaths[1] + L"|" + packing.SourcePaths[2];
+        const bool hasOpacity = packing.SourcePaths[2].length() > 0;
+
         for(uint64 texType = 0; texType < uint64(MaterialTextures::Count); ++texType)
         {
             material.Textures[texType] = nullptr;
 
-            wstring path = directory + material.TextureNames[texType];
-            if(material.TextureNames[texType].length() == 0 || FileExists(path.c_str()) == false)
-                path = DefaultTextures[texType];
-
-            if(path.length() == 0)
+            const bool packed = IsPackedMaterialTexture(MaterialTextures(texType));
+            wstring path = packed ? packedName : MaterialTexturePath(material, directory, MaterialTextures(texType));
+            if(path.length() == 0 || (texType == uint64(MaterialTextures::Opacity) && hasOpacity == false))
             {
                 material.TextureIndices[texType] = uint32(-1);
                 continue;
             }
 
-            const uint64 numLoaded = materialTextures.Count();
-            for(uint64 i = 0; i < numLoaded; ++i)
+            auto existing = textureLookup.find(path);
+            if(existing != textureLookup.end())
             {
-                if(materialTextures[i]->Name == path)
-                {
-                    material.Textures[texType] = &materialTextures[i]->Texture;
-                    material.TextureIndices[texType] = uint32(i);
-                    break;
-                }
+                material.Textures[texType] = &materialTextures[existing->second]->Texture;
+                material.TextureIndices[texType] = existing->second;
+                continue;
             }
 
-            if(material.Textures[texType] == nullptr)
-            {
-                MaterialTexture* newMatTexture = new MaterialTexture();
-                newMatTexture->Name = path;
-                bool useSRGB = forceSRGB && texType == uint64(MaterialTextures::Albedo);
-                LoadTexture(newMatTexture->Texture, path.c_str(), useSRGB ? true : false);
-                uint64 idx = materialTextures.Add(newMatTexture);
-
-                material.Textures[texType] = &newMatTexture->Texture;
-                material.TextureIndices[texType] = uint32(idx);
-            }
+            // The texture gets created later, but its address is already stable
+            MaterialTexture* newMatTexture = new MaterialTexture();
+            newMatTexture->Name = path;
+            newMatTexture->SRGB = forceSRGB && texType == uint64(MaterialTextures::Albedo);
+            newMatTexture->Options.Compression = MaterialTextureFormat(MaterialTextures(texType), compression);
+            newMatTexture->Options.BC7Mode = packed ? 5 : 6;
+            newMatTexture->Packed = packed;
+            if(packed)
+                newMatTexture->Packing = packing;
+            const uint32 idx = uint32(materialTextures.Add(newMatTexture));
+            textureLookup[path] = idx;
+            pendingTextures.Add(newMatTexture);
+
+            material.Textures[texType] = &newMatTexture->Texture;
+            material.TextureIndices[texType] = idx;
         }
     }
 }
 
-void Mesh::InitFromAssimpMesh(const aiMesh& assimpMesh, float sceneScale, MeshVertex* dstVertices, uint8* dstIndices, IndexType indexType_)
+// Loads the textures for every material. The unique paths are gathered up front, then the textures are decoded on
+// the task threads in groups of a few per thread, with each group uploaded through a shared batch before the next
+// one is decoded. This keeps the decoded images for only one group in memory at a time. Source images that were
+// cooked ahead of time are read straight out of the texture cache instead of being decoded.
+void LoadMaterialResources(Array<MeshMaterial>& materials, const wstring& directory, bool32 forceSRGB,
+                           BlockCompressionQuality compression, GrowableList<MaterialTexture*>& materialTextures)
+{
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    GrowableList<MaterialTexture*> pendingTextures;
+    AddMaterialTextures(materials, directory, forceSRGB, compression, materialTextures, pendingTextures);
+
+    const uint64 numPending = pendingTextures.Count();
+    const uint64 groupSize = Tasks::NumThreads() * 2;
+    Array<TextureFileData> images;
+    Array<HRESULT> results;
+    TextureUploadBatch uploadBatch;
+    uint64 peakStagingMemory = 0;
+    uint64 numFromCache = 0;
+    BlockCompressionStats compressionStats;
+    for(uint64 groupStart = 0; groupStart < numPending; groupStart += groupSize)
+    {
+        const uint64 numInGroup = Min(groupSize, numPending - groupStart);
+        images.Init(numInGroup);
+        results.Init(numInGroup, S_OK);
+
+        Tasks::ParallelFor(numInGroup, [&](uint64 start, uint64 end, uint32 threadNum)
+        {
+            for(uint64 i = start; i < end; ++i)
+                results[i] = LoadMaterialTextureFile(*pendingTextures[groupStart + i], images[i]);
+        });
+
+        uint64 decodedSize = 0;
+        for(uint64 i = 0; i < numInGroup; ++i)
+        {
+            MaterialTexture* pending = pendingTextures[groupStart + i];
+            if(FAILED(results[i]))
+                throw Exception(MakeString(L"Failed to load texture '%ls': %ls", pending->Name.c_str(),
+                                           GetDXErrorString(results[i]).c_str()));
+
+            decodedSize += images[i].MemorySize();
+            numFromCache += images[i].FromCache ? 1 : 0;
+            compressionStats.Add(images[i].CompressionStats);
+            uploadBatch.Add(pending->Texture, images[i], pending->SRGB, pending->Name.c_str());
+        }
+
+        uploadBatch.Flush();
+        peakStagingMemory = Max(peakStagingMemory, decodedSize + uploadBatch.PeakBatchSize());
+    }
+
+    if(numPending > 0)
+    {
+        auto endTime = std::chrono::high_resolution_clock::now();
+        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime).count();
+        WriteLog("Loaded %llu textures (%llu from the texture cache) in %lld ms with %u threads, using %llu upload submissions "
+                 "and %.1f MB of peak staging memory", numPending, numFromCache, duration, Tasks::NumThreads(),
+                 uploadBatch.NumSubmissions(), peakStagingMemory / (1024.0 * 1024.0));
+    }
+
+    if(compressionStats.NumTextures > 0)
+    {
+        WriteLog("Block compressed %llu textures from %.1f MB to %.1f MB in %.0f ms of encoding time (%.1f Mtexels/s). "
+                 "PSNR: %.2f dB overall, %.2f dB worst", compressionStats.NumTextures,
+                 compressionStats.UncompressedSize / (1024.0 * 1024.0), compressionStats.CompressedSize / (1024.0 * 1024.0),
+                 compressionStats.EncodeTime, compressionStats.MegaTexelsPerSecond(), compressionStats.PSNR(),
+                 compressionStats.WorstPSNR);
+    }
+}
+
+void Mesh::InitFromAssimpMesh(const aiMesh& assimpMesh, float sceneScale, MeshVertex* dstVertices, uint8* dstIndices)
 {
     numVertices = assimpMesh.mNumVertices;
     numIndices = assimpMesh.mNumFaces * 3;
-    indexType = indexType_;
+    indexType = IndexTypeForVertexCount(numVertices);
+    indices = dstIndices;
 
     if(assimpMesh.HasPositions())
     {
@@ -198,7 +433,7 @@ void Mesh::InitFromAssimpMesh(const aiMesh& assimpMesh, float sceneScale, MeshVe
 
     // Copy the index data
     const uint64 numTriangles = assimpMesh.mNumFaces;
-    if(indexType_ == IndexType::Index16Bit)
+    if(indexType == IndexType::Index16Bit)
     {
         uint16* dstIndices16 = (uint16*)dstIndices;
         for(uint64 triIdx = 0; triIdx < numTriangles; ++triIdx)
@@ -384,14 +619,15 @@ void Mesh::InitPlane(const Float2& dimensions, const Float3& position, const Qua
     aabbMax = Float3(dimensions.x, 0.0f, dimensions.y) * 0.5f;
 }
 
-void Mesh::InitCommon(const MeshVertex* vertices_, const uint8* indices_, uint64 vbAddress, uint64 ibAddress, uint64 vtxOffset_, uint64 idxOffset_)
+void Mesh::InitCommon(const MeshVertex* vertices_, const uint8* indices_, uint64 vbAddress, uint64 ibAddress, uint64 vtxOffset_, uint64 idxByteOffset_)
 {
     Assert_(meshParts.Size() > 0);
+    Assert_(idxByteOffset_ % MeshIndexAlignment == 0);
 
     vertices = vertices_;
     indices = indices_;
     vtxOffset = uint32(vtxOffset_);
-    idxOffset = uint32(idxOffset_);
+    idxByteOffset = uint32(idxByteOffset_);
 
     vbView.BufferLocation = vbAddress;
     vbView.SizeInBytes = sizeof(MeshVertex) * numVertices;
@@ -410,6 +646,7 @@ void Mesh::Shutdown()
     meshParts.Shutdown();
     vertices = nullptr;
     indices = nullptr;
+    positionIndices = nullptr;
 }
 
 const char* Mesh::InputElementTypeString(InputElementType elemType)
@@ -430,6 +667,127 @@ const char* Mesh::InputElementTypeString(InputElementType elemType)
     return ElemStrings[uint64(elemType)];
 }
 
+// Reads the names and texture file names of an imported scene's materials
+static void ReadAssimpMaterials(const aiScene& scene, Array<MeshMaterial>& materials)
+{
+    const uint64 numMaterials = scene.mNumMaterials;
+    materials.Init(numMaterials);
+    for(uint64 i = 0; i < numMaterials; ++i)
+    {
+        MeshMaterial& material = materials[i];
+        const aiMaterial& mat = *scene.mMaterials[i];
+
+        aiString matName;
+        mat.Get(AI_MATKEY_NAME, matName);
+        material.Name = matName.C_Str();
+
+        aiString diffuseTexPath;
+        aiString normalMapPath;
+        aiString roughnessMapPath;
+        aiString metallicMapPath;
+        aiString opacityMapPath;
+        aiString emissiveMapPath;
+        if(mat.GetTexture(aiTextureType_DIFFUSE, 0, &diffuseTexPath) == aiReturn_SUCCESS)
+            material.TextureNames[uint64(MaterialTextures::Albedo)] = GetFileName(AnsiToWString(diffuseTexPath.C_Str()).c_str());
+
+        if(mat.GetTexture(aiTextureType_NORMALS, 0, &normalMapPath) == aiReturn_SUCCESS
+           || mat.GetTexture(aiTextureType_HEIGHT, 0, &normalMapPath) == aiReturn_SUCCESS)
+            material.TextureNames[uint64(MaterialTextures::Normal)] = GetFileName(AnsiToWString(normalMapPath.C_Str()).c_str());
+
+        if(mat.GetTexture(aiTextureType_SHININESS, 0, &roughnessMapPath) == aiReturn_SUCCESS)
+            material.TextureNames[uint64(MaterialTextures::Roughness)] = GetFileName(AnsiToWString(roughnessMapPath.C_Str()).c_str());
+
+        if(mat.GetTexture(aiTextureType_AMBIENT, 0, &metallicMapPath) == aiReturn_SUCCESS)
+            material.TextureNames[uint64(MaterialTextures::Metallic)] = GetFileName(AnsiToWString(metallicMapPath.C_Str()).c_str());
+
+        if(mat.GetTexture(aiTextureType_OPACITY, 0, &opacityMapPath) == aiReturn_SUCCESS)
+            material.TextureNames[uint64(MaterialTextures::Opacity)] = GetFileName(AnsiToWString(opacityMapPath.C_Str()).c_str());
+
+        if(mat.GetTexture(aiTextureType_EMISSIVE, 0, &emissiveMapPath) == aiReturn_SUCCESS)
+            material.TextureNames[uint64(MaterialTextures::Emissive)] = GetFileName(AnsiToWString(emissiveMapPath.C_Str()).c_str());
+    }
+}
+
+static wstring ModelTextureDirectory(const ModelLoadSettings& settings, const wstring& fileDirectory)
+{
+    return settings.TextureDir ? fileDirectory + L"\\" + settings.TextureDir + L"\\" : fileDirectory;
+}
+
+TextureCookStats CookModelTextures(const ModelLoadSettings& settings)
+{
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    const wchar* filePath = settings.FilePath;
+    Assert_(filePath != nullptr);
+    if(FileExists(filePath) == false)
+        throw Exception(MakeString(L"Model file with path '%ls' does not exist", filePath));
+
+    // Only the materials are needed, but they have to come out in the same order as in CreateWithAssimp() since a
+    // texture that's shared between different kinds of maps gets its format from the first one that uses it
+    Assimp::Importer importer;
+    const aiScene* scene = importer.ReadFile(WStringToAnsi(filePath), aiProcess_RemoveRedundantMaterials);
+    if(scene == nullptr)
+        throw Exception(L"Failed to load scene " + std::wstring(filePath) +
+                        L": " + AnsiToWString(importer.GetErrorString()));
+
+    Array<MeshMaterial> materials;
+    ReadAssimpMaterials(*scene, materials);
+
+    GrowableList<MaterialTexture*> materialTextures;
+    GrowableList<MaterialTexture*> pendingTextures;
+    AddMaterialTextures(materials, ModelTextureDirectory(settings, GetDirectoryFromFilePath(filePath)), settings.ForceSRGB,
+                        settings.TextureCompression, materialTextures, pendingTextures);
+
+    enum class CookResult : uint8
+    {
+        Cooked,
+        UpToDate,
+        Failed,
+        NotCookable,
+    };
+
+    // Loading a texture that isn't in the cache is what writes it out, so cooking is just loading each texture the
+    // same way that LoadMaterialResources() would and throwing the result away
+    Array<CookResult> results(pendingTextures.Count(), CookResult::Failed);
+    Tasks::ParallelFor(pendingTextures.Count(), [&](uint64 start, uint64 end, uint32 threadNum)
+    {
+        for(uint64 i = start; i < end; ++i)
+        {
+            const MaterialTexture& matTexture = *pendingTextures[i];
+            if(matTexture.Packed == false && IsCookableTexture(matTexture.Name.c_str()) == false)
+            {
+                results[i] = CookResult::NotCookable;
+                continue;
+            }
+
+            TextureFileData fileData;
+            const HRESULT hr = LoadMaterialTextureFile(matTexture, fileData);
+            if(SUCCEEDED(hr))
+                results[i] = fileData.FromCache ? CookResult::UpToDate : CookResult::Cooked;
+            else
+                WriteLog(L"Failed to cook texture '%ls': %ls", matTexture.Name.c_str(), GetDXErrorString(hr).c_str());
+        }
+    });
+
+    TextureCookStats stats;
+    for(uint64 i = 0; i < results.Size(); ++i)
+    {
+        stats.NumTextures += results[i] != CookResult::NotCookable ? 1 : 0;
+        stats.NumCooked += results[i] == CookResult::Cooked ? 1 : 0;
+        stats.NumUpToDate += results[i] == CookResult::UpToDate ? 1 : 0;
+        stats.NumFailed += results[i] == CookResult::Failed ? 1 : 0;
+    }
+
+    // None of these were ever created on the GPU
+    for(uint64 i = 0; i < materialTextures.Count(); ++i)
+        delete materialTextures[i];
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+    stats.CookTime = double(std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count()) / 1000.0;
+
+    return stats;
+}
+
 // == Model =======================================================================================
 
 void Model::CreateWithAssimp(const ModelLoadSettings& settings)
@@ -458,6 +816,7 @@ void Model::CreateWithAssimp(const ModelLoadSettings& settings)
 
     fileDirectory = GetDirectoryFromFilePath(filePath);
     forceSRGB = settings.ForceSRGB;
+    textureCompression = settings.TextureCompression;
 
     // Grab the lights before we process the scene
     spotLights.Init(scene->mNumLights);
@@ -520,55 +879,18 @@ void Model::CreateWithAssimp(const ModelLoadSettings& settings)
     scene = importer.ApplyPostProcessing(flags);
 
     // Load the materials
-    const uint64 numMaterials = scene->mNumMaterials;
-    meshMaterials.Init(numMaterials);
-    for(uint64 i = 0; i < numMaterials; ++i)
-    {
-        MeshMaterial& material = meshMaterials[i];
-        const aiMaterial& mat = *scene->mMaterials[i];
-
-        aiString matName;
-        mat.Get(AI_MATKEY_NAME, matName);
-        material.Name = matName.C_Str();
-
-        aiString diffuseTexPath;
-        aiString normalMapPath;
-        aiString roughnessMapPath;
-        aiString metallicMapPath;
-        aiString opacityMapPath;
-        aiString emissiveMapPath;
-        if(mat.GetTexture(aiTextureType_DIFFUSE, 0, &diffuseTexPath) == aiReturn_SUCCESS)
-            material.TextureNames[uint64(MaterialTextures::Albedo)] = GetFileName(AnsiToWString(diffuseTexPath.C_Str()).c_str());
-
-        if(mat.GetTexture(aiTextureType_NORMALS, 0, &normalMapPath) == aiReturn_SUCCESS
-           || mat.GetTexture(aiTextureType_HEIGHT, 0, &normalMapPath) == aiReturn_SUCCESS)
-            material.TextureNames[uint64(MaterialTextures::Normal)] = GetFileName(AnsiToWString(normalMapPath.C_Str()).c_str());
-
-        if(mat.GetTexture(aiTextureType_SHININESS, 0, &roughnessMapPath) == aiReturn_SUCCESS)
-            material.TextureNames[uint64(MaterialTextures::Roughness)] = GetFileName(AnsiToWString(roughnessMapPath.C_Str()).c_str());
-
-        if(mat.GetTexture(aiTextureType_AMBIENT, 0, &metallicMapPath) == aiReturn_SUCCESS)
-            material.TextureNames[uint64(MaterialTextures::Metallic)] = GetFileName(AnsiToWString(metallicMapPath.C_Str()).c_str());
-
-        if(mat.GetTexture(aiTextureType_OPACITY, 0, &opacityMapPath) == aiReturn_SUCCESS)
-            material.TextureNames[uint64(MaterialTextures::Opacity)] = GetFileName(AnsiToWString(opacityMapPath.C_Str()).c_str());
-
-        if(mat.GetTexture(aiTextureType_EMISSIVE, 0, &emissiveMapPath) == aiReturn_SUCCESS)
-            material.TextureNames[uint64(MaterialTextures::Emissive)] = GetFileName(AnsiToWString(emissiveMapPath.C_Str()).c_str());
-    }
-
-    std::wstring textureDir = settings.TextureDir ? fileDirectory + L"\\" + settings.TextureDir + L"\\" : fileDirectory;
-    LoadMaterialResources(meshMaterials, textureDir, settings.ForceSRGB, materialTextures);
+    ReadAssimpMaterials(*scene, meshMaterials);
+    LoadMaterialResources(meshMaterials, ModelTextureDirectory(settings, fileDirectory), settings.ForceSRGB,
+                          textureCompression, materialTextures);
 
     aabbMin = FloatMax;
     aabbMax = -FloatMax;
 
-    indexType = IndexType::Index16Bit;
-
-    // Initialize the meshes
+    // Initialize the meshes, with each one only using 32-bit indices if it has too many vertices for 16-bit
     const uint64 numMeshes = scene->mNumMeshes;
     uint64 numVertices = 0;
     uint64 numIndices = 0;
+    uint64 numIndexBytes = 0;
     for(uint64 i = 0; i < numMeshes; ++i)
     {
         const aiMesh& assimpMesh = *scene->mMeshes[i];
@@ -576,22 +898,24 @@ void Model::CreateWithAssimp(const ModelLoadSettings& settings)
         numVertices += assimpMesh.mNumVertices;
         numIndices += assimpMesh.mNumFaces * 3;
 
-        if(assimpMesh.mNumFaces * 3 > 0xFFFF)
-            indexType = IndexType::Index32Bit;
+        const uint64 indexSize = IndexTypeSize(IndexTypeForVertexCount(assimpMesh.mNumVertices));
+        numIndexBytes = AlignTo(numIndexBytes, MeshIndexAlignment) + assimpMesh.mNumFaces * 3 * indexSize;
     }
 
-
-    const uint64 indexSize = indexType == IndexType::Index32Bit ? 4 : 2;
-
     vertices.Init(numVertices);
-    indices.Init(numIndices * indexSize);
+    indices.Init(AlignTo(numIndexBytes, MeshIndexAlignment), 0);
 
     meshes.Init(numMeshes);
     uint64 vtxOffset = 0;
-    uint64 idxOffset = 0;
+    uint64 idxByteOffset = 0;
     for(uint64 i = 0; i < numMeshes; ++i)
     {
-        meshes[i].InitFromAssimpMesh(*scene->mMeshes[i], settings.SceneScale, &vertices[vtxOffset], &indices[idxOffset], indexType);
+        idxByteOffset = AlignTo(idxByteOffset, MeshIndexAlignment);
+        meshes[i].InitFromAssimpMesh(*scene->mMeshes[i], settings.SceneScale, &vertices[vtxOffset], &indices[idxByteOffset]);
+
+        // CreateBuffers sets these again, but the optimizer and xatlas need them before that
+        meshes[i].vtxOffset = uint32(vtxOffset);
+        meshes[i].idxByteOffset = uint32(idxByteOffset);
 
         aabbMin.x = Min(aabbMin.x, meshes[i].AABBMin().x);
         aabbMin.y = Min(aabbMin.y, meshes[i].AABBMin().y);
@@ -602,9 +926,15 @@ void Model::CreateWithAssimp(const ModelLoadSettings& settings)
         aabbMax.z = Max(aabbMax.z, meshes[i].AABBMax().z);
 
         vtxOffset += meshes[i].NumVertices();
-        idxOffset += meshes[i].NumIndices() * indexSize;
+        idxByteOffset += meshes[i].NumIndices() * meshes[i].IndexSize();
     }
 
+    WriteLog("Using %llu bytes of index data for %llu indices (%llu bytes with only 32-bit indices)",
+             indices.Size(), numIndices, numIndices * sizeof(uint32));
+
+    OptimizeMeshes();
+    BuildMeshlets();
+
     // --- xatlas 集成逻辑，从这里开始 ---
     WriteLog("Starting xatlas UV unwrapping...");
 
@@ -630,8 +960,8 @@ void Model::CreateWithAssimp(const ModelLoadSettings& settings)
         
         // 告诉 xatlas 索引数据
         meshDecl.indexCount = mesh.NumIndices();
-        meshDecl.indexData = (void*)(indices.Data() + mesh.IndexOffset() * IndexSize());
-        meshDecl.indexFormat = (IndexSize() == 2) ? xatlas::IndexFormat::UInt16 : xatlas::IndexFormat::UInt32;
+        meshDecl.indexData = (void*)(indices.Data() + mesh.IndexByteOffset());
+        meshDecl.indexFormat = (mesh.IndexSize() == 2) ? xatlas::IndexFormat::UInt16 : xatlas::IndexFormat::UInt32;
         
         xatlas::AddMeshError error = xatlas::AddMesh(atlas, meshDecl);
         if (error != xatlas::AddMeshError::Success)
@@ -647,21 +977,22 @@ void Model::CreateWithAssimp(const ModelLoadSettings& settings)
 
     // 4. 从 xatlas 的输出重建我们的光照贴图专用几何体
     // 首先，计算新的总顶点数和索引数
+    // xatlas always outputs 32-bit indices, but they're narrowed per mesh the same way as the source meshes
     uint32 totalNewVertices = 0;
-    uint32 totalNewIndices = 0;
+    uint64 totalNewIndexBytes = 0;
     for (uint32 i = 0; i < atlas->meshCount; i++) {
         totalNewVertices += atlas->meshes[i].vertexCount;
-        totalNewIndices += atlas->meshes[i].indexCount;
+        const uint64 indexSize = IndexTypeSize(IndexTypeForVertexCount(atlas->meshes[i].vertexCount));
+        totalNewIndexBytes = AlignTo(totalNewIndexBytes, MeshIndexAlignment) + atlas->meshes[i].indexCount * indexSize;
     }
 
     // 初始化我们新增的成员变量
     lightmappedVertices.Init(totalNewVertices);
-    lightmappedIndices.Init(totalNewIndices * sizeof(uint32)); // xatlas 输出总是 32-bit 索引
+    lightmappedIndices.Init(AlignTo(totalNewIndexBytes, MeshIndexAlignment), 0);
     lightmappedMeshes.Init(atlas->meshCount);
 
-    uint32* newIndices = (uint32*)lightmappedIndices.Data();
     uint32 currentVertexOffset = 0;
-    uint32 currentIndexOffset = 0;
+    uint64 currentIndexByteOffset = 0;
     
     for (uint32 i = 0; i < atlas->meshCount; i++)
     {
@@ -684,10 +1015,17 @@ void Model::CreateWithAssimp(const ModelLoadSettings& settings)
             newVertex.LightmapUV = Float2(xatlasVertex.uv[0] / atlas->width, xatlasVertex.uv[1] / atlas->height); // 设置新的LightmapUV
         }
         
-        // 填充新的索引数据
+        // 填充新的索引数据. These stay relative to the mesh, like the source meshes, since the draws
+        // use the vertex offset as the base vertex location
+        currentIndexByteOffset = AlignTo(currentIndexByteOffset, MeshIndexAlignment);
+        const IndexType newIndexType = IndexTypeForVertexCount(outputMesh.vertexCount);
+        uint8* newIndices = &lightmappedIndices[currentIndexByteOffset];
         for (uint32 j = 0; j < outputMesh.indexCount; j++)
         {
-            newIndices[currentIndexOffset + j] = outputMesh.indexArray[j] + currentVertexOffset;
+            if (newIndexType == IndexType::Index16Bit)
+                reinterpret_cast<uint16*>(newIndices)[j] = uint16(outputMesh.indexArray[j]);
+            else
+                reinterpret_cast<uint32*>(newIndices)[j] = outputMesh.indexArray[j];
         }
 
         // 更新光照贴图网格信息
@@ -699,11 +1037,13 @@ void Model::CreateWithAssimp(const ModelLoadSettings& settings)
         newMesh.numVertices = outputMesh.vertexCount;
         newMesh.numIndices = outputMesh.indexCount;
         newMesh.vtxOffset = currentVertexOffset;
-        newMesh.idxOffset = currentIndexOffset;
-        newMesh.indexType = IndexType::Index32Bit; // xatlas 输出是 32-bit
+        newMesh.idxByteOffset = uint32(currentIndexByteOffset);
+        newMesh.indexType = newIndexType;
+        newMesh.meshletOffset = meshes[i].meshletOffset;
+        newMesh.numMeshlets = meshes[i].numMeshlets;
         
         currentVertexOffset += outputMesh.vertexCount;
-        currentIndexOffset += outputMesh.indexCount;
+        currentIndexByteOffset += outputMesh.indexCount * IndexTypeSize(newIndexType);
     }
 
     // 5. 清理 xatlas
@@ -733,7 +1073,7 @@ void Model::CreateFromMeshData(const wchar* filePath)
 
     CreateBuffers();
 
-    LoadMaterialResources(meshMaterials, fileDirectory, forceSRGB, materialTextures);
+    LoadMaterialResources(meshMaterials, fileDirectory, forceSRGB, textureCompression, materialTextures);
 }
 
 void Model::GenerateBoxScene(const Float3& dimensions, const Float3& position,
@@ -745,9 +1085,7 @@ void Model::GenerateBoxScene(const Float3& dimensions, const Float3& position,
     material.TextureNames[uint64(MaterialTextures::Albedo)] = colorMap;
     material.TextureNames[uint64(MaterialTextures::Normal)] = normalMap;
     fileDirectory = L"..\\Content\\Textures\\";
-    LoadMaterialResources(meshMaterials, L"..\\Content\\Textures\\", false, materialTextures);
-
-    indexType = IndexType::Index16Bit;
+    LoadMaterialResources(meshMaterials, L"..\\Content\\Textures\\", false, textureCompression, materialTextures);
 
     vertices.Init(NumBoxVerts);
     indices.Init(NumBoxIndices * sizeof(uint16));
@@ -765,9 +1103,7 @@ void Model::GenerateBoxTestScene()
     material.TextureNames[uint64(MaterialTextures::Albedo)] = L"White.png";
     material.TextureNames[uint64(MaterialTextures::Normal)] = L"Hex.png";
     fileDirectory = L"..\\Content\\Textures\\";
-    LoadMaterialResources(meshMaterials, L"..\\Content\\Textures\\", false, materialTextures);
-
-    indexType = IndexType::Index16Bit;
+    LoadMaterialResources(meshMaterials, L"..\\Content\\Textures\\", false, textureCompression, materialTextures);
 
     vertices.Init(NumBoxVerts * 2);
     indices.Init(NumBoxIndices * 2 * sizeof(uint16));
@@ -788,9 +1124,7 @@ void Model::GeneratePlaneScene(const Float2& dimensions, const Float3& position,
     material.TextureNames[uint64(MaterialTextures::Albedo)] = colorMap;
     material.TextureNames[uint64(MaterialTextures::Normal)] = normalMap;
     fileDirectory = L"..\\Content\\Textures\\";
-    LoadMaterialResources(meshMaterials, L"..\\Content\\Textures\\", false, materialTextures);
-
-    indexType = IndexType::Index16Bit;
+    LoadMaterialResources(meshMaterials, L"..\\Content\\Textures\\", false, textureCompression, materialTextures);
 
     vertices.Init(NumPlaneVerts);
     indices.Init(NumPlaneIndices * sizeof(uint16));
@@ -821,11 +1155,20 @@ void Model::Shutdown()
     materialTextures.Shutdown();
     fileDirectory = L"";
     forceSRGB = false;
+    textureCompression = BlockCompressionQuality::Uncompressed;
 
     vertexBuffer.Shutdown();
     indexBuffer.Shutdown();
     vertices.Shutdown();
     indices.Shutdown();
+    positionBuffer.Shutdown();
+    positionIndexBuffer.Shutdown();
+    positions.Shutdown();
+    positionIndices.Shutdown();
+    compressedVertexBuffer.Shutdown();
+    meshlets.Shutdown();
+    meshletVertices.Shutdown();
+    meshletTriangles.Shutdown();
 
     lightmappedVertexBuffer.Shutdown();
     lightmappedIndexBuffer.Shutdown();
@@ -848,6 +1191,197 @@ uint64 Model::NumInputElements()
     return ArraySize_(StandardInputElements);
 }
 
+const D3D12_INPUT_ELEMENT_DESC* Model::PositionInputElements()
+{
+    return PositionOnlyInputElements;
+}
+
+uint64 Model::NumPositionInputElements()
+{
+    return ArraySize_(PositionOnlyInputElements);
+}
+
+// Re-orders the triangles and vertices of every mesh for the post-transform vertex cache, overdraw, and
+// vertex fetch locality. This also improves the locality of acceleration structure builds.
+void Model::OptimizeMeshes()
+{
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    const uint64 numMeshes = meshes.Size();
+    Array<VertexCacheStats> meshStatsBefore(numMeshes);
+    Array<VertexCacheStats> meshStatsAfter(numMeshes);
+    Tasks::ParallelFor(numMeshes, [&](uint64 start, uint64 end, uint32 threadNum)
+    {
+        for(uint64 meshIdx = start; meshIdx < end; ++meshIdx)
+        {
+            Mesh& mesh = meshes[meshIdx];
+            const uint64 numMeshIndices = mesh.NumIndices();
+            const uint64 numMeshVertices = mesh.NumVertices();
+            if(numMeshIndices == 0 || numMeshVertices == 0)
+                continue;
+
+            Array<uint32> meshIndices(numMeshIndices);
+            for(uint64 i = 0; i < numMeshIndices; ++i)
+                meshIndices[i] = mesh.Index(i);
+
+            MeshVertex* meshVertices = &vertices[mesh.VertexOffset()];
+            meshStatsBefore[meshIdx] = AnalyzeVertexCache(meshIndices.Data(), numMeshIndices, numMeshVertices);
+
+            Array<uint32> cacheOptimizedIndices(numMeshIndices);
+            Array<uint32> clusterStarts;
+            OptimizeVertexCache(meshIndices.Data(), numMeshIndices, numMeshVertices, DefaultVertexCacheSize,
+                                cacheOptimizedIndices.Data(), clusterStarts);
+            OptimizeOverdraw(cacheOptimizedIndices.Data(), numMeshIndices, &meshVertices[0].Position, sizeof(MeshVertex),
+                             clusterStarts, meshIndices.Data());
+
+            Array<uint32> vertexRemap;
+            OptimizeVertexFetch(meshIndices.Data(), numMeshIndices, numMeshVertices, vertexRemap);
+
+            Array<MeshVertex> oldVertices(numMeshVertices);
+            for(uint64 i = 0; i < numMeshVertices; ++i)
+                oldVertices[i] = meshVertices[i];
+            for(uint64 i = 0; i < numMeshVertices; ++i)
+                meshVertices[i] = oldVertices[vertexRemap[i]];
+
+            uint8* dstIndices = &indices[mesh.IndexByteOffset()];
+            for(uint64 i = 0; i < numMeshIndices; ++i)
+            {
+                if(mesh.IndexBufferType() == IndexType::Index16Bit)
+                    reinterpret_cast<uint16*>(dstIndices)[i] = uint16(meshIndices[i]);
+                else
+                    reinterpret_cast<uint32*>(dstIndices)[i] = meshIndices[i];
+            }
+
+            meshStatsAfter[meshIdx] = AnalyzeVertexCache(meshIndices.Data(), numMeshIndices, numMeshVertices);
+        }
+    });
+
+    // ACMR is per-triangle and ATVR is per-vertex, so weight them accordingly
+    double acmrBefore = 0.0;
+    double acmrAfter = 0.0;
+    double atvrBefore = 0.0;
+    double atvrAfter = 0.0;
+    uint64 totalTriangles = 0;
+    uint64 totalVertices = 0;
+    for(uint64 meshIdx = 0; meshIdx < numMeshes; ++meshIdx)
+    {
+        const uint64 numTriangles = meshes[meshIdx].NumIndices() / 3;
+        const uint64 numMeshVertices = meshes[meshIdx].NumVertices();
+        acmrBefore += double(meshStatsBefore[meshIdx].ACMR) * double(numTriangles);
+        acmrAfter += double(meshStatsAfter[meshIdx].ACMR) * double(numTriangles);
+        atvrBefore += double(meshStatsBefore[meshIdx].ATVR) * double(numMeshVertices);
+        atvrAfter += double(meshStatsAfter[meshIdx].ATVR) * double(numMeshVertices);
+        totalTriangles += numTriangles;
+        totalVertices += numMeshVertices;
+    }
+
+    statsBeforeOptimization = VertexCacheStats();
+    statsAfterOptimization = VertexCacheStats();
+    if(totalTriangles > 0 && totalVertices > 0)
+    {
+        statsBeforeOptimization.ACMR = float(acmrBefore / double(totalTriangles));
+        statsBeforeOptimization.ATVR = float(atvrBefore / double(totalVertices));
+        statsAfterOptimization.ACMR = float(acmrAfter / double(totalTriangles));
+        statsAfterOptimization.ATVR = float(atvrAfter / double(totalVertices));
+    }
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime).count();
+    WriteLog("Optimized %llu meshes in %lld ms. ACMR: %.3f -> %.3f, ATVR: %.3f -> %.3f", numMeshes, duration,
+             statsBeforeOptimization.ACMR, statsAfterOptimization.ACMR, statsBeforeOptimization.ATVR, statsAfterOptimization.ATVR);
+}
+
+// Splits every mesh into meshlets for finer-grained culling, re-ordering each mesh's triangles so that the
+// triangles of every meshlet are contiguous in the index buffer
+void Model::BuildMeshlets()
+{
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    const uint64 numMeshes = meshes.Size();
+    Array<GrowableList<Meshlet>> meshMeshlets(numMeshes);
+    Array<GrowableList<uint32>> meshMeshletVertices(numMeshes);
+    Array<GrowableList<uint32>> meshMeshletTriangles(numMeshes);
+    Tasks::ParallelFor(numMeshes, [&](uint64 start, uint64 end, uint32 threadNum)
+    {
+        for(uint64 meshIdx = start; meshIdx < end; ++meshIdx)
+        {
+            const Mesh& mesh = meshes[meshIdx];
+            const uint64 numMeshIndices = mesh.NumIndices();
+
+            // Meshlets can cross part boundaries, so meshes with multiple parts keep their triangle order
+            if(numMeshIndices == 0 || mesh.NumMeshParts() != 1)
+                continue;
+
+            Array<uint32> meshIndices(numMeshIndices);
+            for(uint64 i = 0; i < numMeshIndices; ++i)
+                meshIndices[i] = mesh.Index(i);
+
+            SampleFramework12::BuildMeshlets(meshIndices.Data(), numMeshIndices, &vertices[mesh.VertexOffset()].Position, sizeof(MeshVertex),
+                                             mesh.NumVertices(), MaxMeshletVertices, MaxMeshletTriangles, meshMeshlets[meshIdx],
+                                             meshMeshletVertices[meshIdx], meshMeshletTriangles[meshIdx]);
+
+            uint8* dstIndices = &indices[mesh.IndexByteOffset()];
+            for(uint64 i = 0; i < numMeshIndices; ++i)
+            {
+                if(mesh.IndexBufferType() == IndexType::Index16Bit)
+                    reinterpret_cast<uint16*>(dstIndices)[i] = uint16(meshIndices[i]);
+                else
+                    reinterpret_cast<uint32*>(dstIndices)[i] = meshIndices[i];
+            }
+        }
+    });
+
+    // Merge the per-mesh lists, offsetting the meshlets to their place in the combined vertex and triangle lists
+    uint64 totalMeshlets = 0;
+    uint64 totalVertices = 0;
+    uint64 totalTriangles = 0;
+    for(uint64 meshIdx = 0; meshIdx < numMeshes; ++meshIdx)
+    {
+        totalMeshlets += meshMeshlets[meshIdx].Count();
+        totalVertices += meshMeshletVertices[meshIdx].Count();
+        totalTriangles += meshMeshletTriangles[meshIdx].Count();
+    }
+
+    meshlets.Init(totalMeshlets);
+    meshletVertices.Init(totalVertices);
+    meshletTriangles.Init(totalTriangles);
+
+    uint64 meshletOffset = 0;
+    uint64 vertexOffset = 0;
+    uint64 triangleOffset = 0;
+    for(uint64 meshIdx = 0; meshIdx < numMeshes; ++meshIdx)
+    {
+        Mesh& mesh = meshes[meshIdx];
+        mesh.meshletOffset = uint32(meshletOffset);
+        mesh.numMeshlets = uint32(meshMeshlets[meshIdx].Count());
+
+        for(uint64 i = 0; i < mesh.numMeshlets; ++i)
+        {
+            Meshlet& meshlet = meshlets[meshletOffset + i];
+            meshlet = meshMeshlets[meshIdx][i];
+            meshlet.VertexOffset += uint32(vertexOffset);
+            meshlet.TriangleOffset += uint32(triangleOffset);
+        }
+
+        const GrowableList<uint32>& srcVertices = meshMeshletVertices[meshIdx];
+        const GrowableList<uint32>& srcTriangles = meshMeshletTriangles[meshIdx];
+        if(srcVertices.Count() > 0)
+            memcpy(&meshletVertices[vertexOffset], srcVertices.Data(), srcVertices.Count() * sizeof(uint32));
+        if(srcTriangles.Count() > 0)
+            memcpy(&meshletTriangles[triangleOffset], srcTriangles.Data(), srcTriangles.Count() * sizeof(uint32));
+
+        meshletOffset += mesh.numMeshlets;
+        vertexOffset += srcVertices.Count();
+        triangleOffset += srcTriangles.Count();
+    }
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime).count();
+    WriteLog("Built %llu meshlets in %lld ms, averaging %.1f vertices and %.1f triangles per meshlet", totalMeshlets, duration,
+             totalMeshlets > 0 ? double(totalVertices) / double(totalMeshlets) : 0.0,
+             totalMeshlets > 0 ? double(totalTriangles) / double(totalMeshlets) : 0.0);
+}
+
 void Model::CreateBuffers()
 {
     Assert_(meshes.Size() > 0);
@@ -858,26 +1392,194 @@ void Model::CreateBuffers()
     sbInit.InitData = vertices.Data();
     vertexBuffer.Initialize(sbInit);
 
-    const uint32 indexSize = IndexSize();
+    Assert_(indices.Size() % RawBuffer::Stride == 0);
 
-    FormattedBufferInit fbInit;
-    fbInit.Format = IndexBufferFormat();
-    fbInit.NumElements = indices.Size() / indexSize;
-    fbInit.InitData = indices.Data();
-    indexBuffer.Initialize(fbInit);
+    RawBufferInit rbInit;
+    rbInit.NumElements = indices.Size() / RawBuffer::Stride;
+    rbInit.InitData = indices.Data();
+    rbInit.Name = L"Index Buffer";
+    indexBuffer.Initialize(rbInit);
 
     uint64 vtxOffset = 0;
-    uint64 idxOffset = 0;
+    uint64 ibOffset = 0;
     const uint64 numMeshes = meshes.Size();
     for(uint64 i = 0; i < numMeshes; ++i)
     {
         uint64 vbOffset = vtxOffset * sizeof(MeshVertex);
-        uint64 ibOffset = idxOffset * indexSize;
-        meshes[i].InitCommon(&vertices[vtxOffset], &indices[ibOffset], vertexBuffer.GPUAddress + vbOffset, indexBuffer.GPUAddress + ibOffset, vtxOffset, idxOffset);
+        ibOffset = AlignTo(ibOffset, MeshIndexAlignment);
+        meshes[i].InitCommon(&vertices[vtxOffset], &indices[ibOffset], vertexBuffer.GPUAddress + vbOffset, indexBuffer.GPUAddress + ibOffset, vtxOffset, ibOffset);
 
         vtxOffset += meshes[i].NumVertices();
-        idxOffset += meshes[i].NumIndices();
+        ibOffset += meshes[i].NumIndices() * meshes[i].IndexSize();
     }
+
+    Assert_(AlignTo(ibOffset, MeshIndexAlignment) == indices.Size());
+
+    CreatePositionStream();
+    ComputePositionQuantization();
+}
+
+void Model::CreatePositionStream()
+{
+    positions.Init(vertices.Size());
+    positionIndices.Init(indices.Size(), 0);
+
+    // Vertices that only differ by their normals, UVs, etc. collapse into a single position
+    uint64 numPositions = 0;
+    std::map<std::tuple<uint32, uint32, uint32>, uint32> positionLookup;
+    const uint64 numMeshes = meshes.Size();
+    for(uint64 meshIdx = 0; meshIdx < numMeshes; ++meshIdx)
+    {
+        Mesh& mesh = meshes[meshIdx];
+        mesh.positionOffset = uint32(numPositions);
+
+        Array<uint32> vertexRemap(mesh.NumVertices());
+        positionLookup.clear();
+        for(uint64 i = 0; i < mesh.NumVertices(); ++i)
+        {
+            const Float3& position = vertices[mesh.VertexOffset() + i].Position;
+            uint32 bits[3] = { };
+            memcpy(bits, &position, sizeof(bits));
+
+            const auto key = std::make_tuple(bits[0], bits[1], bits[2]);
+            auto existing = positionLookup.find(key);
+            if(existing != positionLookup.end())
+            {
+                vertexRemap[i] = existing->second;
+                continue;
+            }
+
+            const uint32 positionIdx = uint32(numPositions - mesh.positionOffset);
+            positionLookup[key] = positionIdx;
+            vertexRemap[i] = positionIdx;
+            positions[numPositions++] = position;
+        }
+
+        mesh.numPositions = uint32(numPositions - mesh.positionOffset);
+
+        // There are never more positions than vertices, so the mesh keeps the same index width
+        uint8* dstIndices = &positionIndices[mesh.IndexByteOffset()];
+        for(uint64 i = 0; i < mesh.NumIndices(); ++i)
+        {
+            if(mesh.IndexBufferType() == IndexType::Index16Bit)
+                reinterpret_cast<uint16*>(dstIndices)[i] = uint16(vertexRemap[mesh.Index(i)]);
+            else
+                reinterpret_cast<uint32*>(dstIndices)[i] = vertexRemap[mesh.Index(i)];
+        }
+    }
+
+    // Positions are allocated for the worst case, only keep what's actually used
+    Array<Float3> uniquePositions(numPositions);
+    memcpy(uniquePositions.Data(), positions.Data(), numPositions * sizeof(Float3));
+    positions.Init(numPositions);
+    memcpy(positions.Data(), uniquePositions.Data(), numPositions * sizeof(Float3));
+
+    StructuredBufferInit sbInit;
+    sbInit.Stride = sizeof(Float3);
+    sbInit.NumElements = positions.Size();
+    sbInit.InitData = positions.Data();
+    sbInit.Name = L"Position Buffer";
+    positionBuffer.Initialize(sbInit);
+
+    RawBufferInit rbInit;
+    rbInit.NumElements = positionIndices.Size() / RawBuffer::Stride;
+    rbInit.InitData = positionIndices.Data();
+    rbInit.Name = L"Position Index Buffer";
+    positionIndexBuffer.Initialize(rbInit);
+
+    for(uint64 meshIdx = 0; meshIdx < numMeshes; ++meshIdx)
+    {
+        Mesh& mesh = meshes[meshIdx];
+        mesh.positionIndices = &positionIndices[mesh.IndexByteOffset()];
+        mesh.positionIBView.Format = mesh.IndexBufferFormat();
+        mesh.positionIBView.SizeInBytes = mesh.IndexSize() * mesh.NumIndices();
+        mesh.positionIBView.BufferLocation = positionIndexBuffer.GPUAddress + mesh.IndexByteOffset();
+    }
+
+    WriteLog("Created position stream with %llu positions for %llu vertices (%llu bytes instead of %llu)",
+             positions.Size(), vertices.Size(), positions.MemorySize(), vertices.MemorySize());
+}
+
+// The quantization ranges are always computed, since they're cheap and they go into the per-mesh geometry data
+// whether or not the compressed vertex buffer exists yet
+void Model::ComputePositionQuantization()
+{
+    const uint64 numMeshes = meshes.Size();
+    for(uint64 meshIdx = 0; meshIdx < numMeshes; ++meshIdx)
+    {
+        Mesh& mesh = meshes[meshIdx];
+        const uint64 numMeshVertices = mesh.NumVertices();
+        const MeshVertex* meshVertices = &vertices[mesh.VertexOffset()];
+
+        // Quantize relative to the actual bounds of the vertex data, since the mesh AABB isn't
+        // transformed for procedurally-generated meshes
+        Float3 positionMin = Float3(FloatMax, FloatMax, FloatMax);
+        Float3 positionMax = Float3(-FloatMax, -FloatMax, -FloatMax);
+        for(uint64 i = 0; i < numMeshVertices; ++i)
+        {
+            const Float3& position = meshVertices[i].Position;
+            positionMin = Float3(Min(positionMin.x, position.x), Min(positionMin.y, position.y), Min(positionMin.z, position.z));
+            positionMax = Float3(Max(positionMax.x, position.x), Max(positionMax.y, position.y), Max(positionMax.z, position.z));
+        }
+
+        if(numMeshVertices == 0)
+            positionMin = positionMax = Float3(0.0f, 0.0f, 0.0f);
+
+        mesh.quantizationMin = positionMin;
+        mesh.quantizationScale = (positionMax - positionMin) / 65535.0f;
+    }
+}
+
+void Model::CreateCompressedVertexBuffer()
+{
+    if(compressedVertexBuffer.NumElements > 0)
+        return;
+
+    Array<CompressedMeshVertex> compressedVertices(vertices.Size());
+    compressionStats = VertexCompressionStats();
+
+    const uint64 numMeshes = meshes.Size();
+    for(uint64 meshIdx = 0; meshIdx < numMeshes; ++meshIdx)
+    {
+        const Mesh& mesh = meshes[meshIdx];
+        const uint64 numMeshVertices = mesh.NumVertices();
+        const MeshVertex* meshVertices = &vertices[mesh.VertexOffset()];
+        CompressedMeshVertex* meshCompressedVertices = &compressedVertices[mesh.VertexOffset()];
+
+        for(uint64 i = 0; i < numMeshVertices; ++i)
+        {
+            const MeshVertex& vertex = meshVertices[i];
+            meshCompressedVertices[i] = CompressMeshVertex(vertex, mesh.quantizationMin, mesh.quantizationScale);
+
+            // Measure how much precision was lost by decoding the vertex the same way that the shaders do
+            const MeshVertex decompressed = DecompressMeshVertex(meshCompressedVertices[i], mesh.quantizationMin, mesh.quantizationScale);
+            const Float3 positionDelta = decompressed.Position - vertex.Position;
+            const Float3 positionError = Float3(std::abs(positionDelta.x), std::abs(positionDelta.y), std::abs(positionDelta.z));
+            const Float2 uvError = Float2(std::abs(decompressed.UV.x - vertex.UV.x), std::abs(decompressed.UV.y - vertex.UV.y));
+            const Float2 lightmapUVError = Float2(std::abs(decompressed.LightmapUV.x - vertex.LightmapUV.x),
+                                                  std::abs(decompressed.LightmapUV.y - vertex.LightmapUV.y));
+
+            VertexCompressionStats& stats = compressionStats;
+            stats.MaxPositionError = Max(stats.MaxPositionError, Max(positionError.x, Max(positionError.y, positionError.z)));
+            stats.MaxNormalErrorDegrees = Max(stats.MaxNormalErrorDegrees, AngleBetweenDegrees(decompressed.Normal, vertex.Normal));
+            stats.MaxTangentErrorDegrees = Max(stats.MaxTangentErrorDegrees, AngleBetweenDegrees(decompressed.Tangent, vertex.Tangent));
+            stats.MaxBitangentErrorDegrees = Max(stats.MaxBitangentErrorDegrees, AngleBetweenDegrees(decompressed.Bitangent, vertex.Bitangent));
+            stats.MaxUVError = Max(stats.MaxUVError, Max(uvError.x, uvError.y));
+            stats.MaxLightmapUVError = Max(stats.MaxLightmapUVError, Max(lightmapUVError.x, lightmapUVError.y));
+        }
+    }
+
+    StructuredBufferInit sbInit;
+    sbInit.Stride = sizeof(CompressedMeshVertex);
+    sbInit.NumElements = compressedVertices.Size();
+    sbInit.InitData = compressedVertices.Data();
+    sbInit.Name = L"Compressed Vertex Buffer";
+    compressedVertexBuffer.Initialize(sbInit);
+
+    WriteLog("Compressed %llu vertices from %llu to %llu bytes. Max errors: position %f, normal %.3f deg, tangent %.3f deg, "
+             "bitangent %.3f deg, UV %f, lightmap UV %f", vertices.Size(), vertices.MemorySize(), compressedVertices.MemorySize(),
+             compressionStats.MaxPositionError, compressionStats.MaxNormalErrorDegrees, compressionStats.MaxTangentErrorDegrees,
+             compressionStats.MaxBitangentErrorDegrees, compressionStats.MaxUVError, compressionStats.MaxLightmapUVError);
 }
 
 // --- 新增代码 开始 ---
@@ -893,25 +1595,25 @@ void Model::CreateLightmappedBuffers()
     sbInit.InitData = lightmappedVertices.Data();
     lightmappedVertexBuffer.Initialize(sbInit);
 
-    // 为光照贴图索引数据创建格式化缓冲 (注意总是 32-bit)
-    FormattedBufferInit fbInit;
-    fbInit.Format = DXGI_FORMAT_R32_UINT;
-    fbInit.NumElements = lightmappedIndices.Size() / sizeof(uint32);
-    fbInit.InitData = lightmappedIndices.Data();
-    lightmappedIndexBuffer.Initialize(fbInit);
+    // 为光照贴图索引数据创建缓冲, which mixes 16-bit and 32-bit meshes like the main index buffer
+    RawBufferInit rbInit;
+    rbInit.NumElements = lightmappedIndices.Size() / RawBuffer::Stride;
+    rbInit.InitData = lightmappedIndices.Data();
+    rbInit.Name = L"Lightmapped Index Buffer";
+    lightmappedIndexBuffer.Initialize(rbInit);
 
     // 为每个光照贴图网格设置正确的GPU缓冲视图
     const uint64 numMeshes = lightmappedMeshes.Size();
     for (uint64 i = 0; i < numMeshes; ++i)
     {
         uint64 vbOffset = lightmappedMeshes[i].vtxOffset * sizeof(MeshVertex);
-        uint64 ibOffset = lightmappedMeshes[i].idxOffset * sizeof(uint32);
+        uint64 ibOffset = lightmappedMeshes[i].idxByteOffset;
         lightmappedMeshes[i].InitCommon(&lightmappedVertices[lightmappedMeshes[i].vtxOffset], 
                                          &lightmappedIndices[ibOffset], 
                                          lightmappedVertexBuffer.GPUAddress + vbOffset, 
                                          lightmappedIndexBuffer.GPUAddress + ibOffset, 
                                          lightmappedMeshes[i].vtxOffset, 
-                                         lightmappedMeshes[i].idxOffset);
+                                         ibOffset);
     }
 }
 
@@ -928,7 +1630,7 @@ const StructuredBuffer& Model::GetActiveVertexBuffer() const
     return useLightmapGeometry ? lightmappedVertexBuffer : vertexBuffer;
 }
 
-const FormattedBuffer& Model::GetActiveIndexBuffer() const
+const RawBuffer& Model::GetActiveIndexBuffer() const
 {
     // 根据标志位，返回对应的索引缓冲
     return useLightmapGeometry ? lightmappedIndexBuffer : indexBuffer;
@@ -947,7 +1649,11 @@ uint64 Model::GetActiveVertexCount() const
 
 uint64 Model::GetActiveIndexCount() const
 {
-    return useLightmapGeometry ? lightmappedIndices.Size() / IndexSize() : indices.Size() / IndexSize();
+    const Array<Mesh>& activeMeshes = GetActiveMeshes();
+    uint64 numIndices = 0;
+    for(uint64 i = 0; i < activeMeshes.Size(); ++i)
+        numIndices += activeMeshes[i].NumIndices();
+    return numIndices;
 }
 
 
@@ -956,7 +1662,7 @@ const StructuredBuffer& Model::GetLightmappedVertexBuffer() const
     return lightmappedVertexBuffer;
 }
 
-const FormattedBuffer& Model::GetLightmappedIndexBuffer() const
+const RawBuffer& Model::GetLightmappedIndexBuffer() const
 {
     return lightmappedIndexBuffer;
 }
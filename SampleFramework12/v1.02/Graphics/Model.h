@@ -16,6 +16,9 @@
 #include "..\\Serialization.h"
 #include "..\\Containers.h"
 #include "GraphicsTypes.h"
+#include "Textures.h"
+#include "MeshOptimizer.h"
+#include "BlockCompression.h"
 
 struct aiMesh;
 
@@ -66,6 +69,34 @@ struct MeshVertex
     }
 };
 
+// Quantized version of MeshVertex for bandwidth-bound consumers such as ray tracing hit shaders, at 24 bytes
+// instead of 68. Positions are 16-bit unorm relative to the bounds of their mesh, normals and tangents are
+// octahedral-encoded 16-bit snorm, the bitangent is rebuilt from cross(normal, tangent) and a sign bit,
+// UVs are half-precision and lightmap UVs are 16-bit unorm. Must match the layout in RayTracing.hlsl.
+struct CompressedMeshVertex
+{
+    uint32 PositionXY = 0;
+    uint32 PositionZBitangentSign = 0;
+    uint32 Normal = 0;
+    uint32 Tangent = 0;
+    Half2 UV;
+    uint32 LightmapUV = 0;
+};
+
+CompressedMeshVertex CompressMeshVertex(const MeshVertex& vertex, const Float3& quantizationMin, const Float3& quantizationScale);
+MeshVertex DecompressMeshVertex(const CompressedMeshVertex& vertex, const Float3& quantizationMin, const Float3& quantizationScale);
+
+// Largest errors measured after round-tripping every vertex of a model through CompressedMeshVertex
+struct VertexCompressionStats
+{
+    float MaxPositionError = 0.0f;
+    float MaxNormalErrorDegrees = 0.0f;
+    float MaxTangentErrorDegrees = 0.0f;
+    float MaxBitangentErrorDegrees = 0.0f;
+    float MaxUVError = 0.0f;
+    float MaxLightmapUVError = 0.0f;
+};
+
 enum class MaterialTextures
 {
     Albedo = 0,
@@ -78,6 +109,14 @@ enum class MaterialTextures
     Count
 };
 
+// Roughness, metallic and opacity are loaded into the R, G and B channels of a single packed texture, so those
+// slots of a material all point at the same texture. The opacity slot stays empty when there's no opacity map.
+inline bool IsPackedMaterialTexture(MaterialTextures texType)
+{
+    return texType == MaterialTextures::Roughness || texType == MaterialTextures::Metallic ||
+           texType == MaterialTextures::Opacity;
+}
+
 struct MeshMaterial
 {
     std::string Name;
@@ -119,6 +158,20 @@ enum class IndexType
     Index32Bit = 1
 };
 
+// Index width is picked per mesh, so a model's index data mixes 16-bit and 32-bit meshes.
+// Every mesh starts on a 4-byte boundary so that its indices can be read from a ByteAddressBuffer.
+static const uint64 MeshIndexAlignment = 4;
+
+inline IndexType IndexTypeForVertexCount(uint64 numVertices)
+{
+    return numVertices > 0x10000 ? IndexType::Index32Bit : IndexType::Index16Bit;
+}
+
+inline uint64 IndexTypeSize(IndexType indexType)
+{
+    return indexType == IndexType::Index32Bit ? 4 : 2;
+}
+
 enum class InputElementType : uint64
 {
     Position = 0,
@@ -135,8 +188,18 @@ struct MaterialTexture
 {
     std::wstring Name;
     Texture Texture;
+
+    // How the texture was loaded, so that its mips can be loaded again after they've been streamed out
+    TextureCookOptions Options;
+    TexturePackingDesc Packing;
+    bool Packed = false;
+    bool SRGB = false;
 };
 
+// Reads the file data for a material texture the same way as when its model was loaded. This doesn't touch the
+// device, so it can run on any thread.
+HRESULT LoadMaterialTextureFile(const MaterialTexture& matTexture, TextureFileData& fileData);
+
 struct ModelSpotLight
 {
     Float3 Position;
@@ -165,7 +228,7 @@ public:
 
     // Init from loaded files
     void InitFromAssimpMesh(const aiMesh& assimpMesh, float sceneScale,
-                            MeshVertex* dstVertices, uint8* dstIndices, IndexType indexType);
+                            MeshVertex* dstVertices, uint8* dstIndices);
 
     // Procedural generation
     void InitBox(const Float3& dimensions, const Float3& position,
@@ -176,7 +239,7 @@ public:
                    const Quaternion& orientation, uint32 materialIdx,
                    MeshVertex* dstVertices, uint16* dstIndices);
 
-    void InitCommon(const MeshVertex* vertices, const uint8* indices, uint64 vbAddress, uint64 ibAddress, uint64 vtxOffset, uint64 idxOffset);
+    void InitCommon(const MeshVertex* vertices, const uint8* indices, uint64 vbAddress, uint64 ibAddress, uint64 vtxOffset, uint64 idxByteOffset);
 
     void Shutdown();
 
@@ -187,7 +250,9 @@ public:
     uint32 NumVertices() const { return numVertices; }
     uint32 NumIndices() const { return numIndices; }
     uint32 VertexOffset() const { return vtxOffset; }
-    uint32 IndexOffset() const { return idxOffset; }
+
+    // Offset of the mesh's indices within the model's index data, in bytes since the index width varies per mesh
+    uint32 IndexByteOffset() const { return idxByteOffset; }
 
     IndexType IndexBufferType() const { return indexType; }
     DXGI_FORMAT IndexBufferFormat() const { return indexType == IndexType::Index32Bit ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT; }
@@ -196,13 +261,29 @@ public:
     const MeshVertex* Vertices() const { return vertices; }
     const uint16* Indices() const { Assert_(indexType == IndexType::Index16Bit); return (const uint16*)indices; }
     const uint32* Indices32() const { Assert_(indexType == IndexType::Index32Bit); return (const uint32*)indices; }
+    uint32 Index(uint64 idx) const { return indexType == IndexType::Index32Bit ? Indices32()[idx] : Indices()[idx]; }
+    uint32 PositionIndex(uint64 idx) const { return indexType == IndexType::Index32Bit ? ((const uint32*)positionIndices)[idx] : ((const uint16*)positionIndices)[idx]; }
 
+    // The index buffer views only cover this mesh, so draws start at index 0 of the view
     const D3D12_VERTEX_BUFFER_VIEW* VBView() const { return &vbView; }
     const D3D12_INDEX_BUFFER_VIEW* IBView() const { return &ibView; }
+    const D3D12_INDEX_BUFFER_VIEW* PositionIBView() const { return &positionIBView; }
 
     const Float3& AABBMin() const { return aabbMin; }
     const Float3& AABBMax() const { return aabbMax; }
 
+    // Location of the mesh in the position-only stream, which uses the same index layout as the full vertices
+    uint32 NumPositions() const { return numPositions; }
+    uint32 PositionOffset() const { return positionOffset; }
+
+    // Dequantizes the positions of CompressedMeshVertex as (quantizationMin + position * quantizationScale)
+    const Float3& PositionQuantizationMin() const { return quantizationMin; }
+    const Float3& PositionQuantizationScale() const { return quantizationScale; }
+
+    // Range of the mesh's meshlets in Model::Meshlets(), which is empty for meshes that weren't split up
+    uint32 MeshletOffset() const { return meshletOffset; }
+    uint32 NumMeshlets() const { return numMeshlets; }
+
     static const char* InputElementTypeString(InputElementType elemType);
 
     template<typename TSerializer> void Serialize(TSerializer& serializer)
@@ -211,12 +292,14 @@ public:
         SerializeItem(serializer, numVertices);
         SerializeItem(serializer, numIndices);
         SerializeItem(serializer, vtxOffset);
-        SerializeItem(serializer, idxOffset);
+        SerializeItem(serializer, idxByteOffset);
         uint32 idxType = uint32(indexType);
         SerializeItem(serializer, idxType);
         indexType = IndexType(idxType);
         SerializeItem(serializer, aabbMin);
         SerializeItem(serializer, aabbMax);
+        SerializeItem(serializer, meshletOffset);
+        SerializeItem(serializer, numMeshlets);
     }
 
 protected:
@@ -226,18 +309,29 @@ protected:
     uint32 numVertices = 0;
     uint32 numIndices = 0;
     uint32 vtxOffset = 0;
-    uint32 idxOffset = 0;
+    uint32 idxByteOffset = 0;
 
     IndexType indexType = IndexType::Index16Bit;
 
     const MeshVertex* vertices = nullptr;
     const uint8* indices = nullptr;
+    const uint8* positionIndices = nullptr;
 
     D3D12_VERTEX_BUFFER_VIEW vbView = { };
     D3D12_INDEX_BUFFER_VIEW ibView = { };
+    D3D12_INDEX_BUFFER_VIEW positionIBView = { };
 
     Float3 aabbMin;
     Float3 aabbMax;
+
+    uint32 numPositions = 0;
+    uint32 positionOffset = 0;
+
+    Float3 quantizationMin;
+    Float3 quantizationScale;
+
+    uint32 meshletOffset = 0;
+    uint32 numMeshlets = 0;
 };
 
 struct ModelLoadSettings
@@ -247,8 +341,14 @@ struct ModelLoadSettings
     float SceneScale = 1.0f;
     bool ForceSRGB = false;
     bool MergeMeshes = true;
+    BlockCompressionQuality TextureCompression = BlockCompressionQuality::Uncompressed;
 };
 
+// Cooks the material textures of a model file with the same options and packing that loading it with these
+// settings would use, so that the cooked textures get picked up at load time. This only reads the materials, and
+// doesn't touch the device.
+TextureCookStats CookModelTextures(const ModelLoadSettings& settings);
+
 class Model
 {
 public:
@@ -291,12 +391,36 @@ public:
     const Array<ModelSpotLight>& SpotLights() const { return spotLights; }
     const Array<PointLight>& PointLights() const { return pointLights; }
 
+    // The index buffer mixes 16-bit and 32-bit meshes, use the per-mesh views and offsets to access it
     const StructuredBuffer& VertexBuffer() const { return vertexBuffer; }
-    const FormattedBuffer& IndexBuffer() const { return indexBuffer; }
+    const RawBuffer& IndexBuffer() const { return indexBuffer; }
+
+    // Tightly-packed positions with duplicates removed, for depth-only rendering and acceleration structure builds.
+    // The position index buffer has the same layout as the main index buffer, just remapped to the positions.
+    const StructuredBuffer& PositionBuffer() const { return positionBuffer; }
+    const RawBuffer& PositionIndexBuffer() const { return positionIndexBuffer; }
+    const Float3* Positions() const { return positions.Data(); }
+
+    // Vertex cache efficiency of the imported meshes before and after they were optimized, weighted by
+    // their triangle and vertex counts. The optimized order is baked into the vertex and index data.
+    const VertexCacheStats& StatsBeforeOptimization() const { return statsBeforeOptimization; }
+    const VertexCacheStats& StatsAfterOptimization() const { return statsAfterOptimization; }
+
+    // Meshlets of every mesh, with their vertices and packed triangles. The lightmapped meshes share
+    // these, since xatlas keeps the triangle order and so the meshlet index ranges still apply.
+    const Array<Meshlet>& Meshlets() const { return meshlets; }
+    const Array<uint32>& MeshletVertices() const { return meshletVertices; }
+    const Array<uint32>& MeshletTriangles() const { return meshletTriangles; }
+
+    // The compressed vertex buffer is only created on request, since the full-precision vertex buffer is needed for
+    // rasterization either way. The stats are filled in at the same time.
+    void CreateCompressedVertexBuffer();
+    const StructuredBuffer& CompressedVertexBuffer() const { return compressedVertexBuffer; }
+    const VertexCompressionStats& CompressionStats() const { return compressionStats; }
 
     const MeshVertex* Vertices() const { return vertices.Data(); }
-    const uint16* Indices() const { Assert_(indexType == IndexType::Index16Bit); return (const uint16*)indices.Data(); }
-    const uint32* Indices32() const { Assert_(indexType == IndexType::Index32Bit); return (const uint32*)indices.Data(); }
+    const uint8* IndexData() const { return indices.Data(); }
+    uint64 IndexDataSize() const { return indices.Size(); }
 
     const std::wstring& FileDirectory() const { return fileDirectory; }
 
@@ -304,9 +428,8 @@ public:
     static const InputElementType* InputElementTypes();
     static uint64 NumInputElements();
 
-    IndexType IndexBufferType() const { return indexType; }
-    DXGI_FORMAT IndexBufferFormat() const { return indexType == IndexType::Index32Bit ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT; }
-    uint32 IndexSize() const { return indexType == IndexType::Index32Bit ? 4 : 2; }
+    static const D3D12_INPUT_ELEMENT_DESC* PositionInputElements();
+    static uint64 NumPositionInputElements();
 
     // Serialization
     template<typename TSerializer>
@@ -321,28 +444,32 @@ public:
         SerializeItem(serializer, aabbMax);
         BulkSerializeItem(serializer, vertices);
         BulkSerializeItem(serializer, indices);
-        uint32 idxType = uint32(indexType);
-        SerializeItem(serializer, idxType);
-        indexType = IndexType(idxType);
+        BulkSerializeItem(serializer, meshlets);
+        BulkSerializeItem(serializer, meshletVertices);
+        BulkSerializeItem(serializer, meshletTriangles);
     }
 
     // Set active geometry
     void CreateLightmappedBuffers();
     void SetActiveGeometry(bool useLightmapGeo);
     const StructuredBuffer& GetActiveVertexBuffer() const;
-    const FormattedBuffer& GetActiveIndexBuffer() const;
+    const RawBuffer& GetActiveIndexBuffer() const;
     const Array<Mesh>& GetActiveMeshes() const;
     uint64 GetActiveVertexCount() const;
     uint64 GetActiveIndexCount() const;
 
     const StructuredBuffer& GetLightmappedVertexBuffer() const;
-    const FormattedBuffer& GetLightmappedIndexBuffer() const;
+    const RawBuffer& GetLightmappedIndexBuffer() const;
     const Array<Mesh>& GetLightmappedMeshes() const;
     uint64 GetLightmappedVertexCount() const;
 
 protected:
 
+    void OptimizeMeshes();
+    void BuildMeshlets();
     void CreateBuffers();
+    void CreatePositionStream();
+    void ComputePositionQuantization();
 
     Array<Mesh> meshes;
     Array<MeshMaterial> meshMaterials;
@@ -350,18 +477,33 @@ protected:
     Array<PointLight> pointLights;
     std::wstring fileDirectory;
     bool32 forceSRGB = false;
+    BlockCompressionQuality textureCompression = BlockCompressionQuality::Uncompressed;
     Float3 aabbMin;
     Float3 aabbMax;
 
     StructuredBuffer vertexBuffer;
-    FormattedBuffer indexBuffer;
+    RawBuffer indexBuffer;
     Array<MeshVertex> vertices;
     Array<uint8> indices;
-    IndexType indexType = IndexType::Index16Bit;
+
+    StructuredBuffer positionBuffer;
+    RawBuffer positionIndexBuffer;
+    Array<Float3> positions;
+    Array<uint8> positionIndices;
+
+    VertexCacheStats statsBeforeOptimization;
+    VertexCacheStats statsAfterOptimization;
+
+    Array<Meshlet> meshlets;
+    Array<uint32> meshletVertices;
+    Array<uint32> meshletTriangles;
+
+    StructuredBuffer compressedVertexBuffer;
+    VertexCompressionStats compressionStats;
 
     // Lightmapped geometry
     StructuredBuffer lightmappedVertexBuffer;
-    FormattedBuffer lightmappedIndexBuffer;
+    RawBuffer lightmappedIndexBuffer;
     Array<MeshVertex> lightmappedVertices;
     Array<uint8> lightmappedIndices;
     Array<Mesh> lightmappedMeshes;
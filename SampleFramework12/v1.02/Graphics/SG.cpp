@@ -27,7 +27,11 @@
 
 #include "SG.h"
 #include "Textures.h"
+#include "CubemapProjection.h"
 #include "..\\Containers.h"
+#include "..\\Tasks.h"
+
+#include <mutex>
 
 namespace SampleFramework12
 {
@@ -233,6 +237,442 @@ static void SolveProjection(SGSolveParams& params)
         params.OutSGs[i].Amplitude *= monteCarloFactor;
 }
 
+// Computes the lower-triangular Cholesky factor of a symmetric positive-definite n x n matrix
+static bool CholeskyFactor(const double* matrix, uint64 n, double* outL)
+{
+    for(uint64 i = 0; i < n * n; ++i)
+        outL[i] = 0.0;
+
+    for(uint64 r = 0; r < n; ++r)
+    {
+        for(uint64 c = 0; c <= r; ++c)
+        {
+            double sum = matrix[r * n + c];
+            for(uint64 k = 0; k < c; ++k)
+                sum -= outL[r * n + k] * outL[c * n + k];
+
+            if(r == c)
+            {
+                if(sum <= 0.0)
+                    return false;
+                outL[r * n + r] = std::sqrt(sum);
+            }
+            else
+                outL[r * n + c] = sum / outL[c * n + c];
+        }
+    }
+
+    return true;
+}
+
+// Solves L * transpose(L) * x = b given the Cholesky factor L
+static void CholeskySolve(const double* L, uint64 n, const double* b, double* outX)
+{
+    for(uint64 r = 0; r < n; ++r)
+    {
+        double sum = b[r];
+        for(uint64 k = 0; k < r; ++k)
+            sum -= L[r * n + k] * outX[k];
+        outX[r] = sum / L[r * n + r];
+    }
+
+    for(uint64 r = n; r-- > 0;)
+    {
+        double sum = outX[r];
+        for(uint64 k = r + 1; k < n; ++k)
+            sum -= L[k * n + r] * outX[k];
+        outX[r] = sum / L[r * n + r];
+    }
+}
+
+static inline Float3 SampleValue(const Float3& value)
+{
+    return value;
+}
+
+static inline Float3 SampleValue(const Float4& value)
+{
+    return value.To3D();
+}
+
+void SGSolver::Initialize(const Float3* sampleDirs, uint64 numSamples_, uint64 numSGs_, SGSolveMode solveMode_,
+                          SGDistribution distribution)
+{
+    Assert_(sampleDirs != nullptr);
+    Assert_(numSamples_ > 0);
+    Assert_(numSGs_ > 0 && numSGs_ <= MaxSGs);
+
+    Shutdown();
+
+    numSamples = numSamples_;
+    numSGs = numSGs_;
+    solveMode = solveMode_;
+
+    GenerateUniformSGs(lobes, numSGs, distribution);
+
+    // Same weighting as SolveProjection
+    float projectionFactor = (2.0f * Pi) / numSamples;
+    if(distribution == SGDistribution::Spherical)
+        projectionFactor *= 2.0f;
+    if(distribution == SGDistribution::Spherical && numSGs == 9)
+        projectionFactor *= Pi / 2.46373701f;
+
+    basis.Init(numSGs * numSamples);
+    Tasks::ParallelFor(numSamples, [&](uint64 start, uint64 end, uint32 threadNum)
+    {
+        for(uint64 sampleIdx = start; sampleIdx < end; ++sampleIdx)
+        {
+            const Float3 dir = Float3::Normalize(sampleDirs[sampleIdx]);
+            for(uint64 sgIdx = 0; sgIdx < numSGs; ++sgIdx)
+            {
+                const float dot = Float3::Dot(dir, lobes[sgIdx].Axis);
+                float value = std::exp((dot - 1.0f) * lobes[sgIdx].Sharpness);
+                if(solveMode == SGSolveMode::Projection)
+                    value = dot > 0.0f ? value * projectionFactor : 0.0f;
+                basis[sgIdx * numSamples + sampleIdx] = value;
+            }
+        }
+    }, 1024);
+
+    if(solveMode == SGSolveMode::Projection)
+        return;
+
+    // Build transpose(A) * A from per-block partial sums, which are reduced in order so that the
+    // result doesn't depend on how the blocks were scheduled
+    const uint64 BlockSize = 4096;
+    const uint64 numBlocks = (numSamples + BlockSize - 1) / BlockSize;
+    const uint64 matrixSize = numSGs * numSGs;
+    Array<double> partialSums(numBlocks * matrixSize, 0.0);
+    Tasks::ParallelFor(numBlocks, [&](uint64 startBlock, uint64 endBlock, uint32 threadNum)
+    {
+        for(uint64 blockIdx = startBlock; blockIdx < endBlock; ++blockIdx)
+        {
+            double* partial = &partialSums[blockIdx * matrixSize];
+            const uint64 start = blockIdx * BlockSize;
+            const uint64 end = Min(start + BlockSize, numSamples);
+            for(uint64 r = 0; r < numSGs; ++r)
+            {
+                const float* rowR = &basis[r * numSamples];
+                for(uint64 c = 0; c <= r; ++c)
+                {
+                    const float* rowC = &basis[c * numSamples];
+                    float sum = 0.0f;
+                    for(uint64 sampleIdx = start; sampleIdx < end; ++sampleIdx)
+                        sum += rowR[sampleIdx] * rowC[sampleIdx];
+                    partial[r * numSGs + c] = sum;
+                }
+            }
+        }
+    });
+
+    normalMatrix.Init(matrixSize, 0.0);
+    for(uint64 blockIdx = 0; blockIdx < numBlocks; ++blockIdx)
+        for(uint64 i = 0; i < matrixSize; ++i)
+            normalMatrix[i] += partialSums[blockIdx * matrixSize + i];
+
+    double trace = 0.0;
+    for(uint64 r = 0; r < numSGs; ++r)
+    {
+        for(uint64 c = 0; c < r; ++c)
+            normalMatrix[c * numSGs + r] = normalMatrix[r * numSGs + c];
+        trace += normalMatrix[r * numSGs + r];
+    }
+
+    // A tiny ridge term keeps the factorization stable when the lobes are close to being linearly
+    // dependent, which can happen with lots of lobes and a low number of samples
+    const double ridge = 1e-7 * trace / numSGs;
+    for(uint64 r = 0; r < numSGs; ++r)
+        normalMatrix[r * numSGs + r] += ridge;
+
+    cholesky.Init(matrixSize);
+    if(CholeskyFactor(normalMatrix.Data(), numSGs, cholesky.Data()) == false)
+        throw Exception(L"Failed to factorize the normal matrix for the SG solve");
+}
+
+void SGSolver::Shutdown()
+{
+    numSamples = 0;
+    numSGs = 0;
+    basis.Shutdown();
+    normalMatrix.Shutdown();
+    cholesky.Shutdown();
+}
+
+// Computes transpose(A) * b for a range of samples
+template<typename T> void SGSolver::ProjectSamples(const T* sampleValues, uint64 start, uint64 end, Float3* outProjections) const
+{
+    for(uint64 sgIdx = 0; sgIdx < numSGs; ++sgIdx)
+    {
+        const float* row = &basis[sgIdx * numSamples];
+        Float3 sum;
+        for(uint64 sampleIdx = start; sampleIdx < end; ++sampleIdx)
+            sum += SampleValue(sampleValues[sampleIdx]) * row[sampleIdx];
+        outProjections[sgIdx] = sum;
+    }
+}
+
+// Lawson-Hanson active set NNLS, working on the normal equations so that each iteration only needs
+// to solve a system that's at most numSGs x numSGs
+void SGSolver::SolveNNLS(const double* projections, double* outAmplitudes) const
+{
+    const uint64 n = numSGs;
+    double* x = outAmplitudes;
+
+    // Radiance is usually smooth enough that the unconstrained solution is already non-negative, in
+    // which case the cached factorization gives us the answer directly
+    CholeskySolve(cholesky.Data(), n, projections, x);
+
+    bool allPositive = true;
+    for(uint64 i = 0; i < n; ++i)
+        allPositive = allPositive && x[i] >= 0.0;
+    if(allPositive)
+        return;
+
+    bool passive[MaxSGs] = { };
+    double gradient[MaxSGs] = { };
+    double z[MaxSGs] = { };
+    double subMatrix[MaxSGs * MaxSGs];
+    double subFactor[MaxSGs * MaxSGs];
+    double subProjections[MaxSGs];
+    double subZ[MaxSGs];
+    uint64 subIndices[MaxSGs];
+
+    double maxProjection = 0.0;
+    for(uint64 i = 0; i < n; ++i)
+    {
+        x[i] = 0.0;
+        maxProjection = Max(maxProjection, std::abs(projections[i]));
+    }
+
+    const double tolerance = 1e-10 * Max(maxProjection, 1e-30);
+
+    for(uint64 iteration = 0; iteration < n * 3; ++iteration)
+    {
+        // The gradient of the objective is transpose(A) * (b - Ax)
+        uint64 bestIdx = uint64(-1);
+        double bestGradient = tolerance;
+        for(uint64 r = 0; r < n; ++r)
+        {
+            gradient[r] = projections[r];
+            for(uint64 c = 0; c < n; ++c)
+                gradient[r] -= normalMatrix[r * n + c] * x[c];
+
+            if(passive[r] == false && gradient[r] > bestGradient)
+            {
+                bestGradient = gradient[r];
+                bestIdx = r;
+            }
+        }
+
+        if(bestIdx == uint64(-1))
+            break;
+
+        passive[bestIdx] = true;
+
+        for(uint64 innerIteration = 0; innerIteration < n; ++innerIteration)
+        {
+            // Solve the unconstrained problem for the lobes in the passive set
+            uint64 numPassive = 0;
+            for(uint64 i = 0; i < n; ++i)
+                if(passive[i])
+                    subIndices[numPassive++] = i;
+
+            for(uint64 r = 0; r < numPassive; ++r)
+            {
+                subProjections[r] = projections[subIndices[r]];
+                for(uint64 c = 0; c < numPassive; ++c)
+                    subMatrix[r * numPassive + c] = normalMatrix[subIndices[r] * n + subIndices[c]];
+            }
+
+            if(CholeskyFactor(subMatrix, numPassive, subFactor) == false)
+                return;
+            CholeskySolve(subFactor, numPassive, subProjections, subZ);
+
+            bool feasible = true;
+            for(uint64 i = 0; i < n; ++i)
+                z[i] = 0.0;
+            for(uint64 i = 0; i < numPassive; ++i)
+            {
+                z[subIndices[i]] = subZ[i];
+                feasible = feasible && subZ[i] > 0.0;
+            }
+
+            if(feasible)
+            {
+                for(uint64 i = 0; i < n; ++i)
+                    x[i] = z[i];
+                break;
+            }
+
+            // Step towards z as far as possible while staying non-negative, and drop any lobes that hit zero.
+            // A lobe where x and z are both zero doesn't limit the step (and would divide 0 by 0), it just
+            // gets dropped below.
+            double alpha = 1.0;
+            for(uint64 i = 0; i < n; ++i)
+            {
+                const double denominator = x[i] - z[i];
+                if(passive[i] && z[i] <= 0.0 && denominator > 1e-12)
+                    alpha = Min(alpha, x[i] / denominator);
+            }
+
+            for(uint64 i = 0; i < n; ++i)
+            {
+                x[i] += alpha * (z[i] - x[i]);
+                if(passive[i] && x[i] <= tolerance)
+                {
+                    passive[i] = false;
+                    x[i] = 0.0;
+                }
+            }
+        }
+    }
+}
+
+void SGSolver::SolveFromProjections(const Float3* projections, SG* outSGs) const
+{
+    for(uint64 sgIdx = 0; sgIdx < numSGs; ++sgIdx)
+        outSGs[sgIdx] = lobes[sgIdx];
+
+    if(solveMode == SGSolveMode::Projection)
+    {
+        for(uint64 sgIdx = 0; sgIdx < numSGs; ++sgIdx)
+            outSGs[sgIdx].Amplitude = projections[sgIdx];
+        return;
+    }
+
+    // Linearly solve for the rgb channels one at a time
+    double amplitudes[3][MaxSGs];
+    for(uint32 channel = 0; channel < 3; ++channel)
+    {
+        double channelProjections[MaxSGs];
+        for(uint64 sgIdx = 0; sgIdx < numSGs; ++sgIdx)
+            channelProjections[sgIdx] = projections[sgIdx][channel];
+
+        if(solveMode == SGSolveMode::NNLS)
+            SolveNNLS(channelProjections, amplitudes[channel]);
+        else
+            CholeskySolve(cholesky.Data(), numSGs, channelProjections, amplitudes[channel]);
+    }
+
+    for(uint64 sgIdx = 0; sgIdx < numSGs; ++sgIdx)
+        outSGs[sgIdx].Amplitude = Float3(float(amplitudes[0][sgIdx]), float(amplitudes[1][sgIdx]), float(amplitudes[2][sgIdx]));
+}
+
+template<typename T> void SGSolver::SolveInternal(const T* sampleValues, SG* outSGs) const
+{
+    Assert_(Initialized());
+    Assert_(sampleValues != nullptr);
+    Assert_(outSGs != nullptr);
+
+    const uint64 BlockSize = 8192;
+    const uint64 numBlocks = (numSamples + BlockSize - 1) / BlockSize;
+    Array<Float3> partialProjections(numBlocks * numSGs);
+    Tasks::ParallelFor(numBlocks, [&](uint64 startBlock, uint64 endBlock, uint32 threadNum)
+    {
+        for(uint64 blockIdx = startBlock; blockIdx < endBlock; ++blockIdx)
+        {
+            const uint64 start = blockIdx * BlockSize;
+            const uint64 end = Min(start + BlockSize, numSamples);
+            ProjectSamples(sampleValues, start, end, &partialProjections[blockIdx * numSGs]);
+        }
+    });
+
+    Float3 projections[MaxSGs];
+    for(uint64 blockIdx = 0; blockIdx < numBlocks; ++blockIdx)
+        for(uint64 sgIdx = 0; sgIdx < numSGs; ++sgIdx)
+            projections[sgIdx] += partialProjections[blockIdx * numSGs + sgIdx];
+
+    SolveFromProjections(projections, outSGs);
+}
+
+template<typename T> void SGSolver::SolveBatchInternal(const T* const* sampleValues, uint64 numSets, SG* outSGs) const
+{
+    Assert_(Initialized());
+    Assert_(sampleValues != nullptr);
+    Assert_(outSGs != nullptr);
+
+    // With only a few sets it's better to split up the samples within each set
+    if(numSets < Tasks::NumThreads())
+    {
+        for(uint64 setIdx = 0; setIdx < numSets; ++setIdx)
+            SolveInternal(sampleValues[setIdx], outSGs + setIdx * numSGs);
+        return;
+    }
+
+    Tasks::ParallelFor(numSets, [&](uint64 start, uint64 end, uint32 threadNum)
+    {
+        Float3 projections[MaxSGs];
+        for(uint64 setIdx = start; setIdx < end; ++setIdx)
+        {
+            ProjectSamples(sampleValues[setIdx], 0, numSamples, projections);
+            SolveFromProjections(projections, outSGs + setIdx * numSGs);
+        }
+    });
+}
+
+void SGSolver::Solve(const Float3* sampleValues, SG* outSGs) const
+{
+    SolveInternal(sampleValues, outSGs);
+}
+
+void SGSolver::Solve(const Float4* sampleValues, SG* outSGs) const
+{
+    SolveInternal(sampleValues, outSGs);
+}
+
+void SGSolver::SolveBatch(const Float3* const* sampleValues, uint64 numSets, SG* outSGs) const
+{
+    SolveBatchInternal(sampleValues, numSets, outSGs);
+}
+
+void SGSolver::SolveBatch(const Float4* const* sampleValues, uint64 numSets, SG* outSGs) const
+{
+    SolveBatchInternal(sampleValues, numSets, outSGs);
+}
+
+static std::map<uint64, SGSolver*> sharedSolvers;
+static std::mutex sharedSolversLock;
+
+const SGSolver& SGSolver::GetForCubemap(uint32 resolution, uint64 numSGs, SGSolveMode solveMode)
+{
+    Assert_(numSGs <= MaxSGs);
+    const uint64 key = uint64(resolution) | (numSGs << 32) | (uint64(solveMode) << 48);
+
+    {
+        std::lock_guard<std::mutex> lock(sharedSolversLock);
+        auto existing = sharedSolvers.find(key);
+        if(existing != sharedSolvers.end())
+            return *existing->second;
+    }
+
+    // Same as CubemapProjectionPlan::Get, the solver is built without holding the lock
+    const CubemapProjectionPlan& plan = CubemapProjectionPlan::Get(resolution);
+    Array<Float3> sampleDirs(plan.NumTexels());
+    for(uint64 i = 0; i < sampleDirs.Size(); ++i)
+        sampleDirs[i] = plan.Direction(i);
+
+    SGSolver* newSolver = new SGSolver();
+    newSolver->Initialize(sampleDirs.Data(), sampleDirs.Size(), numSGs, solveMode, SGDistribution::Spherical);
+
+    std::lock_guard<std::mutex> lock(sharedSolversLock);
+    SGSolver*& solver = sharedSolvers[key];
+    if(solver == nullptr)
+        solver = newSolver;
+    else
+        delete newSolver;
+
+    return *solver;
+}
+
+void SGSolver::ReleaseSharedSolvers()
+{
+    std::lock_guard<std::mutex> lock(sharedSolversLock);
+
+    for(auto& pair : sharedSolvers)
+        delete pair.second;
+    sharedSolvers.clear();
+}
+
 // Solve the set of spherical gaussians based on input set of data
 void SolveSGs(SGSolveParams& params)
 {
@@ -246,7 +686,16 @@ void SolveSGs(SGSolveParams& params)
         else
             SolveProjection(params);
     #else
-        SolveProjection(params);
+        if(params.SolveMode == SGSolveMode::Projection)
+        {
+            SolveProjection(params);
+        }
+        else
+        {
+            SGSolver solver;
+            solver.Initialize(params.SampleDirs, params.NumSamples, params.NumSGs, params.SolveMode, params.Distribution);
+            solver.Solve(params.SampleValues, params.OutSGs);
+        }
     #endif
 }
 
@@ -262,6 +711,25 @@ void SolveSGsForCubemap(const Texture& texture, SG* outSGs, uint64 numSGs, SGSol
     const uint32 width = textureData.Width;
     const uint32 height = textureData.Height;
 
+    // The pre-computed projection plan gives the same result as SolveProjection, without having to
+    // compute the directions and lobe weights for every texel
+    if(solveMode == SGSolveMode::Projection && numSGs == CubemapProjectionPlan::NumCoefficients && width == height)
+    {
+        const CubemapProjectionPlan& plan = CubemapProjectionPlan::Get(width);
+        SG9 sg9 = plan.ProjectSG9(textureData.Texels.Data());
+        for(uint64 i = 0; i < numSGs; ++i)
+            outSGs[i] = sg9.Lobes[i];
+        return;
+    }
+
+    // Otherwise use a cached solver, so that the design matrix and its factorization only get built
+    // once per resolution
+    if(numSGs <= SGSolver::MaxSGs && width == height)
+    {
+        SGSolver::GetForCubemap(width, numSGs, solveMode).Solve(textureData.Texels.Data(), outSGs);
+        return;
+    }
+
     Array<Float3> sampleDirs(width * height * 6);
     Array<Float3> sampleValues(width * height * 6);
     for(uint32 face = 0; face < 6; ++face)
@@ -11,6 +11,7 @@
 
 #include "..\\PCH.h"
 #include "..\\SF12_Math.h"
+#include "..\\Containers.h"
 
 namespace SampleFramework12
 {
@@ -126,6 +127,58 @@ void GenerateUniformSGs(SG* outSGs, uint64 numSGs, SGDistribution distribution);
 // Solve for k-number of SG's based on a sphere or hemisphere of samples
 void SolveSGs(SGSolveParams& params);
 
+// Solves for SG amplitudes against a fixed set of sample directions. Since the lobes and directions
+// don't change, the design matrix, its normal equations, and the Cholesky factorization are built once
+// up-front. Each solve then only needs to project the sample values onto the lobes, followed by a tiny
+// solve that's sized by the number of SG's rather than the number of samples. This makes it practical
+// to solve many sets of samples at once, for instance per-texel or per-probe radiance when baking.
+class SGSolver
+{
+
+public:
+
+    static const uint64 MaxSGs = 32;
+
+    void Initialize(const Float3* sampleDirs, uint64 numSamples, uint64 numSGs, SGSolveMode solveMode,
+                    SGDistribution distribution = SGDistribution::Spherical);
+    void Shutdown();
+
+    bool Initialized() const { return numSamples > 0; }
+    uint64 NumSamples() const { return numSamples; }
+    uint64 NumSGs() const { return numSGs; }
+    SGSolveMode SolveMode() const { return solveMode; }
+
+    // Solves for a single set of sample values, with one value per sample direction
+    void Solve(const Float3* sampleValues, SG* outSGs) const;
+    void Solve(const Float4* sampleValues, SG* outSGs) const;
+
+    // Solves many sets of sample values in parallel. outSGs must have room for numSets * NumSGs() lobes.
+    void SolveBatch(const Float3* const* sampleValues, uint64 numSets, SG* outSGs) const;
+    void SolveBatch(const Float4* const* sampleValues, uint64 numSets, SG* outSGs) const;
+
+    // Returns a shared solver whose sample directions are the texels of a cubemap with the given
+    // resolution, which is created on first use
+    static const SGSolver& GetForCubemap(uint32 resolution, uint64 numSGs, SGSolveMode solveMode);
+    static void ReleaseSharedSolvers();
+
+private:
+
+    template<typename T> void SolveInternal(const T* sampleValues, SG* outSGs) const;
+    template<typename T> void SolveBatchInternal(const T* const* sampleValues, uint64 numSets, SG* outSGs) const;
+    template<typename T> void ProjectSamples(const T* sampleValues, uint64 start, uint64 end, Float3* outProjections) const;
+    void SolveFromProjections(const Float3* projections, SG* outSGs) const;
+    void SolveNNLS(const double* projections, double* outAmplitudes) const;
+
+    uint64 numSamples = 0;
+    uint64 numSGs = 0;
+    SGSolveMode solveMode = SGSolveMode::NNLS;
+
+    Array<float> basis;         // numSGs x numSamples, the transposed design matrix (or projection weights)
+    Array<double> normalMatrix; // numSGs x numSGs, transpose(A) * A plus a small ridge term
+    Array<double> cholesky;     // Lower-triangular factor of the normal matrix
+    SG lobes[MaxSGs];
+};
+
 // Projects a sample onto a set of SG's
 void ProjectOntoSGs(const Float3& dir, const Float3& color, SG* outSGs, uint64 numSGs);
 
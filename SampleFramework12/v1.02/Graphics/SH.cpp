@@ -12,6 +12,7 @@
 #include "..\\Utility.h"
 #include "ShaderCompilation.h"
 #include "Textures.h"
+#include "CubemapProjection.h"
 
 namespace SampleFramework12
 {
@@ -67,6 +68,50 @@ Float3 EvalSH9Irradiance(const Float3& dir, const SH9Color& sh)
     return result;
 }
 
+Float3 EvalSH9(const Float3& dir, const SH9Color& sh)
+{
+    SH9 dirSH = ProjectOntoSH9(dir);
+
+    Float3 result;
+    for(uint64 i = 0; i < 9; ++i)
+        result += dirSH.Coefficients[i] * sh.Coefficients[i];
+
+    return result;
+}
+
+// Rotates the function represented by the SH coefficients, such that a lobe pointing in direction
+// d ends up pointing in Float3::Transform(d, rotation). This re-projects the rotated function using
+// the 14-point Lebedev quadrature, which integrates polynomials up to degree 5 exactly. That covers
+// the products of two L2 basis functions, so the result is exact and doesn't need any per-band
+// rotation matrices.
+SH9Color RotateSH9(const SH9Color& sh, const Float3x3& rotation)
+{
+    const float AxisWeight = (4.0f * Pi) * (1.0f / 15.0f);
+    const float CornerWeight = (4.0f * Pi) * (3.0f / 40.0f);
+    const float c = 1.0f / std::sqrt(3.0f);
+
+    const Float3 quadratureDirs[14] =
+    {
+        Float3(1.0f, 0.0f, 0.0f), Float3(-1.0f, 0.0f, 0.0f),
+        Float3(0.0f, 1.0f, 0.0f), Float3(0.0f, -1.0f, 0.0f),
+        Float3(0.0f, 0.0f, 1.0f), Float3(0.0f, 0.0f, -1.0f),
+        Float3(c, c, c), Float3(c, c, -c), Float3(c, -c, c), Float3(c, -c, -c),
+        Float3(-c, c, c), Float3(-c, c, -c), Float3(-c, -c, c), Float3(-c, -c, -c),
+    };
+
+    const Float3x3 invRotation = Float3x3::Transpose(rotation);
+
+    SH9Color result;
+    for(uint64 i = 0; i < ArraySize_(quadratureDirs); ++i)
+    {
+        const Float3 dir = quadratureDirs[i];
+        const Float3 value = EvalSH9(Float3::Transform(dir, invRotation), sh);
+        result += ProjectOntoSH9Color(dir, value) * (i < 6 ? AxisWeight : CornerWeight);
+    }
+
+    return result;
+}
+
 H4 ProjectOntoH4(const Float3& dir)
 {
     H4 result;
@@ -121,38 +166,10 @@ SH9Color ProjectCubemapToSH(const Texture& texture)
     TextureData<Float4> textureData;
     GetTextureData(texture, textureData);
     Assert_(textureData.NumSlices == 6);
-    const uint32 width = textureData.Width;
-    const uint32 height = textureData.Height;
+    Assert_(textureData.Width == textureData.Height);
 
-    SH9Color result;
-    float weightSum = 0.0f;
-    for(uint32 face = 0; face < 6; ++face)
-    {
-        for(uint32 y = 0; y < height; ++y)
-        {
-            for(uint32 x = 0; x < width; ++x)
-            {
-                const uint32 idx = face * (width * height) + y * (width) + x;
-                Float3 sample = textureData.Texels[idx].To3D();
-
-                float u = (x + 0.5f) / width;
-                float v = (y + 0.5f) / height;
-
-                // Account for cubemap texel distribution
-                u = u * 2.0f - 1.0f;
-                v = v * 2.0f - 1.0f;
-                const float temp = 1.0f + u * u + v * v;
-                const float weight = 4.0f / (sqrt(temp) * temp);
-
-                Float3 dir = MapXYSToDirection(x, y, face, width, height);
-                result += ProjectOntoSH9Color(dir, sample) * weight;
-                weightSum += weight;
-            }
-        }
-    }
-
-    result *= (4.0f * 3.14159f) / weightSum;
-    return result;
+    const CubemapProjectionPlan& plan = CubemapProjectionPlan::Get(textureData.Width);
+    return plan.ProjectSH9(textureData.Texels.Data());
 }
 
 }
\ No newline at end of file
@@ -219,6 +219,8 @@ struct ShaderSH9Color
 SH9 ProjectOntoSH9(const Float3& dir);
 SH9Color ProjectOntoSH9Color(const Float3& dir, const Float3& color);
 Float3 EvalSH9Irradiance(const Float3& dir, const SH9Color& sh);
+Float3 EvalSH9(const Float3& dir, const SH9Color& sh);
+SH9Color RotateSH9(const SH9Color& sh, const Float3x3& rotation);
 
 // H-basis functions
 H4 ProjectOntoH4(const Float3& dir);
@@ -0,0 +1,487 @@
+//=================================================================================================
+//
+//  MJP's DX12 Sample Framework
+//  http://mynameismjp.wordpress.com/
+//
+//  All code licensed under the MIT license
+//
+//=================================================================================================
+
+#include "PCH.h"
+
+#include "ShaderCacheArchive.h"
+
+#include "..\\Utility.h"
+#include "..\\Exceptions.h"
+#include "..\\FileIO.h"
+
+namespace SampleFramework12
+{
+
+static const uint32 ArchiveMagic = 0x41434653;      // "SFCA"
+static const uint32 RecordMagic = 0x52434653;       // "SFCR"
+static const uint32 ArchiveVersion = 1;
+static const uint64 RecordAlignment = 16;
+static const uint64 InitialIndexSize = 1024;
+static const uint64 MinCompactionSize = 1024 * 1024;
+
+// Other processes lock this byte (well past the end of any real archive) while they append
+static const uint64 LockOffset = 0x7FFFFFFFFFFFFFF0ull;
+
+struct ArchiveHeader
+{
+    uint32 Magic = 0;
+    uint32 Version = 0;
+    uint64 Reserved = 0;
+};
+
+struct RecordHeader
+{
+    uint32 Magic = 0;
+    uint32 Reserved = 0;
+    Hash Key;
+    Hash ByteCodeHash;
+    uint64 Size = 0;
+};
+
+StaticAssert_(sizeof(ArchiveHeader) % RecordAlignment == 0);
+StaticAssert_(sizeof(RecordHeader) % RecordAlignment == 0);
+
+static uint64 RecordSize(uint64 byteCodeSize)
+{
+    return AlignTo(sizeof(RecordHeader) + byteCodeSize, RecordAlignment);
+}
+
+static uint64 FileSizeOf(HANDLE fileHandle)
+{
+    LARGE_INTEGER fileSize = { };
+    Win32Call(GetFileSizeEx(fileHandle, &fileSize));
+    return uint64(fileSize.QuadPart);
+}
+
+static void ReadAt(HANDLE fileHandle, uint64 offset, uint64 size, void* data)
+{
+    Assert_(size <= UINT32_MAX);
+
+    OVERLAPPED overlapped = { };
+    overlapped.Offset = uint32(offset & 0xFFFFFFFF);
+    overlapped.OffsetHigh = uint32(offset >> 32);
+
+    DWORD bytesRead = 0;
+    if(ReadFile(fileHandle, data, DWORD(size), &bytesRead, &overlapped) == 0 || bytesRead != size)
+        throw Win32Exception(GetLastError(), L"Failed to read from the shader cache archive:\n");
+}
+
+static void WriteAt(HANDLE fileHandle, uint64 offset, uint64 size, const void* data)
+{
+    Assert_(size <= UINT32_MAX);
+
+    OVERLAPPED overlapped = { };
+    overlapped.Offset = uint32(offset & 0xFFFFFFFF);
+    overlapped.OffsetHigh = uint32(offset >> 32);
+
+    DWORD bytesWritten = 0;
+    if(WriteFile(fileHandle, data, DWORD(size), &bytesWritten, &overlapped) == 0 || bytesWritten != size)
+        throw Win32Exception(GetLastError(), L"Failed to write to the shader cache archive:\n");
+}
+
+ShaderCacheArchive::~ShaderCacheArchive()
+{
+    Close();
+}
+
+void ShaderCacheArchive::Open(const wchar* filePath)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    Assert_(IsOpen() == false);
+
+    path = filePath;
+
+    // Other processes can keep reading and appending while we have it open, and FILE_SHARE_DELETE lets one of them
+    // swap in a compacted archive without waiting for everyone else to close it
+    fileHandle = CreateFile(filePath, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                            nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(fileHandle == INVALID_HANDLE_VALUE)
+    {
+        std::wstring errPrefix = std::wstring(L"Failed to open shader cache archive ") + filePath + L":\n";
+        throw Win32Exception(GetLastError(), errPrefix.c_str());
+    }
+
+    index.Init(InitialIndexSize);
+    numEntries = 0;
+    staleBytes = 0;
+    othersAppended = false;
+    indexedSize = sizeof(ArchiveHeader);
+
+    LockFile();
+
+    try
+    {
+        // Start over if the file is new, or was written by a different version
+        ArchiveHeader header;
+        if(FileSizeOf(fileHandle) >= sizeof(ArchiveHeader))
+            ReadAt(fileHandle, 0, sizeof(ArchiveHeader), &header);
+
+        if(header.Magic != ArchiveMagic || header.Version != ArchiveVersion)
+        {
+            header.Magic = ArchiveMagic;
+            header.Version = ArchiveVersion;
+            header.Reserved = 0;
+
+            // Truncating fails if another process has the file mapped, in which case the new records just get
+            // appended after the old ones and are found by resynchronizing on the record magic
+            LARGE_INTEGER zero = { };
+            if(SetFilePointerEx(fileHandle, zero, nullptr, FILE_BEGIN))
+                SetEndOfFile(fileHandle);
+
+            WriteAt(fileHandle, 0, sizeof(ArchiveHeader), &header);
+        }
+
+        MapFile();
+        ReadRecords();
+
+        // Nobody else can be appending while we hold the lock, so a record that runs past the end of the file was
+        // cut off by a crash. Clear its magic so that it can't swallow the records that get appended after it.
+        if(indexedSize < mappedSize)
+        {
+            const uint32 clearedMagic = 0;
+            WriteAt(fileHandle, indexedSize, sizeof(uint32), &clearedMagic);
+            staleBytes += mappedSize - indexedSize;
+            indexedSize = AlignTo(mappedSize, RecordAlignment);
+        }
+    }
+    catch(Exception&)
+    {
+        UnlockFile();
+        UnmapFile();
+        CloseHandle(fileHandle);
+        fileHandle = INVALID_HANDLE_VALUE;
+        index.Shutdown();
+        throw;
+    }
+
+    UnlockFile();
+}
+
+void ShaderCacheArchive::Close()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if(IsOpen() == false)
+        return;
+
+    Compact();
+
+    UnmapFile();
+    if(fileHandle != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(fileHandle);
+        fileHandle = INVALID_HANDLE_VALUE;
+    }
+
+    index.Shutdown();
+    numEntries = 0;
+    staleBytes = 0;
+    othersAppended = false;
+    indexedSize = 0;
+    fileSize = 0;
+}
+
+bool ShaderCacheArchive::Find(Hash key, Array<uint8>& byteCode)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if(IsOpen() == false)
+        return false;
+
+    IndexSlot* slot = FindSlot(key);
+    const bool indexed = slot->Offset != 0;
+    if(indexed == false || slot->Offset + RecordSize(slot->Size) > mappedSize)
+    {
+        // Either it was appended after the file was mapped, or it isn't in the archive at all. fileSize already
+        // accounts for our own appends, so a miss is only worth re-mapping for when another process has grown the
+        // file past that and might have added it in the meantime.
+        const uint64 currFileSize = FileSizeOf(fileHandle);
+        if(indexed == false && currFileSize <= fileSize)
+            return false;
+
+        othersAppended = othersAppended || currFileSize > AlignTo(fileSize, RecordAlignment);
+
+        UnmapFile();
+        MapFile();
+        ReadRecords();
+
+        slot = FindSlot(key);
+        if(slot->Offset == 0 || slot->Offset + RecordSize(slot->Size) > mappedSize)
+            return false;
+    }
+
+    RecordHeader record;
+    memcpy(&record, mappedData + slot->Offset, sizeof(RecordHeader));
+
+    // A record that's still being written (or was mangled) won't match its hash
+    const uint8* recordByteCode = mappedData + slot->Offset + sizeof(RecordHeader);
+    const Hash byteCodeHash = GenerateHash(recordByteCode, int32(slot->Size));
+    if(record.Magic != RecordMagic || !(record.Key == key) || !(record.ByteCodeHash == byteCodeHash))
+        return false;
+
+    byteCode.Init(slot->Size);
+    memcpy(byteCode.Data(), recordByteCode, slot->Size);
+    slot->Used = true;
+
+    return true;
+}
+
+void ShaderCacheArchive::Add(Hash key, const void* byteCode, uint64 byteCodeSize)
+{
+    Assert_(byteCodeSize > 0);
+
+    std::lock_guard<std::mutex> guard(lock);
+    if(IsOpen() == false)
+        return;
+
+    RecordHeader record;
+    record.Magic = RecordMagic;
+    record.Key = key;
+    record.ByteCodeHash = GenerateHash(byteCode, int32(byteCodeSize));
+    record.Size = byteCodeSize;
+
+    // Header, byte code and padding all go out in one write
+    const uint64 recordSize = RecordSize(byteCodeSize);
+    Array<uint8> recordData(recordSize, 0);
+    memcpy(recordData.Data(), &record, sizeof(RecordHeader));
+    memcpy(recordData.Data() + sizeof(RecordHeader), byteCode, byteCodeSize);
+
+    LockFile();
+
+    uint64 offset = 0;
+    try
+    {
+        offset = AlignTo(FileSizeOf(fileHandle), RecordAlignment);
+        WriteAt(fileHandle, offset, recordSize, recordData.Data());
+    }
+    catch(Exception&)
+    {
+        UnlockFile();
+        throw;
+    }
+
+    UnlockFile();
+
+    InsertIntoIndex(key, offset, byteCodeSize, true);
+
+    // If another process appended before us then fileSize is left where it was, so that the next miss re-maps
+    // the file and picks up their records
+    if(AlignTo(fileSize, RecordAlignment) == offset)
+        fileSize = offset + recordSize;
+}
+
+void ShaderCacheArchive::MapFile()
+{
+    Assert_(mappedData == nullptr);
+
+    // Mapping a range that's bigger than the file isn't allowed, and the file can grow between these two calls,
+    // so only the size from before the mapping was created is used
+    fileSize = FileSizeOf(fileHandle);
+    if(fileSize <= sizeof(ArchiveHeader))
+        return;
+
+    mappingHandle = CreateFileMapping(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(mappingHandle == nullptr)
+        throw Win32Exception(GetLastError(), L"Failed to map the shader cache archive:\n");
+
+    mappedData = reinterpret_cast<const uint8*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+    if(mappedData == nullptr)
+    {
+        const DWORD error = GetLastError();
+        CloseHandle(mappingHandle);
+        mappingHandle = nullptr;
+        throw Win32Exception(error, L"Failed to map the shader cache archive:\n");
+    }
+
+    mappedSize = fileSize;
+}
+
+void ShaderCacheArchive::UnmapFile()
+{
+    if(mappedData != nullptr)
+    {
+        UnmapViewOfFile(mappedData);
+        mappedData = nullptr;
+    }
+
+    if(mappingHandle != nullptr)
+    {
+        CloseHandle(mappingHandle);
+        mappingHandle = nullptr;
+    }
+
+    mappedSize = 0;
+}
+
+// Adds the records between indexedSize and the end of the mapping to the index. Anything that doesn't start with
+// the record magic is skipped one alignment unit at a time, which gets past torn records and the leftovers of an
+// archive that couldn't be truncated. A record that runs off the end is left for the next call, since another
+// process might still be writing it.
+void ShaderCacheArchive::ReadRecords()
+{
+    uint64 offset = indexedSize;
+    while(offset + sizeof(RecordHeader) <= mappedSize)
+    {
+        RecordHeader record;
+        memcpy(&record, mappedData + offset, sizeof(RecordHeader));
+        if(record.Magic != RecordMagic || record.Size == 0)
+        {
+            offset += RecordAlignment;
+            staleBytes += RecordAlignment;
+            continue;
+        }
+
+        const uint64 recordSize = RecordSize(record.Size);
+        if(record.Size > mappedSize || recordSize > mappedSize - offset)
+            break;
+
+        InsertIntoIndex(record.Key, offset, record.Size, false);
+        offset += recordSize;
+    }
+
+    indexedSize = offset;
+}
+
+void ShaderCacheArchive::InsertIntoIndex(Hash key, uint64 offset, uint64 size, bool used)
+{
+    // Keep the load factor under 1/2 so that probes stay short
+    if((numEntries + 1) * 2 > index.Size())
+    {
+        GrowableList<IndexSlot> slots;
+        for(uint64 i = 0; i < index.Size(); ++i)
+            if(index[i].Offset != 0)
+                slots.Add(index[i]);
+
+        index.Init(index.Size() * 2);
+        for(uint64 i = 0; i < slots.Count(); ++i)
+            *FindSlot(slots[i].Key) = slots[i];
+    }
+
+    IndexSlot* slot = FindSlot(key);
+    if(slot->Offset == offset)
+    {
+        // Our own record, read back after re-mapping
+        slot->Used = slot->Used || used;
+        return;
+    }
+
+    if(slot->Offset == 0)
+        ++numEntries;
+    else
+        staleBytes += RecordSize(slot->Size);
+
+    slot->Used = slot->Used || used;
+    slot->Key = key;
+    slot->Offset = offset;
+    slot->Size = size;
+}
+
+ShaderCacheArchive::IndexSlot* ShaderCacheArchive::FindSlot(Hash key)
+{
+    const uint64 mask = index.Size() - 1;
+    Assert_(index.Size() > 0 && (index.Size() & mask) == 0);
+
+    uint64 slotIdx = key.A & mask;
+    while(index[slotIdx].Offset != 0 && !(index[slotIdx].Key == key))
+        slotIdx = (slotIdx + 1) & mask;
+
+    return &index[slotIdx];
+}
+
+void ShaderCacheArchive::LockFile()
+{
+    OVERLAPPED overlapped = { };
+    overlapped.Offset = uint32(LockOffset & 0xFFFFFFFF);
+    overlapped.OffsetHigh = uint32(LockOffset >> 32);
+    Win32Call(LockFileEx(fileHandle, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &overlapped));
+}
+
+void ShaderCacheArchive::UnlockFile()
+{
+    OVERLAPPED overlapped = { };
+    overlapped.Offset = uint32(LockOffset & 0xFFFFFFFF);
+    overlapped.OffsetHigh = uint32(LockOffset >> 32);
+    Win32Call(UnlockFileEx(fileHandle, 0, 1, 0, &overlapped));
+}
+
+// Rewrites the archive with only the records that were used in this run, if the rest of them (stale records,
+// shaders that have since been edited, permutations that nothing asked for) take up more than half of it. The
+// new archive is written next to the old one and then renamed over it, so a failure partway through leaves the old
+// one intact.
+//
+// Other processes that have the archive open don't count towards what's used, and they'd keep appending to the old
+// file after the rename. So this is skipped if another process appended at any point while we had it open. One
+// that's running without appending anything can still lose its records, which just means recompiles for it later.
+void ShaderCacheArchive::Compact()
+{
+    const std::wstring tempPath = path + L".tmp";
+
+    LockFile();
+
+    try
+    {
+        // fileSize covers our own appends, so anything past it came from another process
+        if(othersAppended || FileSizeOf(fileHandle) > AlignTo(fileSize, RecordAlignment))
+        {
+            UnlockFile();
+            return;
+        }
+
+        // Pick up our own records that were appended after the file was mapped
+        UnmapFile();
+        MapFile();
+        ReadRecords();
+
+        uint64 usedBytes = sizeof(ArchiveHeader);
+        for(uint64 i = 0; i < index.Size(); ++i)
+            if(index[i].Used && index[i].Offset != 0 && index[i].Offset + RecordSize(index[i].Size) <= mappedSize)
+                usedBytes += RecordSize(index[i].Size);
+
+        const uint64 unusedBytes = fileSize - usedBytes;
+        if(fileSize < MinCompactionSize || unusedBytes * 2 <= fileSize)
+        {
+            UnlockFile();
+            return;
+        }
+
+        {
+            File tempFile(tempPath.c_str(), FileOpenMode::Write);
+
+            ArchiveHeader header;
+            header.Magic = ArchiveMagic;
+            header.Version = ArchiveVersion;
+            tempFile.Write(header);
+
+            // The records are copied straight out of the mapping, padding included
+            for(uint64 i = 0; i < index.Size(); ++i)
+            {
+                const IndexSlot& slot = index[i];
+                if(slot.Used && slot.Offset != 0 && slot.Offset + RecordSize(slot.Size) <= mappedSize)
+                    tempFile.Write(RecordSize(slot.Size), mappedData + slot.Offset);
+            }
+        }
+
+        WriteLog("Compacting shader cache archive from %.2f MB to %.2f MB", double(fileSize) / (1024.0 * 1024.0),
+                 double(usedBytes) / (1024.0 * 1024.0));
+    }
+    catch(Exception&)
+    {
+        UnlockFile();
+        DeleteFile(tempPath.c_str());
+        return;
+    }
+
+    UnmapFile();
+    UnlockFile();
+    CloseHandle(fileHandle);
+    fileHandle = INVALID_HANDLE_VALUE;
+
+    if(MoveFileEx(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) == 0)
+        DeleteFile(tempPath.c_str());
+}
+
+}
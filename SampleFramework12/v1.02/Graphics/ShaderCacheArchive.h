@@ -0,0 +1,91 @@
+//=================================================================================================
+//
+//  MJP's DX12 Sample Framework
+//  http://mynameismjp.wordpress.com/
+//
+//  All code licensed under the MIT license
+//
+//=================================================================================================
+
+#pragma once
+
+#include "..\\PCH.h"
+
+#include "..\\Containers.h"
+#include "..\\MurmurHash.h"
+
+#include <mutex>
+
+namespace SampleFramework12
+{
+
+// Every compiled shader in a single file, keyed by the same hash that used to name the per-shader cache files.
+// The file is a header followed by records that are only ever appended, each one holding the key, a hash of the
+// byte code and the byte code itself. Opening the archive maps it into memory and walks the records to build an
+// open-addressed hash table, so a lookup is a probe into that table followed by a copy out of the mapped file.
+//
+// Appends take a lock on a sentinel byte past the end of the file, which keeps multiple processes writing to the
+// same archive from interleaving their records. A record that was only partially written (by a crash, or by another
+// process that's in the middle of appending) fails its byte code hash check and is treated as a miss.
+//
+// Records get stale as shaders are edited, so Close() rewrites the archive with only the records that were used in
+// this run once the rest of them take up more than half of the file. That's skipped if another process appended to
+// the archive while it was open, since that process is probably still using it.
+class ShaderCacheArchive
+{
+
+public:
+
+    ShaderCacheArchive() = default;
+    ~ShaderCacheArchive();
+
+    ShaderCacheArchive(const ShaderCacheArchive&) = delete;
+    ShaderCacheArchive& operator=(const ShaderCacheArchive&) = delete;
+
+    void Open(const wchar* filePath);
+    void Close();
+
+    // These can be called from any thread
+    bool Find(Hash key, Array<uint8>& byteCode);
+    void Add(Hash key, const void* byteCode, uint64 byteCodeSize);
+
+    bool IsOpen() const { return fileHandle != INVALID_HANDLE_VALUE; }
+    uint64 NumEntries() const { return numEntries; }
+    uint64 FileSize() const { return fileSize; }
+
+protected:
+
+    struct IndexSlot
+    {
+        Hash Key;
+        uint64 Offset = 0;          // Of the record header, 0 for an empty slot
+        uint64 Size = 0;            // Of the byte code
+        bool Used = false;          // Looked up or added in this run
+    };
+
+    void MapFile();
+    void UnmapFile();
+    void ReadRecords();
+    void InsertIntoIndex(Hash key, uint64 offset, uint64 size, bool used);
+    IndexSlot* FindSlot(Hash key);
+    void LockFile();
+    void UnlockFile();
+    void Compact();
+
+    std::wstring path;
+    HANDLE fileHandle = INVALID_HANDLE_VALUE;
+    HANDLE mappingHandle = nullptr;
+    const uint8* mappedData = nullptr;
+    uint64 mappedSize = 0;
+    uint64 fileSize = 0;
+    uint64 indexedSize = 0;     // Everything before this has been added to the index
+
+    Array<IndexSlot> index;
+    uint64 numEntries = 0;
+    uint64 staleBytes = 0;      // Records that were replaced by a later record with the same key
+    bool othersAppended = false;  // Another process added records while we had the archive open
+
+    std::mutex lock;
+};
+
+}
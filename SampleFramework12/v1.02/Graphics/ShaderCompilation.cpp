@@ -10,6 +10,7 @@
 #include "PCH.h"
 
 #include "ShaderCompilation.h"
+#include "ShaderCacheArchive.h"
 #include "DX12.h"
 
 #include "..\\Utility.h"
@@ -18,6 +19,11 @@
 #include "..\\FileIO.h"
 #include "..\\MurmurHash.h"
 #include "..\\Containers.h"
+#include "..\\Serialization.h"
+#include "..\\Tasks.h"
+
+#include <mutex>
+#include <exception>
 
 using std::vector;
 using std::wstring;
@@ -27,7 +33,7 @@ using std::map;
 namespace SampleFramework12
 {
 
-static const uint64 CacheVersion = 3;
+static const uint64 CacheVersion = 4;
 
 static const char* TypeStrings[] = { "vertex", "hull", "domain", "geometry", "pixel", "compute", "lib" };
 StaticAssert_(ArraySize_(TypeStrings) == uint64(ShaderType::NumTypes));
@@ -59,34 +65,167 @@ static Hash MakeCompilerHash()
 
 static Hash CompilerHash = MakeCompilerHash();
 
-static string GetExpandedShaderCode(const wchar* path, GrowableList<wstring>& filePaths)
+static const wstring baseCacheDir = L"ShaderCache\\";
+
+#if _DEBUG
+    static const wstring cacheSubDir = L"Debug\\";
+#else
+    static const std::wstring cacheSubDir = L"Release\\";
+#endif
+
+static const wstring cacheDir = baseCacheDir + cacheSubDir;
+
+static void CreateCacheDirectory()
 {
-    for(uint64 i = 0; i < filePaths.Count(); ++i)
-        if(filePaths[i] == path)
-            return string();
+    if(DirectoryExists(baseCacheDir.c_str()) == false)
+        Win32Call(CreateDirectory(baseCacheDir.c_str(), nullptr));
+
+    if(DirectoryExists(cacheDir.c_str()) == false)
+        Win32Call(CreateDirectory(cacheDir.c_str(), nullptr));
+}
+
+// == Include graph ===============================================================================
 
-    filePaths.Add(path);
+// Every shader file that's been compiled or #included, with a hash of its contents and the files that it includes.
+// The graph is saved alongside the compiled shaders, so that a cache name can be made by walking a shader's
+// dependencies and checking their timestamps, without reading or expanding any source code.
+struct IncludeGraphNode
+{
+    wstring FilePath;
+    uint64 TimeStamp = 0;
+    Hash ContentHash;
+    Array<uint32> Includes;                     // In the order that they appear in the file
 
-    string fileContents = ReadFileAsString(path);
+    bool Validated = false;                     // Checked against the file on disk since startup
+    GrowableList<CompiledShader*> Shaders;      // Every shader that depends on the file
+
+    template<typename TSerializer> void Serialize(TSerializer& serializer)
+    {
+        SerializeItem(serializer, FilePath);
+        SerializeItem(serializer, TimeStamp);
+        SerializeItem(serializer, ContentHash.A);
+        SerializeItem(serializer, ContentHash.B);
+        BulkSerializeItem(serializer, Includes);
+    }
+};
+
+static const uint64 IncludeGraphVersion = 1;
+static const wstring includeGraphPath = cacheDir + L"IncludeGraph.dat";
+
+static GrowableList<IncludeGraphNode*> IncludeGraph;
+static map<wstring, uint32> IncludeGraphLookup;
+static std::mutex IncludeGraphLock;
+static bool IncludeGraphLoaded = false;
+static bool IncludeGraphDirty = false;
+
+static void ClearIncludeGraph()
+{
+    for(uint64 i = 0; i < IncludeGraph.Count(); ++i)
+        delete IncludeGraph[i];
+    IncludeGraph.RemoveAll();
+    IncludeGraphLookup.clear();
+}
+
+static void LoadIncludeGraph()
+{
+    if(IncludeGraphLoaded)
+        return;
+
+    IncludeGraphLoaded = true;
+    if(FileExists(includeGraphPath.c_str()) == false)
+        return;
+
+    try
+    {
+        FileReadSerializer serializer(includeGraphPath.c_str());
+
+        uint64 version = 0;
+        SerializeItem(serializer, version);
+        if(version != IncludeGraphVersion)
+            return;
+
+        uint64 numNodes = 0;
+        SerializeItem(serializer, numNodes);
+        for(uint64 i = 0; i < numNodes; ++i)
+        {
+            IncludeGraphNode* node = new IncludeGraphNode();
+            IncludeGraph.Add(node);
+            SerializeItem(serializer, *node);
+            IncludeGraphLookup[node->FilePath] = uint32(i);
+
+            for(uint64 includeIdx = 0; includeIdx < node->Includes.Size(); ++includeIdx)
+                if(node->Includes[includeIdx] >= numNodes)
+                    throw Exception(L"Invalid include graph");
+        }
+    }
+    catch(Exception&)
+    {
+        // Start over with an empty graph, which just means that every file gets read again
+        ClearIncludeGraph();
+    }
+}
+
+static void SaveIncludeGraph()
+{
+    if(IncludeGraphDirty == false)
+        return;
+
+    CreateCacheDirectory();
+
+    FileWriteSerializer serializer(includeGraphPath.c_str());
+
+    uint64 version = IncludeGraphVersion;
+    SerializeItem(serializer, version);
+
+    uint64 numNodes = IncludeGraph.Count();
+    SerializeItem(serializer, numNodes);
+    for(uint64 i = 0; i < numNodes; ++i)
+        SerializeItem(serializer, *IncludeGraph[i]);
+
+    IncludeGraphDirty = false;
+}
+
+static uint32 FindOrAddIncludeNode(const wstring& filePath)
+{
+    auto existing = IncludeGraphLookup.find(filePath);
+    if(existing != IncludeGraphLookup.end())
+        return existing->second;
+
+    IncludeGraphNode* node = new IncludeGraphNode();
+    node->FilePath = filePath;
+
+    const uint32 nodeIdx = uint32(IncludeGraph.Add(node));
+    IncludeGraphLookup[filePath] = nodeIdx;
+    IncludeGraphDirty = true;
+
+    return nodeIdx;
+}
+
+// Re-reads a file to get the hash of its contents and the files that it includes. Returns true if the contents
+// are different from what the node had before.
+static bool UpdateIncludeNode(uint32 nodeIdx, uint64 timeStamp)
+{
+    IncludeGraphNode* node = IncludeGraph[nodeIdx];
+    const wchar* path = node->FilePath.c_str();
+    const string fileContents = ReadFileAsString(path);
 
     wstring fileDirectory = GetDirectoryFromFilePath(path);
     if(fileDirectory.length() > 0)
         fileDirectory += L"\\";
 
     // Look for includes
+    GrowableList<uint32> includes;
     size_t lineStart = 0;
-    while(true)
+    while(lineStart < fileContents.length())
     {
         size_t lineEnd = fileContents.find('\n', lineStart);
-        size_t lineLength = 0;
         if(lineEnd == string::npos)
-            lineLength = string::npos;
-        else
-            lineLength = lineEnd - lineStart;
+            lineEnd = fileContents.length();
 
-        string line = fileContents.substr(lineStart, lineLength);
-        if(line.find("#include") == 0)
+        if(fileContents.compare(lineStart, 8, "#include") == 0)
         {
+            const string line = fileContents.substr(lineStart, lineEnd - lineStart);
+
             wstring fullIncludePath;
             size_t startQuote = line.find('\"');
             if(startQuote != -1)
@@ -108,29 +247,83 @@ static string GetExpandedShaderCode(const wchar* path, GrowableList<wstring>& fi
             if(FileExists(fullIncludePath.c_str()) == false)
                 throw Exception(L"Couldn't find #included file \"" + fullIncludePath + L"\" in file " + path);
 
-            string includeCode = GetExpandedShaderCode(fullIncludePath.c_str(), filePaths);
-            fileContents.insert(lineEnd + 1, includeCode);
-            lineEnd += includeCode.length();
+            includes.Add(FindOrAddIncludeNode(fullIncludePath));
         }
 
-        if(lineEnd == string::npos)
-            break;
-
         lineStart = lineEnd + 1;
     }
 
-    return fileContents;
+    // FindOrAddIncludeNode() can grow the graph, but the node itself doesn't move
+    const Hash contentHash = GenerateHash(fileContents.data(), int32(fileContents.length()));
+    const bool changed = !(contentHash == node->ContentHash);
+    node->ContentHash = contentHash;
+    node->TimeStamp = timeStamp;
+    node->Includes.Init(includes.Count());
+    for(uint64 i = 0; i < includes.Count(); ++i)
+        node->Includes[i] = includes[i];
+
+    IncludeGraphDirty = true;
+
+    return changed;
 }
 
-static const wstring baseCacheDir = L"ShaderCache\\";
+// Makes sure that a file and everything it includes are up to date, which only re-reads files whose timestamps
+// don't match the graph. Each file is only checked once until UpdateShaders() finds a change, after which every
+// file gets checked again so that the cache key can't mix old and new contents.
+static void ValidateIncludeNode(uint32 nodeIdx)
+{
+    IncludeGraphNode* node = IncludeGraph[nodeIdx];
+    if(node->Validated)
+        return;
 
-#if _DEBUG
-    static const wstring cacheSubDir = L"Debug\\";
-#else
-    static const std::wstring cacheSubDir = L"Release\\";
-#endif
+    if(FileExists(node->FilePath.c_str()) == false)
+        throw Exception(L"Couldn't find shader file \"" + node->FilePath + L"\"");
 
-static const wstring cacheDir = baseCacheDir + cacheSubDir;
+    const uint64 timeStamp = GetFileTimestamp(node->FilePath.c_str());
+    if(timeStamp != node->TimeStamp)
+        UpdateIncludeNode(nodeIdx, timeStamp);
+
+    // Mark it before recursing, in case of include cycles
+    node->Validated = true;
+    for(uint64 i = 0; i < node->Includes.Size(); ++i)
+        ValidateIncludeNode(node->Includes[i]);
+}
+
+// Combines the content hashes of a file and everything that it includes, visiting each file once in the same
+// order that a full expansion of the #includes would. Returns the visited files in dependencies.
+static Hash MakeSourceHash(const wchar* path, GrowableList<uint32>& dependencies)
+{
+    std::lock_guard<std::mutex> lock(IncludeGraphLock);
+
+    LoadIncludeGraph();
+
+    const uint32 rootIdx = FindOrAddIncludeNode(path);
+    ValidateIncludeNode(rootIdx);
+
+    Array<uint8> visited(IncludeGraph.Count(), 0);
+    GrowableList<uint32> stack;
+    stack.Add(rootIdx);
+
+    Hash sourceHash;
+    while(stack.Count() > 0)
+    {
+        const uint32 nodeIdx = stack[stack.Count() - 1];
+        stack.Remove(stack.Count() - 1);
+        if(visited[nodeIdx])
+            continue;
+
+        visited[nodeIdx] = 1;
+        dependencies.Add(nodeIdx);
+
+        const IncludeGraphNode* node = IncludeGraph[nodeIdx];
+        sourceHash = CombineHashes(sourceHash, node->ContentHash);
+
+        for(uint64 i = node->Includes.Size(); i > 0; --i)
+            stack.Add(node->Includes[i - 1]);
+    }
+
+    return sourceHash;
+}
 
 static string MakeDefinesString(const D3D_SHADER_MACRO* defines)
 {
@@ -148,11 +341,10 @@ static string MakeDefinesString(const D3D_SHADER_MACRO* defines)
     return definesString;
 }
 
-static wstring MakeShaderCacheName(const std::string& shaderCode, const char* functionName,
-                                   const char* profile, const D3D_SHADER_MACRO* defines)
+static Hash MakeShaderCacheKey(Hash sourceHash, const char* functionName,
+                               const char* profile, const D3D_SHADER_MACRO* defines)
 {
-    string hashString = shaderCode;
-    hashString += "\n";
+    string hashString;
     if(functionName != nullptr)
     {
         hashString += functionName;
@@ -166,9 +358,60 @@ static wstring MakeShaderCacheName(const std::string& shaderCode, const char* fu
     hashString += ToAnsiString(CacheVersion);
 
     Hash codeHash = GenerateHash(hashString.data(), int(hashString.length()), 0);
+    codeHash = CombineHashes(codeHash, sourceHash);
     codeHash = CombineHashes(codeHash, CompilerHash);
 
-    return cacheDir + codeHash.ToString() + L".cache";
+    return codeHash;
+}
+
+// All compiled shaders live in a single archive, keyed by MakeShaderCacheKey()
+static const wstring cacheArchivePath = cacheDir + L"Shaders.archive";
+static ShaderCacheArchive CacheArchive;
+static std::mutex CacheArchiveLock;
+static bool CacheArchiveOpened = false;
+
+// Shaders used to be cached in a file per shader, named after the cache key. Nothing reads those anymore.
+static void DeleteLegacyCacheFiles()
+{
+    WIN32_FIND_DATA findData = { };
+    HANDLE findHandle = FindFirstFile((cacheDir + L"*.cache").c_str(), &findData);
+    if(findHandle == INVALID_HANDLE_VALUE)
+        return;
+
+    uint64 numDeleted = 0;
+    do
+    {
+        if((findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0 && DeleteFile((cacheDir + findData.cFileName).c_str()))
+            ++numDeleted;
+    }
+    while(FindNextFile(findHandle, &findData));
+
+    FindClose(findHandle);
+
+    WriteLog("Deleted %llu shader cache files from before the shader cache archive", numDeleted);
+}
+
+static ShaderCacheArchive& GetCacheArchive()
+{
+    std::lock_guard<std::mutex> lock(CacheArchiveLock);
+    if(CacheArchiveOpened == false)
+    {
+        CacheArchiveOpened = true;
+
+        try
+        {
+            CreateCacheDirectory();
+            CacheArchive.Open(cacheArchivePath.c_str());
+            DeleteLegacyCacheFiles();
+        }
+        catch(Exception& exception)
+        {
+            // Everything still works without it, shaders just get compiled every time
+            WriteLog(L"Failed to open the shader cache archive: %ls", exception.GetMessage().c_str());
+        }
+    }
+
+    return CacheArchive;
 }
 
 static HRESULT CompileShaderDXC(const wchar* path, const D3D_SHADER_MACRO* defines, const char* functionName,
@@ -242,27 +485,51 @@ static HRESULT CompileShaderDXC(const wchar* path, const D3D_SHADER_MACRO* defin
     return hr;
 }
 
-static void CompileShader(const wchar* path, const char* functionName, ShaderType type,
-                          const D3D_SHADER_MACRO* defines, GrowableList<wstring>& filePaths,
-                          Array<uint8>& byteCode)
+static const char* ShaderFunctionName(const CompiledShader* shader)
+{
+    return shader->Type != ShaderType::Library ? shader->FunctionName.c_str() : nullptr;
+}
+
+// Makes the key for a shader in the cache archive, and returns the graph nodes of the files that it depends on
+static Hash MakeShaderCacheKey(const CompiledShader* shader, GrowableList<uint32>& dependencies)
 {
+    const wchar* path = shader->FilePath.c_str();
     if(FileExists(path) == false)
     {
         Assert_(false);
         throw Exception(L"Shader file " + std::wstring(path) + L" does not exist");
     }
 
-    uint64 profileIdx = uint64(type);
+    uint64 profileIdx = uint64(shader->Type);
     Assert_(profileIdx < ArraySize_(ProfileStrings));
     const char* profileString = ProfileStrings[profileIdx];
 
-    // Make a hash off the expanded shader code
-    string shaderCode = GetExpandedShaderCode(path, filePaths);
-    wstring cacheName = MakeShaderCacheName(shaderCode, functionName, profileString, defines);
+    D3D_SHADER_MACRO defines[CompileOptions::MaxDefines + 1];
+    shader->CompileOpts.MakeDefines(defines);
+
+    // Make a hash off the shader file and everything that it includes
+    const Hash sourceHash = MakeSourceHash(path, dependencies);
+    return MakeShaderCacheKey(sourceHash, ShaderFunctionName(shader), profileString, defines);
+}
+
+// Loads the byte code from the cache archive if it's there, otherwise compiles the shader and adds it to the archive.
+// The archive does its own locking, so this can run on any thread.
+static void LoadOrCompileShader(CompiledShader* shader, Hash cacheKey)
+{
+    const wchar* path = shader->FilePath.c_str();
+    const char* functionName = ShaderFunctionName(shader);
+    const ShaderType type = shader->Type;
+    const char* profileString = ProfileStrings[uint64(type)];
+
+    D3D_SHADER_MACRO defines[CompileOptions::MaxDefines + 1];
+    shader->CompileOpts.MakeDefines(defines);
 
-    if(FileExists(cacheName.c_str()))
+    Array<uint8>& byteCode = shader->ByteCode;
+
+    ShaderCacheArchive& cacheArchive = GetCacheArchive();
+    if(cacheArchive.Find(cacheKey, byteCode))
     {
-        ReadFileAsByteArray(cacheName.c_str(), byteCode);
+        shader->ByteCodeHash = GenerateHash(byteCode.Data(), int(byteCode.Size()));
         return;
     }
 
@@ -304,84 +571,36 @@ static void CompileShader(const wchar* path, const char* functionName, ShaderTyp
         }
         else
         {
-            // Create the cache directory if it doesn't exist
-            if(DirectoryExists(baseCacheDir.c_str()) == false)
-                Win32Call(CreateDirectory(baseCacheDir.c_str(), nullptr));
-
-            if(DirectoryExists(cacheDir.c_str()) == false)
-                Win32Call(CreateDirectory(cacheDir.c_str(), nullptr));
-
-            File cacheFile(cacheName.c_str(), FileOpenMode::Write);
-
-            // Write the compiled shader to disk
+            // Add the compiled shader to the archive
             const uint64 shaderSize = compiledShader->GetBufferSize();
-            cacheFile.Write(shaderSize, compiledShader->GetBufferPointer());
+            cacheArchive.Add(cacheKey, compiledShader->GetBufferPointer(), shaderSize);
 
             // Return the compiled shader bytecode
             byteCode.Init(shaderSize);
             memcpy(byteCode.Data(), compiledShader->GetBufferPointer(), shaderSize);
+            shader->ByteCodeHash = GenerateHash(byteCode.Data(), int(byteCode.Size()));
 
             return;
         }
     }
 }
 
-struct ShaderFile
-{
-    wstring FilePath;
-    uint64 TimeStamp;
-    GrowableList<CompiledShader*> Shaders;
-
-    ShaderFile(const wstring& filePath) : TimeStamp(0), FilePath(filePath)
-    {
-    }
-};
-
-static GrowableList<ShaderFile*> ShaderFiles;
 static GrowableList<CompiledShader*> CompiledShaders;
-static SRWLOCK ShaderFilesLock = SRWLOCK_INIT;
 static SRWLOCK CompiledShadersLock = SRWLOCK_INIT;
 
-static void CompileShader(CompiledShader* shader)
+// Adds the shader to the graph nodes that it depends on, so that UpdateShaders() knows to recompile it
+static void RegisterShaderDependencies(CompiledShader* shader, const GrowableList<uint32>& dependencies)
 {
-    Assert_(shader != nullptr);
-
-    const char* functionName = shader->Type != ShaderType::Library ? shader->FunctionName.c_str() : nullptr;
+    std::lock_guard<std::mutex> lock(IncludeGraphLock);
 
-    GrowableList<wstring> filePaths;
-    D3D_SHADER_MACRO defines[CompileOptions::MaxDefines + 1];
-    shader->CompileOpts.MakeDefines(defines);
-    CompileShader(shader->FilePath.c_str(), functionName, shader->Type, defines, filePaths, shader->ByteCode);
-    shader->ByteCodeHash = GenerateHash(shader->ByteCode.Data(), int(shader->ByteCode.Size()));
-
-    for(uint64 fileIdx = 0; fileIdx < filePaths.Count(); ++ fileIdx)
+    for(uint64 depIdx = 0; depIdx < dependencies.Count(); ++depIdx)
     {
-        const wstring& filePath = filePaths[fileIdx];
-        ShaderFile* shaderFile = nullptr;
-        const uint64 numShaderFiles = ShaderFiles.Count();
-        for(uint64 shaderFileIdx = 0; shaderFileIdx < numShaderFiles; ++shaderFileIdx)
-        {
-            if(ShaderFiles[shaderFileIdx]->FilePath == filePath)
-            {
-                shaderFile = ShaderFiles[shaderFileIdx];
-                break;
-            }
-        }
-        if(shaderFile == nullptr)
-        {
-            shaderFile = new ShaderFile(filePath);
-
-            AcquireSRWLockExclusive(&ShaderFilesLock);
-
-            ShaderFiles.Add(shaderFile);
-
-            ReleaseSRWLockExclusive(&ShaderFilesLock);
-        }
+        IncludeGraphNode* node = IncludeGraph[dependencies[depIdx]];
 
         bool containsShader = false;
-        for(uint64 shaderIdx = 0; shaderIdx < shaderFile->Shaders.Count(); ++shaderIdx)
+        for(uint64 shaderIdx = 0; shaderIdx < node->Shaders.Count(); ++shaderIdx)
         {
-            if(shaderFile->Shaders[shaderIdx] == shader)
+            if(node->Shaders[shaderIdx] == shader)
             {
                 containsShader = true;
                 break;
@@ -389,10 +608,20 @@ static void CompileShader(CompiledShader* shader)
         }
 
         if(containsShader == false)
-            shaderFile->Shaders.Add(shader);
+            node->Shaders.Add(shader);
     }
 }
 
+static void CompileShader(CompiledShader* shader)
+{
+    Assert_(shader != nullptr);
+
+    GrowableList<uint32> dependencies;
+    const Hash cacheKey = MakeShaderCacheKey(shader, dependencies);
+    LoadOrCompileShader(shader, cacheKey);
+    RegisterShaderDependencies(shader, dependencies);
+}
+
 CompiledShaderPtr CompileFromFile(const wchar* path, const char* functionName,
                                   ShaderType type, const CompileOptions& compileOpts)
 {
@@ -413,70 +642,241 @@ CompiledShaderPtr CompileFromFile(const wchar* path, const char* functionName,
     return compiledShader;
 }
 
+// Re-reads a file whose timestamp has changed, and returns true if its contents are actually different
+static bool CheckIncludeNodeForChanges(uint32 nodeIdx)
+{
+    std::lock_guard<std::mutex> lock(IncludeGraphLock);
+
+    IncludeGraphNode* node = IncludeGraph[nodeIdx];
+    if(node->Shaders.Count() == 0 || FileExists(node->FilePath.c_str()) == false)
+        return false;
+
+    const uint64 newTimeStamp = GetFileTimestamp(node->FilePath.c_str());
+    if(newTimeStamp == node->TimeStamp)
+        return false;
+
+    // Retry a few times to avoid file conflicts with text editors
+    const uint64 NumRetries = 10;
+    for(uint64 retryCount = 0; retryCount < NumRetries; ++retryCount)
+    {
+        try
+        {
+            return UpdateIncludeNode(nodeIdx, newTimeStamp);
+        }
+        catch(Win32Exception& exception)
+        {
+            if(retryCount == NumRetries - 1)
+                throw exception;
+            Sleep(15);
+        }
+    }
+
+    return false;
+}
+
 bool UpdateShaders(bool updateAll)
 {
-    uint64 numShaderFiles = ShaderFiles.Count();
-    if(numShaderFiles == 0)
+    const uint64 numNodes = IncludeGraph.Count();
+    if(numNodes == 0)
         return false;
 
-    static uint64 currFile = 0;
+    static uint64 currNode = 0;
 
-    const uint64 numShadersToCheck = updateAll ? numShaderFiles : 1;
-    bool shaderChanged = false;
+    const uint64 numNodesToCheck = updateAll ? numNodes : 1;
+    bool foundChange = false;
 
-    for(uint64 i = 0; i < numShadersToCheck; ++i)
+    for(uint64 i = 0; i < numNodesToCheck && foundChange == false; ++i)
     {
-        currFile = (currFile + 1) % uint64(numShaderFiles);
+        // Saving a file without changing it (or touching it from source control) only costs a re-hash
+        currNode = (currNode + 1) % numNodes;
+        foundChange = CheckIncludeNodeForChanges(uint32(currNode));
+    }
+
+    if(foundChange == false)
+        return false;
+
+    // Several files are often saved at once, so check all of them before recompiling anything. Otherwise a shader
+    // would be compiled against files that the graph hasn't caught up with, and cached under the wrong key.
+    GrowableList<uint32> changedNodes;
+    changedNodes.Add(uint32(currNode));
+    for(uint64 nodeIdx = 0; nodeIdx < numNodes; ++nodeIdx)
+        if(nodeIdx != currNode && CheckIncludeNodeForChanges(uint32(nodeIdx)))
+            changedNodes.Add(uint32(nodeIdx));
 
-        ShaderFile* file = ShaderFiles[currFile];
-        const uint64 newTimeStamp = GetFileTimestamp(file->FilePath.c_str());
-        if(file->TimeStamp == 0)
+    // Only the shaders that depend on the changed files need to be recompiled
+    GrowableList<CompiledShader*> shaders;
+    {
+        std::lock_guard<std::mutex> lock(IncludeGraphLock);
+
+        for(uint64 i = 0; i < changedNodes.Count(); ++i)
         {
-            file->TimeStamp = newTimeStamp;
-            return false;
+            const IncludeGraphNode* node = IncludeGraph[changedNodes[i]];
+            WriteLog("Hot-swapping shaders for %ls\n", node->FilePath.c_str());
+
+            for(uint64 shaderIdx = 0; shaderIdx < node->Shaders.Count(); ++shaderIdx)
+            {
+                bool containsShader = false;
+                for(uint64 j = 0; j < shaders.Count() && containsShader == false; ++j)
+                    containsShader = shaders[j] == node->Shaders[shaderIdx];
+
+                if(containsShader == false)
+                    shaders.Add(node->Shaders[shaderIdx]);
+            }
         }
 
-        if(file->TimeStamp < newTimeStamp)
+        // Anything that changes from here on gets picked up by MakeSourceHash(), and the key will match what DXC reads
+        for(uint64 nodeIdx = 0; nodeIdx < IncludeGraph.Count(); ++nodeIdx)
+            IncludeGraph[nodeIdx]->Validated = false;
+    }
+
+    for(uint64 shaderIdx = 0; shaderIdx < shaders.Count(); ++shaderIdx)
+    {
+        const uint64 NumRetries = 10;
+        for(uint64 retryCount = 0; retryCount < NumRetries; ++retryCount)
         {
-            WriteLog("Hot-swapping shaders for %ls\n", file->FilePath.c_str());
-            file->TimeStamp = newTimeStamp;
-            for(uint64 fileIdx = 0; fileIdx < file->Shaders.Count(); ++fileIdx)
+            try
             {
-                // Retry a few times to avoid file conflicts with text editors
-                const uint64 NumRetries = 10;
-                for(uint64 retryCount = 0; retryCount < NumRetries; ++retryCount)
-                {
-                    try
-                    {
-                        CompiledShader* shader = file->Shaders[fileIdx];
-                        CompileShader(shader);
-                        break;
-                    }
-                    catch(Win32Exception& exception)
-                    {
-                        if(retryCount == NumRetries - 1)
-                            throw exception;
-                        Sleep(15);
-                    }
-                }
+                CompileShader(shaders[shaderIdx]);
+                break;
+            }
+            catch(Win32Exception& exception)
+            {
+                if(retryCount == NumRetries - 1)
+                    throw exception;
+                Sleep(15);
             }
-
-            shaderChanged = true;
         }
     }
 
-    return shaderChanged;
+    return true;
 }
 
 void ShutdownShaders()
 {
-    for(uint64 i = 0; i < ShaderFiles.Count(); ++i)
-        delete ShaderFiles[i];
+    {
+        std::lock_guard<std::mutex> lock(IncludeGraphLock);
+        try
+        {
+            SaveIncludeGraph();
+        }
+        catch(Exception&)
+        {
+            // Not worth failing over, the graph will just get rebuilt on the next run
+        }
+        ClearIncludeGraph();
+    }
+
+    CacheArchive.Close();
 
     for(uint64 i = 0; i < CompiledShaders.Count(); ++i)
         delete CompiledShaders[i];
 }
 
+// == ShaderCompileBatch ==========================================================================
+
+ShaderCompileBatch::~ShaderCompileBatch()
+{
+    // Anything that was never compiled isn't in the global list yet
+    for(uint64 i = 0; i < requests.Count(); ++i)
+        delete requests[i].Shader;
+}
+
+void ShaderCompileBatch::Add(CompiledShaderPtr& output, const wchar* path, const char* functionName,
+                             ShaderType type, const CompileOptions& compileOpts)
+{
+    if(type == ShaderType::Library)
+    {
+        Assert_(functionName == nullptr);
+    }
+
+    Request request;
+    request.Output = &output;
+    request.Shader = new CompiledShader(path, functionName, compileOpts, type);
+    requests.Add(request);
+}
+
+void ShaderCompileBatch::Compile()
+{
+    const uint64 numRequests = requests.Count();
+    if(numRequests == 0)
+        return;
+
+    // Work out all of the cache keys up front, which only needs the include graph. Requests with the same
+    // cache key would produce the same byte code, so only the first one of those gets compiled.
+    Array<Hash> cacheKeys(numRequests);
+    Array<GrowableList<uint32>> dependencies(numRequests);
+    Array<uint64> sourceRequests(numRequests);
+    GrowableList<uint64> uniqueRequests;
+    map<std::pair<uint64, uint64>, uint64> cacheKeyLookup;
+    for(uint64 i = 0; i < numRequests; ++i)
+    {
+        cacheKeys[i] = MakeShaderCacheKey(requests[i].Shader, dependencies[i]);
+
+        const std::pair<uint64, uint64> lookupKey(cacheKeys[i].A, cacheKeys[i].B);
+        auto existing = cacheKeyLookup.find(lookupKey);
+        if(existing != cacheKeyLookup.end())
+        {
+            sourceRequests[i] = existing->second;
+            continue;
+        }
+
+        cacheKeyLookup[lookupKey] = i;
+        sourceRequests[i] = i;
+        uniqueRequests.Add(i);
+    }
+
+    // Open the archive here rather than having the first task do it while the others wait
+    GetCacheArchive();
+
+    // One shader per task, since compile times vary wildly. Exceptions can't propagate out of the task threads,
+    // so the first one is held on to and re-thrown once everything has finished.
+    std::exception_ptr compileException;
+    std::mutex exceptionLock;
+    Tasks::ParallelFor(uniqueRequests.Count(), [&](uint64 start, uint64 end, uint32 threadNum)
+    {
+        for(uint64 i = start; i < end; ++i)
+        {
+            const uint64 requestIdx = uniqueRequests[i];
+            try
+            {
+                LoadOrCompileShader(requests[requestIdx].Shader, cacheKeys[requestIdx]);
+            }
+            catch(...)
+            {
+                std::lock_guard<std::mutex> lock(exceptionLock);
+                if(compileException == nullptr)
+                    compileException = std::current_exception();
+            }
+        }
+    });
+
+    if(compileException != nullptr)
+        std::rethrow_exception(compileException);
+
+    AcquireSRWLockExclusive(&CompiledShadersLock);
+
+    for(uint64 i = 0; i < numRequests; ++i)
+    {
+        const uint64 sourceIdx = sourceRequests[i];
+        CompiledShader* shader = requests[sourceIdx].Shader;
+        if(sourceIdx == i)
+        {
+            RegisterShaderDependencies(shader, dependencies[i]);
+            CompiledShaders.Add(shader);
+        }
+        else
+        {
+            delete requests[i].Shader;
+        }
+
+        *requests[i].Output = shader;
+    }
+
+    ReleaseSRWLockExclusive(&CompiledShadersLock);
+
+    requests.RemoveAll();
+}
+
 // == CompileOptions ==============================================================================
 
 CompileOptions::CompileOptions()
@@ -127,6 +127,37 @@ typedef CompiledShaderPtr ShaderPtr;
 CompiledShaderPtr CompileFromFile(const wchar* path, const char* functionName, ShaderType type,
                                   const CompileOptions& compileOpts = CompileOptions());
 
+// Collects shaders and compiles them together on the task threads, which is much faster than a series of
+// CompileFromFile() calls when the cache is cold. Requests that end up with the same cache key (same source,
+// entry point, type and defines) are only compiled once, and all of them get the same CompiledShader.
+class ShaderCompileBatch
+{
+
+public:
+
+    ~ShaderCompileBatch();
+
+    // The compiled shader is written to output by Compile(), so output needs to stay alive until then
+    void Add(CompiledShaderPtr& output, const wchar* path, const char* functionName, ShaderType type,
+             const CompileOptions& compileOpts = CompileOptions());
+
+    // Compiles (or loads from the cache) everything that was added, and blocks until it's done. The batch is
+    // empty afterwards and can be re-used.
+    void Compile();
+
+    uint64 NumPending() const { return requests.Count(); }
+
+protected:
+
+    struct Request
+    {
+        CompiledShaderPtr* Output = nullptr;
+        CompiledShader* Shader = nullptr;
+    };
+
+    GrowableList<Request> requests;
+};
+
 bool UpdateShaders(bool updateAll);
 void ShutdownShaders();
 
@@ -97,29 +97,31 @@ void Initialize(ShadowMapMode smMode, ShadowMSAAMode msaaMode)
     {
         std::wstring fullScreenTriPath = SampleFrameworkDir() + L"Shaders\\FullScreenTriangle.hlsl";
         std::wstring smConvertPath = SampleFrameworkDir() + L"Shaders\\SMConvert.hlsl";
-        fullScreenTriVS = CompileFromFile(fullScreenTriPath.c_str(), "FullScreenTriangleVS", ShaderType::Vertex);
+
+        ShaderCompileBatch shaderBatch;
+        shaderBatch.Add(fullScreenTriVS, fullScreenTriPath.c_str(), "FullScreenTriangleVS", ShaderType::Vertex);
         for(uint32 i = 0; i <= MaxFilterRadius; ++i)
         {
             CompileOptions opts;
             opts.Add("SampleRadius_", i);
             opts.Add("Vertical_", 0);
-            filterSMHorizontalPS[i] = CompileFromFile(smConvertPath.c_str(), "FilterSM", ShaderType::Pixel, opts);
+            shaderBatch.Add(filterSMHorizontalPS[i], smConvertPath.c_str(), "FilterSM", ShaderType::Pixel, opts);
 
             opts.Reset();
             opts.Add("SampleRadius_", i);
             opts.Add("Vertical_", 1);
-            filterSMVerticalPS[i] = CompileFromFile(smConvertPath.c_str(), "FilterSM", ShaderType::Pixel, opts);
+            shaderBatch.Add(filterSMVerticalPS[i], smConvertPath.c_str(), "FilterSM", ShaderType::Pixel, opts);
         }
 
-        filter3x3PS = CompileFromFile(smConvertPath.c_str(), "FilterSM3x3", ShaderType::Pixel);
-        filter5x5PS = CompileFromFile(smConvertPath.c_str(), "FilterSM5x5", ShaderType::Pixel);
+        shaderBatch.Add(filter3x3PS, smConvertPath.c_str(), "FilterSM3x3", ShaderType::Pixel);
+        shaderBatch.Add(filter5x5PS, smConvertPath.c_str(), "FilterSM5x5", ShaderType::Pixel);
 
         {
             CompileOptions opts;
             opts.Add("EVSM_", smMode == ShadowMapMode::EVSM ? 1 : 0);
             opts.Add("MSM_", smMode == ShadowMapMode::MSM ? 1 : 0);
             opts.Add("MSAASamples_", NumMSAASamples());
-            smConvertPS = CompileFromFile(smConvertPath.c_str(), "SMConvert", ShaderType::Pixel, opts);
+            shaderBatch.Add(smConvertPS, smConvertPath.c_str(), "SMConvert", ShaderType::Pixel, opts);
         }
 
         for(uint32 i = 0; i <= MaxFilterRadius; ++i)
@@ -130,9 +132,11 @@ void Initialize(ShadowMapMode smMode, ShadowMSAAMode msaaMode)
             opts.Add("MSM_", smMode == ShadowMapMode::MSM ? 1 : 0);
             opts.Add("MSAASamples_", NumMSAASamples());
             opts.Add("CS_", 1);
-            smConvertAndFilterCS[i] = CompileFromFile(smConvertPath.c_str(), "SMConvertAndFilter", ShaderType::Compute, opts);
+            shaderBatch.Add(smConvertAndFilterCS[i], smConvertPath.c_str(), "SMConvertAndFilter", ShaderType::Compute, opts);
         }
 
+        shaderBatch.Compile();
+
         {
             D3D12_ROOT_PARAMETER1 rootParameters[NumRootParams] = { };
             rootParameters[RootParam_StandardDescriptors].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
@@ -13,10 +13,15 @@
 
 #include "../Utility.h"
 #include "../SF12_Math.h"
+#include "../Tasks.h"
+#include "../Timer.h"
+#include "../FileIO.h"
+#include "../Serialization.h"
 #include "../HosekSky/ArHosekSkyModel.h"
 #include "ShaderCompilation.h"
 #include "Textures.h"
 #include "Spectrum.h"
+#include "CubemapProjection.h"
 #include "Sampling.h"
 #include "DX12.h"
 
@@ -32,6 +37,10 @@ static const uint64 NumVertices = 8;
 static const float PhysicalSunSize = DegToRad(0.27f);
 static const float CosPhysicalSunSize = std::cos(PhysicalSunSize);
 
+// Bump this whenever the contents of the sky LUT change, so that stale cache files get regenerated
+static const uint32 SkyLUTVersion = 2;
+static const uint32 SkyLUTSHResolution = 32;
+
 static float AngleBetween(const Float3& dir0, const Float3& dir1)
 {
     return std::acos(std::max(Float3::Dot(dir0, dir1), 0.00001f));
@@ -45,51 +54,34 @@ static float IrradianceIntegral(float theta)
     return Pi * sinTheta * sinTheta;
 }
 
-bool SkyCache::Init(const Float3& sunDirection_, float sunSize, const Float3& groundAlbedo_, float turbidity, bool createCubemap)
+static Float3 SampleSkyModel(ArHosekSkyModelState* stateR, ArHosekSkyModelState* stateG, ArHosekSkyModelState* stateB,
+                             const Float3& sunDirection, const Float3& sampleDir)
 {
-    Float3 sunDirection = sunDirection_;
-    Float3 groundAlbedo = groundAlbedo_;
-    sunDirection.y = Saturate(sunDirection.y);
-    sunDirection = Float3::Normalize(sunDirection);
-    turbidity = Clamp(turbidity, 1.0f, 32.0f);
-    groundAlbedo = Saturate(groundAlbedo);
-    sunSize = Max(sunSize, 0.01f);
-
-    // Do nothing if we're already up-to-date
-    if(Initialized() && sunDirection == SunDirection && groundAlbedo == Albedo && turbidity == Turbidity && SunSize == sunSize)
-        return false;
-
-    Shutdown();
+    float gamma = AngleBetween(sampleDir, sunDirection);
+    float theta = AngleBetween(sampleDir, Float3(0, 1, 0));
 
-    sunDirection.y = Saturate(sunDirection.y);
-    sunDirection = Float3::Normalize(sunDirection);
-    turbidity = Clamp(turbidity, 1.0f, 32.0f);
-    groundAlbedo = Saturate(groundAlbedo);
+    Float3 radiance;
 
-    float thetaS = AngleBetween(sunDirection, Float3(0, 1, 0));
-    float elevation = Pi_2 - thetaS;
-    StateR = arhosek_rgb_skymodelstate_alloc_init(turbidity, groundAlbedo.x, elevation);
-    StateG = arhosek_rgb_skymodelstate_alloc_init(turbidity, groundAlbedo.y, elevation);
-    StateB = arhosek_rgb_skymodelstate_alloc_init(turbidity, groundAlbedo.z, elevation);
+    radiance.x = float(arhosek_tristim_skymodel_radiance(stateR, theta, gamma, 0));
+    radiance.y = float(arhosek_tristim_skymodel_radiance(stateG, theta, gamma, 1));
+    radiance.z = float(arhosek_tristim_skymodel_radiance(stateB, theta, gamma, 2));
 
-    Albedo = groundAlbedo;
-    Elevation = elevation;
-    SunDirection = sunDirection;
-    Turbidity = turbidity;
-    SunSize = sunSize;
+    // Multiply by standard luminous efficacy of 683 lm/W to bring us in line with the photometric
+    // units used during rendering
+    radiance *= 683.0f;
 
-    // Compute the irradiance of the sun for a surface perpendicular to the sun using monte carlo integration.
-    // Note that the solar radiance function provided by the authors of this sky model only works using
-    // spectral rendering, so we sample a range of wavelengths and then convert to RGB.
-    SampledSpectrum groundAlbedoSpectrum = SampledSpectrum::FromRGB(Albedo, SpectrumType::Reflectance);
-    SampledSpectrum solarRadiance;
+    return radiance * FP16Scale;
+}
 
-    // Init the Hosek solar radiance model for all wavelengths
-    ArHosekSkyModelState* skyStates[NumSpectralSamples] = { };
-    for(int32 i = 0; i < NumSpectralSamples; ++i)
-        skyStates[i] = arhosekskymodelstate_alloc_init(thetaS, turbidity, groundAlbedoSpectrum[i]);
+// Computes the irradiance of the sun for a surface perpendicular to the sun using monte carlo integration.
+// Note that the solar radiance function provided by the authors of this sky model only works using
+// spectral rendering, so we sample a range of wavelengths and then convert to RGB.
+static Float3 ComputeSunIrradiance(const Float3& sunDirection, float turbidity, const Float3& groundAlbedo)
+{
+    const float thetaS = AngleBetween(sunDirection, Float3(0, 1, 0));
+    SampledSpectrum groundAlbedoSpectrum = SampledSpectrum::FromRGB(groundAlbedo, SpectrumType::Reflectance);
 
-    SunIrradiance = Float3(0.0f);
+    Float3 sunIrradiance = Float3(0.0f);
 
     // Uniformly sample the solid area of the solar disc.
     // Note that we use the *actual* sun size here and not the passed in the sun direction, so that
@@ -100,6 +92,10 @@ bool SkyCache::Init(const Float3& sunDirection_, float sunSize, const Float3& gr
     Float3x3 sunOrientation = Float3x3(sunDirX, sunDirY, sunDirection);
 
     const uint64 NumSamples = 8;
+    const uint64 NumDiscSamples = NumSamples * NumSamples;
+    Float3 discSampleDirs[NumDiscSamples];
+    double discSampleThetaS[NumDiscSamples];
+    double discSampleGamma[NumDiscSamples];
     for(uint64 x = 0; x < NumSamples; ++x)
     {
         for(uint64 y = 0; y < NumSamples; ++y)
@@ -109,37 +105,304 @@ bool SkyCache::Init(const Float3& sunDirection_, float sunSize, const Float3& gr
             Float3 sampleDir = SampleDirectionCone(u1, u2, CosPhysicalSunSize);
             sampleDir = Float3::Transform(sampleDir, sunOrientation);
 
-            float sampleThetaS = AngleBetween(sampleDir, Float3(0, 1, 0));
-            float sampleGamma = AngleBetween(sampleDir, sunDirection);
-
-            for(int32 i = 0; i < NumSpectralSamples; ++i)
-            {
-                float wavelength = Lerp(float(SampledLambdaStart), float(SampledLambdaEnd), i / float(NumSpectralSamples));
-                solarRadiance[i] = float(arhosekskymodel_solar_radiance(skyStates[i], sampleThetaS, sampleGamma, wavelength));
-            }
+            const uint64 sampleIdx = x * NumSamples + y;
+            discSampleDirs[sampleIdx] = sampleDir;
+            discSampleThetaS[sampleIdx] = AngleBetween(sampleDir, Float3(0, 1, 0));
+            discSampleGamma[sampleIdx] = AngleBetween(sampleDir, sunDirection);
+        }
+    }
 
-            Float3 sampleRadiance = solarRadiance.ToRGB();
+    // Every wavelength needs its own Hosek model state, but they're otherwise independent. So we
+    // hand out whole wavelengths to the task threads, and have each one init its state and evaluate
+    // all of the disc samples in one tight loop. The results are stored wavelength-major so that the
+    // threads never write to the same cache lines.
+    Array<float> solarRadiance(NumSpectralSamples * NumDiscSamples);
+    Tasks::ParallelFor(NumSpectralSamples, [&](uint64 start, uint64 end, uint32 threadNum)
+    {
+        for(uint64 i = start; i < end; ++i)
+        {
+            ArHosekSkyModelState* skyState = arhosekskymodelstate_alloc_init(thetaS, turbidity, groundAlbedoSpectrum[int32(i)]);
 
-            // Pre-scale by our FP16 scaling factor, so that we can use the irradiance value
-            // and have the resulting lighting still fit comfortably in an FP16 render target
-            sampleRadiance *= FP16Scale;
+            const double wavelength = Lerp(float(SampledLambdaStart), float(SampledLambdaEnd), i / float(NumSpectralSamples));
+            float* wavelengthRadiance = &solarRadiance[i * NumDiscSamples];
+            for(uint64 sampleIdx = 0; sampleIdx < NumDiscSamples; ++sampleIdx)
+                wavelengthRadiance[sampleIdx] = float(arhosekskymodel_solar_radiance(skyState, discSampleThetaS[sampleIdx],
+                                                                                      discSampleGamma[sampleIdx], wavelength));
 
-            SunIrradiance += sampleRadiance * Saturate(Float3::Dot(sampleDir, sunDirection));
+            arhosekskymodelstate_free(skyState);
         }
+    });
+
+    for(uint64 sampleIdx = 0; sampleIdx < NumDiscSamples; ++sampleIdx)
+    {
+        SampledSpectrum sampleSpectrum;
+        for(int32 i = 0; i < NumSpectralSamples; ++i)
+            sampleSpectrum[i] = solarRadiance[i * NumDiscSamples + sampleIdx];
+
+        Float3 sampleRadiance = sampleSpectrum.ToRGB();
+
+        // Pre-scale by our FP16 scaling factor, so that we can use the irradiance value
+        // and have the resulting lighting still fit comfortably in an FP16 render target
+        sampleRadiance *= FP16Scale;
+
+        sunIrradiance += sampleRadiance * Saturate(Float3::Dot(discSampleDirs[sampleIdx], sunDirection));
     }
 
     // Apply the monte carlo factor of 1 / (PDF * N)
     float pdf = SampleDirectionCone_PDF(CosPhysicalSunSize);
-    SunIrradiance *= (1.0f / NumSamples) * (1.0f / NumSamples) * (1.0f / pdf);
+    sunIrradiance *= (1.0f / NumSamples) * (1.0f / NumSamples) * (1.0f / pdf);
 
     // Account for luminous efficiency and coordinate system scaling
-    SunIrradiance *= 683.0f * 100.0f;
+    sunIrradiance *= 683.0f * 100.0f;
+
+    return sunIrradiance;
+}
+
+// Projects the sky radiance for a single RGB sky model state onto SH, without the sun
+static SH9Color ProjectSkyOntoSH(ArHosekSkyModelState* state, const Float3& sunDirection, const CubemapProjectionPlan& plan)
+{
+    Array<Float3> radiance(plan.NumTexels());
+    for(uint64 i = 0; i < plan.NumTexels(); ++i)
+        radiance[i] = SampleSkyModel(state, state, state, sunDirection, plan.Direction(i));
+
+    return plan.ProjectSH9(radiance.Data());
+}
+
+// == SkyLUT ======================================================================================
+
+// The RGB sky model lerps linearly between the albedo = 0 and albedo = 1 datasets and between integer
+// turbidity values, so those axes can be sampled coarsely without losing anything. The elevation is fit
+// with a quintic bezier in (elevation / (Pi / 2)) ^ (1 / 3), so we sample uniformly in that space.
+static float SkyLUTElevationCoord(float elevation)
+{
+    return std::pow(Saturate(elevation / Pi_2), 1.0f / 3.0f);
+}
+
+static float SkyLUTElevation(float coord)
+{
+    return coord * coord * coord * Pi_2;
+}
+
+// Reference sun direction used for all LUT entries, with the sun in the XY plane
+static Float3 SkyLUTSunDirection(float elevation)
+{
+    return Float3(std::cos(elevation), std::sin(elevation), 0.0f);
+}
+
+void SkyLUT::Initialize(const wchar* cacheFilePath)
+{
+    Shutdown();
+
+    if(cacheFilePath != nullptr && FileExists(cacheFilePath))
+    {
+        FileReadSerializer serializer(cacheFilePath);
+        SerializeItem(serializer, Version);
+        if(Version == SkyLUTVersion)
+        {
+            BulkSerializeItem(serializer, Entries);
+            if(Entries.Size() == NumEntries)
+            {
+                WriteLog("Loaded sky LUT from '%ls'", cacheFilePath);
+                return;
+            }
+        }
+
+        Shutdown();
+    }
+
+    Generate();
+
+    if(cacheFilePath != nullptr)
+    {
+        FileWriteSerializer serializer(cacheFilePath);
+        Serialize(serializer);
+    }
+}
+
+void SkyLUT::Generate()
+{
+    Timer timer;
+
+    Version = SkyLUTVersion;
+    Entries.Init(NumEntries);
+
+    const CubemapProjectionPlan& shPlan = CubemapProjectionPlan::Get(SkyLUTSHResolution);
 
-    // Clean up
-    for(uint64 i = 0; i < NumSpectralSamples; ++i)
+    Tasks::ParallelFor(NumEntries, [&](uint64 start, uint64 end, uint32 threadNum)
     {
-        arhosekskymodelstate_free(skyStates[i]);
-        skyStates[i] = nullptr;
+        for(uint64 entryIdx = start; entryIdx < end; ++entryIdx)
+        {
+            const uint64 elevationIdx = entryIdx % NumElevations;
+            const uint64 turbidityIdx = (entryIdx / NumElevations) % NumTurbidities;
+            const uint64 albedoIdx = entryIdx / (NumElevations * NumTurbidities);
+
+            const float elevation = SkyLUTElevation(elevationIdx / float(NumElevations - 1));
+            const float turbidity = 1.0f + turbidityIdx;
+            const float albedo = albedoIdx / float(NumAlbedos - 1);
+            const Float3 sunDirection = SkyLUTSunDirection(elevation);
+
+            Entry& entry = Entries[entryIdx];
+
+            ArHosekSkyModelState* state = arhosek_rgb_skymodelstate_alloc_init(turbidity, albedo, elevation);
+            for(uint64 channel = 0; channel < 3; ++channel)
+            {
+                for(uint64 i = 0; i < ArraySize_(entry.Configs[channel]); ++i)
+                    entry.Configs[channel][i] = state->configs[channel][i];
+                entry.Radiances[channel] = state->radiances[channel];
+            }
+
+            entry.SunIrradiance = ComputeSunIrradiance(sunDirection, turbidity, Float3(albedo));
+            entry.SH = ProjectSkyOntoSH(state, sunDirection, shPlan);
+
+            arhosekskymodelstate_free(state);
+        }
+    });
+
+    timer.Update();
+    WriteLog("Generated sky LUT with %llu entries in %.2f ms", NumEntries, timer.ElapsedMillisecondsF());
+}
+
+void SkyLUT::Shutdown()
+{
+    Version = 0;
+    Entries.Shutdown();
+}
+
+SkyLUT::Entry SkyLUT::Interpolate(float elevation, float turbidity, float albedo) const
+{
+    Assert_(Initialized());
+
+    const float elevationCoord = SkyLUTElevationCoord(elevation) * (NumElevations - 1);
+    const float turbidityCoord = Clamp(turbidity - 1.0f, 0.0f, float(NumTurbidities - 1));
+    const float albedoCoord = Saturate(albedo) * (NumAlbedos - 1);
+
+    const uint64 e0 = Min<uint64>(uint64(elevationCoord), NumElevations - 2);
+    const uint64 t0 = Min<uint64>(uint64(turbidityCoord), NumTurbidities - 2);
+    const uint64 a0 = Min<uint64>(uint64(albedoCoord), NumAlbedos - 2);
+    const float eLerp = elevationCoord - e0;
+    const float tLerp = turbidityCoord - t0;
+    const float aLerp = albedoCoord - a0;
+
+    Entry result = { };
+    for(uint64 corner = 0; corner < 8; ++corner)
+    {
+        const uint64 eOffset = corner & 1;
+        const uint64 tOffset = (corner >> 1) & 1;
+        const uint64 aOffset = (corner >> 2) & 1;
+        const float weight = (eOffset ? eLerp : 1.0f - eLerp) *
+                             (tOffset ? tLerp : 1.0f - tLerp) *
+                             (aOffset ? aLerp : 1.0f - aLerp);
+        if(weight == 0.0f)
+            continue;
+
+        const uint64 entryIdx = (e0 + eOffset) + (t0 + tOffset) * NumElevations + (a0 + aOffset) * NumElevations * NumTurbidities;
+        const Entry& entry = Entries[entryIdx];
+        for(uint64 channel = 0; channel < 3; ++channel)
+        {
+            for(uint64 i = 0; i < ArraySize_(entry.Configs[channel]); ++i)
+                result.Configs[channel][i] += entry.Configs[channel][i] * weight;
+            result.Radiances[channel] += entry.Radiances[channel] * weight;
+        }
+
+        result.SunIrradiance += entry.SunIrradiance * weight;
+        result.SH += entry.SH * weight;
+    }
+
+    return result;
+}
+
+// == SkyCache ====================================================================================
+
+bool SkyCache::Init(const Float3& sunDirection_, float sunSize, const Float3& groundAlbedo_, float turbidity,
+                    bool createCubemap, const SkyLUT* lut)
+{
+    Float3 sunDirection = sunDirection_;
+    Float3 groundAlbedo = groundAlbedo_;
+    sunDirection.y = Saturate(sunDirection.y);
+    sunDirection = Float3::Normalize(sunDirection);
+    turbidity = Clamp(turbidity, 1.0f, 32.0f);
+    groundAlbedo = Saturate(groundAlbedo);
+    sunSize = Max(sunSize, 0.01f);
+
+    if(lut != nullptr && lut->Initialized() == false)
+        lut = nullptr;
+
+    // Do nothing if we're already up-to-date
+    if(Initialized() && sunDirection == SunDirection && groundAlbedo == Albedo && turbidity == Turbidity && SunSize == sunSize && LUT == lut)
+        return false;
+
+    Shutdown();
+
+    sunDirection.y = Saturate(sunDirection.y);
+    sunDirection = Float3::Normalize(sunDirection);
+    turbidity = Clamp(turbidity, 1.0f, 32.0f);
+    groundAlbedo = Saturate(groundAlbedo);
+
+    float thetaS = AngleBetween(sunDirection, Float3(0, 1, 0));
+    float elevation = Pi_2 - thetaS;
+
+    Albedo = groundAlbedo;
+    Elevation = elevation;
+    SunDirection = sunDirection;
+    Turbidity = turbidity;
+    SunSize = sunSize;
+    LUT = lut;
+
+    if(lut != nullptr)
+    {
+        // Each channel of the RGB model only depends on the matching channel of the ground albedo,
+        // so we do a separate lookup per channel and pull out the data for that channel.
+        const float channelAlbedo[3] = { groundAlbedo.x, groundAlbedo.y, groundAlbedo.z };
+        ArHosekSkyModelState** channelStates[3] = { &StateR, &StateG, &StateB };
+        float sunIrradiance[3] = { };
+        float sh[9][3] = { };
+
+        for(uint32 channel = 0; channel < 3; ++channel)
+        {
+            SkyLUT::Entry entry = lut->Interpolate(elevation, turbidity, channelAlbedo[channel]);
+
+            ArHosekSkyModelState* state = reinterpret_cast<ArHosekSkyModelState*>(malloc(sizeof(ArHosekSkyModelState)));
+            memset(state, 0, sizeof(ArHosekSkyModelState));
+            state->turbidity = turbidity;
+            state->albedo = channelAlbedo[channel];
+            state->elevation = elevation;
+            for(uint64 c = 0; c < 3; ++c)
+            {
+                for(uint64 i = 0; i < ArraySize_(entry.Configs[c]); ++i)
+                    state->configs[c][i] = entry.Configs[c][i];
+                state->radiances[c] = entry.Radiances[c];
+            }
+            *channelStates[channel] = state;
+
+            sunIrradiance[channel] = entry.SunIrradiance[channel];
+            for(uint64 i = 0; i < 9; ++i)
+                sh[i][channel] = entry.SH.Coefficients[i][channel];
+        }
+
+        SunIrradiance = Float3(sunIrradiance[0], sunIrradiance[1], sunIrradiance[2]);
+
+        // The LUT stores the SH for a sun in the XY plane, so rotate it about the Y axis to match the
+        // actual sun azimuth. The sky is symmetric about the plane containing the sun, so this is exact.
+        Float3 sunHorizontal = Float3(sunDirection.x, 0.0f, sunDirection.z);
+        if(Float3::Length(sunHorizontal) > 0.0001f)
+            sunHorizontal = Float3::Normalize(sunHorizontal);
+        else
+            sunHorizontal = Float3(1.0f, 0.0f, 0.0f);
+
+        const Float3 up = Float3(0.0f, 1.0f, 0.0f);
+        const Float3x3 azimuthRotation = Float3x3(sunHorizontal, up, Float3::Cross(sunHorizontal, up));
+        SH9Color skySH;
+        for(uint64 i = 0; i < 9; ++i)
+            skySH.Coefficients[i] = Float3(sh[i][0], sh[i][1], sh[i][2]);
+        SH = RotateSH9(skySH, azimuthRotation);
+    }
+    else
+    {
+        StateR = arhosek_rgb_skymodelstate_alloc_init(turbidity, groundAlbedo.x, elevation);
+        StateG = arhosek_rgb_skymodelstate_alloc_init(turbidity, groundAlbedo.y, elevation);
+        StateB = arhosek_rgb_skymodelstate_alloc_init(turbidity, groundAlbedo.z, elevation);
+
+        SunIrradiance = ComputeSunIrradiance(sunDirection, turbidity, groundAlbedo);
     }
 
     // Compute a uniform solar radiance value such that integrating this radiance over a disc with
@@ -160,55 +423,31 @@ bool SkyCache::Init(const Float3& sunDirection_, float sunSize, const Float3& gr
         const uint64 CubeMapRes = 128;
         const uint64 NumTexels = CubeMapRes * CubeMapRes * 6;
         Array<Float3> samples(NumTexels);
-        Array<Float3> sampleDirs(NumTexels);
         Array<Half4> texels(NumTexels);
 
-        // We'll also project the sky onto SH coefficients for use during rendering
-        SH = SH9Color();
-        float weightSum = 0.0f;
+        const CubemapProjectionPlan& plan = CubemapProjectionPlan::Get(uint32(CubeMapRes));
 
-        for(uint64 s = 0; s < 6; ++s)
+        Tasks::ParallelFor(NumTexels, [&](uint64 start, uint64 end, uint32 threadNum)
         {
-            for(uint64 y = 0; y < CubeMapRes; ++y)
+            for(uint64 idx = start; idx < end; ++idx)
             {
-                for(uint64 x = 0; x < CubeMapRes; ++x)
-                {
-                    Float3 dir = MapXYSToDirection(x, y, s, CubeMapRes, CubeMapRes);
-                    Float3 radiance = Sample(dir);
-
-                    uint64 idx = (s * CubeMapRes * CubeMapRes) + (y * CubeMapRes) + x;
-                    samples[idx] = radiance;
-                    texels[idx] = Half4(Float4(radiance, 1.0f));
-                    sampleDirs[idx] = dir;
-
-                    float u = (x + 0.5f) / CubeMapRes;
-                    float v = (y + 0.5f) / CubeMapRes;
-
-                    // Account for cubemap texel distribution
-                    u = u * 2.0f - 1.0f;
-                    v = v * 2.0f - 1.0f;
-                    const float temp = 1.0f + u * u + v * v;
-                    const float weight = 4.0f / (std::sqrt(temp) * temp);
-
-                    SH += ProjectOntoSH9Color(dir, radiance) * weight;
-                    weightSum += weight;
-                }
+                Float3 dir = plan.Direction(idx);
+                Float3 radiance = Sample(dir);
+
+                samples[idx] = radiance;
+                texels[idx] = Half4(Float4(radiance, 1.0f));
             }
-        }
+        }, CubeMapRes);
 
-        SH *= (4.0f * 3.14159f) / weightSum;
+        // We'll also project the sky onto SH coefficients for use during rendering, unless we already
+        // got them from the LUT
+        if(lut == nullptr)
+            SH = plan.ProjectSH9(samples.Data());
 
         Create2DTexture(CubeMap, CubeMapRes, CubeMapRes, 1, 1, DXGI_FORMAT_R16G16B16A16_FLOAT, true, texels.Data());
 
-        SGSolveParams solveParams;
-        solveParams.SampleDirs = sampleDirs.Data();
-        solveParams.SampleValues = samples.Data();
-        solveParams.NumSamples = NumTexels;
-        solveParams.SolveMode = SGSolveMode::NNLS;
-        solveParams.Distribution = SGDistribution::Spherical;
-        solveParams.NumSGs = 9;
-        solveParams.OutSGs = SG.Lobes;
-        SolveSGs(solveParams);
+        // The solver for the cubemap directions is shared, so only the first Init pays for building it
+        SGSolver::GetForCubemap(uint32(CubeMapRes), 9, SGSolveMode::NNLS).Solve(samples.Data(), SG.Lobes);
     }
 
     return true;
@@ -242,6 +481,7 @@ void SkyCache::Shutdown()
     SunRadiance = 0.0f;
     SunIrradiance = 0.0f;
     SH = SH9Color();
+    LUT = nullptr;
 }
 
 SkyCache::~SkyCache()
@@ -253,20 +493,7 @@ Float3 SkyCache::Sample(Float3 sampleDir) const
 {
     Assert_(StateR != nullptr);
 
-    float gamma = AngleBetween(sampleDir, SunDirection);
-    float theta = AngleBetween(sampleDir, Float3(0, 1, 0));
-
-    Float3 radiance;
-
-    radiance.x = float(arhosek_tristim_skymodel_radiance(StateR, theta, gamma, 0));
-    radiance.y = float(arhosek_tristim_skymodel_radiance(StateG, theta, gamma, 1));
-    radiance.z = float(arhosek_tristim_skymodel_radiance(StateB, theta, gamma, 2));
-
-    // Multiply by standard luminous efficacy of 683 lm/W to bring us in line with the photometric
-    // units used during rendering
-    radiance *= 683.0f;
-
-    return radiance * FP16Scale;
+    return SampleSkyModel(StateR, StateG, StateB, SunDirection, sampleDir);
 }
 
 #endif // EnableSkyModel_
@@ -13,6 +13,8 @@
 
 #include "..\\InterfacePointers.h"
 #include "..\\SF12_Math.h"
+#include "..\\Containers.h"
+#include "..\\Serialization.h"
 #include "ShaderCompilation.h"
 #include "GraphicsTypes.h"
 #include "SH.h"
@@ -26,6 +28,44 @@ namespace SampleFramework12
 
 #if EnableSkyModel_
 
+// Pre-computed table of sky model coefficients, sun irradiance, and sky SH, keyed by sun elevation,
+// turbidity, and ground albedo. Interpolating from this is much cheaper than cooking the Hosek
+// datasets and re-integrating the sun, which makes it suitable for animating the time of day.
+struct SkyLUT
+{
+    static const uint64 NumElevations = 64;
+    static const uint64 NumTurbidities = 10;
+    static const uint64 NumAlbedos = 3;
+    static const uint64 NumEntries = NumElevations * NumTurbidities * NumAlbedos;
+
+    struct Entry
+    {
+        double Configs[3][9];
+        double Radiances[3];
+        Float3 SunIrradiance;
+        SH9Color SH;            // Sky SH for a sun in the XY plane
+    };
+
+    uint32 Version = 0;
+    Array<Entry> Entries;
+
+    // Loads the table from the cache file if it's present and up-to-date, otherwise it's generated
+    // and written back out to the cache file
+    void Initialize(const wchar* cacheFilePath);
+    void Generate();
+    void Shutdown();
+
+    bool Initialized() const { return Entries.Size() > 0; }
+
+    Entry Interpolate(float elevation, float turbidity, float albedo) const;
+
+    template<typename TSerializer> void Serialize(TSerializer& serializer)
+    {
+        SerializeItem(serializer, Version);
+        BulkSerializeItem(serializer, Entries);
+    }
+};
+
 // Cached data for the procedural sky model
 struct SkyCache
 {
@@ -43,8 +83,10 @@ struct SkyCache
     Texture CubeMap;
     SH9Color SH;
     SG9 SG;
+    const SkyLUT* LUT = nullptr;
 
-    bool Init(const Float3& sunDirection, float sunSize, const Float3& groundAlbedo, float turbidity, bool createCubemap);
+    bool Init(const Float3& sunDirection, float sunSize, const Float3& groundAlbedo, float turbidity,
+              bool createCubemap, const SkyLUT* lut = nullptr);
     void Shutdown();
     ~SkyCache();
 
@@ -0,0 +1,402 @@
+//=================================================================================================
+//
+//  MJP's DX12 Sample Framework
+//  http://mynameismjp.wordpress.com/
+//
+//  All code licensed under the MIT license
+//
+//=================================================================================================
+
+#include "PCH.h"
+
+#include "TextureCooking.h"
+#include "Textures.h"
+#include "Model.h"
+#include "..\\Utility.h"
+#include "..\\Exceptions.h"
+#include "..\\FileIO.h"
+#include "..\\Tasks.h"
+
+namespace SampleFramework12
+{
+
+static const uint32 CookedTextureMagic = 0x58544653;    // "SFTX"
+static const uint32 CookedTextureVersion = 1;
+
+static const wchar* CacheDir = L"TextureCache\\";
+
+static const wchar* CookableExtensions[] = { L"png", L"tga", L"jpg", L"jpeg", L"bmp", L"tif", L"tiff", L"gif" };
+
+// Wraps a FILE that's closed when it goes out of scope. The cooking functions run on the task threads and report
+// failures through return values, so they avoid the throwing File class.
+struct ScopedFile
+{
+    FILE* Handle = nullptr;
+
+    ScopedFile(const wchar* path, const wchar* mode)
+    {
+        if(_wfopen_s(&Handle, path, mode) != 0)
+            Handle = nullptr;
+    }
+
+    ~ScopedFile()
+    {
+        if(Handle != nullptr)
+            fclose(Handle);
+    }
+
+    bool Read(void* data, uint64 size) const { return fread(data, 1, size_t(size), Handle) == size; }
+    bool Write(const void* data, uint64 size) const { return fwrite(data, 1, size_t(size), Handle) == size; }
+};
+
+static bool GetFileInfo(const wchar* filePath, uint64& size, uint64& timestamp)
+{
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if(GetFileAttributesEx(filePath, GetFileExInfoStandard, &attributes) == 0)
+        return false;
+
+    size = attributes.nFileSizeLow | (uint64(attributes.nFileSizeHigh) << 32);
+    timestamp = attributes.ftLastWriteTime.dwLowDateTime | (uint64(attributes.ftLastWriteTime.dwHighDateTime) << 32);
+    return true;
+}
+
+// Textures with more than one source combine the sizes, timestamps and hashes of all of them. Empty paths are
+// channels without a source, and get skipped.
+static bool GetSourceInfo(const wchar* const* sourcePaths, uint64 numSources, uint64& size, uint64& timestamp)
+{
+    size = 0;
+    timestamp = 0;
+    for(uint64 i = 0; i < numSources; ++i)
+    {
+        if(sourcePaths[i][0] == 0)
+            continue;
+
+        uint64 fileSize = 0;
+        uint64 fileTimestamp = 0;
+        if(GetFileInfo(sourcePaths[i], fileSize, fileTimestamp) == false)
+            return false;
+
+        size += fileSize;
+        timestamp = timestamp * 31 + fileTimestamp;
+    }
+
+    return true;
+}
+
+static bool HashSourceFiles(const wchar* const* sourcePaths, uint64 numSources, Hash& hash)
+{
+    bool firstSource = true;
+    for(uint64 i = 0; i < numSources; ++i)
+    {
+        if(sourcePaths[i][0] == 0)
+            continue;
+
+        uint64 size = 0;
+        uint64 timestamp = 0;
+        ScopedFile file(sourcePaths[i], L"rb");
+        if(file.Handle == nullptr || GetFileInfo(sourcePaths[i], size, timestamp) == false)
+            return false;
+
+        Array<uint8> data(size);
+        if(size > 0 && file.Read(data.Data(), size) == false)
+            return false;
+
+        const Hash fileHash = GenerateHash(data.Data(), int32(size));
+        hash = firstSource ? fileHash : CombineHashes(hash, fileHash);
+        firstSource = false;
+    }
+
+    return true;
+}
+
+static void CreateCacheDirectory()
+{
+    // Several threads can get here at once, so it's fine if the directory already exists
+    if(CreateDirectory(CacheDir, nullptr) == 0)
+        Assert_(GetLastError() == ERROR_ALREADY_EXISTS);
+}
+
+DirectX::TexMetadata CookedTexture::Metadata() const
+{
+    DirectX::TexMetadata metaData = { };
+    metaData.width = Header.Width;
+    metaData.height = Header.Height;
+    metaData.depth = Header.Depth;
+    metaData.arraySize = Header.ArraySize;
+    metaData.mipLevels = Header.NumMips;
+    metaData.miscFlags = Header.MiscFlags;
+    metaData.format = Header.Format;
+    metaData.dimension = DirectX::TEX_DIMENSION(Header.Dimension);
+    return metaData;
+}
+
+bool IsCookableTexture(const wchar* sourcePath)
+{
+    std::wstring extension = GetFileExtension(sourcePath);
+    std::transform(extension.begin(), extension.end(), extension.begin(), towlower);
+    for(uint64 i = 0; i < ArraySize_(CookableExtensions); ++i)
+        if(extension == CookableExtensions[i])
+            return true;
+
+    return false;
+}
+
+std::wstring CookedTexturePath(const wchar* const* sourcePaths, uint64 numSources, const TextureCookOptions& options)
+{
+    // Relative paths can refer to the same file in different ways, so the name comes from the full paths
+    std::wstring key;
+    for(uint64 i = 0; i < numSources; ++i)
+    {
+        if(i > 0)
+            key += L"|";
+
+        wchar fullPath[1024] = { };
+        if(sourcePaths[i][0] != 0)
+            GetFullPathName(sourcePaths[i], ArraySize_(fullPath), fullPath, nullptr);
+        key += fullPath;
+    }
+
+    std::transform(key.begin(), key.end(), key.begin(), towlower);
+
+    Hash hash = GenerateHash(key.data(), int32(key.length() * sizeof(wchar)));
+    hash = CombineHashes(hash, GenerateHash(&options, sizeof(options), CookedTextureVersion));
+
+    return CacheDir + hash.ToString() + L".sftex";
+}
+
+void BuildCookedTexture(const DirectX::ScratchImage& image, CookedTexture& cooked)
+{
+    const DirectX::TexMetadata& metaData = image.GetMetadata();
+    const bool is3D = metaData.dimension == DirectX::TEX_DIMENSION_TEXTURE3D;
+
+    CookedTextureHeader& header = cooked.Header;
+    header.Magic = CookedTextureMagic;
+    header.Version = CookedTextureVersion;
+    header.Width = uint32(metaData.width);
+    header.Height = uint32(metaData.height);
+    header.Depth = uint32(metaData.depth);
+    header.ArraySize = uint32(metaData.arraySize);
+    header.NumMips = uint32(metaData.mipLevels);
+    header.MiscFlags = uint32(metaData.miscFlags);
+    header.Dimension = uint32(metaData.dimension);
+    header.Format = metaData.format;
+    header.NumSubresources = metaData.mipLevels * metaData.arraySize;
+
+    // Lay out the subresources the same way as GetCopyableFootprints, with the rows aligned to 256 bytes and each
+    // subresource aligned to 512 bytes. The last row of a subresource isn't padded.
+    cooked.Subresources.Init(header.NumSubresources);
+    uint64 dataSize = 0;
+    for(uint64 arrayIdx = 0; arrayIdx < metaData.arraySize; ++arrayIdx)
+    {
+        for(uint64 mipIdx = 0; mipIdx < metaData.mipLevels; ++mipIdx)
+        {
+            const DirectX::Image* subImage = image.GetImage(mipIdx, arrayIdx, 0);
+            Assert_(subImage != nullptr);
+
+            CookedSubresource& subresource = cooked.Subresources[mipIdx + arrayIdx * metaData.mipLevels];
+            subresource.Offset = AlignTo(dataSize, uint64(D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT));
+            subresource.RowSize = uint32(subImage->rowPitch);
+            subresource.RowPitch = uint32(AlignTo(subImage->rowPitch, uint64(D3D12_TEXTURE_DATA_PITCH_ALIGNMENT)));
+            subresource.NumRows = uint32(subImage->slicePitch / subImage->rowPitch);
+            subresource.Depth = is3D ? uint32(Max<uint64>(metaData.depth >> mipIdx, 1)) : 1;
+
+            const uint64 numTotalRows = uint64(subresource.NumRows) * subresource.Depth;
+            dataSize = subresource.Offset + subresource.RowPitch * (numTotalRows - 1) + subresource.RowSize;
+        }
+    }
+
+    header.DataSize = dataSize;
+    cooked.Data.Init(dataSize, 0);
+
+    for(uint64 arrayIdx = 0; arrayIdx < metaData.arraySize; ++arrayIdx)
+    {
+        for(uint64 mipIdx = 0; mipIdx < metaData.mipLevels; ++mipIdx)
+        {
+            const CookedSubresource& subresource = cooked.Subresources[mipIdx + arrayIdx * metaData.mipLevels];
+            uint8* dstMem = cooked.Data.Data() + subresource.Offset;
+            for(uint64 z = 0; z < subresource.Depth; ++z)
+            {
+                const DirectX::Image* subImage = image.GetImage(mipIdx, arrayIdx, z);
+                const uint8* srcMem = subImage->pixels;
+                for(uint64 y = 0; y < subresource.NumRows; ++y)
+                {
+                    memcpy(dstMem, srcMem, subresource.RowSize);
+                    dstMem += subresource.RowPitch;
+                    srcMem += subImage->rowPitch;
+                }
+            }
+        }
+    }
+}
+
+HRESULT WriteCookedTexture(const wchar* const* sourcePaths, uint64 numSources, const DirectX::ScratchImage& image,
+                           const TextureCookOptions& options)
+{
+    CookedTexture cooked;
+    CookedTextureHeader& header = cooked.Header;
+    if(GetSourceInfo(sourcePaths, numSources, header.SourceSize, header.SourceTimestamp) == false ||
+       HashSourceFiles(sourcePaths, numSources, header.SourceHash) == false)
+        return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+
+    BuildCookedTexture(image, cooked);
+
+    // Write to a temporary file first, so that a half-written texture never shows up in the cache
+    CreateCacheDirectory();
+    const std::wstring cookedPath = CookedTexturePath(sourcePaths, numSources, options);
+    const std::wstring tempPath = cookedPath + L"." + ToString(GetCurrentThreadId()) + L".tmp";
+    {
+        ScopedFile file(tempPath.c_str(), L"wb");
+        if(file.Handle == nullptr)
+            return HRESULT_FROM_WIN32(ERROR_CANNOT_MAKE);
+
+        const bool written = file.Write(&header, sizeof(header)) &&
+                             file.Write(cooked.Subresources.Data(), cooked.Subresources.MemorySize()) &&
+                             file.Write(cooked.Data.Data(), cooked.Data.Size());
+        if(written == false)
+            return HRESULT_FROM_WIN32(ERROR_WRITE_FAULT);
+    }
+
+    if(MoveFileEx(tempPath.c_str(), cookedPath.c_str(), MOVEFILE_REPLACE_EXISTING) == 0)
+    {
+        const HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        DeleteFile(tempPath.c_str());
+        return hr;
+    }
+
+    return S_OK;
+}
+
+// Checks the header of a cooked texture against its source, falling back to comparing the contents when only the
+// timestamp is different. If the contents still match, the header gets the new timestamp.
+static bool CookedTextureUpToDate(const wchar* const* sourcePaths, uint64 numSources, CookedTextureHeader& header)
+{
+    if(header.Magic != CookedTextureMagic || header.Version != CookedTextureVersion)
+        return false;
+
+    uint64 sourceSize = 0;
+    uint64 sourceTimestamp = 0;
+    if(GetSourceInfo(sourcePaths, numSources, sourceSize, sourceTimestamp) == false || sourceSize != header.SourceSize)
+        return false;
+
+    if(sourceTimestamp == header.SourceTimestamp)
+        return true;
+
+    Hash sourceHash;
+    if(HashSourceFiles(sourcePaths, numSources, sourceHash) && sourceHash == header.SourceHash)
+    {
+        header.SourceTimestamp = sourceTimestamp;
+        return true;
+    }
+
+    return false;
+}
+
+// Stores a new source timestamp in the header of a cooked texture. This is skipped if the file is in use, since
+// it only saves hashing the source again on the next load.
+static void UpdateCookedTimestamp(const wchar* cookedPath, uint64 sourceTimestamp)
+{
+    ScopedFile file(cookedPath, L"r+b");
+    if(file.Handle == nullptr || fseek(file.Handle, offsetof(CookedTextureHeader, SourceTimestamp), SEEK_SET) != 0)
+        return;
+
+    file.Write(&sourceTimestamp, sizeof(sourceTimestamp));
+}
+
+bool ReadCookedTexture(const wchar* const* sourcePaths, uint64 numSources, const TextureCookOptions& options,
+                       CookedTexture& cooked)
+{
+    const std::wstring cookedPath = CookedTexturePath(sourcePaths, numSources, options);
+    CookedTextureHeader& header = cooked.Header;
+    uint64 storedTimestamp = 0;
+    {
+        ScopedFile file(cookedPath.c_str(), L"rb");
+        if(file.Handle == nullptr || file.Read(&header, sizeof(header)) == false)
+            return false;
+
+        storedTimestamp = header.SourceTimestamp;
+        if(CookedTextureUpToDate(sourcePaths, numSources, header) == false)
+            return false;
+
+        cooked.Subresources.Init(header.NumSubresources);
+        cooked.Data.Init(header.DataSize);
+        if(file.Read(cooked.Subresources.Data(), cooked.Subresources.MemorySize()) == false ||
+           file.Read(cooked.Data.Data(), cooked.Data.Size()) == false)
+            return false;
+    }
+
+    // The source was touched without changing, so save the next load from hashing it. This has to wait until the
+    // file is closed, since files opened with _wfopen_s can't be shared with a writer.
+    if(header.SourceTimestamp != storedTimestamp)
+        UpdateCookedTimestamp(cookedPath.c_str(), header.SourceTimestamp);
+
+    return true;
+}
+
+namespace TextureCooker
+{
+
+static const wchar* CompressionNames[] = { L"uncompressed", L"fast", L"high" };
+StaticAssert_(ArraySize_(CompressionNames) == uint64(BlockCompressionQuality::NumValues));
+
+bool ParseCommandLine(const wchar* cmdLine, BlockCompressionQuality& compression)
+{
+    if(cmdLine == nullptr)
+        return false;
+
+    GrowableList<std::wstring> parts = Split(std::wstring(cmdLine), L" ");
+    for(uint64 i = 0; i < parts.Count(); ++i)
+    {
+        if(parts[i] == L"-cooktextures" || parts[i] == L"--cooktextures")
+        {
+            for(uint64 c = 0; c < ArraySize_(CompressionNames) && i + 1 < parts.Count(); ++c)
+                if(parts[i + 1] == CompressionNames[c])
+                    compression = BlockCompressionQuality(c);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+int32 Run(const ModelLoadSettings* models, uint64 numModels)
+{
+    Tasks::Initialize();
+
+    TextureCookStats totals;
+    for(uint64 i = 0; i < numModels; ++i)
+    {
+        const ModelLoadSettings& settings = models[i];
+        WriteLog(L"Cooking textures for '%ls' with %u threads, using %ls compression", settings.FilePath,
+                 Tasks::NumThreads(), CompressionNames[uint64(settings.TextureCompression)]);
+
+        try
+        {
+            const TextureCookStats stats = CookModelTextures(settings);
+            WriteLog("Cooked %llu of %llu textures in %.2f seconds, %llu were up to date and %llu failed",
+                     stats.NumCooked, stats.NumTextures, stats.CookTime / 1000.0, stats.NumUpToDate, stats.NumFailed);
+
+            totals.NumTextures += stats.NumTextures;
+            totals.NumCooked += stats.NumCooked;
+            totals.NumUpToDate += stats.NumUpToDate;
+            totals.NumFailed += stats.NumFailed;
+            totals.CookTime += stats.CookTime;
+        }
+        catch(Exception& exception)
+        {
+            WriteLog(L"Failed to cook textures for '%ls': %ls", settings.FilePath, exception.GetMessage().c_str());
+            totals.NumFailed += 1;
+        }
+    }
+
+    if(numModels > 1)
+        WriteLog("Cooked %llu of %llu textures for %llu models in %.2f seconds, %llu were up to date and %llu failed",
+                 totals.NumCooked, totals.NumTextures, numModels, totals.CookTime / 1000.0, totals.NumUpToDate, totals.NumFailed);
+
+    Tasks::Shutdown();
+
+    return totals.NumFailed > 0 ? 1 : 0;
+}
+
+}
+
+}
@@ -0,0 +1,135 @@
+//=================================================================================================
+//
+//  MJP's DX12 Sample Framework
+//  http://mynameismjp.wordpress.com/
+//
+//  All code licensed under the MIT license
+//
+//=================================================================================================
+
+#pragma once
+
+#include "..\\PCH.h"
+
+#include "..\\Containers.h"
+#include "..\\MurmurHash.h"
+#include "BlockCompression.h"
+
+namespace SampleFramework12
+{
+
+struct ModelLoadSettings;
+
+// Cooked textures are source images (PNG, TGA, JPEG, etc.) that were decoded ahead of time, with a full mip chain
+// stored in the layout that D3D12 uses for placed subresource footprints. Loading one is a single file read
+// followed by a memcpy into upload memory. They live in TextureCache\ under a name made from the full source path
+// and the cook options, and the header records the size, timestamp and hash of the source so that stale entries
+// can be detected. DDS files are already in a GPU format, so they're never cooked.
+
+struct TextureCookOptions
+{
+    uint32 MipFilter = DirectX::TEX_FILTER_DEFAULT;
+
+    // BC format to encode to after generating the mips, or DXGI_FORMAT_UNKNOWN to keep the decoded format
+    DXGI_FORMAT Compression = DXGI_FORMAT_UNKNOWN;
+
+    // BC7 mode to encode with, see BlockCompress()
+    uint32 BC7Mode = 6;
+
+    // RGBA8 value for the channels of a packed texture that don't have a source
+    uint32 PackedFill = 0;
+};
+
+struct CookedSubresource
+{
+    uint64 Offset = 0;
+    uint32 RowPitch = 0;
+    uint32 RowSize = 0;
+    uint32 NumRows = 0;
+    uint32 Depth = 0;
+};
+
+struct CookedTextureHeader
+{
+    uint32 Magic = 0;
+    uint32 Version = 0;
+    uint64 SourceSize = 0;
+    uint64 SourceTimestamp = 0;
+    Hash SourceHash;
+
+    uint32 Width = 0;
+    uint32 Height = 0;
+    uint32 Depth = 0;
+    uint32 ArraySize = 0;
+    uint32 NumMips = 0;
+    uint32 MiscFlags = 0;
+    uint32 Dimension = 0;
+    DXGI_FORMAT Format = DXGI_FORMAT_UNKNOWN;
+
+    uint64 NumSubresources = 0;
+    uint64 DataSize = 0;
+};
+
+struct CookedTexture
+{
+    CookedTextureHeader Header;
+    Array<CookedSubresource> Subresources;
+    Array<uint8> Data;
+
+    DirectX::TexMetadata Metadata() const;
+};
+
+bool IsCookableTexture(const wchar* sourcePath);
+
+// Textures that are built from several sources, like packed channels, are cooked under the paths of all of them.
+// Empty paths are allowed for channels without a source.
+std::wstring CookedTexturePath(const wchar* const* sourcePaths, uint64 numSources, const TextureCookOptions& options);
+
+// Converts an image that already has its full mip chain into the cooked layout
+void BuildCookedTexture(const DirectX::ScratchImage& image, CookedTexture& cooked);
+
+// Writes out the cooked version of a decoded source texture. These don't throw, so they're safe to call from
+// the task threads.
+HRESULT WriteCookedTexture(const wchar* const* sourcePaths, uint64 numSources, const DirectX::ScratchImage& image,
+                           const TextureCookOptions& options);
+
+// Reads the cooked version of a source texture, returning false if there isn't one or if the source has changed
+bool ReadCookedTexture(const wchar* const* sourcePaths, uint64 numSources, const TextureCookOptions& options,
+                       CookedTexture& cooked);
+
+inline std::wstring CookedTexturePath(const wchar* sourcePath, const TextureCookOptions& options)
+{
+    return CookedTexturePath(&sourcePath, 1, options);
+}
+
+inline HRESULT WriteCookedTexture(const wchar* sourcePath, const DirectX::ScratchImage& image, const TextureCookOptions& options)
+{
+    return WriteCookedTexture(&sourcePath, 1, image, options);
+}
+
+inline bool ReadCookedTexture(const wchar* sourcePath, const TextureCookOptions& options, CookedTexture& cooked)
+{
+    return ReadCookedTexture(&sourcePath, 1, options, cooked);
+}
+
+struct TextureCookStats
+{
+    uint64 NumTextures = 0;
+    uint64 NumCooked = 0;
+    uint64 NumUpToDate = 0;
+    uint64 NumFailed = 0;
+    double CookTime = 0.0;
+};
+
+// Headless cooking of the material textures of a set of models, without creating a window or a D3D12 device.
+// Cooked textures are keyed on their cook options, so each one is cooked with the options that loading its model
+// would pick for it (see CookModelTextures()). This is launched with "-cooktextures [uncompressed|fast|high]" on the
+// command line, where the block compression overrides the one passed in to ParseCommandLine(). That needs to
+// match the compression that the models are loaded with at runtime, or the cooked textures won't be used.
+namespace TextureCooker
+{
+    bool ParseCommandLine(const wchar* cmdLine, BlockCompressionQuality& compression);
+    int32 Run(const ModelLoadSettings* models, uint64 numModels);
+}
+
+}
@@ -0,0 +1,285 @@
+//=================================================================================================
+//
+//  MJP's DX12 Sample Framework
+//  http://mynameismjp.wordpress.com/
+//
+//  All code licensed under the MIT license
+//
+//=================================================================================================
+
+#include "PCH.h"
+
+#include "TextureResidency.h"
+#include "..\\Assert.h"
+#include "..\\Timer.h"
+
+namespace SampleFramework12
+{
+
+void TextureResidencyManager::Initialize(TextureResidencyBackend* residencyBackend, uint64 budget)
+{
+    Shutdown();
+
+    Assert_(residencyBackend != nullptr);
+    backend = residencyBackend;
+    budgetBytes = budget;
+    textures.Init(256);
+    streamInList.Init(256);
+    evictionList.Init(256);
+}
+
+void TextureResidencyManager::Shutdown()
+{
+    backend = nullptr;
+    textures.Shutdown();
+    streamInList.Shutdown();
+    evictionList.Shutdown();
+    residentBytes = 0;
+    currFrame = 1;
+    stats = TextureResidencyStats();
+}
+
+uint32 TextureResidencyManager::AddTexture(uint32 width, uint32 height, uint32 numMips, uint32 maxFirstMip, uint32 firstMip)
+{
+    Assert_(backend != nullptr);
+    Assert_(numMips > 0 && numMips <= MaxMips);
+    Assert_(firstMip < numMips);
+
+    TrackedTexture texture;
+    texture.Width = width;
+    texture.Height = height;
+    texture.NumMips = numMips;
+
+    // Everything from the mip tail down stays resident
+    uint32 tailMip = 0;
+    while(tailMip + 1 < numMips && Max(width >> tailMip, height >> tailMip) > MipTailSize)
+        ++tailMip;
+    texture.MaxFirstMip = Min(Min(maxFirstMip, tailMip), numMips - 1);
+    texture.FirstMip = firstMip;
+    texture.RequestedMip = texture.MaxFirstMip;
+    texture.LastRequestedMip = firstMip;
+
+    // The index is passed to the backend, so it needs to have the texture at the same index
+    const uint32 textureIdx = uint32(textures.Count());
+    for(uint32 mip = 0; mip < numMips; ++mip)
+        texture.Sizes[mip] = backend->ResidentSize(textureIdx, mip);
+
+    residentBytes += texture.Sizes[firstMip];
+    textures.Add(texture);
+
+    return textureIdx;
+}
+
+void TextureResidencyManager::RequestTexture(uint32 textureIdx, float uvDensity, float pixelsPerUnit)
+{
+    const TrackedTexture& texture = textures[textureIdx];
+
+    // Each mip halves the texel density, so the finest useful mip is the one with about one texel per pixel
+    const float texelsPerUnit = std::sqrt(float(texture.Width) * float(texture.Height)) * uvDensity;
+    const float texelsPerPixel = texelsPerUnit / Max(pixelsPerUnit, 0.0001f);
+    const float mip = std::log2(Max(texelsPerPixel, 1.0f)) + mipBias;
+    RequestMip(textureIdx, uint32(Clamp(mip, 0.0f, float(texture.NumMips - 1))));
+}
+
+void TextureResidencyManager::RequestMip(uint32 textureIdx, uint32 mip)
+{
+    TrackedTexture& texture = textures[textureIdx];
+    texture.RequestedMip = Min(texture.RequestedMip, Min(mip, texture.MaxFirstMip));
+    texture.LastUsedFrame = currFrame;
+}
+
+bool TextureResidencyManager::SetFirstMip(uint32 textureIdx, uint32 firstMip)
+{
+    TrackedTexture& texture = textures[textureIdx];
+    if(backend->SetFirstResidentMip(textureIdx, firstMip) == false)
+    {
+        ++stats.NumFailed;
+        return false;
+    }
+
+    residentBytes = residentBytes - texture.Sizes[texture.FirstMip] + texture.Sizes[firstMip];
+    texture.FirstMip = firstMip;
+    return true;
+}
+
+void TextureResidencyManager::StreamInFailed(uint32 textureIdx, uint32 firstMip)
+{
+    TrackedTexture& texture = textures[textureIdx];
+    Assert_(firstMip >= texture.FirstMip && firstMip < texture.NumMips);
+
+    residentBytes = residentBytes - texture.Sizes[texture.FirstMip] + texture.Sizes[firstMip];
+    texture.FirstMip = firstMip;
+    ++stats.NumFailed;
+    stats.ResidentBytes = residentBytes;
+}
+
+// Trims textures back to what they need this frame, least recently used first, until enough memory is freed
+uint64 TextureResidencyManager::EvictFor(uint64 bytesNeeded)
+{
+    uint64 freedBytes = 0;
+    while(freedBytes < bytesNeeded && evictionCursor < evictionList.Count())
+    {
+        const uint32 textureIdx = evictionList[evictionCursor++];
+        const TrackedTexture& texture = textures[textureIdx];
+        const uint32 targetMip = texture.LastUsedFrame == currFrame ? texture.RequestedMip : texture.MaxFirstMip;
+        if(targetMip <= texture.FirstMip)
+            continue;
+
+        const uint64 prevSize = texture.Sizes[texture.FirstMip];
+        if(SetFirstMip(textureIdx, targetMip) == false)
+            continue;
+
+        const uint64 evictedBytes = prevSize - texture.Sizes[targetMip];
+        freedBytes += evictedBytes;
+        stats.NumEvicted += 1;
+        stats.BytesEvicted += evictedBytes;
+    }
+
+    return freedBytes;
+}
+
+void TextureResidencyManager::Update()
+{
+    Timer timer;
+
+    stats = TextureResidencyStats();
+    stats.NumTextures = textures.Count();
+    stats.BudgetBytes = budgetBytes;
+
+    streamInList.RemoveAll();
+    evictionList.RemoveAll();
+    evictionCursor = 0;
+
+    for(uint32 i = 0; i < textures.Count(); ++i)
+    {
+        TrackedTexture& texture = textures[i];
+        const bool used = texture.LastUsedFrame == currFrame;
+        const uint32 neededMip = used ? texture.RequestedMip : texture.MaxFirstMip;
+        stats.RequestedBytes += texture.Sizes[neededMip];
+
+        if(used)
+        {
+            stats.NumRequested += 1;
+            texture.LastRequestedMip = neededMip;
+        }
+
+        if(neededMip < texture.FirstMip)
+            streamInList.Add(i);
+        else if(neededMip > texture.FirstMip)
+            evictionList.Add(i);
+    }
+
+    // Textures missing the most mips go first, since they're the ones that look the worst
+    std::sort(streamInList.begin(), streamInList.end(), [&](uint32 a, uint32 b)
+    {
+        const uint32 missingA = textures[a].FirstMip - textures[a].RequestedMip;
+        const uint32 missingB = textures[b].FirstMip - textures[b].RequestedMip;
+        return missingA != missingB ? missingA > missingB : a < b;
+    });
+
+    std::sort(evictionList.begin(), evictionList.end(), [&](uint32 a, uint32 b)
+    {
+        return textures[a].LastUsedFrame != textures[b].LastUsedFrame ? textures[a].LastUsedFrame < textures[b].LastUsedFrame : a < b;
+    });
+
+    uint64 streamedBytes = 0;
+    for(uint64 i = 0; i < streamInList.Count() && streamedBytes < maxStreamInBytes; ++i)
+    {
+        const uint32 textureIdx = streamInList[i];
+        const TrackedTexture& texture = textures[textureIdx];
+        const uint64 prevSize = texture.Sizes[texture.FirstMip];
+
+        uint32 targetMip = texture.RequestedMip;
+        const uint64 neededBytes = texture.Sizes[targetMip] - prevSize;
+        if(residentBytes + neededBytes > budgetBytes)
+            EvictFor(residentBytes + neededBytes - budgetBytes);
+
+        // Settle for a coarser mip if the rest of the budget is taken by textures that are in use
+        while(targetMip < texture.FirstMip && residentBytes + texture.Sizes[targetMip] - prevSize > budgetBytes)
+            ++targetMip;
+
+        if(targetMip < texture.FirstMip && SetFirstMip(textureIdx, targetMip))
+        {
+            const uint64 loadedBytes = texture.Sizes[targetMip] - prevSize;
+            streamedBytes += loadedBytes;
+            stats.NumStreamedIn += 1;
+            stats.BytesStreamedIn += loadedBytes;
+        }
+    }
+
+    for(uint64 i = 0; i < streamInList.Count(); ++i)
+    {
+        const TrackedTexture& texture = textures[streamInList[i]];
+        if(texture.FirstMip > texture.RequestedMip)
+            stats.NumStarved += 1;
+    }
+
+    // The budget can shrink at runtime, in which case everything that isn't needed goes right away
+    if(residentBytes > budgetBytes)
+        EvictFor(residentBytes - budgetBytes);
+
+    for(uint64 i = 0; i < textures.Count(); ++i)
+        textures[i].RequestedMip = textures[i].MaxFirstMip;
+    ++currFrame;
+
+    timer.Update();
+    stats.ResidentBytes = residentBytes;
+    stats.UpdateTime = timer.ElapsedMicrosecondsD() / 1000.0;
+}
+
+float TextureResidencyManager::ProjectedPixelsPerUnit(const Float3& boundsMin, const Float3& boundsMax, const Float3& viewPosition,
+                                                      float projectionScale, float minDistance)
+{
+    const Float3 closestPoint = Float3::Clamp(viewPosition, boundsMin, boundsMax);
+    const float distance = Max(Float3::Distance(closestPoint, viewPosition), minDistance);
+    return projectionScale / distance;
+}
+
+// == SimulatedResidencyBackend ===================================================================
+
+uint32 SimulatedResidencyBackend::AddTexture(uint32 width, uint32 height, uint32 numMips, uint32 bitsPerTexel, bool blockCompressed)
+{
+    SimulatedTexture texture;
+    texture.Width = width;
+    texture.Height = height;
+    texture.NumMips = numMips;
+    texture.BitsPerTexel = bitsPerTexel;
+    texture.BlockCompressed = blockCompressed;
+    return uint32(textures.Add(texture));
+}
+
+uint64 SimulatedResidencyBackend::ResidentSize(uint32 textureIdx, uint32 firstMip)
+{
+    const SimulatedTexture& texture = textures[textureIdx];
+
+    uint64 size = 0;
+    for(uint32 mip = firstMip; mip < texture.NumMips; ++mip)
+    {
+        uint64 mipWidth = Max(texture.Width >> mip, 1u);
+        uint64 mipHeight = Max(texture.Height >> mip, 1u);
+        if(texture.BlockCompressed)
+        {
+            mipWidth = AlignTo(mipWidth, 4ull);
+            mipHeight = AlignTo(mipHeight, 4ull);
+        }
+
+        size += mipWidth * mipHeight * texture.BitsPerTexel / 8;
+    }
+
+    return size;
+}
+
+bool SimulatedResidencyBackend::SetFirstResidentMip(uint32 textureIdx, uint32 firstMip)
+{
+    SimulatedTexture& texture = textures[textureIdx];
+    Assert_(firstMip < texture.NumMips);
+    ++numCalls;
+
+    if(failStreamIns && firstMip < texture.FirstMip)
+        return false;
+
+    texture.FirstMip = firstMip;
+    return true;
+}
+
+}
@@ -0,0 +1,173 @@
+//=================================================================================================
+//
+//  MJP's DX12 Sample Framework
+//  http://mynameismjp.wordpress.com/
+//
+//  All code licensed under the MIT license
+//
+//=================================================================================================
+
+#pragma once
+
+#include "..\\PCH.h"
+
+#include "..\\Containers.h"
+#include "..\\SF12_Math.h"
+
+namespace SampleFramework12
+{
+
+// Changes which mips of a texture are on the GPU. The residency manager only makes decisions on the CPU and leaves
+// the actual work to the backend, so it can be driven by a fake backend without a device. A texture with a first
+// mip of N has mips [N, NumMips) resident, with mip N acting as its top level.
+class TextureResidencyBackend
+{
+
+public:
+
+    virtual ~TextureResidencyBackend() { }
+
+    // Memory used by a texture when its mips starting at firstMip are resident
+    virtual uint64 ResidentSize(uint32 textureIdx, uint32 firstMip) = 0;
+
+    // Returns false if the change couldn't be made, in which case the texture keeps its current mips. A backend
+    // can also return true for a stream-in that it finishes later, and report a failure with StreamInFailed().
+    virtual bool SetFirstResidentMip(uint32 textureIdx, uint32 firstMip) = 0;
+};
+
+struct TextureResidencyStats
+{
+    uint64 NumTextures = 0;
+    uint64 NumRequested = 0;
+    uint64 NumStarved = 0;          // Requested textures that stayed coarser than needed because of the budget
+    uint64 NumStreamedIn = 0;
+    uint64 NumEvicted = 0;
+    uint64 NumFailed = 0;
+    uint64 BytesStreamedIn = 0;
+    uint64 BytesEvicted = 0;
+
+    uint64 ResidentBytes = 0;
+    uint64 RequestedBytes = 0;      // What would be resident if every request was met
+    uint64 BudgetBytes = 0;
+
+    double UpdateTime = 0.0;        // In milliseconds, including the time spent in the backend
+};
+
+// Tracks the finest mip that each texture needs, based on the projected texel density of the surfaces that use it,
+// and streams mips in and out to match against a memory budget. Textures that aren't requested in a frame keep
+// whatever they have until the memory is needed elsewhere, at which point the least recently used ones are trimmed
+// back first. Mips at or below MipTailSize are never evicted, so every texture always has something to sample.
+class TextureResidencyManager
+{
+
+public:
+
+    static const uint32 MipTailSize = 64;
+
+    void Initialize(TextureResidencyBackend* residencyBackend, uint64 budget);
+    void Shutdown();
+
+    // Registers a texture whose mips starting at firstMip are already resident. maxFirstMip is the coarsest first
+    // mip the backend can handle, which is further limited to the mip tail.
+    uint32 AddTexture(uint32 width, uint32 height, uint32 numMips, uint32 maxFirstMip, uint32 firstMip = 0);
+
+    // Records that a texture is used on a surface this frame. uvDensity is the number of UV units per world unit on
+    // the surface, and pixelsPerUnit is how many pixels a world unit covers on screen at the surface's distance.
+    void RequestTexture(uint32 textureIdx, float uvDensity, float pixelsPerUnit);
+
+    // Asks for a specific first mip, for callers that already know what they need
+    void RequestMip(uint32 textureIdx, uint32 mip);
+
+    // Applies this frame's requests and starts the next frame
+    void Update();
+
+    // For backends that finish stream-ins later on: puts a texture back to the first mip it actually has after its
+    // stream-in failed, and counts the failure in the stats of the current frame
+    void StreamInFailed(uint32 textureIdx, uint32 firstMip);
+
+    void SetBudget(uint64 budget) { budgetBytes = budget; }
+    void SetMipBias(float bias) { mipBias = bias; }
+    void SetMaxStreamInBytesPerFrame(uint64 maxBytes) { maxStreamInBytes = maxBytes; }
+
+    uint64 NumTextures() const { return textures.Count(); }
+    uint32 FirstResidentMip(uint32 textureIdx) const { return textures[textureIdx].FirstMip; }
+    uint32 LastRequestedMip(uint32 textureIdx) const { return textures[textureIdx].LastRequestedMip; }
+    uint64 ResidentBytes() const { return residentBytes; }
+    const TextureResidencyStats& Stats() const { return stats; }
+
+    // Pixels covered on screen by a world unit at the closest point of a bounding box, where projectionScale is the
+    // viewport height divided by 2 * tan(fovY / 2). Views inside the box are clamped to minDistance.
+    static float ProjectedPixelsPerUnit(const Float3& boundsMin, const Float3& boundsMax, const Float3& viewPosition,
+                                        float projectionScale, float minDistance);
+
+protected:
+
+    static const uint32 MaxMips = 16;
+
+    struct TrackedTexture
+    {
+        uint32 Width = 0;
+        uint32 Height = 0;
+        uint32 NumMips = 0;
+        uint32 MaxFirstMip = 0;
+        uint32 FirstMip = 0;
+        uint32 RequestedMip = 0;
+        uint32 LastRequestedMip = 0;
+        uint64 LastUsedFrame = 0;
+        uint64 Sizes[MaxMips] = { };
+    };
+
+    bool SetFirstMip(uint32 textureIdx, uint32 firstMip);
+    uint64 EvictFor(uint64 bytesNeeded);
+
+    TextureResidencyBackend* backend = nullptr;
+    GrowableList<TrackedTexture> textures;
+    GrowableList<uint32> streamInList;
+    GrowableList<uint32> evictionList;
+    uint64 evictionCursor = 0;
+
+    uint64 budgetBytes = 0;
+    uint64 residentBytes = 0;
+    uint64 maxStreamInBytes = 64 * 1024 * 1024;
+    float mipBias = 0.0f;
+    uint64 currFrame = 1;
+
+    TextureResidencyStats stats;
+};
+
+// Fake backend that only keeps track of sizes, for driving the residency manager without a device. The sizes come
+// from the dimensions and bits per texel of each texture, with the blocks of compressed formats rounded up to 4x4.
+class SimulatedResidencyBackend : public TextureResidencyBackend
+{
+
+public:
+
+    uint32 AddTexture(uint32 width, uint32 height, uint32 numMips, uint32 bitsPerTexel, bool blockCompressed);
+
+    uint64 ResidentSize(uint32 textureIdx, uint32 firstMip) override;
+    bool SetFirstResidentMip(uint32 textureIdx, uint32 firstMip) override;
+
+    // Makes every following stream-in fail, to simulate running out of memory or a missing source file
+    void SetFailStreamIns(bool fail) { failStreamIns = fail; }
+
+    uint32 FirstResidentMip(uint32 textureIdx) const { return textures[textureIdx].FirstMip; }
+    uint64 NumCalls() const { return numCalls; }
+
+protected:
+
+    struct SimulatedTexture
+    {
+        uint32 Width = 0;
+        uint32 Height = 0;
+        uint32 NumMips = 0;
+        uint32 BitsPerTexel = 0;
+        bool BlockCompressed = false;
+        uint32 FirstMip = 0;
+    };
+
+    GrowableList<SimulatedTexture> textures;
+    bool failStreamIns = false;
+    uint64 numCalls = 0;
+};
+
+}
@@ -0,0 +1,437 @@
+//=================================================================================================
+//
+//  MJP's DX12 Sample Framework
+//  http://mynameismjp.wordpress.com/
+//
+//  All code licensed under the MIT license
+//
+//=================================================================================================
+
+#include "PCH.h"
+
+#include "TextureSampler.h"
+#include "..\\Assert.h"
+#include "..\\Tasks.h"
+
+namespace SampleFramework12
+{
+
+static_assert(TextureSampler::TileSize == 8, "MortonIndex only handles 3 bits per coordinate");
+
+// Spreads out the low 3 bits of a value so that they take up every other bit
+static uint32 SpreadBits3(uint32 x)
+{
+    return (x & 1) | ((x & 2) << 1) | ((x & 4) << 2);
+}
+
+// Index of a texel within its tile, with the texels of the tile in Morton order
+static uint32 MortonIndex(uint32 x, uint32 y)
+{
+    return SpreadBits3(x) | (SpreadBits3(y) << 1);
+}
+
+// Rounds down to the nearest integer, for values that fit in an int32
+// Floats of 2^23 and up are already whole numbers, and they're passed through since they can be out of int32 range
+static __m128 FloorSSE(__m128 x)
+{
+    const __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+    const __m128 floored = _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, x), _mm_set1_ps(1.0f)));
+    const __m128 absX = _mm_andnot_ps(_mm_set1_ps(-0.0f), x);
+    const __m128 isWhole = _mm_cmpge_ps(absX, _mm_set1_ps(8388608.0f));
+    return _mm_or_ps(_mm_and_ps(isWhole, x), _mm_andnot_ps(isWhole, floored));
+}
+
+static __m128i SelectSSE(__m128i mask, __m128i a, __m128i b)
+{
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+// Picks the cubemap face for a direction along with the UV coordinates on that face, matching SampleCubemap
+static Float2 CubemapFaceUV(const Float3& direction, uint32& faceIdx)
+{
+    const float maxComponent = Max(Max(std::abs(direction.x), std::abs(direction.y)), std::abs(direction.z));
+    faceIdx = 0;
+    Float2 uv = Float2(direction.y, direction.z);
+    if(direction.x == maxComponent)
+    {
+        faceIdx = 0;
+        uv = Float2(-direction.z, -direction.y) / direction.x;
+    }
+    else if(-direction.x == maxComponent)
+    {
+        faceIdx = 1;
+        uv = Float2(direction.z, -direction.y) / -direction.x;
+    }
+    else if(direction.y == maxComponent)
+    {
+        faceIdx = 2;
+        uv = Float2(direction.x, direction.z) / direction.y;
+    }
+    else if(-direction.y == maxComponent)
+    {
+        faceIdx = 3;
+        uv = Float2(direction.x, -direction.z) / -direction.y;
+    }
+    else if(direction.z == maxComponent)
+    {
+        faceIdx = 4;
+        uv = Float2(direction.x, -direction.y) / direction.z;
+    }
+    else if(-direction.z == maxComponent)
+    {
+        faceIdx = 5;
+        uv = Float2(-direction.x, -direction.y) / -direction.z;
+    }
+
+    return uv * Float2(0.5f, 0.5f) + Float2(0.5f, 0.5f);
+}
+
+void TextureSampler::Initialize(const TextureData<UByte4N>& texData, bool tiledLayout)
+{
+    InitializeInternal(texData, tiledLayout);
+}
+
+void TextureSampler::Initialize(const TextureData<UShort4N>& texData, bool tiledLayout)
+{
+    InitializeInternal(texData, tiledLayout);
+}
+
+void TextureSampler::Initialize(const TextureData<Half4>& texData, bool tiledLayout)
+{
+    InitializeInternal(texData, tiledLayout);
+}
+
+void TextureSampler::Initialize(const TextureData<Float4>& texData, bool tiledLayout)
+{
+    InitializeInternal(texData, tiledLayout);
+}
+
+template<typename T> void TextureSampler::InitializeInternal(const TextureData<T>& texData, bool tiledLayout)
+{
+    Shutdown();
+
+    Assert_(texData.Width > 0 && texData.Height > 0);
+    width = texData.Width;
+    height = texData.Height;
+    numSlices = Max(texData.NumSlices, 1u);
+    tiled = tiledLayout;
+
+    numMips = 1;
+    while(Max(width >> numMips, height >> numMips) > 0)
+        ++numMips;
+    Assert_(numMips <= MaxMips);
+
+    // The pyramid is built in row-major order, and then swizzled into tiles afterwards
+    uint64 linearOffsets[MaxMips] = { };
+    uint64 linearSliceSize = 0;
+    sliceSize = 0;
+    for(uint32 mip = 0; mip < numMips; ++mip)
+    {
+        MipLevel& level = mips[mip];
+        level.Width = Max(width >> mip, 1u);
+        level.Height = Max(height >> mip, 1u);
+        level.TilesX = (level.Width + TileSize - 1) / TileSize;
+        level.Offset = sliceSize;
+
+        linearOffsets[mip] = linearSliceSize;
+        linearSliceSize += uint64(level.Width) * level.Height;
+
+        const uint32 tilesY = (level.Height + TileSize - 1) / TileSize;
+        sliceSize += tiled ? uint64(level.TilesX) * tilesY * TileSize * TileSize : uint64(level.Width) * level.Height;
+    }
+
+    Array<Float4> linearTexels;
+    Array<Float4>& pyramid = tiled ? linearTexels : texels;
+    pyramid.Init(linearSliceSize * numSlices);
+
+    const uint64 numTopTexels = uint64(width) * height;
+    Tasks::ParallelFor(uint64(numSlices) * height, [&](uint64 start, uint64 end, uint32)
+    {
+        for(uint64 row = start; row < end; ++row)
+        {
+            const uint64 sliceIdx = row / height;
+            const uint64 y = row % height;
+            const T* srcRow = &texData.Texels[sliceIdx * numTopTexels + y * width];
+            Float4* dstRow = &pyramid[sliceIdx * linearSliceSize + y * width];
+            for(uint64 x = 0; x < width; ++x)
+                dstRow[x] = Float4(srcRow[x].ToSIMD());
+        }
+    }, 16);
+
+    // Each mip is a 2x2 box filter of the one above it, with the last row or column repeated for odd sizes
+    for(uint32 mip = 1; mip < numMips; ++mip)
+    {
+        const MipLevel& srcLevel = mips[mip - 1];
+        const MipLevel& dstLevel = mips[mip];
+        Tasks::ParallelFor(uint64(numSlices) * dstLevel.Height, [&](uint64 start, uint64 end, uint32)
+        {
+            const __m128 quarter = _mm_set1_ps(0.25f);
+            for(uint64 row = start; row < end; ++row)
+            {
+                const uint64 sliceIdx = row / dstLevel.Height;
+                const uint32 y = uint32(row % dstLevel.Height);
+                const Float4* srcTexels = &pyramid[sliceIdx * linearSliceSize + linearOffsets[mip - 1]];
+                Float4* dstRow = &pyramid[sliceIdx * linearSliceSize + linearOffsets[mip] + uint64(y) * dstLevel.Width];
+
+                const Float4* srcRow0 = srcTexels + uint64(Min(y * 2, srcLevel.Height - 1)) * srcLevel.Width;
+                const Float4* srcRow1 = srcTexels + uint64(Min(y * 2 + 1, srcLevel.Height - 1)) * srcLevel.Width;
+                for(uint32 x = 0; x < dstLevel.Width; ++x)
+                {
+                    const uint32 x0 = Min(x * 2, srcLevel.Width - 1);
+                    const uint32 x1 = Min(x * 2 + 1, srcLevel.Width - 1);
+                    const __m128 sum0 = _mm_add_ps(_mm_loadu_ps(&srcRow0[x0].x), _mm_loadu_ps(&srcRow0[x1].x));
+                    const __m128 sum1 = _mm_add_ps(_mm_loadu_ps(&srcRow1[x0].x), _mm_loadu_ps(&srcRow1[x1].x));
+                    _mm_storeu_ps(&dstRow[x].x, _mm_mul_ps(_mm_add_ps(sum0, sum1), quarter));
+                }
+            }
+        }, 4);
+    }
+
+    if(tiled == false)
+        return;
+
+    texels.Init(sliceSize * numSlices, Float4(0.0f, 0.0f, 0.0f, 0.0f));
+    for(uint32 mip = 0; mip < numMips; ++mip)
+    {
+        const MipLevel& level = mips[mip];
+        Tasks::ParallelFor(uint64(numSlices) * level.Height, [&](uint64 start, uint64 end, uint32)
+        {
+            for(uint64 row = start; row < end; ++row)
+            {
+                const uint32 sliceIdx = uint32(row / level.Height);
+                const uint32 y = uint32(row % level.Height);
+                const Float4* srcRow = &linearTexels[sliceIdx * linearSliceSize + linearOffsets[mip] + uint64(y) * level.Width];
+                for(uint32 x = 0; x < level.Width; ++x)
+                    texels[TexelOffset(x, y, mip, sliceIdx)] = srcRow[x];
+            }
+        }, 16);
+    }
+}
+
+void TextureSampler::Shutdown()
+{
+    texels.Shutdown();
+    for(uint32 i = 0; i < MaxMips; ++i)
+        mips[i] = MipLevel();
+    width = 0;
+    height = 0;
+    numMips = 0;
+    numSlices = 0;
+    sliceSize = 0;
+}
+
+uint64 TextureSampler::TexelOffset(uint32 x, uint32 y, uint32 mip, uint32 arraySlice) const
+{
+    const MipLevel& level = mips[mip];
+    const uint64 offset = arraySlice * sliceSize + level.Offset;
+    if(tiled == false)
+        return offset + uint64(y) * level.Width + x;
+
+    const uint64 tileIdx = uint64(y / TileSize) * level.TilesX + x / TileSize;
+    return offset + tileIdx * (TileSize * TileSize) + MortonIndex(x % TileSize, y % TileSize);
+}
+
+Float4 TextureSampler::Texel(uint32 x, uint32 y, uint32 mip, uint32 arraySlice) const
+{
+    Assert_(mip < numMips && arraySlice < numSlices);
+    Assert_(x < mips[mip].Width && y < mips[mip].Height);
+    return texels[TexelOffset(x, y, mip, arraySlice)];
+}
+
+float TextureSampler::LODFromDifferentials(Float2 duvdx, Float2 duvdy) const
+{
+    const Float2 texSize = Float2(float(width), float(height));
+    const float footprint = Max(Float2::Length(duvdx * texSize), Float2::Length(duvdy * texSize));
+    return std::log2(Max(footprint, 1e-8f));
+}
+
+float TextureSampler::LODFromRayCone(float coneWidth, float cosTheta, float uvDensity) const
+{
+    const float texelsPerUnit = std::sqrt(float(width) * float(height)) * uvDensity;
+    const float footprint = texelsPerUnit * std::abs(coneWidth) / Max(std::abs(cosTheta), 1e-4f);
+    return std::log2(Max(footprint, 1e-8f));
+}
+
+float TextureSampler::CubemapLODFromConeAngle(float coneAngle) const
+{
+    // A face covers 2 units at a distance of 1, so a texel in the middle of a face spans about 2 / width radians
+    const float footprint = coneAngle * float(width) * 0.5f;
+    return std::log2(Max(footprint, 1e-8f));
+}
+
+void TextureSampler::Sample(const float* u, const float* v, const float* lods, uint64 numSamples, Float4* results,
+                            uint32 arraySlice, SamplerAddressMode addressMode) const
+{
+    Assert_(arraySlice < numSlices);
+
+    uint32 slices[BatchSize];
+    for(uint64 i = 0; i < BatchSize; ++i)
+        slices[i] = arraySlice;
+
+    for(uint64 batchStart = 0; batchStart < numSamples; batchStart += BatchSize)
+    {
+        const uint64 batchCount = Min<uint64>(numSamples - batchStart, BatchSize);
+        SampleBatch(u + batchStart, v + batchStart, lods + batchStart, slices, batchCount, results + batchStart, addressMode);
+    }
+}
+
+void TextureSampler::SampleCubemap(const Float3* directions, const float* lods, uint64 numSamples, Float4* results) const
+{
+    Assert_(numSlices == 6);
+
+    for(uint64 batchStart = 0; batchStart < numSamples; batchStart += BatchSize)
+    {
+        const uint64 batchCount = Min<uint64>(numSamples - batchStart, BatchSize);
+
+        float u[BatchSize] = { };
+        float v[BatchSize] = { };
+        uint32 faces[BatchSize] = { };
+        for(uint64 i = 0; i < batchCount; ++i)
+        {
+            const Float2 uv = CubemapFaceUV(directions[batchStart + i], faces[i]);
+            u[i] = uv.x;
+            v[i] = uv.y;
+        }
+
+        // Each face is sampled on its own, so the footprints are clamped at the face edges
+        SampleBatch(u, v, lods + batchStart, faces, batchCount, results + batchStart, SamplerAddressMode::Clamp);
+    }
+}
+
+void TextureSampler::SampleBatch(const float* u, const float* v, const float* lods, const uint32* slices, uint64 numSamples,
+                                 Float4* results, SamplerAddressMode addressMode) const
+{
+    Assert_(numSamples <= BatchSize);
+    Assert_(numMips > 0);
+
+    // Partial batches are padded out so that the SIMD loads stay in bounds
+    float batchU[BatchSize] = { };
+    float batchV[BatchSize] = { };
+    float batchLODs[BatchSize] = { };
+    for(uint64 i = 0; i < numSamples; ++i)
+    {
+        batchU[i] = u[i];
+        batchV[i] = v[i];
+        batchLODs[i] = lods[i];
+    }
+
+    // The 2x2 footprint of every sample in both of its mips, along with the weights of the 4 texels in each
+    uint32 mipIndices[2][BatchSize];
+    float mipLerps[BatchSize];
+    int32 texelX[2][2][BatchSize];
+    int32 texelY[2][2][BatchSize];
+    float weights[2][4][BatchSize];
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 halfTexel = _mm_set1_ps(0.5f);
+    const __m128 maxLOD = _mm_set1_ps(float(numMips - 1));
+    const __m128i zeroInt = _mm_setzero_si128();
+    const __m128i oneInt = _mm_set1_epi32(1);
+
+    for(uint64 laneStart = 0; laneStart < BatchSize; laneStart += 4)
+    {
+        // NaN LODs end up at 0, since _mm_max_ps returns its second operand when either one is NaN
+        const __m128 lod = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(batchLODs + laneStart), zero), maxLOD);
+        const __m128 mipFloor = FloorSSE(lod);
+        const __m128 mipLerp = _mm_sub_ps(lod, mipFloor);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&mipIndices[0][laneStart]), _mm_cvttps_epi32(mipFloor));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&mipIndices[1][laneStart]), _mm_cvttps_epi32(_mm_min_ps(_mm_add_ps(mipFloor, one), maxLOD)));
+        _mm_storeu_ps(&mipLerps[laneStart], mipLerp);
+
+        const __m128 mipWeights[2] = { _mm_sub_ps(one, mipLerp), mipLerp };
+
+        __m128 sampleU = _mm_loadu_ps(batchU + laneStart);
+        __m128 sampleV = _mm_loadu_ps(batchV + laneStart);
+        if(addressMode == SamplerAddressMode::Wrap)
+        {
+            // Infinities turn into NaN here, and those go to 0 the same way as the LODs. The clamp to 1 is only for
+            // rounding, since tiny negative values can come out as exactly 1.
+            sampleU = _mm_min_ps(_mm_max_ps(_mm_sub_ps(sampleU, FloorSSE(sampleU)), zero), one);
+            sampleV = _mm_min_ps(_mm_max_ps(_mm_sub_ps(sampleV, FloorSSE(sampleV)), zero), one);
+        }
+
+        for(uint64 level = 0; level < 2; ++level)
+        {
+            const uint32* laneMips = &mipIndices[level][laneStart];
+            const MipLevel& mip0 = mips[laneMips[0]];
+            const MipLevel& mip1 = mips[laneMips[1]];
+            const MipLevel& mip2 = mips[laneMips[2]];
+            const MipLevel& mip3 = mips[laneMips[3]];
+            const __m128i levelWidth = _mm_setr_epi32(int32(mip0.Width), int32(mip1.Width), int32(mip2.Width), int32(mip3.Width));
+            const __m128i levelHeight = _mm_setr_epi32(int32(mip0.Height), int32(mip1.Height), int32(mip2.Height), int32(mip3.Height));
+            const __m128 levelWidthF = _mm_cvtepi32_ps(levelWidth);
+            const __m128 levelHeightF = _mm_cvtepi32_ps(levelHeight);
+
+            __m128 x = _mm_sub_ps(_mm_mul_ps(sampleU, levelWidthF), halfTexel);
+            __m128 y = _mm_sub_ps(_mm_mul_ps(sampleV, levelHeightF), halfTexel);
+            if(addressMode == SamplerAddressMode::Clamp)
+            {
+                x = _mm_min_ps(_mm_max_ps(x, zero), _mm_sub_ps(levelWidthF, one));
+                y = _mm_min_ps(_mm_max_ps(y, zero), _mm_sub_ps(levelHeightF, one));
+            }
+
+            const __m128 xFloor = FloorSSE(x);
+            const __m128 yFloor = FloorSSE(y);
+            const __m128 fracX = _mm_sub_ps(x, xFloor);
+            const __m128 fracY = _mm_sub_ps(y, yFloor);
+
+            __m128i x0 = _mm_cvttps_epi32(xFloor);
+            __m128i y0 = _mm_cvttps_epi32(yFloor);
+            __m128i x1 = _mm_add_epi32(x0, oneInt);
+            __m128i y1 = _mm_add_epi32(y0, oneInt);
+            if(addressMode == SamplerAddressMode::Wrap)
+            {
+                // Wrapped coordinates are in [-0.5, size - 0.5], so only one texel of the footprint can be outside
+                x0 = _mm_add_epi32(x0, _mm_and_si128(_mm_cmplt_epi32(x0, zeroInt), levelWidth));
+                y0 = _mm_add_epi32(y0, _mm_and_si128(_mm_cmplt_epi32(y0, zeroInt), levelHeight));
+                x1 = _mm_andnot_si128(_mm_cmpeq_epi32(x1, levelWidth), x1);
+                y1 = _mm_andnot_si128(_mm_cmpeq_epi32(y1, levelHeight), y1);
+            }
+            else
+            {
+                x1 = SelectSSE(_mm_cmpeq_epi32(x1, levelWidth), x0, x1);
+                y1 = SelectSSE(_mm_cmpeq_epi32(y1, levelHeight), y0, y1);
+            }
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&texelX[level][0][laneStart]), x0);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&texelX[level][1][laneStart]), x1);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&texelY[level][0][laneStart]), y0);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&texelY[level][1][laneStart]), y1);
+
+            const __m128 invFracX = _mm_sub_ps(one, fracX);
+            const __m128 invFracY = _mm_sub_ps(one, fracY);
+            const __m128 topWeight = _mm_mul_ps(invFracY, mipWeights[level]);
+            const __m128 bottomWeight = _mm_mul_ps(fracY, mipWeights[level]);
+            _mm_storeu_ps(&weights[level][0][laneStart], _mm_mul_ps(invFracX, topWeight));
+            _mm_storeu_ps(&weights[level][1][laneStart], _mm_mul_ps(fracX, topWeight));
+            _mm_storeu_ps(&weights[level][2][laneStart], _mm_mul_ps(invFracX, bottomWeight));
+            _mm_storeu_ps(&weights[level][3][laneStart], _mm_mul_ps(fracX, bottomWeight));
+        }
+    }
+
+    // Gather and blend the 8 texels of each sample, skipping the second mip when it doesn't contribute
+    for(uint64 lane = 0; lane < numSamples; ++lane)
+    {
+        const uint32 slice = slices[lane];
+        Assert_(slice < numSlices);
+
+        __m128 result = _mm_setzero_ps();
+        const uint64 numLevels = mipLerps[lane] > 0.0f ? 2 : 1;
+        for(uint64 level = 0; level < numLevels; ++level)
+        {
+            const uint32 mip = mipIndices[level][lane];
+            const uint32 xs[2] = { uint32(texelX[level][0][lane]), uint32(texelX[level][1][lane]) };
+            const uint32 ys[2] = { uint32(texelY[level][0][lane]), uint32(texelY[level][1][lane]) };
+            for(uint64 i = 0; i < 4; ++i)
+            {
+                const Float4& texel = texels[TexelOffset(xs[i & 1], ys[i >> 1], mip, slice)];
+                result = _mm_add_ps(result, _mm_mul_ps(_mm_loadu_ps(&texel.x), _mm_set1_ps(weights[level][i][lane])));
+            }
+        }
+
+        _mm_storeu_ps(&results[lane].x, result);
+    }
+}
+
+}
@@ -0,0 +1,108 @@
+//=================================================================================================
+//
+//  MJP's DX12 Sample Framework
+//  http://mynameismjp.wordpress.com/
+//
+//  All code licensed under the MIT license
+//
+//=================================================================================================
+
+#pragma once
+
+#include "..\\PCH.h"
+
+#include "..\\Containers.h"
+#include "..\\SF12_Math.h"
+#include "Textures.h"
+
+namespace SampleFramework12
+{
+
+enum class SamplerAddressMode : uint32
+{
+    Wrap = 0,
+    Clamp,
+
+    NumValues
+};
+
+// Trilinear CPU sampling of TextureData, for shading paths that need more than the single bilinear lookups of
+// SampleTexture2D. The full mip pyramid is built up front with a box filter and converted to Float4. Each mip is
+// stored in 8x8 tiles with the texels of a tile in Morton order, so that the footprint of a sample and the
+// footprints of nearby samples land in the same few cache lines. Samples are processed in batches of 8: the
+// coordinate, wrapping and weight math runs on a pair of SSE registers, and the 8 texels that each sample needs
+// from its two mips are then gathered and blended.
+class TextureSampler
+{
+
+public:
+
+    static const uint64 BatchSize = 8;
+    static const uint32 TileSize = 8;
+    static const uint32 MaxMips = 16;
+
+    // Every slice of the texture gets its own mip chain. Passing tiled = false keeps each mip in row-major order,
+    // which is only useful for comparing against the tiled layout.
+    void Initialize(const TextureData<UByte4N>& texData, bool tiled = true);
+    void Initialize(const TextureData<UShort4N>& texData, bool tiled = true);
+    void Initialize(const TextureData<Half4>& texData, bool tiled = true);
+    void Initialize(const TextureData<Float4>& texData, bool tiled = true);
+    void Shutdown();
+
+    // Mip level for a footprint given by the derivatives of the UV coordinates from one pixel to the next
+    float LODFromDifferentials(Float2 duvdx, Float2 duvdy) const;
+
+    // Mip level for a ray cone that hits a surface, from "Texture Level of Detail Strategies for Real-Time Ray
+    // Tracing" in Ray Tracing Gems. coneWidth is the width of the cone at the hit point, cosTheta is the cosine of
+    // the angle between the ray and the surface normal, and uvDensity is the number of UV units per world unit.
+    float LODFromRayCone(float coneWidth, float cosTheta, float uvDensity) const;
+
+    // Mip level for a cubemap lookup covering a cone of directions with the given apex angle, in radians
+    float CubemapLODFromConeAngle(float coneAngle) const;
+
+    // Trilinear samples from one array slice, with a result for each set of coordinates. The inputs are separate
+    // streams of U, V and LOD, and numSamples doesn't need to be a multiple of BatchSize.
+    void Sample(const float* u, const float* v, const float* lods, uint64 numSamples, Float4* results,
+                uint32 arraySlice = 0, SamplerAddressMode addressMode = SamplerAddressMode::Wrap) const;
+
+    // Trilinear samples from a cubemap, using the same face layout as SampleCubemap
+    void SampleCubemap(const Float3* directions, const float* lods, uint64 numSamples, Float4* results) const;
+
+    Float4 Texel(uint32 x, uint32 y, uint32 mip, uint32 arraySlice = 0) const;
+
+    uint32 Width() const { return width; }
+    uint32 Height() const { return height; }
+    uint32 NumMips() const { return numMips; }
+    uint32 NumSlices() const { return numSlices; }
+    bool Tiled() const { return tiled; }
+    uint64 MemorySize() const { return texels.MemorySize(); }
+
+protected:
+
+    struct MipLevel
+    {
+        uint32 Width = 0;
+        uint32 Height = 0;
+        uint32 TilesX = 0;
+        uint64 Offset = 0;
+    };
+
+    template<typename T> void InitializeInternal(const TextureData<T>& texData, bool tiledLayout);
+
+    uint64 TexelOffset(uint32 x, uint32 y, uint32 mip, uint32 arraySlice) const;
+
+    // Samples up to BatchSize coordinates, each from its own array slice
+    void SampleBatch(const float* u, const float* v, const float* lods, const uint32* slices, uint64 numSamples,
+                     Float4* results, SamplerAddressMode addressMode) const;
+
+    Array<Float4> texels;
+    MipLevel mips[MaxMips];
+    uint32 width = 0;
+    uint32 height = 0;
+    uint32 numMips = 0;
+    uint32 numSlices = 0;
+    uint64 sliceSize = 0;
+    bool tiled = true;
+};
+
+}
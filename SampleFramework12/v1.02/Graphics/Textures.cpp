@@ -15,7 +15,6 @@
 #include "..\\FileIO.h"
 #include "ShaderCompilation.h"
 #include "GraphicsTypes.h"
-#include "TinyEXR.h"
 #include "DX12.h"
 
 namespace SampleFramework12
@@ -35,33 +34,171 @@ static uint64 NumMipLevels(uint64 width, uint64 height, uint64 depth = 1)
     return numMips;
 }
 
-void LoadTexture(Texture& texture, const wchar* filePath, bool forceSRGB)
+// Generates the full mip chain for a decoded image, and then block compresses it if the options ask for it
+static HRESULT FinishDecodedImage(const DirectX::Image& baseImage, DirectX::ScratchImage& image,
+                                  const TextureCookOptions& options, BlockCompressionStats* compressionStats)
 {
-    texture.Shutdown();
-    if(FileExists(filePath) == false)
-        throw Exception(MakeString(L"Texture file with path '%ls' does not exist", filePath));
+    DirectX::TexMetadata baseMetaData = { };
+    baseMetaData.width = baseImage.width;
+    baseMetaData.height = baseImage.height;
+    baseMetaData.depth = 1;
+    baseMetaData.arraySize = 1;
+    baseMetaData.mipLevels = 1;
+    baseMetaData.format = baseImage.format;
+    baseMetaData.dimension = DirectX::TEX_DIMENSION_TEXTURE2D;
+
+    const bool compress = options.Compression != DXGI_FORMAT_UNKNOWN && IsBlockCompressible(baseMetaData);
+    DirectX::ScratchImage mipImage;
+    HRESULT hr = DirectX::GenerateMipMaps(baseImage, options.MipFilter, 0, compress ? mipImage : image, false);
+    if(FAILED(hr) || compress == false)
+        return hr;
+
+    return BlockCompress(mipImage, options.Compression, image, compressionStats, options.BC7Mode);
+}
 
-    DirectX::ScratchImage image;
+// Loads a texture file as it's stored, without generating any mips
+static HRESULT LoadImageFile(const wchar* filePath, DirectX::ScratchImage& image)
+{
+    const std::wstring extension = GetFileExtension(filePath);
+    if(extension == L"DDS" || extension == L"dds")
+        return DirectX::LoadFromDDSFile(filePath, DirectX::DDS_FLAGS_NONE, nullptr, image);
+    else if(extension == L"TGA" || extension == L"tga")
+        return DirectX::LoadFromTGAFile(filePath, nullptr, image);
+    else
+        return DirectX::LoadFromWICFile(filePath, DirectX::WIC_FLAGS_NONE, nullptr, image);
+}
 
+HRESULT DecodeTextureFile(const wchar* filePath, DirectX::ScratchImage& image, const TextureCookOptions& options,
+                          BlockCompressionStats* compressionStats)
+{
+    // DDS files already have their mips and final format
     const std::wstring extension = GetFileExtension(filePath);
     if(extension == L"DDS" || extension == L"dds")
+        return LoadImageFile(filePath, image);
+
+    DirectX::ScratchImage tempImage;
+    HRESULT hr = LoadImageFile(filePath, tempImage);
+    if(FAILED(hr))
+        return hr;
+
+    return FinishDecodedImage(*tempImage.GetImage(0, 0, 0), image, options, compressionStats);
+}
+
+HRESULT LoadTextureFile(const wchar* filePath, TextureFileData& fileData, const TextureCookOptions& options)
+{
+    const bool cookable = IsCookableTexture(filePath);
+    fileData.FromCache = cookable && ReadCookedTexture(filePath, options, fileData.Cooked);
+    if(fileData.FromCache)
+        return S_OK;
+
+    HRESULT hr = DecodeTextureFile(filePath, fileData.Image, options, &fileData.CompressionStats);
+    if(FAILED(hr))
+        return hr;
+
+    // Failing to write to the cache only means that the texture gets decoded again next time
+    if(cookable && FAILED(WriteCookedTexture(filePath, fileData.Image, options)))
+        WriteLog(L"Failed to add texture '%ls' to the texture cache", filePath);
+
+    return S_OK;
+}
+
+// Decodes the top mip of a texture that's used as one channel of a packed texture, and converts it to RGBA8
+static HRESULT DecodePackingSource(const wchar* filePath, DirectX::ScratchImage& image)
+{
+    DirectX::ScratchImage decodedImage;
+    HRESULT hr = LoadImageFile(filePath, decodedImage);
+    if(FAILED(hr))
+        return hr;
+
+    const DirectX::Image& topMip = *decodedImage.GetImage(0, 0, 0);
+    if(topMip.format == DXGI_FORMAT_R8G8B8A8_UNORM)
+        return image.InitializeFromImage(topMip);
+    else if(DirectX::IsCompressed(topMip.format))
+        return DirectX::Decompress(topMip, DXGI_FORMAT_R8G8B8A8_UNORM, image);
+    else
+        return DirectX::Convert(topMip, DXGI_FORMAT_R8G8B8A8_UNORM, DirectX::TEX_FILTER_DEFAULT, DirectX::TEX_THRESHOLD_DEFAULT, image);
+}
+
+HRESULT LoadPackedTextureFile(const TexturePackingDesc& desc, TextureFileData& fileData, const TextureCookOptions& options)
+{
+    const uint64 numChannels = TexturePackingDesc::MaxChannels;
+    const wchar* sourcePaths[numChannels] = { };
+    for(uint64 c = 0; c < numChannels; ++c)
+        sourcePaths[c] = desc.SourcePaths[c].c_str();
+
+    TextureCookOptions packedOptions = options;
+    packedOptions.PackedFill = 0;
+    for(uint64 c = 0; c < numChannels; ++c)
+        packedOptions.PackedFill |= uint32(desc.FillValues[c]) << (c * 8);
+
+    fileData.FromCache = ReadCookedTexture(sourcePaths, numChannels, packedOptions, fileData.Cooked);
+    if(fileData.FromCache)
+        return S_OK;
+
+    // The packed texture gets the size of the largest source, and the rest are resized to match
+    DirectX::ScratchImage sources[numChannels];
+    uint64 width = 1;
+    uint64 height = 1;
+    for(uint64 c = 0; c < numChannels; ++c)
     {
-        DXCall(DirectX::LoadFromDDSFile(filePath, DirectX::DDS_FLAGS_NONE, nullptr, image));
+        if(desc.SourcePaths[c].length() == 0)
+            continue;
+
+        HRESULT hr = DecodePackingSource(sourcePaths[c], sources[c]);
+        if(FAILED(hr))
+            return hr;
+
+        width = Max<uint64>(width, sources[c].GetMetadata().width);
+        height = Max<uint64>(height, sources[c].GetMetadata().height);
     }
-    else if(extension == L"TGA" || extension == L"tga")
+
+    for(uint64 c = 0; c < numChannels; ++c)
     {
-        DirectX::ScratchImage tempImage;
-        DXCall(DirectX::LoadFromTGAFile(filePath, nullptr, tempImage));
-        DXCall(DirectX::GenerateMipMaps(*tempImage.GetImage(0, 0, 0), DirectX::TEX_FILTER_DEFAULT, 0, image, false));
+        if(desc.SourcePaths[c].length() == 0)
+            continue;
+
+        const DirectX::Image& srcImage = *sources[c].GetImage(0, 0, 0);
+        if(srcImage.width == width && srcImage.height == height)
+            continue;
+
+        DirectX::ScratchImage resizedImage;
+        HRESULT hr = DirectX::Resize(srcImage, width, height, DirectX::TEX_FILTER_DEFAULT, resizedImage);
+        if(FAILED(hr))
+            return hr;
+        sources[c] = std::move(resizedImage);
     }
-    else
+
+    DirectX::ScratchImage packedImage;
+    HRESULT hr = packedImage.Initialize2D(DXGI_FORMAT_R8G8B8A8_UNORM, width, height, 1, 1);
+    if(FAILED(hr))
+        return hr;
+
+    // Each channel comes from the first channel of its source
+    const DirectX::Image& dstImage = *packedImage.GetImage(0, 0, 0);
+    for(uint64 c = 0; c < numChannels; ++c)
     {
-        DirectX::ScratchImage tempImage;
-        DXCall(DirectX::LoadFromWICFile(filePath, DirectX::WIC_FLAGS_NONE, nullptr, tempImage));
-        DXCall(DirectX::GenerateMipMaps(*tempImage.GetImage(0, 0, 0), DirectX::TEX_FILTER_DEFAULT, 0, image, false));
+        const DirectX::Image* srcImage = sources[c].GetImage(0, 0, 0);
+        for(uint64 y = 0; y < height; ++y)
+        {
+            uint8* dstTexels = dstImage.pixels + y * dstImage.rowPitch + c;
+            const uint8* srcTexels = srcImage ? srcImage->pixels + y * srcImage->rowPitch : nullptr;
+            for(uint64 x = 0; x < width; ++x)
+                dstTexels[x * 4] = srcTexels ? srcTexels[x * 4] : desc.FillValues[c];
+        }
     }
 
-    const DirectX::TexMetadata& metaData = image.GetMetadata();
+    hr = FinishDecodedImage(dstImage, fileData.Image, options, &fileData.CompressionStats);
+    if(FAILED(hr))
+        return hr;
+
+    if(FAILED(WriteCookedTexture(sourcePaths, numChannels, fileData.Image, packedOptions)))
+        WriteLog(L"Failed to add packed texture '%ls' to the texture cache", sourcePaths[0]);
+
+    return S_OK;
+}
+
+static ID3D12Resource* CreateTextureResource(const DirectX::TexMetadata& metaData, bool forceSRGB, const wchar* name)
+{
     DXGI_FORMAT format = metaData.format;
     if(forceSRGB)
         format = DirectX::MakeSRGB(format);
@@ -81,10 +218,19 @@ void LoadTexture(Texture& texture, const wchar* filePath, bool forceSRGB)
     textureDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
     textureDesc.Alignment = 0;
 
+    ID3D12Resource* resource = nullptr;
+    DXCall(DX12::Device->CreateCommittedResource(DX12::GetDefaultHeapProps(), D3D12_HEAP_FLAG_NONE, &textureDesc,
+                                                 D3D12_RESOURCE_STATE_COMMON, nullptr, IID_PPV_ARGS(&resource)));
+    resource->SetName(name);
+
+    return resource;
+}
+
+// Creates the resource and SRV for a texture file, without filling in its contents
+static void CreateTextureForFile(Texture& texture, const DirectX::TexMetadata& metaData, bool forceSRGB, const wchar* name)
+{
     ID3D12Device* device = DX12::Device;
-    DXCall(device->CreateCommittedResource(DX12::GetDefaultHeapProps(), D3D12_HEAP_FLAG_NONE, &textureDesc,
-                                           D3D12_RESOURCE_STATE_COMMON, nullptr, IID_PPV_ARGS(&texture.Resource)));
-    texture.Resource->SetName(filePath);
+    texture.Resource = CreateTextureResource(metaData, forceSRGB, name);
 
     PersistentDescriptorAlloc srvAlloc = DX12::SRVDescriptorHeap.AllocatePersistent();
     texture.SRV = srvAlloc.Index;
@@ -105,42 +251,99 @@ void LoadTexture(Texture& texture, const wchar* filePath, bool forceSRGB)
     for(uint32 i = 0; i < DX12::SRVDescriptorHeap.NumHeaps; ++i)
         device->CreateShaderResourceView(texture.Resource, srvDescPtr, srvAlloc.Handles[i]);
 
-    const uint64 numSubResources = metaData.mipLevels * metaData.arraySize;
+    texture.Width = uint32(metaData.width);
+    texture.Height = uint32(metaData.height);
+    texture.Depth = uint32(metaData.depth);
+    texture.NumMips = uint32(metaData.mipLevels);
+    texture.ArraySize = uint32(metaData.arraySize);
+    texture.Format = metaData.format;
+    texture.Cubemap = metaData.IsCubemap() ? 1 : 0;
+}
+
+// Returns the amount of upload buffer memory needed for all of a texture's subresources
+static uint64 TextureUploadSize(ID3D12Resource* resource)
+{
+    D3D12_RESOURCE_DESC textureDesc = resource->GetDesc();
+    const uint64 arraySize = textureDesc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D ? 1 : textureDesc.DepthOrArraySize;
+    const uint64 numSubResources = uint64(textureDesc.MipLevels) * arraySize;
+
+    uint64 textureMemSize = 0;
+    DX12::Device->GetCopyableFootprints(&textureDesc, 0, uint32(numSubResources), 0, nullptr, nullptr, nullptr, &textureMemSize);
+    return textureMemSize;
+}
+
+// Copies texture file data into upload memory, and records the copies into the texture. Cooked data is already in
+// the same layout as the upload buffer, unless the driver picked a different one. The texture can leave out the
+// finest mips of the file, in which case its first mip comes from firstMip in the file data.
+static void UploadFileData(ID3D12Resource* resource, const TextureFileData& fileData, ID3D12GraphicsCommandList* cmdList,
+                           ID3D12Resource* uploadResource, uint8* uploadMem, uint64 resourceOffset, uint64 firstMip = 0)
+{
+    const DirectX::TexMetadata metaData = fileData.Metadata();
+    D3D12_RESOURCE_DESC textureDesc = resource->GetDesc();
+    Assert_(firstMip + textureDesc.MipLevels == metaData.mipLevels);
+
+    const uint64 numMips = textureDesc.MipLevels;
+    const uint64 numSubResources = numMips * metaData.arraySize;
     D3D12_PLACED_SUBRESOURCE_FOOTPRINT* layouts = (D3D12_PLACED_SUBRESOURCE_FOOTPRINT*)_alloca(sizeof(D3D12_PLACED_SUBRESOURCE_FOOTPRINT) * numSubResources);
     uint32* numRows = (uint32*)_alloca(sizeof(uint32) * numSubResources);
     uint64* rowSizes = (uint64*)_alloca(sizeof(uint64) * numSubResources);
 
     uint64 textureMemSize = 0;
-    device->GetCopyableFootprints(&textureDesc, 0, uint32(numSubResources), 0, layouts, numRows, rowSizes, &textureMemSize);
+    DX12::Device->GetCopyableFootprints(&textureDesc, 0, uint32(numSubResources), 0, layouts, numRows, rowSizes, &textureMemSize);
 
-    // Get a GPU upload buffer
-    UploadContext uploadContext = DX12::ResourceUploadBegin(textureMemSize);
-    uint8* uploadMem = reinterpret_cast<uint8*>(uploadContext.CPUAddress);
-
-    for(uint64 arrayIdx = 0; arrayIdx < metaData.arraySize; ++arrayIdx)
+    bool matchingLayout = fileData.FromCache && firstMip == 0 && fileData.Cooked.Header.DataSize == textureMemSize;
+    for(uint64 i = 0; i < numSubResources && matchingLayout; ++i)
     {
+        const CookedSubresource& subresource = fileData.Cooked.Subresources[i];
+        matchingLayout = subresource.Offset == layouts[i].Offset && subresource.RowPitch == layouts[i].Footprint.RowPitch &&
+                         subresource.NumRows == numRows[i] && subresource.Depth == layouts[i].Footprint.Depth;
+    }
 
-        for(uint64 mipIdx = 0; mipIdx < metaData.mipLevels; ++mipIdx)
+    if(matchingLayout)
+    {
+        memcpy(uploadMem, fileData.Cooked.Data.Data(), textureMemSize);
+    }
+    else
+    {
+        for(uint64 arrayIdx = 0; arrayIdx < metaData.arraySize; ++arrayIdx)
         {
-            const uint64 subResourceIdx = mipIdx + (arrayIdx * metaData.mipLevels);
-
-            const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& subResourceLayout = layouts[subResourceIdx];
-            const uint64 subResourceHeight = numRows[subResourceIdx];
-            const uint64 subResourcePitch = subResourceLayout.Footprint.RowPitch;
-            const uint64 subResourceDepth = subResourceLayout.Footprint.Depth;
-            uint8* dstSubResourceMem = reinterpret_cast<uint8*>(uploadMem) + subResourceLayout.Offset;
 
-            for(uint64 z = 0; z < subResourceDepth; ++z)
+            for(uint64 mipIdx = 0; mipIdx < numMips; ++mipIdx)
             {
-                const DirectX::Image* subImage = image.GetImage(mipIdx, arrayIdx, z);
-                Assert_(subImage != nullptr);
-                const uint8* srcSubResourceMem = subImage->pixels;
+                const uint64 subResourceIdx = mipIdx + (arrayIdx * numMips);
+                const uint64 srcMipIdx = mipIdx + firstMip;
+                const uint64 srcSubResourceIdx = srcMipIdx + (arrayIdx * metaData.mipLevels);
 
-                for(uint64 y = 0; y < subResourceHeight; ++y)
+                const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& subResourceLayout = layouts[subResourceIdx];
+                const uint64 subResourceHeight = numRows[subResourceIdx];
+                const uint64 subResourcePitch = subResourceLayout.Footprint.RowPitch;
+                const uint64 subResourceDepth = subResourceLayout.Footprint.Depth;
+                uint8* dstSubResourceMem = uploadMem + subResourceLayout.Offset;
+
+                for(uint64 z = 0; z < subResourceDepth; ++z)
                 {
-                    memcpy(dstSubResourceMem, srcSubResourceMem, Min(subResourcePitch, subImage->rowPitch));
-                    dstSubResourceMem += subResourcePitch;
-                    srcSubResourceMem += subImage->rowPitch;
+                    const uint8* srcSubResourceMem = nullptr;
+                    uint64 srcPitch = 0;
+                    if(fileData.FromCache)
+                    {
+                        const CookedSubresource& subresource = fileData.Cooked.Subresources[srcSubResourceIdx];
+                        srcPitch = subresource.RowPitch;
+                        srcSubResourceMem = fileData.Cooked.Data.Data() + subresource.Offset + z * subresource.NumRows * srcPitch;
+                    }
+                    else
+                    {
+                        const DirectX::Image* subImage = fileData.Image.GetImage(srcMipIdx, arrayIdx, z);
+                        Assert_(subImage != nullptr);
+                        srcPitch = subImage->rowPitch;
+                        srcSubResourceMem = subImage->pixels;
+                    }
+
+                    for(uint64 y = 0; y < subResourceHeight; ++y)
+                    {
+                        memcpy(dstSubResourceMem, srcSubResourceMem, Min(rowSizes[subResourceIdx], srcPitch));
+                        dstSubResourceMem += subResourcePitch;
+                        srcSubResourceMem += srcPitch;
+                    }
                 }
             }
         }
@@ -149,26 +352,180 @@ void LoadTexture(Texture& texture, const wchar* filePath, bool forceSRGB)
     for(uint64 subResourceIdx = 0; subResourceIdx < numSubResources; ++subResourceIdx)
     {
         D3D12_TEXTURE_COPY_LOCATION dst = { };
-        dst.pResource = texture.Resource;
+        dst.pResource = resource;
         dst.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
         dst.SubresourceIndex = uint32(subResourceIdx);
         D3D12_TEXTURE_COPY_LOCATION src = { };
-        src.pResource = uploadContext.Resource;
+        src.pResource = uploadResource;
         src.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
         src.PlacedFootprint = layouts[subResourceIdx];
-        src.PlacedFootprint.Offset += uploadContext.ResourceOffset;
-        uploadContext.CmdList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+        src.PlacedFootprint.Offset += resourceOffset;
+        cmdList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
     }
+}
+
+void LoadTexture(Texture& texture, const wchar* filePath, bool forceSRGB)
+{
+    texture.Shutdown();
+    if(FileExists(filePath) == false)
+        throw Exception(MakeString(L"Texture file with path '%ls' does not exist", filePath));
+
+    TextureFileData fileData;
+    DXCall(LoadTextureFile(filePath, fileData));
+
+    CreateTextureForFile(texture, fileData.Metadata(), forceSRGB, filePath);
+
+    // Get a GPU upload buffer
+    UploadContext uploadContext = DX12::ResourceUploadBegin(TextureUploadSize(texture.Resource));
+
+    UploadFileData(texture.Resource, fileData, uploadContext.CmdList, uploadContext.Resource,
+                    reinterpret_cast<uint8*>(uploadContext.CPUAddress), uploadContext.ResourceOffset);
 
     DX12::ResourceUploadEnd(uploadContext);
+}
 
-    texture.Width = uint32(metaData.width);
-    texture.Height = uint32(metaData.height);
-    texture.Depth = uint32(metaData.depth);
-    texture.NumMips = uint32(metaData.mipLevels);
-    texture.ArraySize = uint32(metaData.arraySize);
-    texture.Format = metaData.format;
-    texture.Cubemap = metaData.IsCubemap() ? 1 : 0;
+TextureUploadBatch::TextureUploadBatch(uint64 maxSize) : pendingUploads(64), maxBatchSize(maxSize)
+{
+}
+
+TextureUploadBatch::~TextureUploadBatch()
+{
+    Flush();
+}
+
+void TextureUploadBatch::Add(Texture& texture, const TextureFileData& fileData, bool forceSRGB, const wchar* name)
+{
+    texture.Shutdown();
+    CreateTextureForFile(texture, fileData.Metadata(), forceSRGB, name);
+
+    // Oversized textures still go through, they just end up in a batch of their own
+    const uint64 uploadSize = AlignTo(TextureUploadSize(texture.Resource), uint64(D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT));
+    if(pendingUploads.Count() > 0 && batchSize + uploadSize > maxBatchSize)
+        Flush();
+
+    PendingUpload upload;
+    upload.TargetTexture = &texture;
+    upload.FileData = &fileData;
+    upload.Offset = batchSize;
+    pendingUploads.Add(upload);
+
+    batchSize += uploadSize;
+}
+
+void TextureUploadBatch::Flush()
+{
+    if(pendingUploads.Count() == 0)
+        return;
+
+    UploadContext uploadContext = DX12::ResourceUploadBegin(batchSize);
+    uint8* uploadMem = reinterpret_cast<uint8*>(uploadContext.CPUAddress);
+
+    for(uint64 i = 0; i < pendingUploads.Count(); ++i)
+    {
+        const PendingUpload& upload = pendingUploads[i];
+        UploadFileData(upload.TargetTexture->Resource, *upload.FileData, uploadContext.CmdList, uploadContext.Resource,
+                        uploadMem + upload.Offset, uploadContext.ResourceOffset + upload.Offset);
+    }
+
+    DX12::ResourceUploadEnd(uploadContext);
+
+    peakBatchSize = Max(peakBatchSize, batchSize);
+    numSubmissions += 1;
+    batchSize = 0;
+    pendingUploads.RemoveAll();
+}
+
+// Swaps in a new resource for a streamed texture. The SRV is updated right away for the current frame, and for the
+// other frames once the GPU is done with their descriptors. The old resource can still be in use by the GPU or by a
+// copy that was just submitted, so its release is always deferred.
+static void ReplaceTextureResource(Texture& texture, ID3D12Resource* resource)
+{
+    const D3D12_RESOURCE_DESC desc = resource->GetDesc();
+
+    D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = { };
+    srvDesc.Format = desc.Format;
+    srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+    srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+    srvDesc.Texture2D.MostDetailedMip = 0;
+    srvDesc.Texture2D.MipLevels = desc.MipLevels;
+    srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
+
+    D3D12_CPU_DESCRIPTOR_HANDLE handle = DX12::SRVDescriptorHeap.CPUHandleFromIndex(texture.SRV, DX12::CurrFrameIdx);
+    DX12::Device->CreateShaderResourceView(resource, &srvDesc, handle);
+    DX12::DeferredCreateSRV(resource, srvDesc, texture.SRV);
+
+    DX12::DeferredRelease(texture.Resource, true);
+    texture.Resource = resource;
+    texture.Width = uint32(desc.Width);
+    texture.Height = desc.Height;
+    texture.NumMips = desc.MipLevels;
+    texture.CreateFrame = DX12::CurrentCPUFrame;
+}
+
+void StreamTextureMips(Texture& texture, const TextureFileData& fileData, uint64 firstMip, bool forceSRGB, const wchar* name)
+{
+    Assert_(texture.Valid());
+    Assert_(texture.Cubemap == false && texture.ArraySize == 1 && texture.Depth == 1);
+
+    DirectX::TexMetadata metaData = fileData.Metadata();
+    Assert_(firstMip < metaData.mipLevels);
+    metaData.width = Max<uint64>(metaData.width >> firstMip, 1);
+    metaData.height = Max<uint64>(metaData.height >> firstMip, 1);
+    metaData.mipLevels -= firstMip;
+
+    ID3D12Resource* resource = CreateTextureResource(metaData, forceSRGB, name);
+
+    UploadContext uploadContext = DX12::ResourceUploadBegin(TextureUploadSize(resource));
+    UploadFileData(resource, fileData, uploadContext.CmdList, uploadContext.Resource,
+                   reinterpret_cast<uint8*>(uploadContext.CPUAddress), uploadContext.ResourceOffset, firstMip);
+    DX12::ResourceUploadEnd(uploadContext);
+
+    ReplaceTextureResource(texture, resource);
+}
+
+void DropTextureMips(Texture& texture, uint64 numMipsToDrop, const wchar* name)
+{
+    Assert_(texture.Valid());
+    Assert_(texture.Cubemap == false && texture.ArraySize == 1 && texture.Depth == 1);
+    Assert_(numMipsToDrop > 0 && numMipsToDrop < texture.NumMips);
+
+    D3D12_RESOURCE_DESC textureDesc = texture.Resource->GetDesc();
+    textureDesc.Width = Max<uint64>(textureDesc.Width >> numMipsToDrop, 1);
+    textureDesc.Height = Max<uint32>(textureDesc.Height >> numMipsToDrop, 1);
+    textureDesc.MipLevels -= uint16(numMipsToDrop);
+
+    ID3D12Resource* resource = nullptr;
+    DXCall(DX12::Device->CreateCommittedResource(DX12::GetDefaultHeapProps(), D3D12_HEAP_FLAG_NONE, &textureDesc,
+                                                 D3D12_RESOURCE_STATE_COMMON, nullptr, IID_PPV_ARGS(&resource)));
+    resource->SetName(name);
+
+    // The remaining mips are copied on the GPU, so the upload buffer only provides the command list
+    UploadContext uploadContext = DX12::ResourceUploadBegin(D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+    for(uint32 mipIdx = 0; mipIdx < textureDesc.MipLevels; ++mipIdx)
+    {
+        D3D12_TEXTURE_COPY_LOCATION dst = { };
+        dst.pResource = resource;
+        dst.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+        dst.SubresourceIndex = mipIdx;
+        D3D12_TEXTURE_COPY_LOCATION src = { };
+        src.pResource = texture.Resource;
+        src.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+        src.SubresourceIndex = mipIdx + uint32(numMipsToDrop);
+        uploadContext.CmdList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+    }
+    DX12::ResourceUploadEnd(uploadContext);
+
+    ReplaceTextureResource(texture, resource);
+}
+
+uint64 TextureMipChainSize(const D3D12_RESOURCE_DESC& fullDesc, uint64 firstMip)
+{
+    Assert_(firstMip < fullDesc.MipLevels);
+    D3D12_RESOURCE_DESC desc = fullDesc;
+    desc.Width = Max<uint64>(desc.Width >> firstMip, 1);
+    desc.Height = Max<uint32>(desc.Height >> firstMip, 1);
+    desc.MipLevels -= uint16(firstMip);
+    return DX12::Device->GetResourceAllocationInfo(0, 1, &desc).SizeInBytes;
 }
 
 void Create2DTexture(Texture& texture, uint64 width, uint64 height, uint64 numMips,
@@ -492,14 +849,14 @@ void SaveTextureAsDDS(const Texture& texture, const wchar* filePath)
                         scratchImage.GetMetadata(), DirectX::DDS_FLAGS_FORCE_DX10_EXT, filePath));
 }
 
-void SaveTextureAsEXR(const Texture& texture, const wchar* filePath)
+void SaveTextureAsEXR(const Texture& texture, const wchar* filePath, const EXRWriteSettings& settings)
 {
     TextureData<Float4> textureData;
     GetTextureData(texture, textureData);
-    SaveTextureAsEXR(textureData, filePath);
+    SaveTextureAsEXR(textureData, filePath, settings);
 }
 
-void SaveTextureAsEXR(const TextureData<Float4>& texture, const wchar* filePath)
+void SaveTextureAsEXR(const TextureData<Float4>& texture, const wchar* filePath, const EXRWriteSettings& settings)
 {
     WriteLog("Saving EXR file '%ls'", filePath);
 
@@ -507,39 +864,7 @@ void SaveTextureAsEXR(const TextureData<Float4>& texture, const wchar* filePath)
     Assert_(texture.Width > 0 && texture.Height > 0);
     Assert_(texture.NumSlices == 1);
 
-    const uint64 numTexels = texture.Texels.Size();
-    std::vector<float> channelDataR;
-    std::vector<float> channelDataG;
-    std::vector<float> channelDataB;
-    channelDataR.resize(numTexels);
-    channelDataG.resize(numTexels);
-    channelDataB.resize(numTexels);
-    for(uint64 i = 0; i < numTexels; ++i)
-    {
-        channelDataR[i] = texture.Texels[i].x;
-        channelDataG[i] = texture.Texels[i].y;
-        channelDataB[i] = texture.Texels[i].z;
-    }
-
-    float* imageChannels[3] = { channelDataB.data(), channelDataG.data(), channelDataR.data() };
-    const char* channelNames[3] = { "B", "G", "R" };
-
-    EXRImage exrImage;
-    exrImage.num_channels = 3;
-    exrImage.width = texture.Width;
-    exrImage.height = texture.Height;
-    exrImage.channel_names = channelNames;
-    exrImage.images = imageChannels;
-
-    std::string filePathAnsi = WStringToAnsi(filePath);
-
-    const char* errorString = nullptr;
-    int returnCode = SaveMultiChannelEXR(&exrImage, filePathAnsi.c_str(), &errorString);
-    if(returnCode != 0)
-    {
-        AssertFail_("%s", errorString);
-        throw Exception(AnsiToWString(errorString));
-    }
+    SaveEXR(filePath, texture.Texels.Data(), texture.Width, texture.Height, settings);
 }
 
 void SaveTextureAsPNG(const Texture& texture, const wchar* filePath)
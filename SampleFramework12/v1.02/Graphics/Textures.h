@@ -13,7 +13,10 @@
 
 #include "..\\InterfacePointers.h"
 #include "..\\Serialization.h"
+#include "..\\EXRWriter.h"
 #include "GraphicsTypes.h"
+#include "TextureCooking.h"
+#include "BlockCompression.h"
 
 namespace SampleFramework12
 {
@@ -35,6 +38,93 @@ void UploadTextureData(const Texture& texture, const void* initData);
 void UploadTextureData(const Texture& texture, const void* initData, ID3D12GraphicsCommandList* cmdList,
                        ID3D12Resource* uploadResource, void* uploadCPUMem, uint64 resourceOffset);
 
+// Decodes a texture file, generating a full mip chain for formats that don't store one. Those formats are also
+// block compressed if the options ask for it and the texture's dimensions allow it.
+HRESULT DecodeTextureFile(const wchar* filePath, DirectX::ScratchImage& image,
+                          const TextureCookOptions& options = TextureCookOptions(),
+                          BlockCompressionStats* compressionStats = nullptr);
+
+// The contents of a texture file in memory, either decoded from the source or read from the texture cache
+struct TextureFileData
+{
+    DirectX::ScratchImage Image;
+    CookedTexture Cooked;
+    bool FromCache = false;
+    BlockCompressionStats CompressionStats;
+
+    DirectX::TexMetadata Metadata() const { return FromCache ? Cooked.Metadata() : Image.GetMetadata(); }
+    uint64 MemorySize() const { return FromCache ? Cooked.Data.Size() : Image.GetPixelsSize(); }
+};
+
+// Reads a texture file into memory, using the cooked version from the texture cache when it's up to date. Source
+// textures that get decoded are added to the cache. This doesn't touch the device or throw, so it can run on any
+// thread.
+HRESULT LoadTextureFile(const wchar* filePath, TextureFileData& fileData,
+                        const TextureCookOptions& options = TextureCookOptions());
+
+// Describes an RGBA8 texture whose channels each come from the first channel of a separate source texture.
+// Channels without a source path are filled with a constant instead.
+struct TexturePackingDesc
+{
+    static const uint64 MaxChannels = 4;
+
+    std::wstring SourcePaths[MaxChannels];
+    uint8 FillValues[MaxChannels] = { 0, 0, 0, 255 };
+};
+
+// Builds a packed texture from its sources, resizing them all to the size of the largest one. The result goes
+// through the texture cache in the same way as LoadTextureFile, keyed on all of the source paths.
+HRESULT LoadPackedTextureFile(const TexturePackingDesc& desc, TextureFileData& fileData,
+                              const TextureCookOptions& options = TextureCookOptions());
+
+// Creates textures from file data and copies all of it through as few upload submissions as possible. The file
+// data needs to stay alive until the next Flush(), which happens automatically whenever the next texture wouldn't
+// fit in the batch.
+class TextureUploadBatch
+{
+
+public:
+
+    static const uint64 DefaultMaxBatchSize = 32 * 1024 * 1024;
+
+    explicit TextureUploadBatch(uint64 maxSize = DefaultMaxBatchSize);
+    ~TextureUploadBatch();
+
+    TextureUploadBatch(const TextureUploadBatch&) = delete;
+    TextureUploadBatch& operator=(const TextureUploadBatch&) = delete;
+
+    void Add(Texture& texture, const TextureFileData& fileData, bool forceSRGB, const wchar* name);
+    void Flush();
+
+    uint64 NumSubmissions() const { return numSubmissions; }
+    uint64 PeakBatchSize() const { return peakBatchSize; }
+
+protected:
+
+    struct PendingUpload
+    {
+        const Texture* TargetTexture = nullptr;
+        const TextureFileData* FileData = nullptr;
+        uint64 Offset = 0;
+    };
+
+    GrowableList<PendingUpload> pendingUploads;
+    uint64 maxBatchSize = 0;
+    uint64 batchSize = 0;
+    uint64 numSubmissions = 0;
+    uint64 peakBatchSize = 0;
+};
+
+// Mip streaming for 2D textures. These replace the texture's resource with one that holds a different part of its
+// mip chain, keeping the same SRV index so that descriptor indices already stored in material buffers stay valid.
+// StreamTextureMips creates the texture from the file data starting at firstMip, and DropTextureMips keeps the
+// coarser mips that are already on the GPU.
+void StreamTextureMips(Texture& texture, const TextureFileData& fileData, uint64 firstMip, bool forceSRGB, const wchar* name);
+void DropTextureMips(Texture& texture, uint64 numMipsToDrop, const wchar* name);
+
+// GPU memory used by a texture with the given full-resolution description, when its mips from firstMip are resident
+uint64 TextureMipChainSize(const D3D12_RESOURCE_DESC& fullDesc, uint64 firstMip);
+
 template<typename T> struct TextureData
 {
     Array<T> Texels;
@@ -71,8 +161,8 @@ void GetTextureData(const Texture& texture, TextureData<Half4>& textureData);
 void GetTextureData(const Texture& texture, TextureData<Float4>& textureData);
 
 void SaveTextureAsDDS(const Texture& texture, const wchar* filePath);
-void SaveTextureAsEXR(const Texture& texture, const wchar* filePath);
-void SaveTextureAsEXR(const TextureData<Float4>& texture, const wchar* filePath);
+void SaveTextureAsEXR(const Texture& texture, const wchar* filePath, const EXRWriteSettings& settings = EXRWriteSettings());
+void SaveTextureAsEXR(const TextureData<Float4>& texture, const wchar* filePath, const EXRWriteSettings& settings = EXRWriteSettings());
 void SaveTextureAsPNG(const Texture& texture, const wchar* filePath);
 void SaveTextureAsPNG(const TextureData<UByte4N>& texture, const wchar* filePath);
 void SaveTextureAsTIFF(const Texture& texture, const wchar* filePath);
@@ -82,6 +172,8 @@ Float3 MapXYSToDirection(uint64 x, uint64 y, uint64 s, uint64 width, uint64 heig
 
 // == Texture Sampling Functions ==================================================================
 
+// These do a single bilinear lookup from the top mip. See TextureSampler for batched trilinear sampling.
+
 template<typename T> static DirectX::XMVECTOR SampleTexture2D(Float2 uv, uint32 arraySlice, const Array<T>& texels,
                                                               uint32 texWidth, uint32 texHeight, uint32 numSlices)
 {
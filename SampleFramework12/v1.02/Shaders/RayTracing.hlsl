@@ -20,6 +20,69 @@ struct MeshVertex
     float2 LightmapUV;
 };
 
+// Quantized vertex layout, see CompressedMeshVertex in Model.h
+struct CompressedMeshVertex
+{
+    uint PositionXY;
+    uint PositionZBitangentSign;
+    uint Normal;
+    uint Tangent;
+    uint UV;
+    uint LightmapUV;
+};
+
+float2 UnpackSNorm16x2(in uint packed)
+{
+    const int2 signExtended = int2(packed << 16, packed) >> 16;
+    return max(signExtended / 32767.0f, -1.0f);
+}
+
+float3 OctDecode(in float2 e)
+{
+    float3 n = float3(e, 1.0f - abs(e.x) - abs(e.y));
+    if(n.z < 0.0f)
+    {
+        n.x = (1.0f - abs(e.y)) * (e.x >= 0.0f ? 1.0f : -1.0f);
+        n.y = (1.0f - abs(e.x)) * (e.y >= 0.0f ? 1.0f : -1.0f);
+    }
+
+    return normalize(n);
+}
+
+MeshVertex DecompressMeshVertex(in CompressedMeshVertex vtx, in float3 quantizationMin, in float3 quantizationScale)
+{
+    const uint3 quantized = uint3(vtx.PositionXY & 0xFFFF, vtx.PositionXY >> 16, vtx.PositionZBitangentSign & 0xFFFF);
+
+    MeshVertex result;
+    result.Position = quantizationMin + quantized * quantizationScale;
+    result.Normal = OctDecode(UnpackSNorm16x2(vtx.Normal));
+    result.Tangent = OctDecode(UnpackSNorm16x2(vtx.Tangent));
+    result.Bitangent = normalize(cross(result.Normal, result.Tangent)) * ((vtx.PositionZBitangentSign >> 16) ? -1.0f : 1.0f);
+    result.UV = f16tof32(uint2(vtx.UV & 0xFFFF, vtx.UV >> 16));
+    result.LightmapUV = uint2(vtx.LightmapUV & 0xFFFF, vtx.LightmapUV >> 16) / 65535.0f;
+
+    return result;
+}
+
+// Loads the indices of a triangle from a raw buffer that mixes 16-bit and 32-bit index ranges.
+// byteOffset is the 4-byte aligned start of the range that the triangle belongs to.
+uint3 LoadTriangleIndices(in ByteAddressBuffer idxBuffer, in uint byteOffset, in uint triangleIdx, in bool index16Bit)
+{
+    if(index16Bit)
+    {
+        // 3 16-bit indices are only 2-byte aligned, so load the surrounding 8 bytes and pick them out
+        const uint triangleOffset = byteOffset + triangleIdx * 6;
+        const uint alignedOffset = triangleOffset & ~3;
+        const uint2 packed = idxBuffer.Load2(alignedOffset);
+        if(triangleOffset == alignedOffset)
+            return uint3(packed.x & 0xFFFF, packed.x >> 16, packed.y & 0xFFFF);
+        else
+            return uint3(packed.x >> 16, packed.y & 0xFFFF, packed.y >> 16);
+    }
+
+    return idxBuffer.Load3(byteOffset + triangleIdx * 12);
+}
+
 float BarycentricLerp(in float v0, in float v1, in float v2, in float3 barycentrics)
 {
     return v0 * barycentrics.x + v1 * barycentrics.y + v2 * barycentrics.z;
@@ -0,0 +1,130 @@
+//=================================================================================================
+//
+//  MJP's DX12 Sample Framework
+//  http://mynameismjp.wordpress.com/
+//
+//  All code licensed under the MIT license
+//
+//=================================================================================================
+
+#include "PCH.h"
+
+#include "Tasks.h"
+
+#include <mutex>
+
+#include "Assert.h"
+#include "SF12_Math.h"
+#include "EnkiTS/TaskScheduler.h"
+
+namespace SampleFramework12
+{
+
+namespace Tasks
+{
+
+static enki::TaskScheduler* scheduler = nullptr;
+static std::mutex schedulerLock;
+
+void Initialize(uint32 numThreads)
+{
+    std::lock_guard<std::mutex> lock(schedulerLock);
+    if(scheduler != nullptr)
+        return;
+
+    if(numThreads == 0)
+        numThreads = Max(std::thread::hardware_concurrency(), 1u);
+
+    scheduler = new enki::TaskScheduler();
+    scheduler->Initialize(numThreads);
+}
+
+void Shutdown()
+{
+    std::lock_guard<std::mutex> lock(schedulerLock);
+    if(scheduler == nullptr)
+        return;
+
+    scheduler->WaitforAllAndShutdown();
+    delete scheduler;
+    scheduler = nullptr;
+}
+
+bool Initialized()
+{
+    return scheduler != nullptr;
+}
+
+enki::TaskScheduler& Scheduler()
+{
+    if(scheduler == nullptr)
+        Initialize();
+
+    return *scheduler;
+}
+
+uint32 NumThreads()
+{
+    return Scheduler().GetNumTaskThreads() + 1;
+}
+
+void ParallelFor(uint64 count, const RangeFunction& func, uint64 minRangeSize)
+{
+    if(count == 0)
+        return;
+
+    enki::TaskScheduler& ts = Scheduler();
+    const uint32 externalThreadNum = ts.GetNumTaskThreads();
+
+    minRangeSize = Max<uint64>(minRangeSize, 1);
+    const uint64 numChunks = (count + minRangeSize - 1) / minRangeSize;
+    Assert_(numChunks <= UINT32_MAX);
+
+    enki::TaskSet taskSet(uint32(numChunks), [&](enki::TaskSetPartition range, uint32 threadNum)
+    {
+        const uint64 start = range.start * minRangeSize;
+        const uint64 end = Min<uint64>(range.end * minRangeSize, count);
+        func(start, end, threadNum < externalThreadNum ? threadNum : externalThreadNum);
+    });
+
+    ts.AddTaskSetToPipe(&taskSet);
+    ts.WaitforTaskSet(&taskSet);
+}
+
+AsyncTask::~AsyncTask()
+{
+    Wait();
+}
+
+void AsyncTask::Start(const std::function<void()>& func)
+{
+    Wait();
+
+    function = func;
+    taskSet = new enki::TaskSet(1, [this](enki::TaskSetPartition, uint32)
+    {
+        function();
+    });
+
+    Scheduler().AddTaskSetToPipe(taskSet);
+}
+
+bool AsyncTask::Finished() const
+{
+    return taskSet == nullptr || taskSet->GetIsComplete();
+}
+
+void AsyncTask::Wait()
+{
+    if(taskSet == nullptr)
+        return;
+
+    Scheduler().WaitforTaskSet(taskSet);
+    delete taskSet;
+    taskSet = nullptr;
+    function = nullptr;
+}
+
+}
+
+}
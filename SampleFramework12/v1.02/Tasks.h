@@ -0,0 +1,74 @@
+//=================================================================================================
+//
+//  MJP's DX12 Sample Framework
+//  http://mynameismjp.wordpress.com/
+//
+//  All code licensed under the MIT license
+//
+//=================================================================================================
+
+#pragma once
+
+#include "PCH.h"
+
+namespace enki
+{
+    class TaskScheduler;
+    class TaskSet;
+}
+
+namespace SampleFramework12
+{
+
+namespace Tasks
+{
+
+// Thin wrapper around a single, shared EnkiTS scheduler. The App initializes it on startup, but
+// it's also lazily initialized on first use so that headless tools can use it without an App.
+void Initialize(uint32 numThreads = 0);
+void Shutdown();
+bool Initialized();
+
+enki::TaskScheduler& Scheduler();
+
+// Number of distinct thread indices that can be passed to a task function. This includes one
+// extra slot for work that ends up running inline on a thread that the scheduler doesn't know
+// about, so it's always safe to size per-thread scratch data with this value.
+uint32 NumThreads();
+
+// Runs func over [0, count) by splitting it into ranges of at least minRangeSize elements, and
+// blocks until all ranges have completed. Don't hold on to per-thread scratch data across a
+// nested ParallelFor, since the waiting thread can pick up other ranges from the outer loop.
+typedef std::function<void(uint64 start, uint64 end, uint32 threadNum)> RangeFunction;
+void ParallelFor(uint64 count, const RangeFunction& func, uint64 minRangeSize = 1);
+
+// Runs a function on a task thread without blocking the caller. Wait() blocks until it has finished, while
+// running other tasks in the meantime, and it's called automatically before restarting or destroying the task.
+class AsyncTask
+{
+
+public:
+
+    AsyncTask() = default;
+    ~AsyncTask();
+
+    AsyncTask(const AsyncTask&) = delete;
+    AsyncTask& operator=(const AsyncTask&) = delete;
+
+    void Start(const std::function<void()>& func);
+    void Wait();
+
+    bool Running() const { return taskSet != nullptr; }
+
+    // True once the function has returned, or if nothing was started. Wait() still needs to be called to clean up.
+    bool Finished() const;
+
+protected:
+
+    enki::TaskSet* taskSet = nullptr;
+    std::function<void()> function;
+};
+
+}
+
+}
@@ -8330,3 +8330,26 @@ int SaveDeepEXR(const DeepImage *deepImage, const char *filename,
 
   return 0; // OK
 }
+
+unsigned long long CompressZlib(unsigned char *dst,
+                                unsigned long long dstCapacity,
+                                const unsigned char *src,
+                                unsigned long long srcSize, int level) {
+  miniz::mz_ulong outSize = (miniz::mz_ulong)dstCapacity;
+  int ret = miniz::mz_compress2(dst, &outSize, src, (miniz::mz_ulong)srcSize,
+                                level);
+  return ret == miniz::MZ_OK ? outSize : 0;
+}
+
+unsigned long long CompressZlibBound(unsigned long long srcSize) {
+  return miniz::mz_compressBound((miniz::mz_ulong)srcSize);
+}
+
+unsigned long long DecompressZlib(unsigned char *dst,
+                                  unsigned long long dstCapacity,
+                                  const unsigned char *src,
+                                  unsigned long long srcSize) {
+  miniz::mz_ulong outSize = (miniz::mz_ulong)dstCapacity;
+  int ret = miniz::mz_uncompress(dst, &outSize, src, (miniz::mz_ulong)srcSize);
+  return ret == miniz::MZ_OK ? outSize : 0;
+}
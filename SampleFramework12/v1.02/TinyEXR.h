@@ -91,6 +91,25 @@ extern int LoadDeepEXR(DeepImage *out_image, const char *filename,
 // extern int SaveDeepEXR(const DeepImage *in_image, const char *filename,
 //                       const char **err);
 
+// Compresses a buffer into a zlib stream with the bundled miniz, for writers
+// that build their own EXR chunks. This is thread safe.
+// Returns the compressed size, or 0 if `dst` is too small.
+extern unsigned long long CompressZlib(unsigned char *dst,
+                                       unsigned long long dstCapacity,
+                                       const unsigned char *src,
+                                       unsigned long long srcSize, int level);
+
+// Upper bound on the output size of CompressZlib.
+extern unsigned long long CompressZlibBound(unsigned long long srcSize);
+
+// Decompresses a zlib stream made by CompressZlib. This is thread safe.
+// Returns the decompressed size, or 0 if the stream is malformed or doesn't
+// fit in `dst`.
+extern unsigned long long DecompressZlib(unsigned char *dst,
+                                         unsigned long long dstCapacity,
+                                         const unsigned char *src,
+                                         unsigned long long srcSize);
+
 // NOT YET IMPLEMENTED:
 // Loads multi-part OpenEXR deep image.
 // Application must free memory of variables in DeepImage(image, offset_table)